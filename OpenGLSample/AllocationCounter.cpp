@@ -0,0 +1,182 @@
+#include <atomic>
+#include <cstdlib>
+#include <new>
+#if defined(_WIN32)
+#include <malloc.h>
+#endif
+#include "AllocationCounter.h"
+
+using namespace std;
+
+#if !defined(NDEBUG)
+
+namespace
+{
+	atomic<size_t> gAllocationCount{ 0 };
+	thread_local bool tlsCounting = true;
+
+	void* UCountedAllocate(size_t size)
+	{
+		if (tlsCounting)
+			gAllocationCount.fetch_add(1, memory_order_relaxed);
+		return malloc(size > 0 ? size : 1);
+	}
+
+#if defined(__cpp_aligned_new)
+	// MSVC has no aligned_alloc, its aligned blocks need their own free
+	void* UCountedAllocateAligned(size_t size, align_val_t alignment)
+	{
+		if (tlsCounting)
+			gAllocationCount.fetch_add(1, memory_order_relaxed);
+
+		size_t bytes = static_cast<size_t>(alignment);
+		size = size > 0 ? (size + bytes - 1) / bytes * bytes : bytes;
+#if defined(_WIN32)
+		return _aligned_malloc(size, bytes);
+#else
+		return aligned_alloc(bytes, size);
+#endif
+	}
+
+	void UFreeAligned(void* memory)
+	{
+#if defined(_WIN32)
+		_aligned_free(memory);
+#else
+		free(memory);
+#endif
+	}
+#endif
+}
+
+size_t UAllocationCount()
+{
+	return gAllocationCount.load(memory_order_relaxed);
+}
+
+void UCountAllocations(bool enabled)
+{
+	tlsCounting = enabled;
+}
+
+void* operator new(size_t size)
+{
+	void* memory = UCountedAllocate(size);
+	if (memory == nullptr)
+		throw bad_alloc();
+	return memory;
+}
+
+void* operator new[](size_t size)
+{
+	return operator new(size);
+}
+
+void* operator new(size_t size, const nothrow_t&) noexcept
+{
+	return UCountedAllocate(size);
+}
+
+void* operator new[](size_t size, const nothrow_t&) noexcept
+{
+	return UCountedAllocate(size);
+}
+
+void operator delete(void* memory) noexcept
+{
+	free(memory);
+}
+
+void operator delete[](void* memory) noexcept
+{
+	free(memory);
+}
+
+void operator delete(void* memory, size_t) noexcept
+{
+	free(memory);
+}
+
+void operator delete[](void* memory, size_t) noexcept
+{
+	free(memory);
+}
+
+void operator delete(void* memory, const nothrow_t&) noexcept
+{
+	free(memory);
+}
+
+void operator delete[](void* memory, const nothrow_t&) noexcept
+{
+	free(memory);
+}
+
+// C++17 routes over-aligned types here, earlier standards through the plain forms
+#if defined(__cpp_aligned_new)
+void* operator new(size_t size, align_val_t alignment)
+{
+	void* memory = UCountedAllocateAligned(size, alignment);
+	if (memory == nullptr)
+		throw bad_alloc();
+	return memory;
+}
+
+void* operator new[](size_t size, align_val_t alignment)
+{
+	return operator new(size, alignment);
+}
+
+void* operator new(size_t size, align_val_t alignment, const nothrow_t&) noexcept
+{
+	return UCountedAllocateAligned(size, alignment);
+}
+
+void* operator new[](size_t size, align_val_t alignment, const nothrow_t&) noexcept
+{
+	return UCountedAllocateAligned(size, alignment);
+}
+
+void operator delete(void* memory, align_val_t) noexcept
+{
+	UFreeAligned(memory);
+}
+
+void operator delete[](void* memory, align_val_t) noexcept
+{
+	UFreeAligned(memory);
+}
+
+void operator delete(void* memory, size_t, align_val_t) noexcept
+{
+	UFreeAligned(memory);
+}
+
+void operator delete[](void* memory, size_t, align_val_t) noexcept
+{
+	UFreeAligned(memory);
+}
+
+void operator delete(void* memory, align_val_t, const nothrow_t&) noexcept
+{
+	UFreeAligned(memory);
+}
+
+void operator delete[](void* memory, align_val_t, const nothrow_t&) noexcept
+{
+	UFreeAligned(memory);
+}
+#endif
+
+#else
+
+size_t UAllocationCount()
+{
+	return 0;
+}
+
+void UCountAllocations(bool)
+{
+}
+
+#endif
@@ -0,0 +1,15 @@
+#pragma once
+
+#include <cstddef>
+
+// Number of heap allocations made through operator new since startup by
+// the threads that count them. Debug builds replace the global operator new,
+// aligned forms included, to count, so the render loop can check it
+// allocates nothing once it is warm. Direct malloc calls, ours or a
+// library's, are not counted. Release builds keep the default operator new
+// and always return 0.
+size_t UAllocationCount();
+
+// Every thread counts by default. A thread whose allocations are expected,
+// like the main thread building snapshots, excludes itself.
+void UCountAllocations(bool enabled);
@@ -0,0 +1,88 @@
+#include <algorithm>
+#include <cstdint>
+#include "Arena.h"
+
+using namespace std;
+
+namespace
+{
+	// overflow blocks are at least this large so small allocations share them
+	const size_t minOverflowSize = 64 * 1024;
+
+	size_t UAlignUp(size_t value, size_t alignment)
+	{
+		return (value + alignment - 1) & ~(alignment - 1);
+	}
+}
+
+void Arena::Create(size_t capacity)
+{
+	Destroy();
+
+	this->capacity = capacity;
+	block = capacity > 0 ? new unsigned char[capacity] : nullptr;
+	current = block;
+	currentSize = capacity;
+	overflow.reserve(8);
+}
+
+void Arena::Destroy()
+{
+	for (unsigned char* extra : overflow)
+		delete[] extra;
+	overflow.clear();
+
+	delete[] block;
+	block = nullptr;
+	current = nullptr;
+	capacity = 0;
+	currentSize = 0;
+	offset = 0;
+	used = 0;
+	peak = 0;
+}
+
+// Frees everything allocated since the last Reset(). The main block grows
+// to the peak when the frame needed overflow blocks.
+void Arena::Reset()
+{
+	peak = max(peak, used);
+
+	if (!overflow.empty())
+	{
+		for (unsigned char* extra : overflow)
+			delete[] extra;
+		overflow.clear();
+
+		delete[] block;
+		capacity = UAlignUp(peak + peak / 4, 4096);
+		block = new unsigned char[capacity];
+	}
+
+	current = block;
+	currentSize = capacity;
+	offset = 0;
+	used = 0;
+}
+
+// alignment must be a power of two
+void* Arena::Allocate(size_t size, size_t alignment)
+{
+	uintptr_t base = (uintptr_t)current;
+	size_t start = current != nullptr ? UAlignUp(base + offset, alignment) - base : 0;
+
+	if (current == nullptr || start + size > currentSize)
+	{
+		// the frame outgrew the block, continue in a new one
+		currentSize = max(size + alignment, minOverflowSize);
+		current = new unsigned char[currentSize];
+		overflow.push_back(current);
+
+		base = (uintptr_t)current;
+		start = UAlignUp(base, alignment) - base;
+	}
+
+	offset = start + size;
+	used += size;
+	return current + start;
+}
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <cstddef>
+#include <new>
+#include <vector>
+
+// Linear allocator for data that lives for one frame: draw lists, matrices,
+// culling results and scratch arrays. Allocating bumps a pointer and Reset()
+// frees everything at once. When a frame needs more than the block holds the
+// arena takes overflow blocks from the heap and grows the block to the peak
+// on the next Reset(), so a steady frame never touches the heap. Destructors
+// of objects placed in the arena are not run.
+class Arena
+{
+public:
+	size_t capacity = 0; // bytes in the main block
+	size_t used = 0; // bytes allocated since the last Reset(), overflow included
+	size_t peak = 0; // most bytes used in one frame
+
+public:
+	Arena() {}
+	Arena(const Arena&) = delete;
+	Arena& operator=(const Arena&) = delete;
+	~Arena() { Destroy(); }
+
+	void Create(size_t capacity);
+	void Destroy();
+	void Reset();
+
+	void* Allocate(size_t size, size_t alignment = alignof(std::max_align_t));
+
+	// Uninitialized storage for count objects
+	template<typename T>
+	T* AllocateArray(size_t count) { return static_cast<T*>(Allocate(sizeof(T) * count, alignof(T))); }
+
+	template<typename T, typename... Args>
+	T* New(Args&&... args) { return new (Allocate(sizeof(T), alignof(T))) T(static_cast<Args&&>(args)...); }
+
+private:
+	unsigned char* block = nullptr;
+	size_t offset = 0; // into the current block
+	unsigned char* current = nullptr; // main block or the last overflow block
+	size_t currentSize = 0;
+	std::vector<unsigned char*> overflow;
+};
@@ -0,0 +1,194 @@
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cctype>
+#include "Benchmark.h"
+
+using namespace std;
+
+namespace
+{
+	// One time field, empty is a missing time (-1). False unless the whole field is a number.
+	bool UParseMs(const string& field, float& ms)
+	{
+		ms = -1.0f;
+		if (field.empty())
+			return true;
+
+		char* end = nullptr;
+		ms = strtof(field.c_str(), &end);
+		if (end == field.c_str())
+			return false;
+		while (isspace((unsigned char)*end))
+			++end;
+		return *end == '\0';
+	}
+}
+
+void Benchmark::Create(size_t numFrames)
+{
+	cpuMs.assign(numFrames, -1.0f);
+	gpuMs.assign(numFrames, -1.0f);
+}
+
+void Benchmark::SetCpuTime(int frame, float ms)
+{
+	if (frame >= 0 && frame < (int)cpuMs.size())
+		cpuMs[frame] = ms;
+}
+
+void Benchmark::SetGpuTime(int frame, float ms)
+{
+	if (frame >= 0 && frame < (int)gpuMs.size())
+		gpuMs[frame] = ms;
+}
+
+bool Benchmark::Write(const char* path) const
+{
+	ofstream file(path);
+	if (!file)
+	{
+		cout << "ERROR::BENCHMARK::CANNOT_OPEN " << path << endl;
+		return false;
+	}
+
+	file << "frame,cpuMs,gpuMs" << endl;
+	for (size_t i = 0; i < cpuMs.size(); ++i)
+	{
+		file << i << ",";
+		if (cpuMs[i] >= 0.0f)
+			file << cpuMs[i];
+		file << ",";
+		if (gpuMs[i] >= 0.0f)
+			file << gpuMs[i];
+		file << "\n";
+	}
+
+	cout << "INFO: Benchmark of " << cpuMs.size() << " frames written to " << path << endl;
+	return true;
+}
+
+bool Benchmark::Compare(const char* basePath, const char* testPath)
+{
+	vector<float> baseCpu, baseGpu, testCpu, testGpu;
+	if (!URead(basePath, baseCpu, baseGpu) || !URead(testPath, testCpu, testGpu))
+		return false;
+
+	if (baseCpu.size() != testCpu.size())
+		cout << "WARNING: " << basePath << " has " << baseCpu.size() << " frames, " << testPath << " has " << testCpu.size() << endl;
+
+	cout << "base: " << basePath << endl << "test: " << testPath << endl;
+	UPrintComparison("CPU", baseCpu, testCpu);
+	UPrintComparison("GPU", baseGpu, testGpu);
+	return true;
+}
+
+bool Benchmark::URead(const char* path, vector<float>& cpuMs, vector<float>& gpuMs)
+{
+	ifstream file(path);
+	if (!file)
+	{
+		cout << "ERROR::BENCHMARK::CANNOT_OPEN " << path << endl;
+		return false;
+	}
+
+	string line;
+	getline(file, line); // header
+	for (size_t row = 2; getline(file, line); ++row)
+	{
+		// empty fields are missing times
+		string frame, cpu, gpu;
+		stringstream fields(line);
+		getline(fields, frame, ',');
+		getline(fields, cpu, ',');
+		getline(fields, gpu, ',');
+
+		float cpuTime, gpuTime;
+		if (!UParseMs(cpu, cpuTime) || !UParseMs(gpu, gpuTime))
+		{
+			cout << "ERROR::BENCHMARK::INVALID_FILE " << path << " line " << row << endl;
+			return false;
+		}
+
+		cpuMs.push_back(cpuTime);
+		gpuMs.push_back(gpuTime);
+	}
+
+	return true;
+}
+
+// Over the frames that have a time
+Benchmark::Distribution Benchmark::UDistribution(const vector<float>& times)
+{
+	vector<float> sorted;
+	for (float ms : times)
+	{
+		if (ms >= 0.0f)
+			sorted.push_back(ms);
+	}
+
+	Distribution distribution = {};
+	distribution.numFrames = sorted.size();
+	if (sorted.empty())
+		return distribution;
+
+	sort(sorted.begin(), sorted.end());
+
+	double sum = 0.0;
+	for (float ms : sorted)
+		sum += ms;
+
+	distribution.mean = sum / sorted.size();
+	distribution.p50 = sorted[(sorted.size() - 1) * 50 / 100];
+	distribution.p90 = sorted[(sorted.size() - 1) * 90 / 100];
+	distribution.p99 = sorted[(sorted.size() - 1) * 99 / 100];
+	distribution.max = sorted.back();
+	return distribution;
+}
+
+// Median of the per frame ratios test / base - 1. Both runs drew the same
+// views, so this cancels the cost differences between parts of the path.
+double Benchmark::UPairedMedianChange(const vector<float>& base, const vector<float>& test)
+{
+	vector<double> ratios;
+	for (size_t i = 0; i < min(base.size(), test.size()); ++i)
+	{
+		if (base[i] > 0.0f && test[i] >= 0.0f)
+			ratios.push_back(test[i] / base[i] - 1.0);
+	}
+
+	if (ratios.empty())
+		return 0.0;
+
+	nth_element(ratios.begin(), ratios.begin() + ratios.size() / 2, ratios.end());
+	return ratios[ratios.size() / 2];
+}
+
+void Benchmark::UPrintComparison(const char* name, const vector<float>& base, const vector<float>& test)
+{
+	Distribution a = UDistribution(base);
+	Distribution b = UDistribution(test);
+	if (a.numFrames == 0 || b.numFrames == 0)
+	{
+		cout << name << ": no times to compare" << endl;
+		return;
+	}
+
+	auto change = [](double from, double to) { return from > 0.0 ? (to / from - 1.0) * 100.0 : 0.0; };
+
+	char line[160];
+	cout << name << " ms      mean      p50      p90      p99      max   frames" << endl;
+	snprintf(line, sizeof(line), "  base %9.3f %8.3f %8.3f %8.3f %8.3f %8zu", a.mean, a.p50, a.p90, a.p99, a.max, a.numFrames);
+	cout << line << endl;
+	snprintf(line, sizeof(line), "  test %9.3f %8.3f %8.3f %8.3f %8.3f %8zu", b.mean, b.p50, b.p90, b.p99, b.max, b.numFrames);
+	cout << line << endl;
+	snprintf(line, sizeof(line), "  diff %+8.1f%% %+7.1f%% %+7.1f%% %+7.1f%% %+7.1f%%", change(a.mean, b.mean), change(a.p50, b.p50),
+		change(a.p90, b.p90), change(a.p99, b.p99), change(a.max, b.max));
+	cout << line << endl;
+	snprintf(line, sizeof(line), "  per frame median change %+.1f%%", UPairedMedianChange(base, test) * 100.0);
+	cout << line << endl;
+}
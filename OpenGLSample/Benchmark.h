@@ -0,0 +1,42 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+// CPU and GPU time of every frame of a camera path replay. Both runs of a
+// comparison replay the same path, so their distributions, and the frames
+// themselves, line up.
+class Benchmark
+{
+public:
+	void Create(size_t numFrames);
+
+	// frames outside the replay are ignored, frames never set stay missing
+	void SetCpuTime(int frame, float ms);
+	void SetGpuTime(int frame, float ms);
+
+	// CSV: frame,cpuMs,gpuMs, missing times are left empty
+	bool Write(const char* path) const;
+
+	// Prints the distributions of two written runs and how test changed against base
+	static bool Compare(const char* basePath, const char* testPath);
+
+private:
+	struct Distribution
+	{
+		size_t numFrames;
+		double mean;
+		double p50;
+		double p90;
+		double p99;
+		double max;
+	};
+
+	std::vector<float> cpuMs; // negative while missing
+	std::vector<float> gpuMs;
+
+	static bool URead(const char* path, std::vector<float>& cpuMs, std::vector<float>& gpuMs);
+	static Distribution UDistribution(const std::vector<float>& times);
+	static double UPairedMedianChange(const std::vector<float>& base, const std::vector<float>& test);
+	static void UPrintComparison(const char* name, const std::vector<float>& base, const std::vector<float>& test);
+};
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <cfloat>
+
+// Local space bounding volumes of a mesh. The sphere shares the box center.
+struct Bounds
+{
+	glm::vec3 min; // axis aligned box
+	glm::vec3 max;
+	glm::vec3 center; // bounding sphere
+	float radius;
+};
+
+// Computes the bounds of interleaved vertex data, position first
+inline Bounds UComputeBounds(const GLfloat* vertexData, size_t numVerts, size_t floatsPerStride)
+{
+	Bounds bounds;
+	bounds.min = glm::vec3(FLT_MAX);
+	bounds.max = glm::vec3(-FLT_MAX);
+
+	for (size_t i = 0; i < numVerts; ++i)
+	{
+		const GLfloat* p = vertexData + i * floatsPerStride;
+		bounds.min = glm::min(bounds.min, glm::vec3(p[0], p[1], p[2]));
+		bounds.max = glm::max(bounds.max, glm::vec3(p[0], p[1], p[2]));
+	}
+
+	bounds.center = (bounds.min + bounds.max) * 0.5f;
+	bounds.radius = 0.0f;
+
+	for (size_t i = 0; i < numVerts; ++i)
+	{
+		const GLfloat* p = vertexData + i * floatsPerStride;
+		bounds.radius = std::max(bounds.radius, glm::length(glm::vec3(p[0], p[1], p[2]) - bounds.center));
+	}
+
+	return bounds;
+}
+
+// World space box of local bounds under a transform (Arvo)
+inline void UTransformBounds(const Bounds& bounds, const glm::mat4& model, glm::vec3& worldMin, glm::vec3& worldMax)
+{
+	glm::vec3 center = glm::vec3(model * glm::vec4((bounds.min + bounds.max) * 0.5f, 1.0f));
+	glm::vec3 extent = (bounds.max - bounds.min) * 0.5f;
+	glm::vec3 worldExtent = glm::abs(glm::vec3(model[0])) * extent.x + glm::abs(glm::vec3(model[1])) * extent.y + glm::abs(glm::vec3(model[2])) * extent.z;
+
+	worldMin = center - worldExtent;
+	worldMax = center + worldExtent;
+}
@@ -1,7 +1,9 @@
 #include "Box.h"
+#include "CpuProfiler.h"
 
 void Box::CreateMesh()
 {
+	CPU_PROFILE_SCOPE("Box::CreateMesh");
 	UCreateBox(boxMesh);
 }
 
@@ -74,6 +76,11 @@ void Box::UCreateBox(GLMesh& mesh)
 
 	mesh.numVert = sizeof(verts) / (sizeof(verts[0]) * (floatsPerVertex + floatsPerNormal + floatsPerUV));
 	mesh.numIndicies = sizeof(indices) / sizeof(indices[0]);
+	mesh.bounds = UComputeBounds(verts, mesh.numVert, floatsPerVertex + floatsPerNormal + floatsPerUV); // culling volumes
+
+	// CPU copy of the triangles for picking
+	mesh.triangles.clear();
+	UAppendTriangles(mesh.triangles, verts, floatsPerVertex + floatsPerNormal + floatsPerUV, GL_TRIANGLES, 0, mesh.numIndicies, indices);
 
 	glGenVertexArrays(1, &mesh.vao); // we can also generate multiple VAOs or buffers at the same time
 	glBindVertexArray(mesh.vao);
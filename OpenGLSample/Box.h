@@ -3,6 +3,11 @@
 #include <GL/glew.h>
 #include <glm/glm.hpp>
 
+#include <vector>
+
+#include "Bounds.h"
+#include "MeshTriangles.h"
+
 class Box
 {
 	struct GLMesh
@@ -11,6 +16,8 @@ class Box
 		GLuint vbos[2]; // Vertex buffer object
 		GLuint numVert; // number of verticies in an object
 		GLuint numIndicies;// number if indicies in an object
+		Bounds bounds; // local space bounding box and sphere
+		std::vector<glm::vec3> triangles; // local space triangle list for picking
 	};
 
 public:
@@ -0,0 +1,439 @@
+#include <algorithm>
+#include "Bvh.h"
+
+using namespace std;
+
+namespace
+{
+	const int sahBins = 12; // bins per axis for the SAH sweep
+	const int maxLeafItems = 4; // leaves never get larger than this
+
+	float USurfaceArea(const glm::vec3& min, const glm::vec3& max)
+	{
+		glm::vec3 e = max - min;
+		return e.x * e.y + e.y * e.z + e.z * e.x;
+	}
+
+	// Slab test, returns the entry distance or FLT_MAX on a miss
+	float URayBox(const glm::vec3& origin, const glm::vec3& inverseDirection, const glm::vec3& min, const glm::vec3& max, float maxDistance)
+	{
+		glm::vec3 t1 = (min - origin) * inverseDirection;
+		glm::vec3 t2 = (max - origin) * inverseDirection;
+		glm::vec3 tMin = glm::min(t1, t2);
+		glm::vec3 tMax = glm::max(t1, t2);
+		float tNear = std::max(std::max(tMin.x, tMin.y), std::max(tMin.z, 0.0f));
+		float tFar = std::min(std::min(tMax.x, tMax.y), std::min(tMax.z, maxDistance));
+
+		return tNear <= tFar ? tNear : FLT_MAX;
+	}
+
+	// Moller-Trumbore, returns the distance or FLT_MAX on a miss
+	float URayTriangle(const glm::vec3& origin, const glm::vec3& direction, const glm::vec3& v0, const glm::vec3& v1, const glm::vec3& v2)
+	{
+		const float epsilon = 1e-7f;
+		glm::vec3 edge1 = v1 - v0;
+		glm::vec3 edge2 = v2 - v0;
+		glm::vec3 h = glm::cross(direction, edge2);
+		float a = glm::dot(edge1, h);
+		if (a > -epsilon && a < epsilon)
+			return FLT_MAX;
+
+		float f = 1.0f / a;
+		glm::vec3 s = origin - v0;
+		float u = f * glm::dot(s, h);
+		if (u < 0.0f || u > 1.0f)
+			return FLT_MAX;
+
+		glm::vec3 q = glm::cross(s, edge1);
+		float v = f * glm::dot(direction, q);
+		if (v < 0.0f || u + v > 1.0f)
+			return FLT_MAX;
+
+		float t = f * glm::dot(edge2, q);
+		return t > epsilon ? t : FLT_MAX;
+	}
+}
+
+// Builds the hierarchy from scratch
+void Bvh::Build(const vector<DrawItem>& items)
+{
+	int count = (int)items.size();
+	itemMin.resize(count);
+	itemMax.resize(count);
+	itemCenter.resize(count);
+	itemInverse.resize(count);
+	itemLeaf.assign(count, 0);
+	itemIndices.resize(count);
+
+	for (int i = 0; i < count; ++i)
+	{
+		UUpdateItem(items[i], i);
+		itemIndices[i] = i;
+	}
+
+	nodes.clear();
+	parents.clear();
+	depth = 0;
+	if (count == 0)
+		return;
+
+	nodes.reserve(count > 0 ? 2 * count - 1 : 1);
+	parents.reserve(nodes.capacity());
+
+	Node root;
+	root.leftFirst = 0;
+	root.count = count;
+	nodes.push_back(root);
+	parents.push_back(-1);
+
+	UUpdateNodeBounds(0);
+	USubdivide(0, 0);
+}
+
+// Updates every node after item transforms changed, the topology is kept
+void Bvh::Refit(const vector<DrawItem>& items)
+{
+	for (int i = 0; i < (int)items.size(); ++i)
+		UUpdateItem(items[i], i);
+
+	// children are always stored after their parent
+	for (int i = (int)nodes.size() - 1; i >= 0; --i)
+	{
+		Node& node = nodes[i];
+		if (node.count > 0)
+		{
+			UUpdateNodeBounds(i);
+		}
+		else
+		{
+			const Node& left = nodes[node.leftFirst];
+			const Node& right = nodes[node.leftFirst + 1];
+			node.min = glm::min(left.min, right.min);
+			node.max = glm::max(left.max, right.max);
+		}
+	}
+}
+
+// Updates the nodes above one item after its transform changed
+void Bvh::RefitItem(const vector<DrawItem>& items, int item)
+{
+	UUpdateItem(items[item], item);
+
+	int nodeIndex = itemLeaf[item];
+	UUpdateNodeBounds(nodeIndex);
+
+	for (nodeIndex = parents[nodeIndex]; nodeIndex >= 0; nodeIndex = parents[nodeIndex])
+	{
+		Node& node = nodes[nodeIndex];
+		const Node& left = nodes[node.leftFirst];
+		const Node& right = nodes[node.leftFirst + 1];
+		node.min = glm::min(left.min, right.min);
+		node.max = glm::max(left.max, right.max);
+	}
+}
+
+// Collects the items intersecting the frustum. Subtrees fully inside are
+// taken without testing their items.
+void Bvh::CullFrustum(const glm::vec4 planes[6], vector<int>& visible) const
+{
+	visible.clear();
+	if (nodes.empty())
+		return;
+
+	UCullNode(0, planes, 0x3f, visible);
+}
+
+// Closest item and triangle along a world space ray
+Bvh::Hit Bvh::Raycast(const vector<DrawItem>& items, const glm::vec3& origin, const glm::vec3& direction) const
+{
+	Hit hit;
+	if (nodes.empty())
+		return hit;
+
+	glm::vec3 inverseDirection = glm::vec3(1.0f) / direction;
+
+	// every level leaves at most one sibling behind, so depth + 2 entries never overflow
+	vector<int> stack;
+	stack.reserve(depth + 2);
+	stack.push_back(0);
+
+	while (!stack.empty())
+	{
+		const Node& node = nodes[stack.back()];
+		stack.pop_back();
+		if (URayBox(origin, inverseDirection, node.min, node.max, hit.distance) == FLT_MAX)
+			continue;
+
+		if (node.count > 0)
+		{
+			for (int i = node.leftFirst; i < node.leftFirst + node.count; ++i)
+			{
+				int item = itemIndices[i];
+				if (items[item].triangles == nullptr)
+					continue;
+				if (URayBox(origin, inverseDirection, itemMin[item], itemMax[item], hit.distance) == FLT_MAX)
+					continue;
+
+				// t is the same in local space when the direction is not renormalized
+				glm::vec3 localOrigin = glm::vec3(itemInverse[item] * glm::vec4(origin, 1.0f));
+				glm::vec3 localDirection = glm::vec3(itemInverse[item] * glm::vec4(direction, 0.0f));
+
+				const glm::vec3* triangles = items[item].triangles;
+				for (size_t t = 0; t < items[item].numTriangles * 3; t += 3)
+				{
+					float distance = URayTriangle(localOrigin, localDirection, triangles[t], triangles[t + 1], triangles[t + 2]);
+					if (distance < hit.distance)
+					{
+						hit.distance = distance;
+						hit.item = item;
+						hit.triangle = int(t / 3);
+					}
+				}
+			}
+			continue;
+		}
+
+		// visit the nearer child first
+		int left = node.leftFirst;
+		int right = node.leftFirst + 1;
+		float leftDistance = URayBox(origin, inverseDirection, nodes[left].min, nodes[left].max, hit.distance);
+		float rightDistance = URayBox(origin, inverseDirection, nodes[right].min, nodes[right].max, hit.distance);
+		if (leftDistance > rightDistance)
+		{
+			swap(left, right);
+			swap(leftDistance, rightDistance);
+		}
+
+		if (rightDistance != FLT_MAX)
+			stack.push_back(right);
+		if (leftDistance != FLT_MAX)
+			stack.push_back(left);
+	}
+
+	return hit;
+}
+
+void Bvh::UUpdateItem(const DrawItem& item, int index)
+{
+	UTransformBounds(item.bounds, item.model, itemMin[index], itemMax[index]);
+	itemCenter[index] = (itemMin[index] + itemMax[index]) * 0.5f;
+	itemInverse[index] = glm::inverse(item.model);
+}
+
+// Splits a node along the cheapest SAH plane until splitting stops paying off
+void Bvh::USubdivide(int nodeIndex, int level)
+{
+	Node& node = nodes[nodeIndex];
+	depth = max(depth, level);
+
+	int axis;
+	float splitPos;
+	float splitCost = UFindBestSplit(node, axis, splitPos);
+	float leafCost = float(node.count) * USurfaceArea(node.min, node.max);
+
+	if (splitCost >= leafCost && node.count <= maxLeafItems)
+	{
+		for (int i = node.leftFirst; i < node.leftFirst + node.count; ++i)
+			itemLeaf[itemIndices[i]] = nodeIndex;
+		return;
+	}
+
+	// partition the items around the split plane
+	int first = node.leftFirst;
+	int i = first;
+	int j = first + node.count - 1;
+	while (i <= j)
+	{
+		if (itemCenter[itemIndices[i]][axis] < splitPos)
+			++i;
+		else
+			swap(itemIndices[i], itemIndices[j--]);
+	}
+
+	// degenerate split (all centers equal), fall back to a median split
+	int leftCount = i - first;
+	if (leftCount == 0 || leftCount == node.count)
+		leftCount = node.count / 2;
+
+	int leftIndex = (int)nodes.size();
+	Node left;
+	left.leftFirst = first;
+	left.count = leftCount;
+	Node right;
+	right.leftFirst = first + leftCount;
+	right.count = node.count - leftCount;
+
+	node.leftFirst = leftIndex;
+	node.count = 0;
+
+	// node is invalidated by the push_backs
+	nodes.push_back(left);
+	nodes.push_back(right);
+	parents.push_back(nodeIndex);
+	parents.push_back(nodeIndex);
+
+	UUpdateNodeBounds(leftIndex);
+	UUpdateNodeBounds(leftIndex + 1);
+	USubdivide(leftIndex, level + 1);
+	USubdivide(leftIndex + 1, level + 1);
+}
+
+void Bvh::UUpdateNodeBounds(int nodeIndex)
+{
+	Node& node = nodes[nodeIndex];
+	node.min = glm::vec3(FLT_MAX);
+	node.max = glm::vec3(-FLT_MAX);
+
+	for (int i = node.leftFirst; i < node.leftFirst + node.count; ++i)
+	{
+		node.min = glm::min(node.min, itemMin[itemIndices[i]]);
+		node.max = glm::max(node.max, itemMax[itemIndices[i]]);
+	}
+}
+
+// Binned SAH over the item centers, returns the cost of the best split
+float Bvh::UFindBestSplit(const Node& node, int& axis, float& splitPos) const
+{
+	float bestCost = FLT_MAX;
+	axis = 0;
+	splitPos = 0.0f;
+
+	for (int a = 0; a < 3; ++a)
+	{
+		float boundsMin = FLT_MAX;
+		float boundsMax = -FLT_MAX;
+		for (int i = node.leftFirst; i < node.leftFirst + node.count; ++i)
+		{
+			boundsMin = std::min(boundsMin, itemCenter[itemIndices[i]][a]);
+			boundsMax = std::max(boundsMax, itemCenter[itemIndices[i]][a]);
+		}
+		if (boundsMin == boundsMax)
+			continue;
+
+		struct Bin
+		{
+			glm::vec3 min = glm::vec3(FLT_MAX);
+			glm::vec3 max = glm::vec3(-FLT_MAX);
+			int count = 0;
+		} bins[sahBins];
+
+		float scale = sahBins / (boundsMax - boundsMin);
+		for (int i = node.leftFirst; i < node.leftFirst + node.count; ++i)
+		{
+			int item = itemIndices[i];
+			int b = std::min(sahBins - 1, int((itemCenter[item][a] - boundsMin) * scale));
+			bins[b].count++;
+			bins[b].min = glm::min(bins[b].min, itemMin[item]);
+			bins[b].max = glm::max(bins[b].max, itemMax[item]);
+		}
+
+		// sweep from both sides
+		float leftArea[sahBins - 1];
+		float rightArea[sahBins - 1];
+		int leftCount[sahBins - 1];
+		int rightCount[sahBins - 1];
+		glm::vec3 leftMin(FLT_MAX), leftMax(-FLT_MAX), rightMin(FLT_MAX), rightMax(-FLT_MAX);
+		int leftSum = 0;
+		int rightSum = 0;
+
+		for (int i = 0; i < sahBins - 1; ++i)
+		{
+			leftSum += bins[i].count;
+			leftCount[i] = leftSum;
+			leftMin = glm::min(leftMin, bins[i].min);
+			leftMax = glm::max(leftMax, bins[i].max);
+			leftArea[i] = leftSum > 0 ? USurfaceArea(leftMin, leftMax) : 0.0f;
+
+			rightSum += bins[sahBins - 1 - i].count;
+			rightCount[sahBins - 2 - i] = rightSum;
+			rightMin = glm::min(rightMin, bins[sahBins - 1 - i].min);
+			rightMax = glm::max(rightMax, bins[sahBins - 1 - i].max);
+			rightArea[sahBins - 2 - i] = rightSum > 0 ? USurfaceArea(rightMin, rightMax) : 0.0f;
+		}
+
+		float binWidth = (boundsMax - boundsMin) / sahBins;
+		for (int i = 0; i < sahBins - 1; ++i)
+		{
+			float cost = leftCount[i] * leftArea[i] + rightCount[i] * rightArea[i];
+			if (cost < bestCost)
+			{
+				bestCost = cost;
+				axis = a;
+				splitPos = boundsMin + binWidth * (i + 1);
+			}
+		}
+	}
+
+	return bestCost;
+}
+
+void Bvh::UCullNode(int nodeIndex, const glm::vec4 planes[6], int planeMask, vector<int>& visible) const
+{
+	const Node& node = nodes[nodeIndex];
+	glm::vec3 center = (node.min + node.max) * 0.5f;
+	glm::vec3 extent = (node.max - node.min) * 0.5f;
+
+	for (int p = 0; p < 6; ++p)
+	{
+		if ((planeMask & (1 << p)) == 0)
+			continue;
+
+		glm::vec3 normal = glm::vec3(planes[p]);
+		float dist = glm::dot(center, normal) + planes[p].w;
+		float radius = glm::dot(extent, glm::abs(normal));
+
+		if (dist + radius < 0.0f)
+			return; // outside
+		if (dist - radius >= 0.0f)
+			planeMask &= ~(1 << p); // inside this plane, children are too
+	}
+
+	if (planeMask == 0)
+	{
+		UAppendSubtree(nodeIndex, visible);
+		return;
+	}
+
+	if (node.count > 0)
+	{
+		// test the items of partially visible leaves
+		for (int i = node.leftFirst; i < node.leftFirst + node.count; ++i)
+		{
+			int item = itemIndices[i];
+			glm::vec3 itemCenterPos = (itemMin[item] + itemMax[item]) * 0.5f;
+			glm::vec3 itemExtent = (itemMax[item] - itemMin[item]) * 0.5f;
+			bool isOutside = false;
+
+			for (int p = 0; p < 6 && !isOutside; ++p)
+			{
+				if ((planeMask & (1 << p)) == 0)
+					continue;
+
+				glm::vec3 normal = glm::vec3(planes[p]);
+				isOutside = glm::dot(itemCenterPos, normal) + planes[p].w + glm::dot(itemExtent, glm::abs(normal)) < 0.0f;
+			}
+
+			if (!isOutside)
+				visible.push_back(item);
+		}
+		return;
+	}
+
+	UCullNode(node.leftFirst, planes, planeMask, visible);
+	UCullNode(node.leftFirst + 1, planes, planeMask, visible);
+}
+
+void Bvh::UAppendSubtree(int nodeIndex, vector<int>& visible) const
+{
+	const Node& node = nodes[nodeIndex];
+
+	if (node.count > 0)
+	{
+		for (int i = node.leftFirst; i < node.leftFirst + node.count; ++i)
+			visible.push_back(itemIndices[i]);
+		return;
+	}
+
+	UAppendSubtree(node.leftFirst, visible);
+	UAppendSubtree(node.leftFirst + 1, visible);
+}
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include <cfloat>
+#include <vector>
+
+#include "DrawItem.h"
+
+// Bounding volume hierarchy over the items of a draw list. Built with a
+// binned SAH, refit in place when transforms change. Used for hierarchical
+// frustum culling and for mouse ray picking.
+class Bvh
+{
+public:
+	struct Node
+	{
+		glm::vec3 min;
+		int leftFirst; // left child (right is leftFirst + 1), or first leaf item
+		glm::vec3 max;
+		int count; // number of items in a leaf, 0 for inner nodes
+	};
+
+	struct Hit
+	{
+		int item = -1; // index into the draw list, -1 when nothing was hit
+		int triangle = -1; // triangle index in the item's mesh
+		float distance = FLT_MAX; // along the ray direction
+	};
+
+	std::vector<Node> nodes;
+	std::vector<int> itemIndices; // draw list indices in leaf order
+	int depth = 0; // levels below the root, bounds the traversal stack
+
+public:
+	void Build(const std::vector<DrawItem>& items);
+	void Refit(const std::vector<DrawItem>& items);
+	void RefitItem(const std::vector<DrawItem>& items, int item);
+
+	void CullFrustum(const glm::vec4 planes[6], std::vector<int>& visible) const;
+	Hit Raycast(const std::vector<DrawItem>& items, const glm::vec3& origin, const glm::vec3& direction) const;
+
+private:
+	// world space item data
+	std::vector<glm::vec3> itemMin;
+	std::vector<glm::vec3> itemMax;
+	std::vector<glm::vec3> itemCenter;
+	std::vector<glm::mat4> itemInverse; // world to local, for picking
+
+	std::vector<int> parents; // parent of every node, -1 for the root
+	std::vector<int> itemLeaf; // leaf node of every item
+
+	void UUpdateItem(const DrawItem& item, int index);
+	void USubdivide(int nodeIndex, int level);
+	void UUpdateNodeBounds(int nodeIndex);
+	float UFindBestSplit(const Node& node, int& axis, float& splitPos) const;
+	void UCullNode(int nodeIndex, const glm::vec4 planes[6], int planeMask, std::vector<int>& visible) const;
+	void UAppendSubtree(int nodeIndex, std::vector<int>& visible) const;
+};
@@ -0,0 +1,67 @@
+#include <iostream>
+#include <fstream>
+#include "CameraPath.h"
+
+using namespace std;
+
+bool CameraPath::Save(const char* path) const
+{
+	ofstream file(path, ios::binary);
+	if (!file)
+	{
+		cout << "ERROR::CAMERAPATH::CANNOT_OPEN " << path << endl;
+		return false;
+	}
+
+	Header header = { magic, version, (uint32_t)sizeof(Frame), (uint32_t)frames.size() };
+	file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+	file.write(reinterpret_cast<const char*>(frames.data()), frames.size() * sizeof(Frame));
+
+	if (!file)
+	{
+		cout << "ERROR::CAMERAPATH::WRITE_FAILED " << path << endl;
+		return false;
+	}
+
+	return true;
+}
+
+bool CameraPath::Load(const char* path)
+{
+	ifstream file(path, ios::binary);
+	if (!file)
+	{
+		cout << "ERROR::CAMERAPATH::CANNOT_OPEN " << path << endl;
+		return false;
+	}
+
+	Header header = {};
+	file.read(reinterpret_cast<char*>(&header), sizeof(header));
+	if (!file || header.magic != magic || header.version != version || header.frameSize != sizeof(Frame))
+	{
+		cout << "ERROR::CAMERAPATH::INVALID_FILE " << path << endl;
+		return false;
+	}
+
+	// the count must fit in what the file holds before anything is allocated for it
+	streamoff headerEnd = file.tellg();
+	file.seekg(0, ios::end);
+	streamoff frameBytes = file.tellg() - headerEnd;
+	file.seekg(headerEnd);
+	if (!file || (uint64_t)header.numFrames * sizeof(Frame) > (uint64_t)frameBytes)
+	{
+		cout << "ERROR::CAMERAPATH::TRUNCATED " << path << endl;
+		return false;
+	}
+
+	frames.resize(header.numFrames);
+	file.read(reinterpret_cast<char*>(frames.data()), frames.size() * sizeof(Frame));
+	if (!file)
+	{
+		cout << "ERROR::CAMERAPATH::TRUNCATED " << path << endl;
+		frames.clear();
+		return false;
+	}
+
+	return true;
+}
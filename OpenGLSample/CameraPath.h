@@ -0,0 +1,65 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+// Camera, input and render settings of every published frame. Recorded
+// while flying around and replayed frame by frame, so a benchmark looks at
+// exactly the same views on every run. The file is a small header followed
+// by the frames as they are laid out in memory, little endian.
+class CameraPath
+{
+public:
+	static const uint32_t magic = 0x48545043; // "CPTH"
+	static const uint32_t version = 1;
+
+	// keys held during the frame
+	enum Key
+	{
+		KEY_FORWARD = 1 << 0,
+		KEY_BACKWARD = 1 << 1,
+		KEY_LEFT = 1 << 2,
+		KEY_RIGHT = 1 << 3,
+		KEY_UP = 1 << 4,
+		KEY_DOWN = 1 << 5,
+		KEY_ORTHOGRAPHIC = 1 << 6
+	};
+
+	// toggles of the frame, the culling mode takes bits 8 to 15
+	enum Setting
+	{
+		SETTING_DEFERRED = 1 << 0,
+		SETTING_SHADOWS = 1 << 1,
+		SETTING_OCCLUSION = 1 << 2,
+		SETTING_LOD = 1 << 3,
+		SETTING_HUD = 1 << 4,
+		SETTING_REVERSE_Z = 1 << 5,
+		SETTING_DEPTH_PREPASS = 1 << 6,
+		SETTING_DYNAMIC_RESOLUTION = 1 << 7
+	};
+
+	struct Frame
+	{
+		float position[3]; // camera position as drawn, after interpolation
+		float yaw;
+		float pitch;
+		float zoom;
+		uint32_t keys;
+		uint32_t settings;
+	};
+
+	std::vector<Frame> frames;
+
+public:
+	bool Save(const char* path) const;
+	bool Load(const char* path);
+
+private:
+	struct Header
+	{
+		uint32_t magic;
+		uint32_t version;
+		uint32_t frameSize; // catches files written with another Frame layout
+		uint32_t numFrames;
+	};
+};
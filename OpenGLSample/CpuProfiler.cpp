@@ -0,0 +1,144 @@
+#include <iostream>
+#include <fstream>
+#include <iomanip>
+#include <chrono>
+#include <algorithm>
+#include "CpuProfiler.h"
+
+using namespace std;
+
+namespace
+{
+	// ring of the calling thread, registered on its first event
+	thread_local void* tlsThreadBuffer = nullptr;
+	thread_local const char* tlsThreadName = nullptr;
+
+	// names are string literals, only quotes and backslashes need escaping
+	void UWriteName(ofstream& file, const char* name)
+	{
+		file << '"';
+		for (const char* c = name; *c != '\0'; ++c)
+		{
+			if (*c == '"' || *c == '\\')
+				file << '\\';
+			file << *c;
+		}
+		file << '"';
+	}
+}
+
+CpuProfiler& UCpuProfiler()
+{
+	static CpuProfiler profiler;
+	return profiler;
+}
+
+void CpuProfiler::SetCapturing(bool capturing)
+{
+	this->capturing.store(capturing);
+}
+
+void CpuProfiler::SetThreadName(const char* name)
+{
+	tlsThreadName = name;
+	UThreadBuffer().name = name;
+}
+
+// Owner thread only, readers see the event once the count moved past it
+void CpuProfiler::Record(const char* name, int64_t begin, int64_t end)
+{
+	ThreadBuffer& buffer = UThreadBuffer();
+	uint64_t index = buffer.numEvents.load(memory_order_relaxed);
+
+	Event& event = buffer.events[index & (eventsPerThread - 1)];
+	event.name = name;
+	event.begin = begin;
+	event.end = end;
+
+	buffer.numEvents.store(index + 1, memory_order_release);
+}
+
+// Call while not capturing
+void CpuProfiler::Clear()
+{
+	lock_guard<mutex> lock(threadsMutex);
+	for (unique_ptr<ThreadBuffer>& buffer : threads)
+		buffer->numEvents.store(0);
+}
+
+bool CpuProfiler::ExportTrace(const char* path)
+{
+	ofstream file(path);
+	if (!file)
+	{
+		cout << "ERROR::CPUPROFILER::CANNOT_OPEN " << path << endl;
+		return false;
+	}
+
+	lock_guard<mutex> lock(threadsMutex);
+
+	// timestamps start at the oldest event kept
+	int64_t origin = INT64_MAX;
+	for (unique_ptr<ThreadBuffer>& buffer : threads)
+	{
+		uint64_t numEvents = buffer->numEvents.load(memory_order_acquire);
+		uint64_t first = numEvents > eventsPerThread ? numEvents - eventsPerThread : 0;
+		for (uint64_t i = first; i < numEvents; ++i)
+			origin = min(origin, buffer->events[i & (eventsPerThread - 1)].begin);
+	}
+
+	// microseconds with nanosecond digits, long captures must not switch to exponents
+	file << fixed << setprecision(3);
+	file << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+	bool firstEvent = true;
+	size_t numWritten = 0;
+
+	for (unique_ptr<ThreadBuffer>& buffer : threads)
+	{
+		file << (firstEvent ? "" : ",") << "\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << buffer->id << ",\"args\":{\"name\":";
+		UWriteName(file, buffer->name != nullptr ? buffer->name : "Thread");
+		file << "}}";
+		firstEvent = false;
+
+		uint64_t numEvents = buffer->numEvents.load(memory_order_acquire);
+		uint64_t first = numEvents > eventsPerThread ? numEvents - eventsPerThread : 0;
+		for (uint64_t i = first; i < numEvents; ++i)
+		{
+			const Event& event = buffer->events[i & (eventsPerThread - 1)];
+
+			// complete events in microseconds, nesting follows from the times
+			file << ",\n{\"name\":";
+			UWriteName(file, event.name);
+			file << ",\"ph\":\"X\",\"pid\":1,\"tid\":" << buffer->id << ",\"ts\":" << (event.begin - origin) / 1000.0
+				<< ",\"dur\":" << (event.end - event.begin) / 1000.0 << "}";
+			++numWritten;
+		}
+	}
+
+	file << "\n]}" << endl;
+	cout << "INFO: CPU trace: " << numWritten << " events of " << threads.size() << " threads written to " << path << endl;
+	return true;
+}
+
+int64_t CpuProfiler::Now()
+{
+	return chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// The first event of a thread registers its ring
+CpuProfiler::ThreadBuffer& CpuProfiler::UThreadBuffer()
+{
+	if (tlsThreadBuffer == nullptr)
+	{
+		unique_ptr<ThreadBuffer> buffer(new ThreadBuffer());
+		buffer->events.reset(new Event[eventsPerThread]);
+		buffer->name = tlsThreadName;
+
+		lock_guard<mutex> lock(threadsMutex);
+		buffer->id = (int)threads.size() + 1;
+		tlsThreadBuffer = buffer.get();
+		threads.push_back(move(buffer));
+	}
+
+	return *static_cast<ThreadBuffer*>(tlsThreadBuffer);
+}
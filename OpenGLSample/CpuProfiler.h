@@ -0,0 +1,89 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+// Scoped CPU timing markers. Every thread writes its scopes into a ring of
+// its own without locks, the newest eventsPerThread survive. While capture
+// is off a scope costs one relaxed load; defining CPU_PROFILER_DISABLED
+// compiles the markers out entirely. ExportTrace() writes Chrome
+// trace_event JSON with one timeline per thread, for Perfetto or
+// chrome://tracing.
+class CpuProfiler
+{
+public:
+	static const size_t eventsPerThread = 1 << 15; // power of two
+
+	struct Event
+	{
+		const char* name; // string literals only, they are kept by address
+		int64_t begin; // nanoseconds of the steady clock
+		int64_t end;
+	};
+
+public:
+	void SetCapturing(bool capturing);
+	bool IsCapturing() const { return capturing.load(std::memory_order_relaxed); }
+
+	// names the calling thread in the trace, a string literal. Naming a
+	// thread up front keeps its first event from allocating the ring.
+	void SetThreadName(const char* name);
+
+	void Record(const char* name, int64_t begin, int64_t end);
+	void Clear();
+
+	// Call while not capturing, scopes still open are left out
+	bool ExportTrace(const char* path);
+
+	static int64_t Now();
+
+private:
+	struct ThreadBuffer
+	{
+		const char* name;
+		int id;
+		std::unique_ptr<Event[]> events;
+		std::atomic<uint64_t> numEvents{ 0 }; // written so far, the ring keeps the newest
+	};
+
+	std::atomic<bool> capturing{ false };
+	std::mutex threadsMutex; // guards the list, never the events
+	std::vector<std::unique_ptr<ThreadBuffer>> threads; // kept after their thread ends
+
+	ThreadBuffer& UThreadBuffer();
+};
+
+CpuProfiler& UCpuProfiler();
+
+// Times the enclosing scope while capture is on
+class CpuProfileScope
+{
+public:
+	explicit CpuProfileScope(const char* name) : name(name), begin(UCpuProfiler().IsCapturing() ? CpuProfiler::Now() : -1) {}
+	~CpuProfileScope()
+	{
+		if (begin >= 0)
+			UCpuProfiler().Record(name, begin, CpuProfiler::Now());
+	}
+
+	CpuProfileScope(const CpuProfileScope&) = delete;
+	CpuProfileScope& operator=(const CpuProfileScope&) = delete;
+
+private:
+	const char* name;
+	int64_t begin;
+};
+
+#define CPU_PROFILE_CONCAT_INNER(a, b) a##b
+#define CPU_PROFILE_CONCAT(a, b) CPU_PROFILE_CONCAT_INNER(a, b)
+
+#ifndef CPU_PROFILER_DISABLED
+#define CPU_PROFILE_SCOPE(name) CpuProfileScope CPU_PROFILE_CONCAT(cpuProfileScope, __LINE__)(name)
+#define CPU_PROFILE_THREAD(name) UCpuProfiler().SetThreadName(name)
+#else
+#define CPU_PROFILE_SCOPE(name) ((void)0)
+#define CPU_PROFILE_THREAD(name) ((void)0)
+#endif
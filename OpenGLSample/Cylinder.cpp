@@ -1,13 +1,27 @@
 #include "Cylinder.h"
+#include "CpuProfiler.h"
+
+#include <cmath>
 
 void Cylinder::CreateMesh()
 {
+	CPU_PROFILE_SCOPE("Cylinder::CreateMesh");
 	UCreateCyilinder(cylinderMesh);
+
+	// coarser levels for distant bottles, down to a few dozen triangles
+	const int lodSegments[] = { 16, 10, 6 };
+	lodMeshes.resize(sizeof(lodSegments) / sizeof(lodSegments[0]));
+	for (size_t i = 0; i < lodMeshes.size(); ++i)
+		UCreateCylinderLod(lodMeshes[i], lodSegments[i]);
 }
 
 void Cylinder::DestroyMesh()
 {
 	UDestroyCyilinder(cylinderMesh);
+
+	for (GLMesh& lodMesh : lodMeshes)
+		UDestroyCyilinder(lodMesh);
+	lodMeshes.clear();
 }
 
 void Cylinder::UCreateCyilinder(GLMesh& mesh)
@@ -245,6 +259,15 @@ void Cylinder::UCreateCyilinder(GLMesh& mesh)
 
 	mesh.numVert = sizeof(Verticies) / (sizeof(Verticies[0]) * (floatsPerVertex + floatsPerNormal + floatsPerUV)); // vertex data
 	mesh.numIndicies = 0; // index data
+	mesh.bounds = UComputeBounds(Verticies, mesh.numVert, floatsPerVertex + floatsPerNormal + floatsPerUV); // culling volumes
+	mesh.error = 1.0f - cos(glm::radians(180.0f / 36.0f)); // 36 segments
+
+	// CPU copy of the triangles for picking, same ranges as the draw calls (bottom, top, body)
+	const GLuint floatsPerStride = floatsPerVertex + floatsPerNormal + floatsPerUV;
+	mesh.triangles.clear();
+	UAppendTriangles(mesh.triangles, Verticies, floatsPerStride, GL_TRIANGLE_FAN, 0, 36);
+	UAppendTriangles(mesh.triangles, Verticies, floatsPerStride, GL_TRIANGLE_FAN, 36, 36);
+	UAppendTriangles(mesh.triangles, Verticies, floatsPerStride, GL_TRIANGLE_STRIP, 72, mesh.numVert - 72);
 
 	// Create VAO
 	glGenVertexArrays(1, &mesh.vao); // generates VAO
@@ -269,6 +292,75 @@ void Cylinder::UCreateCyilinder(GLMesh& mesh)
 
 }
 
+// Creates a coarser cylinder with the same draw ranges: bottom fan, top fan
+// and body strip. Picking always uses the finest level, so no triangle copy
+// is kept.
+void Cylinder::UCreateCylinderLod(GLMesh& mesh, int segments)
+{
+	std::vector<GLfloat> verticies;
+
+	auto addVertex = [&](float x, float y, float z, glm::vec3 normal, float u, float v)
+	{
+		GLfloat values[] = { x, y, z, normal.x, normal.y, normal.z, u, v };
+		verticies.insert(verticies.end(), values, values + 8);
+	};
+
+	// bottom and top caps, same texture mapping as the full cylinder
+	for (int cap = 0; cap < 2; ++cap)
+	{
+		float y = float(cap);
+		glm::vec3 normal(0.0f, cap == 0 ? -1.0f : 1.0f, 0.0f);
+
+		for (int i = 0; i < segments; ++i)
+		{
+			float angle = glm::radians(-360.0f * i / segments);
+			float x = cos(angle);
+			float z = sin(angle);
+			addVertex(x, y, z, normal, 0.5f + 0.5f * z, 0.5f + 0.5f * x);
+		}
+	}
+
+	// body, the seam is closed by repeating the first column
+	for (int i = 0; i <= segments; ++i)
+	{
+		float angle = glm::radians(360.0f * i / segments);
+		float x = cos(angle);
+		float z = sin(angle);
+		glm::vec3 normal(x, 0.0f, z);
+		addVertex(x, 0.0f, z, normal, float(i) / segments, 0.0f);
+		addVertex(x, 1.0f, z, normal, float(i) / segments, 1.0f);
+	}
+
+	const GLuint floatsPerVertex = 3;
+	const GLuint floatsPerNormal = 3;
+	const GLuint floatsPerUV = 2;
+	const GLuint floatsPerStride = floatsPerVertex + floatsPerNormal + floatsPerUV;
+
+	mesh.numVert = verticies.size() / floatsPerStride;
+	mesh.numIndicies = 0;
+	mesh.bounds = UComputeBounds(verticies.data(), mesh.numVert, floatsPerStride);
+	mesh.error = 1.0f - cos(glm::radians(180.0f / segments));
+
+	glGenVertexArrays(1, &mesh.vao);
+	glBindVertexArray(mesh.vao);
+
+	glGenBuffers(1, mesh.vbos);
+	glBindBuffer(GL_ARRAY_BUFFER, mesh.vbos[0]);
+	glBufferData(GL_ARRAY_BUFFER, sizeof(GLfloat) * verticies.size(), verticies.data(), GL_STATIC_DRAW);
+	std::vector<GLfloat>().swap(verticies); // uploaded, the GPU copy is the only one needed
+
+	GLint stride = sizeof(float) * floatsPerStride;
+
+	glVertexAttribPointer(0, floatsPerVertex, GL_FLOAT, GL_FALSE, stride, (void*)0);
+	glEnableVertexAttribArray(0);
+
+	glVertexAttribPointer(1, floatsPerNormal, GL_FLOAT, GL_FALSE, stride, (void*)(sizeof(float) * (floatsPerVertex)));
+	glEnableVertexAttribArray(1);
+
+	glVertexAttribPointer(2, floatsPerUV, GL_FLOAT, GL_FALSE, stride, (void*)(sizeof(float) * (floatsPerVertex + floatsPerNormal)));
+	glEnableVertexAttribArray(2);
+}
+
 void Cylinder::UDestroyCyilinder(GLMesh& mesh)
 {
 	glDeleteVertexArrays(1, &mesh.vao); // destroys VAO
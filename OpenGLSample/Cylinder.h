@@ -3,6 +3,11 @@
 #include <GL/glew.h>
 #include <glm/glm.hpp>
 
+#include <vector>
+
+#include "Bounds.h"
+#include "MeshTriangles.h"
+
 class Cylinder
 {
 	struct GLMesh 
@@ -11,13 +16,18 @@ class Cylinder
 		GLuint vbos[2]; // Vertex buffer object
 		GLuint numVert; // number of verticies in an object
 		GLuint numIndicies;// number if indicies in an object
+		Bounds bounds; // local space bounding box and sphere
+		std::vector<glm::vec3> triangles; // local space triangle list for picking
+		float error; // distance to the true surface, for level of detail
 	};
 
 public:
 	GLMesh cylinderMesh;
+	std::vector<GLMesh> lodMeshes; // coarser levels of detail, finest first
 
 private:
 	void UCreateCyilinder(GLMesh& mesh);
+	void UCreateCylinderLod(GLMesh& mesh, int segments);
 	void UDestroyCyilinder(GLMesh& mesh);
 
 public:
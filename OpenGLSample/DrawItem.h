@@ -0,0 +1,37 @@
+#pragma once
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+#include <vector>
+
+#include "Bounds.h"
+
+// One glDraw* call made on a mesh's VAO
+struct DrawRange
+{
+	GLenum mode; // primitive type
+	GLint first; // first vertex (arrays) or first index (elements)
+	GLsizei count; // number of vertices or indicies
+	bool extraTexture; // layers uTextureExtra on top of the base texture
+};
+
+// One object of the scene and everything needed to draw it
+struct DrawItem
+{
+	const char* region; // scene region the object belongs to
+	GLuint vao; // vertex array object of the mesh
+	bool indexed; // glDrawElements instead of glDrawArrays
+	DrawRange ranges[3]; // draw calls made on the VAO
+	int numRanges; // number of used ranges
+	GLuint texture; // base texture (unit 0)
+	GLuint textureExtra; // overlay texture (unit 9), 0 when unused
+	glm::mat4 model; // world transform
+	bool dynamic; // moves every frame, kept out of the cached shadow maps
+	bool occluder; // rasterized into the software occlusion buffer
+	Bounds bounds; // local space bounds of the mesh
+	const glm::vec3* triangles; // local space triangles of the mesh, 3 positions each, for picking
+	size_t numTriangles;
+	int lodChain; // LodManager chain of the mesh, -1 for a single level
+	int lodLevel; // level currently drawn, 0 is the finest
+};
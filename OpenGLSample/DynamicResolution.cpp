@@ -0,0 +1,76 @@
+#include <algorithm>
+#include <cmath>
+#include "DynamicResolution.h"
+
+using namespace std;
+
+const int DynamicResolution::numSteps;
+
+namespace
+{
+	// weight of a new sample in the filtered time, smooths out single spikes
+	const float filterWeight = 0.25f;
+}
+
+// latencyFrames is how many frames late the GPU times are read back
+void DynamicResolution::Create(float budgetMs, int latencyFrames)
+{
+	this->budgetMs = budgetMs;
+	this->latencyFrames = max(latencyFrames, 1);
+	Reset();
+}
+
+// Back to full scale, forgets the filtered time
+void DynamicResolution::Reset()
+{
+	step = 0;
+	settleFrames = latencyFrames;
+	filteredMs = -1.0f;
+}
+
+float DynamicResolution::Update(float gpuMs)
+{
+	if (settleFrames > 0)
+	{
+		--settleFrames;
+		return Scale();
+	}
+
+	if (gpuMs <= 0.0f)
+		return Scale();
+
+	filteredMs = filteredMs < 0.0f ? gpuMs : filteredMs + (gpuMs - filteredMs) * filterWeight;
+
+	int newStep = step;
+	if (filteredMs > budgetMs && step < numSteps)
+	{
+		// the time scales with the pixels, the area with the square of the scale
+		float target = Scale() * sqrt(budgetMs / filteredMs);
+		float stepSize = (maxScale - minScale) / numSteps;
+		newStep = min(max((int)ceil((maxScale - target) / stepSize), step + 1), numSteps);
+	}
+	else if (filteredMs < budgetMs * headroom && step > 0)
+	{
+		newStep = step - 1;
+	}
+
+	if (newStep != step)
+	{
+		step = newStep;
+		settleFrames = latencyFrames;
+		filteredMs = -1.0f;
+	}
+
+	return Scale();
+}
+
+float DynamicResolution::Scale() const
+{
+	return maxScale - (maxScale - minScale) * step / numSteps;
+}
+
+// Size of a scene target for a window dimension, never 0
+int DynamicResolution::ScaledSize(int size) const
+{
+	return max(1, (int)(size * Scale() + 0.5f));
+}
@@ -0,0 +1,36 @@
+#pragma once
+
+// Resolution scale of the scene targets, adapted every frame to keep the
+// GPU time of a frame under a budget. GPU times arrive a few frames late,
+// so after every change the controller waits until frames drawn at the new
+// scale are read back. Going down jumps straight to the scale the budget
+// allows, assuming the time follows the pixel count; going up takes one
+// step at a time once there is headroom. Scales are quantized to steps so
+// the frame graph pool only ever sees a handful of target sizes.
+class DynamicResolution
+{
+public:
+	static const int numSteps = 10; // between minScale and maxScale
+
+	float budgetMs = 15.0f; // GPU time of a whole frame
+	float headroom = 0.8f; // fraction of the budget below which the scale goes up
+	float minScale = 0.5f;
+	float maxScale = 1.0f;
+
+public:
+	void Create(float budgetMs, int latencyFrames);
+	void Reset();
+
+	// Feeds the newest GPU frame time, returns the scale of the next frame
+	float Update(float gpuMs);
+
+	float Scale() const;
+	int Step() const { return step; } // 0 at maxScale
+	int ScaledSize(int size) const;
+
+private:
+	int step = 0;
+	int latencyFrames = 1;
+	int settleFrames = 0; // frames left until the last change shows in the times
+	float filteredMs = -1.0f; // negative until the first sample after a change
+};
@@ -0,0 +1,487 @@
+#include <algorithm>
+#include <iostream>
+#include "FrameGraph.h"
+#include "GLState.h"
+
+using namespace std;
+
+namespace
+{
+	// frames a pooled texture may stay unused before it is deleted
+	const int maxUnusedFrames = 3;
+
+	bool UIsDepthFormat(GLenum format)
+	{
+		return format == GL_DEPTH_COMPONENT16 || format == GL_DEPTH_COMPONENT24 || format == GL_DEPTH_COMPONENT32F
+			|| format == GL_DEPTH24_STENCIL8 || format == GL_DEPTH32F_STENCIL8;
+	}
+
+	size_t UBytesPerPixel(GLenum format)
+	{
+		switch (format)
+		{
+		case GL_R8:
+			return 1;
+		case GL_DEPTH_COMPONENT16:
+		case GL_RG8:
+		case GL_R16F:
+			return 2;
+		case GL_RGBA16F:
+		case GL_RG32F:
+		case GL_DEPTH32F_STENCIL8:
+			return 8;
+		case GL_RGBA32F:
+			return 16;
+		default:
+			return 4;
+		}
+	}
+
+	bool USameDesc(const FrameGraph::TextureDesc& a, const FrameGraph::TextureDesc& b)
+	{
+		return a.width == b.width && a.height == b.height && a.internalFormat == b.internalFormat;
+	}
+}
+
+// Declares a new transient texture written by this pass
+FrameGraph::Resource FrameGraph::Builder::Create(const char* name, const TextureDesc& desc)
+{
+	TextureEntry entry = { name, desc, false, false, 0, -1, -1 };
+	graph.textures.push_back(entry);
+
+	Resource resource = graph.UAddNode((int)graph.textures.size() - 1, pass);
+	graph.writes.push_back(resource);
+	return resource;
+}
+
+// Declares that this pass samples a texture written by an earlier pass
+FrameGraph::Resource FrameGraph::Builder::Read(Resource resource)
+{
+	graph.reads.push_back(resource);
+
+	int writer = graph.nodes[resource].writer;
+	if (writer >= 0 && writer != pass)
+		graph.dependencies.push_back(writer);
+
+	return resource;
+}
+
+// Declares that this pass draws on top of a texture and returns the new version
+FrameGraph::Resource FrameGraph::Builder::Write(Resource resource)
+{
+	// the previous contents are kept, so the last writer runs first
+	int writer = graph.nodes[resource].writer;
+	if (writer >= 0 && writer != pass)
+		graph.dependencies.push_back(writer);
+
+	Resource written = graph.UAddNode(graph.nodes[resource].texture, pass);
+	graph.writes.push_back(written);
+	return written;
+}
+
+// Clears the passes of the last frame, the texture pool is kept. The
+// closures of this frame are allocated from frameArena.
+void FrameGraph::Reset(Arena& frameArena)
+{
+	UDestroyClosures();
+
+	textures.clear();
+	nodes.clear();
+	passes.clear();
+	reads.clear();
+	writes.clear();
+	dependencies.clear();
+	order.clear();
+	arena = &frameArena;
+}
+
+// Adds a texture owned outside the graph, such as a cached shadow map
+FrameGraph::Resource FrameGraph::Import(const char* name, GLuint texture, const TextureDesc& desc)
+{
+	TextureEntry entry = { name, desc, true, false, texture, -1, -1 };
+	textures.push_back(entry);
+	return UAddNode((int)textures.size() - 1, -1);
+}
+
+// Adds the default framebuffer, passes writing to it are never culled
+FrameGraph::Resource FrameGraph::ImportBackbuffer(int width, int height)
+{
+	TextureEntry entry = { "Backbuffer", { width, height, GL_RGBA8 }, true, true, 0, -1, -1 };
+	textures.push_back(entry);
+	return UAddNode((int)textures.size() - 1, -1);
+}
+
+// Culls unused passes, orders the rest and assigns the transient textures
+void FrameGraph::Compile()
+{
+	numPasses = passes.size();
+
+	// a pass is live when the backbuffer depends on it, every pass is pushed at most once
+	int* stack = arena->AllocateArray<int>(passes.size());
+	size_t stackSize = 0;
+	for (size_t i = 0; i < passes.size(); ++i)
+	{
+		for (int w = 0; w < passes[i].numWrites; ++w)
+		{
+			Resource resource = writes[passes[i].firstWrite + w];
+			if (textures[nodes[resource].texture].backbuffer && !passes[i].live)
+			{
+				passes[i].live = true;
+				stack[stackSize++] = (int)i;
+			}
+		}
+	}
+
+	while (stackSize > 0)
+	{
+		const Pass& pass = passes[stack[--stackSize]];
+
+		for (int d = 0; d < pass.numDependencies; ++d)
+		{
+			int dependency = dependencies[pass.firstDependency + d];
+			if (!passes[dependency].live)
+			{
+				passes[dependency].live = true;
+				stack[stackSize++] = dependency;
+			}
+		}
+	}
+
+	// topological order, ties keep the declaration order
+	int* remaining = arena->AllocateArray<int>(passes.size());
+	bool* scheduled = arena->AllocateArray<bool>(passes.size());
+	for (size_t i = 0; i < passes.size(); ++i)
+	{
+		remaining[i] = passes[i].live ? passes[i].numDependencies : 0;
+		scheduled[i] = false;
+	}
+
+	while (true)
+	{
+		int next = -1;
+		for (size_t i = 0; i < passes.size() && next < 0; ++i)
+		{
+			if (passes[i].live && !scheduled[i] && remaining[i] == 0)
+				next = (int)i;
+		}
+
+		if (next < 0)
+			break;
+
+		scheduled[next] = true;
+		order.push_back(next);
+
+		for (size_t i = 0; i < passes.size(); ++i)
+		{
+			for (int d = 0; d < passes[i].numDependencies; ++d)
+			{
+				if (dependencies[passes[i].firstDependency + d] == next)
+					--remaining[i];
+			}
+		}
+	}
+
+	numCulledPasses = passes.size() - order.size();
+
+	// lifetime of every texture in execution order
+	for (size_t position = 0; position < order.size(); ++position)
+	{
+		const Pass& pass = passes[order[position]];
+
+		for (int i = 0; i < pass.numReads + pass.numWrites; ++i)
+		{
+			Resource resource = i < pass.numReads ? reads[pass.firstRead + i] : writes[pass.firstWrite + i - pass.numReads];
+			TextureEntry& entry = textures[nodes[resource].texture];
+			if (entry.firstUse < 0)
+				entry.firstUse = (int)position;
+			entry.lastUse = (int)position;
+		}
+	}
+
+	// transient textures take a pooled texture at their first use and give
+	// it back after their last, so later passes with the same desc alias it
+	numTransientTextures = 0;
+	for (size_t position = 0; position < order.size(); ++position)
+	{
+		for (TextureEntry& entry : textures)
+		{
+			if (!entry.imported && entry.firstUse == (int)position)
+				entry.texture = UAcquire(entry.desc);
+		}
+
+		for (TextureEntry& entry : textures)
+		{
+			if (!entry.imported && entry.lastUse == (int)position)
+				URelease(entry.texture);
+		}
+	}
+
+	for (const TextureEntry& entry : textures)
+	{
+		if (!entry.imported)
+			++numTransientTextures;
+	}
+
+	UTrimPool();
+}
+
+// Runs the live passes with their render targets bound
+void FrameGraph::Execute()
+{
+	for (int index : order)
+	{
+		if (profiler != nullptr)
+			profiler->Begin(passes[index].name);
+
+		UBindTargets(passes[index]);
+		passes[index].execute(passes[index].closure);
+
+		if (profiler != nullptr)
+			profiler->End();
+	}
+
+	UGLState().BindFramebuffer(GL_FRAMEBUFFER, 0);
+
+	// culled passes hold closures too
+	UDestroyClosures();
+}
+
+// Deletes the pooled textures and framebuffers
+void FrameGraph::Destroy()
+{
+	for (CachedFramebuffer& framebuffer : framebuffers)
+		UGLState().DeleteFramebuffers(1, &framebuffer.fbo);
+
+	for (PooledTexture& pooled : pool)
+		UGLState().DeleteTextures(1, &pooled.texture);
+
+	framebuffers.clear();
+	pool.clear();
+
+	UDestroyClosures();
+	textures.clear();
+	nodes.clear();
+	passes.clear();
+	reads.clear();
+	writes.clear();
+	dependencies.clear();
+	order.clear();
+	arena = nullptr;
+
+	numPhysicalTextures = 0;
+	physicalBytes = 0;
+}
+
+// Texture name of a resource, valid while the passes execute
+GLuint FrameGraph::Texture(Resource resource) const
+{
+	return textures[nodes[resource].texture].texture;
+}
+
+FrameGraph::Resource FrameGraph::UAddNode(int texture, int writer)
+{
+	ResourceNode node = { texture, writer };
+	nodes.push_back(node);
+	return (Resource)nodes.size() - 1;
+}
+
+int FrameGraph::UBeginPass(const char* name)
+{
+	Pass pass = {};
+	pass.name = name;
+	pass.firstRead = (int)reads.size();
+	pass.firstWrite = (int)writes.size();
+	pass.firstDependency = (int)dependencies.size();
+	pass.live = false;
+	passes.push_back(pass);
+
+	return (int)passes.size() - 1;
+}
+
+// The builder appended the accesses of this pass last, so they are contiguous
+void FrameGraph::UEndPass(int pass)
+{
+	Pass& current = passes[pass];
+	current.numReads = (int)reads.size() - current.firstRead;
+	current.numWrites = (int)writes.size() - current.firstWrite;
+	current.numDependencies = (int)dependencies.size() - current.firstDependency;
+}
+
+// Runs the destructors of the closures, the arena memory is freed with the arena
+void FrameGraph::UDestroyClosures()
+{
+	for (Pass& pass : passes)
+	{
+		if (pass.closure != nullptr)
+			pass.destroy(pass.closure);
+		pass.closure = nullptr;
+	}
+}
+
+// Takes a free pooled texture with the same desc or creates one
+GLuint FrameGraph::UAcquire(const TextureDesc& desc)
+{
+	for (PooledTexture& pooled : pool)
+	{
+		if (!pooled.busy && USameDesc(pooled.desc, desc))
+		{
+			pooled.busy = true;
+			pooled.unusedFrames = 0;
+			return pooled.texture;
+		}
+	}
+
+	PooledTexture pooled = { desc, 0, true, 0 };
+	glGenTextures(1, &pooled.texture);
+	UGLState().BindTexture(0, GL_TEXTURE_2D, pooled.texture);
+	glTexStorage2D(GL_TEXTURE_2D, 1, desc.internalFormat, desc.width, desc.height);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	UGLState().BindTexture(0, GL_TEXTURE_2D, 0);
+
+	pool.push_back(pooled);
+	return pooled.texture;
+}
+
+void FrameGraph::URelease(GLuint texture)
+{
+	for (PooledTexture& pooled : pool)
+	{
+		if (pooled.texture == texture)
+			pooled.busy = false;
+	}
+}
+
+// Deletes textures no pass asked for lately, such as the old size after a resize
+void FrameGraph::UTrimPool()
+{
+	GLuint* used = arena->AllocateArray<GLuint>(textures.size());
+	size_t numUsed = 0;
+	for (const TextureEntry& entry : textures)
+	{
+		if (!entry.imported && entry.firstUse >= 0)
+			used[numUsed++] = entry.texture;
+	}
+
+	bool deleted = false;
+	for (size_t i = 0; i < pool.size();)
+	{
+		bool isUsed = false;
+		for (size_t u = 0; u < numUsed; ++u)
+			isUsed = isUsed || used[u] == pool[i].texture;
+
+		if (!isUsed && ++pool[i].unusedFrames > maxUnusedFrames)
+		{
+			UGLState().DeleteTextures(1, &pool[i].texture);
+			pool.erase(pool.begin() + i);
+			deleted = true;
+		}
+		else
+		{
+			++i;
+		}
+	}
+
+	// cached framebuffers may point at a deleted texture
+	if (deleted)
+	{
+		for (CachedFramebuffer& framebuffer : framebuffers)
+			UGLState().DeleteFramebuffers(1, &framebuffer.fbo);
+		framebuffers.clear();
+	}
+
+	numPhysicalTextures = pool.size();
+	physicalBytes = 0;
+	for (const PooledTexture& pooled : pool)
+		physicalBytes += (size_t)pooled.desc.width * pooled.desc.height * UBytesPerPixel(pooled.desc.internalFormat);
+}
+
+// Binds the framebuffer for the textures a pass writes. Passes writing only
+// imported textures, like the shadow maps, bind their own targets.
+void FrameGraph::UBindTargets(const Pass& pass)
+{
+	GLuint attachments[maxAttachments];
+	GLenum formats[maxAttachments];
+	int numAttachments = 0;
+	int width = 0;
+	int height = 0;
+
+	for (int w = 0; w < pass.numWrites; ++w)
+	{
+		const TextureEntry& entry = textures[nodes[writes[pass.firstWrite + w]].texture];
+
+		if (entry.backbuffer)
+		{
+			UGLState().BindFramebuffer(GL_FRAMEBUFFER, 0);
+			UGLState().Viewport(0, 0, entry.desc.width, entry.desc.height);
+			return;
+		}
+
+		if (entry.imported)
+			continue;
+
+		if (numAttachments == maxAttachments)
+		{
+			cout << "ERROR::FRAMEGRAPH::TOO_MANY_ATTACHMENTS " << pass.name << endl;
+			break;
+		}
+
+		attachments[numAttachments] = entry.texture;
+		formats[numAttachments] = entry.desc.internalFormat;
+		++numAttachments;
+		width = entry.desc.width;
+		height = entry.desc.height;
+	}
+
+	if (numAttachments == 0)
+		return;
+
+	for (const CachedFramebuffer& framebuffer : framebuffers)
+	{
+		if (framebuffer.numAttachments == numAttachments && equal(attachments, attachments + numAttachments, framebuffer.attachments))
+		{
+			UGLState().BindFramebuffer(GL_FRAMEBUFFER, framebuffer.fbo);
+			UGLState().Viewport(0, 0, width, height);
+			return;
+		}
+	}
+
+	// first use of this set of targets
+	CachedFramebuffer framebuffer;
+	copy(attachments, attachments + numAttachments, framebuffer.attachments);
+	framebuffer.numAttachments = numAttachments;
+	glGenFramebuffers(1, &framebuffer.fbo);
+	UGLState().BindFramebuffer(GL_FRAMEBUFFER, framebuffer.fbo);
+
+	GLenum drawBuffers[maxAttachments];
+	int numDrawBuffers = 0;
+	for (int i = 0; i < numAttachments; ++i)
+	{
+		if (UIsDepthFormat(formats[i]))
+		{
+			GLenum attachment = formats[i] == GL_DEPTH24_STENCIL8 || formats[i] == GL_DEPTH32F_STENCIL8
+				? GL_DEPTH_STENCIL_ATTACHMENT : GL_DEPTH_ATTACHMENT;
+			glFramebufferTexture2D(GL_FRAMEBUFFER, attachment, GL_TEXTURE_2D, attachments[i], 0);
+		}
+		else
+		{
+			GLenum attachment = GL_COLOR_ATTACHMENT0 + (GLenum)numDrawBuffers;
+			glFramebufferTexture2D(GL_FRAMEBUFFER, attachment, GL_TEXTURE_2D, attachments[i], 0);
+			drawBuffers[numDrawBuffers++] = attachment;
+		}
+	}
+
+	if (numDrawBuffers == 0)
+		glDrawBuffer(GL_NONE);
+	else
+		glDrawBuffers((GLsizei)numDrawBuffers, drawBuffers);
+
+	GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+	if (status != GL_FRAMEBUFFER_COMPLETE)
+		cout << "ERROR::FRAMEGRAPH::INCOMPLETE_FRAMEBUFFER " << pass.name << " " << status << endl;
+
+	framebuffers.push_back(framebuffer);
+	UGLState().Viewport(0, 0, width, height);
+}
@@ -0,0 +1,154 @@
+#pragma once
+
+#include <GL/glew.h>
+
+#include <vector>
+
+#include "Arena.h"
+#include "GpuProfiler.h"
+
+// Frame graph. Every frame the passes are declared with the textures they
+// read and write, then Compile() culls the passes whose outputs nobody
+// uses, orders the rest from their dependencies and gives every transient
+// texture a physical texture from a pool. Transient textures whose
+// lifetimes do not overlap share the same physical texture, so the pool
+// only grows to the largest set of targets alive at the same time. The
+// execute closures and the compile scratch live in the frame arena, so a
+// frame with the same passes as the last one makes no heap allocations.
+class FrameGraph
+{
+public:
+	typedef int Resource; // one version of a texture, -1 is invalid
+	static const int maxAttachments = 8; // transient textures one pass may write
+
+	struct TextureDesc
+	{
+		int width;
+		int height;
+		GLenum internalFormat;
+	};
+
+	// Declares the inputs and outputs of a pass during AddPass
+	class Builder
+	{
+	public:
+		Resource Create(const char* name, const TextureDesc& desc);
+		Resource Read(Resource resource);
+		Resource Write(Resource resource);
+
+	private:
+		friend class FrameGraph;
+		Builder(FrameGraph& graph, int pass) : graph(graph), pass(pass) {}
+
+		FrameGraph& graph;
+		int pass;
+	};
+
+	size_t numPasses = 0; // passes declared last frame
+	size_t numCulledPasses = 0; // passes not executed last frame
+	size_t numTransientTextures = 0; // transient textures declared last frame
+	size_t numPhysicalTextures = 0; // pool size after the last frame
+	size_t physicalBytes = 0; // memory of the pool
+	GpuProfiler* profiler = nullptr; // times every executed pass when set
+
+public:
+	void Reset(Arena& frameArena);
+	Resource Import(const char* name, GLuint texture, const TextureDesc& desc);
+	Resource ImportBackbuffer(int width, int height);
+
+	// setup(builder) declares the reads and writes and returns the callable drawing the pass
+	template<typename Setup>
+	void AddPass(const char* name, const Setup& setup);
+
+	void Compile();
+	void Execute();
+	void Destroy();
+
+	GLuint Texture(Resource resource) const;
+
+private:
+	struct TextureEntry
+	{
+		const char* name; // string literals, kept for debugging
+		TextureDesc desc;
+		bool imported;
+		bool backbuffer; // the default framebuffer, the graph's only output
+		GLuint texture; // imported texture or physical texture for this frame
+		int firstUse; // execution order of the first and last pass using it
+		int lastUse;
+	};
+
+	// one version of a texture, written by at most one pass
+	struct ResourceNode
+	{
+		int texture;
+		int writer;
+	};
+
+	// reads, writes and dependencies are ranges of the shared arrays below
+	struct Pass
+	{
+		const char* name;
+		void* closure; // in the frame arena
+		void (*execute)(void* closure);
+		void (*destroy)(void* closure);
+		int firstRead, numReads;
+		int firstWrite, numWrites;
+		int firstDependency, numDependencies;
+		bool live;
+	};
+
+	// physical textures and framebuffers kept between frames
+	struct PooledTexture
+	{
+		TextureDesc desc;
+		GLuint texture;
+		bool busy;
+		int unusedFrames;
+	};
+
+	struct CachedFramebuffer
+	{
+		GLuint attachments[maxAttachments];
+		int numAttachments;
+		GLuint fbo;
+	};
+
+	// cleared every frame, the capacity is kept
+	std::vector<TextureEntry> textures;
+	std::vector<ResourceNode> nodes;
+	std::vector<Pass> passes;
+	std::vector<Resource> reads;
+	std::vector<Resource> writes;
+	std::vector<int> dependencies;
+	std::vector<int> order; // live passes in execution order
+	Arena* arena = nullptr;
+
+	std::vector<PooledTexture> pool;
+	std::vector<CachedFramebuffer> framebuffers;
+
+	Resource UAddNode(int texture, int writer);
+	int UBeginPass(const char* name);
+	void UEndPass(int pass);
+	void UDestroyClosures();
+	GLuint UAcquire(const TextureDesc& desc);
+	void URelease(GLuint texture);
+	void UTrimPool();
+	void UBindTargets(const Pass& pass);
+};
+
+// Copies the execute callable into the frame arena, it is destroyed once it ran
+template<typename Setup>
+void FrameGraph::AddPass(const char* name, const Setup& setup)
+{
+	int index = UBeginPass(name);
+	Builder builder(*this, index);
+	auto execute = setup(builder);
+	typedef decltype(execute) Execute;
+
+	Pass& pass = passes[index];
+	pass.closure = arena->New<Execute>(execute);
+	pass.execute = [](void* closure) { (*static_cast<Execute*>(closure))(); };
+	pass.destroy = [](void* closure) { static_cast<Execute*>(closure)->~Execute(); };
+	UEndPass(index);
+}
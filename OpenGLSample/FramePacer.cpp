@@ -0,0 +1,145 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <thread>
+#include <GLFW/glfw3.h>
+#include "FramePacer.h"
+
+#if defined(_WIN32)
+#define NOMINMAX
+#include <windows.h>
+#include <timeapi.h>
+#pragma comment(lib, "winmm.lib")
+#endif
+
+using namespace std;
+
+const char* const FramePacer::modeNames[3] = { "vsync", "adaptive vsync", "capped" };
+
+double UClockSeconds()
+{
+	static const chrono::steady_clock::time_point start = chrono::steady_clock::now();
+	return chrono::duration<double>(chrono::steady_clock::now() - start).count();
+}
+
+// Needs the GL context current, the swap interval belongs to it
+void FramePacer::Create(Mode mode, size_t historySize)
+{
+#if defined(_WIN32)
+	// 1 ms sleep granularity instead of the 15.6 ms default
+	timeBeginPeriod(1);
+#endif
+
+	adaptiveSupported = glfwExtensionSupported("WGL_EXT_swap_control_tear") || glfwExtensionSupported("GLX_EXT_swap_control_tear");
+
+	intervals.assign(max(historySize, (size_t)1), 0.0);
+	sorted.reserve(intervals.size());
+	nextInterval = 0;
+	numIntervals = 0;
+	lastPresent = 0.0;
+
+	SetMode(mode);
+}
+
+void FramePacer::Destroy()
+{
+#if defined(_WIN32)
+	timeEndPeriod(1);
+#endif
+
+	intervals.clear();
+	sorted.clear();
+}
+
+// Sets the swap interval of the mode and restarts the schedule
+void FramePacer::SetMode(Mode mode)
+{
+	this->mode = mode;
+	nextDeadline = 0.0;
+
+	if (mode == PACING_VSYNC)
+		glfwSwapInterval(1);
+	else if (mode == PACING_ADAPTIVE)
+		glfwSwapInterval(adaptiveSupported ? -1 : 1); // late frames tear instead of waiting a whole refresh
+	else
+		glfwSwapInterval(0);
+}
+
+// Capped mode only: blocks until the next frame is due, call right before the swap
+void FramePacer::WaitForNextFrame()
+{
+	if (mode != PACING_CAPPED || targetFps <= 0.0)
+		return;
+
+	double period = 1.0 / targetFps;
+	double now = UClockSeconds();
+
+	// a long stall restarts the schedule instead of rushing to catch up
+	if (nextDeadline == 0.0 || now - nextDeadline > period)
+		nextDeadline = now;
+
+	// coarse sleeps while the deadline is far away
+	while (nextDeadline - now > spinMargin)
+	{
+		this_thread::sleep_for(chrono::duration<double>(nextDeadline - now - spinMargin));
+		now = UClockSeconds();
+	}
+
+	// the last stretch spins, the scheduler cannot wake us that precisely
+	while (now < nextDeadline)
+	{
+		this_thread::yield();
+		now = UClockSeconds();
+	}
+
+	nextDeadline += period;
+}
+
+// Records the interval since the last present, call right after the swap
+void FramePacer::FramePresented()
+{
+	double now = UClockSeconds();
+
+	if (lastPresent > 0.0 && !intervals.empty())
+	{
+		intervals[nextInterval] = (now - lastPresent) * 1000.0;
+		nextInterval = (nextInterval + 1) % intervals.size();
+		numIntervals = min(numIntervals + 1, intervals.size());
+	}
+
+	lastPresent = now;
+}
+
+FramePacer::Stats FramePacer::ComputeStats() const
+{
+	Stats stats = {};
+	stats.numFrames = numIntervals;
+	if (numIntervals == 0)
+		return stats;
+
+	sorted.assign(intervals.begin(), intervals.begin() + numIntervals);
+	sort(sorted.begin(), sorted.end());
+
+	double sum = 0.0;
+	for (double interval : sorted)
+		sum += interval;
+	stats.mean = sum / numIntervals;
+
+	double variance = 0.0;
+	for (double interval : sorted)
+		variance += (interval - stats.mean) * (interval - stats.mean);
+	stats.stdDev = sqrt(variance / numIntervals);
+
+	stats.min = sorted.front();
+	stats.max = sorted.back();
+	stats.p99 = sorted[min(numIntervals - 1, (size_t)(numIntervals * 0.99))];
+
+	double median = sorted[numIntervals / 2];
+	for (double interval : sorted)
+	{
+		if (interval > median * 1.5)
+			++stats.numHitches;
+	}
+
+	return stats;
+}
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+// Monotonic clock in seconds. steady_clock never jumps with the wall clock
+// and a double keeps sub microsecond precision over very long uptimes.
+double UClockSeconds();
+
+// Frame pacing for the thread that owns the GL context. Vsync and adaptive
+// vsync leave the pacing to the swap; capped mode sleeps until shortly
+// before the next deadline and spins the rest, so frames go out on an even
+// schedule without burning a core. The intervals between presented frames
+// are kept for jitter statistics.
+class FramePacer
+{
+public:
+	enum Mode { PACING_VSYNC, PACING_ADAPTIVE, PACING_CAPPED };
+	static const char* const modeNames[3];
+
+	// over the last history intervals, in milliseconds
+	struct Stats
+	{
+		size_t numFrames;
+		double mean;
+		double stdDev; // jitter
+		double min;
+		double max;
+		double p99;
+		size_t numHitches; // intervals over 1.5 times the median
+	};
+
+	double targetFps = 60.0; // capped mode
+	double spinMargin = 0.002; // seconds before the deadline where sleeping stops
+
+public:
+	void Create(Mode mode, size_t historySize);
+	void Destroy();
+
+	void SetMode(Mode mode);
+	Mode GetMode() const { return mode; }
+
+	void WaitForNextFrame();
+	void FramePresented();
+	Stats ComputeStats() const;
+
+private:
+	Mode mode = PACING_VSYNC;
+	bool adaptiveSupported = false;
+	double nextDeadline = 0.0;
+	double lastPresent = 0.0;
+
+	std::vector<double> intervals; // ring of present to present times
+	size_t nextInterval = 0;
+	size_t numIntervals = 0;
+	mutable std::vector<double> sorted; // scratch for the percentiles
+};
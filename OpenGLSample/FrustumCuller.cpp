@@ -0,0 +1,219 @@
+#include <cmath>
+#include "FrustumCuller.h"
+
+#if defined(__AVX__)
+#include <immintrin.h>
+#define FRUSTUM_AVX
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define FRUSTUM_SSE
+#endif
+
+using namespace std;
+
+// Gribb/Hartmann plane extraction from projection * view
+void FrustumCuller::ExtractPlanes(const glm::mat4& viewProjection)
+{
+	// rows of the column major matrix
+	glm::vec4 row[4];
+	for (int i = 0; i < 4; ++i)
+		row[i] = glm::vec4(viewProjection[0][i], viewProjection[1][i], viewProjection[2][i], viewProjection[3][i]);
+
+	planes[0] = row[3] + row[0]; // left
+	planes[1] = row[3] - row[0]; // right
+	planes[2] = row[3] + row[1]; // bottom
+	planes[3] = row[3] - row[1]; // top
+	planes[4] = row[3] + row[2]; // near
+	planes[5] = row[3] - row[2]; // far
+
+	for (int i = 0; i < 6; ++i)
+	{
+		float length = glm::length(glm::vec3(planes[i]));
+		planes[i] = planes[i] / length;
+		absNormals[i] = glm::abs(glm::vec3(planes[i]));
+	}
+}
+
+// Transforms the local bounds of every item to world space
+void FrustumCuller::UpdateBounds(const vector<DrawItem>& items)
+{
+	size_t count = items.size();
+	centerX.resize(count);
+	centerY.resize(count);
+	centerZ.resize(count);
+	extentX.resize(count);
+	extentY.resize(count);
+	extentZ.resize(count);
+	radius.resize(count);
+
+	UParallelFor(jobs, count, 1024, [this, &items](size_t begin, size_t end)
+	{
+		UUpdateBounds(items, begin, end);
+	});
+}
+
+// World space bounds of the items in [begin, end)
+void FrustumCuller::UUpdateBounds(const vector<DrawItem>& items, size_t begin, size_t end)
+{
+	for (size_t i = begin; i < end; ++i)
+	{
+		const glm::mat4& model = items[i].model;
+		const Bounds& bounds = items[i].bounds;
+
+		glm::vec3 center = glm::vec3(model * glm::vec4(bounds.center, 1.0f));
+		glm::vec3 extent = (bounds.max - bounds.min) * 0.5f;
+
+		// box extents through |rotation * scale| (Arvo)
+		glm::vec3 axisX = glm::vec3(model[0]);
+		glm::vec3 axisY = glm::vec3(model[1]);
+		glm::vec3 axisZ = glm::vec3(model[2]);
+		glm::vec3 worldExtent = glm::abs(axisX) * extent.x + glm::abs(axisY) * extent.y + glm::abs(axisZ) * extent.z;
+
+		// sphere radius grows with the largest axis scale
+		float maxScale = max(glm::length(axisX), max(glm::length(axisY), glm::length(axisZ)));
+
+		centerX[i] = center.x;
+		centerY[i] = center.y;
+		centerZ[i] = center.z;
+		extentX[i] = worldExtent.x;
+		extentY[i] = worldExtent.y;
+		extentZ[i] = worldExtent.z;
+		radius[i] = bounds.radius * maxScale;
+	}
+}
+
+// Writes 1 for every item that intersects the frustum, 0 otherwise.
+// An item is outside when it is behind any plane; per plane the tighter of
+// the box and the sphere radius is used.
+void FrustumCuller::Cull(vector<uint8_t>& visible)
+{
+	visible.resize(centerX.size());
+
+	UParallelFor(jobs, visible.size(), 2048, [this, &visible](size_t begin, size_t end)
+	{
+		UCull(visible, begin, end);
+	});
+}
+
+// Tests the items in [begin, end)
+void FrustumCuller::UCull(vector<uint8_t>& visible, size_t begin, size_t end) const
+{
+	size_t count = end;
+	size_t i = begin;
+
+#if defined(FRUSTUM_AVX)
+	const __m256 zero = _mm256_setzero_ps();
+	for (; i + 8 <= count; i += 8)
+	{
+		__m256 cx = _mm256_loadu_ps(&centerX[i]);
+		__m256 cy = _mm256_loadu_ps(&centerY[i]);
+		__m256 cz = _mm256_loadu_ps(&centerZ[i]);
+		__m256 ex = _mm256_loadu_ps(&extentX[i]);
+		__m256 ey = _mm256_loadu_ps(&extentY[i]);
+		__m256 ez = _mm256_loadu_ps(&extentZ[i]);
+		__m256 r = _mm256_loadu_ps(&radius[i]);
+		__m256 outside = zero;
+
+		for (int p = 0; p < 6; ++p)
+		{
+			__m256 dist = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(cx, _mm256_set1_ps(planes[p].x)), _mm256_mul_ps(cy, _mm256_set1_ps(planes[p].y))),
+				_mm256_add_ps(_mm256_mul_ps(cz, _mm256_set1_ps(planes[p].z)), _mm256_set1_ps(planes[p].w)));
+			__m256 boxRadius = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(ex, _mm256_set1_ps(absNormals[p].x)), _mm256_mul_ps(ey, _mm256_set1_ps(absNormals[p].y))),
+				_mm256_mul_ps(ez, _mm256_set1_ps(absNormals[p].z)));
+			__m256 reach = _mm256_add_ps(dist, _mm256_min_ps(boxRadius, r));
+			outside = _mm256_or_ps(outside, _mm256_cmp_ps(reach, zero, _CMP_LT_OQ));
+		}
+
+		int mask = _mm256_movemask_ps(outside);
+		for (int k = 0; k < 8; ++k)
+			visible[i + k] = ((mask >> k) & 1) == 0;
+	}
+#elif defined(FRUSTUM_SSE)
+	const __m128 zero = _mm_setzero_ps();
+	for (; i + 4 <= count; i += 4)
+	{
+		__m128 cx = _mm_loadu_ps(&centerX[i]);
+		__m128 cy = _mm_loadu_ps(&centerY[i]);
+		__m128 cz = _mm_loadu_ps(&centerZ[i]);
+		__m128 ex = _mm_loadu_ps(&extentX[i]);
+		__m128 ey = _mm_loadu_ps(&extentY[i]);
+		__m128 ez = _mm_loadu_ps(&extentZ[i]);
+		__m128 r = _mm_loadu_ps(&radius[i]);
+		__m128 outside = zero;
+
+		for (int p = 0; p < 6; ++p)
+		{
+			__m128 dist = _mm_add_ps(_mm_add_ps(_mm_mul_ps(cx, _mm_set1_ps(planes[p].x)), _mm_mul_ps(cy, _mm_set1_ps(planes[p].y))),
+				_mm_add_ps(_mm_mul_ps(cz, _mm_set1_ps(planes[p].z)), _mm_set1_ps(planes[p].w)));
+			__m128 boxRadius = _mm_add_ps(_mm_add_ps(_mm_mul_ps(ex, _mm_set1_ps(absNormals[p].x)), _mm_mul_ps(ey, _mm_set1_ps(absNormals[p].y))),
+				_mm_mul_ps(ez, _mm_set1_ps(absNormals[p].z)));
+			__m128 reach = _mm_add_ps(dist, _mm_min_ps(boxRadius, r));
+			outside = _mm_or_ps(outside, _mm_cmplt_ps(reach, zero));
+		}
+
+		int mask = _mm_movemask_ps(outside);
+		for (int k = 0; k < 4; ++k)
+			visible[i + k] = ((mask >> k) & 1) == 0;
+	}
+#endif
+
+	// remaining items, or every item without SIMD
+	for (; i < count; ++i)
+	{
+		bool isOutside = false;
+
+		for (int p = 0; p < 6 && !isOutside; ++p)
+		{
+			float dist = centerX[i] * planes[p].x + centerY[i] * planes[p].y + centerZ[i] * planes[p].z + planes[p].w;
+			float boxRadius = extentX[i] * absNormals[p].x + extentY[i] * absNormals[p].y + extentZ[i] * absNormals[p].z;
+			isOutside = dist + min(boxRadius, radius[i]) < 0.0f;
+		}
+
+		visible[i] = !isOutside;
+	}
+}
+
+// Copies the items that intersect the frustum into visibleItems
+void FrustumCuller::Cull(const vector<DrawItem>& items, vector<DrawItem>& visibleItems)
+{
+	Cull(visibility);
+
+	// every chunk counts its visible items, then copies them to its own slots
+	const size_t chunkSize = 4096;
+	size_t numChunks = (items.size() + chunkSize - 1) / chunkSize;
+	chunkOffsets.assign(numChunks + 1, 0);
+
+	UParallelFor(jobs, numChunks, 1, [this, &items, chunkSize](size_t begin, size_t end)
+	{
+		for (size_t chunk = begin; chunk < end; ++chunk)
+		{
+			size_t last = min((chunk + 1) * chunkSize, items.size());
+			size_t numVisibleInChunk = 0;
+			for (size_t i = chunk * chunkSize; i < last; ++i)
+				numVisibleInChunk += visibility[i];
+			chunkOffsets[chunk + 1] = numVisibleInChunk;
+		}
+	});
+
+	for (size_t chunk = 0; chunk < numChunks; ++chunk)
+		chunkOffsets[chunk + 1] += chunkOffsets[chunk];
+
+	visibleItems.resize(chunkOffsets[numChunks]);
+
+	UParallelFor(jobs, numChunks, 1, [this, &items, &visibleItems, chunkSize](size_t begin, size_t end)
+	{
+		for (size_t chunk = begin; chunk < end; ++chunk)
+		{
+			size_t last = min((chunk + 1) * chunkSize, items.size());
+			size_t slot = chunkOffsets[chunk];
+			for (size_t i = chunk * chunkSize; i < last; ++i)
+			{
+				if (visibility[i])
+					visibleItems[slot++] = items[i];
+			}
+		}
+	});
+
+	numTested = items.size();
+	numVisible = visibleItems.size();
+}
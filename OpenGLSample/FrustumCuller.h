@@ -0,0 +1,43 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <vector>
+
+#include "DrawItem.h"
+#include "JobSystem.h"
+
+// View frustum culling of a draw list. World space bounds are kept as SoA
+// arrays so one plane is tested against 4 (SSE) or 8 (AVX) items at once.
+class FrustumCuller
+{
+public:
+	glm::vec4 planes[6]; // left, right, bottom, top, near, far (xyz normal, w distance)
+	size_t numTested = 0; // items tested last frame
+	size_t numVisible = 0; // items that passed last frame
+	JobSystem* jobs = nullptr; // splits the loops over cores when set
+
+public:
+	void ExtractPlanes(const glm::mat4& viewProjection);
+	void UpdateBounds(const std::vector<DrawItem>& items);
+	void Cull(std::vector<uint8_t>& visible);
+	void Cull(const std::vector<DrawItem>& items, std::vector<DrawItem>& visibleItems);
+
+private:
+	// world space bounds, one entry per item
+	std::vector<float> centerX;
+	std::vector<float> centerY;
+	std::vector<float> centerZ;
+	std::vector<float> extentX; // box half size
+	std::vector<float> extentY;
+	std::vector<float> extentZ;
+	std::vector<float> radius; // sphere around the box center
+
+	std::vector<uint8_t> visibility;
+	std::vector<size_t> chunkOffsets; // first output slot of each chunk of the draw list
+	glm::vec3 absNormals[6]; // |plane normal|, used for the box extents
+
+	void UUpdateBounds(const std::vector<DrawItem>& items, size_t begin, size_t end);
+	void UCull(std::vector<uint8_t>& visible, size_t begin, size_t end) const;
+};
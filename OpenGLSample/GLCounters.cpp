@@ -0,0 +1,249 @@
+#include <iostream>
+#include "GLCounters.h"
+
+using namespace std;
+
+const char* const GLCounters::stateCategoryNames[NUM_STATE_CATEGORIES] = { "vertexArray", "texture", "buffer", "framebuffer", "viewport", "enable", "depth", "colorMask" };
+
+namespace
+{
+	GLCounters gCounters = {};
+
+	size_t UPrimitives(GLenum mode, GLsizei count)
+	{
+		switch (mode)
+		{
+		case GL_TRIANGLES:
+			return count / 3;
+		case GL_TRIANGLE_STRIP:
+		case GL_TRIANGLE_FAN:
+			return count >= 3 ? count - 2 : 0;
+		case GL_LINES:
+			return count / 2;
+		case GL_LINE_STRIP:
+			return count >= 2 ? count - 1 : 0;
+		case GL_LINE_LOOP:
+			return count >= 2 ? count : 0;
+		default:
+			return count; // points
+		}
+	}
+
+	size_t UPixelBytes(GLenum format, GLenum type)
+	{
+		size_t components = 4;
+		switch (format)
+		{
+		case GL_RED:
+		case GL_DEPTH_COMPONENT:
+			components = 1;
+			break;
+		case GL_RG:
+			components = 2;
+			break;
+		case GL_RGB:
+		case GL_BGR:
+			components = 3;
+			break;
+		}
+
+		switch (type)
+		{
+		case GL_UNSIGNED_SHORT:
+		case GL_SHORT:
+		case GL_HALF_FLOAT:
+			return components * 2;
+		case GL_UNSIGNED_INT:
+		case GL_INT:
+		case GL_FLOAT:
+			return components * 4;
+		default:
+			return components;
+		}
+	}
+}
+
+GLCounters& UGLCounters()
+{
+	return gCounters;
+}
+
+// Appends to path, a header row starts new CSV files
+bool GLCounterLog::Create(const char* path, size_t interval)
+{
+	string name = path;
+	json = name.size() >= 5 && name.compare(name.size() - 5, 5, ".json") == 0;
+
+	file.open(path, ios::out | ios::app);
+	if (!file.is_open())
+	{
+		cout << "ERROR::GLCOUNTERS::CANNOT_OPEN " << path << endl;
+		return false;
+	}
+
+	this->interval = interval > 0 ? interval : 1;
+	numFrames = 0;
+	frameIndex = 0;
+	sum = {};
+
+	file.seekp(0, ios::end);
+	if (!json && file.tellp() == 0)
+	{
+		file << "frame,drawCalls,primitives,dispatches,programSwitches";
+		for (const char* category : GLCounters::stateCategoryNames)
+			file << "," << category;
+		file << ",filteredStateCalls,uniformUploads,bufferBytes,textureBytes" << endl;
+	}
+
+	return true;
+}
+
+void GLCounterLog::Destroy()
+{
+	if (file.is_open())
+		file.close();
+}
+
+void GLCounterLog::AddFrame(const GLCounters& counters)
+{
+	++frameIndex;
+	if (!file.is_open())
+		return;
+
+	sum.numDrawCalls += counters.numDrawCalls;
+	sum.numPrimitives += counters.numPrimitives;
+	sum.numDispatches += counters.numDispatches;
+	sum.numProgramSwitches += counters.numProgramSwitches;
+	for (int i = 0; i < GLCounters::NUM_STATE_CATEGORIES; ++i)
+		sum.stateChanges[i] += counters.stateChanges[i];
+	sum.numFilteredStateCalls += counters.numFilteredStateCalls;
+	sum.numUniformUploads += counters.numUniformUploads;
+	sum.bufferBytes += counters.bufferBytes;
+	sum.textureBytes += counters.textureBytes;
+
+	if (++numFrames < interval)
+		return;
+
+	UWrite();
+	numFrames = 0;
+	sum = {};
+}
+
+// Mean per frame over the interval
+void GLCounterLog::UWrite()
+{
+	double frames = (double)numFrames;
+
+	if (json)
+	{
+		file << "{\"frame\":" << frameIndex << ",\"drawCalls\":" << sum.numDrawCalls / frames << ",\"primitives\":" << sum.numPrimitives / frames
+			<< ",\"dispatches\":" << sum.numDispatches / frames << ",\"programSwitches\":" << sum.numProgramSwitches / frames << ",\"stateChanges\":{";
+		for (int i = 0; i < GLCounters::NUM_STATE_CATEGORIES; ++i)
+			file << (i > 0 ? "," : "") << "\"" << GLCounters::stateCategoryNames[i] << "\":" << sum.stateChanges[i] / frames;
+		file << "},\"filteredStateCalls\":" << sum.numFilteredStateCalls / frames << ",\"uniformUploads\":" << sum.numUniformUploads / frames
+			<< ",\"bufferBytes\":" << sum.bufferBytes / frames << ",\"textureBytes\":" << sum.textureBytes / frames << "}" << endl;
+		return;
+	}
+
+	file << frameIndex << "," << sum.numDrawCalls / frames << "," << sum.numPrimitives / frames << "," << sum.numDispatches / frames
+		<< "," << sum.numProgramSwitches / frames;
+	for (size_t changes : sum.stateChanges)
+		file << "," << changes / frames;
+	file << "," << sum.numFilteredStateCalls / frames << "," << sum.numUniformUploads / frames << "," << sum.bufferBytes / frames
+		<< "," << sum.textureBytes / frames << endl;
+}
+
+void UDrawArrays(GLenum mode, GLint first, GLsizei count)
+{
+	++gCounters.numDrawCalls;
+	gCounters.numPrimitives += UPrimitives(mode, count);
+	glDrawArrays(mode, first, count);
+}
+
+void UDrawElements(GLenum mode, GLsizei count, GLenum type, const void* indices)
+{
+	++gCounters.numDrawCalls;
+	gCounters.numPrimitives += UPrimitives(mode, count);
+	glDrawElements(mode, count, type, indices);
+}
+
+void UMultiDrawArraysIndirectCount(GLenum mode, const void* indirect, GLintptr drawCount, GLsizei maxDrawCount, GLsizei stride)
+{
+	++gCounters.numDrawCalls;
+	glMultiDrawArraysIndirectCountARB(mode, indirect, drawCount, maxDrawCount, stride);
+}
+
+void UMultiDrawElementsIndirectCount(GLenum mode, GLenum type, const void* indirect, GLintptr drawCount, GLsizei maxDrawCount, GLsizei stride)
+{
+	++gCounters.numDrawCalls;
+	glMultiDrawElementsIndirectCountARB(mode, type, indirect, drawCount, maxDrawCount, stride);
+}
+
+void UDispatchCompute(GLuint x, GLuint y, GLuint z)
+{
+	++gCounters.numDispatches;
+	glDispatchCompute(x, y, z);
+}
+
+void UUniform1i(GLint location, GLint value)
+{
+	++gCounters.numUniformUploads;
+	glUniform1i(location, value);
+}
+
+void UUniform1f(GLint location, GLfloat value)
+{
+	++gCounters.numUniformUploads;
+	glUniform1f(location, value);
+}
+
+void UUniform1ui(GLint location, GLuint value)
+{
+	++gCounters.numUniformUploads;
+	glUniform1ui(location, value);
+}
+
+void UUniform3f(GLint location, GLfloat x, GLfloat y, GLfloat z)
+{
+	++gCounters.numUniformUploads;
+	glUniform3f(location, x, y, z);
+}
+
+void UUniform2fv(GLint location, GLsizei count, const GLfloat* value)
+{
+	++gCounters.numUniformUploads;
+	glUniform2fv(location, count, value);
+}
+
+void UUniform4fv(GLint location, GLsizei count, const GLfloat* value)
+{
+	++gCounters.numUniformUploads;
+	glUniform4fv(location, count, value);
+}
+
+void UUniformMatrix4fv(GLint location, GLsizei count, GLboolean transpose, const GLfloat* value)
+{
+	++gCounters.numUniformUploads;
+	glUniformMatrix4fv(location, count, transpose, value);
+}
+
+void UBufferData(GLenum target, GLsizeiptr size, const void* data, GLenum usage)
+{
+	// storage without data is allocated on the GPU, nothing crosses the bus
+	if (data != nullptr)
+		gCounters.bufferBytes += (size_t)size;
+	glBufferData(target, size, data, usage);
+}
+
+void UBufferSubData(GLenum target, GLintptr offset, GLsizeiptr size, const void* data)
+{
+	gCounters.bufferBytes += (size_t)size;
+	glBufferSubData(target, offset, size, data);
+}
+
+void UTexImage2D(GLenum target, GLint level, GLint internalFormat, GLsizei width, GLsizei height, GLenum format, GLenum type, const void* pixels)
+{
+	if (pixels != nullptr)
+		gCounters.textureBytes += (size_t)width * height * UPixelBytes(format, type);
+	glTexImage2D(target, level, internalFormat, width, height, 0, format, type, pixels);
+}
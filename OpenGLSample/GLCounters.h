@@ -0,0 +1,71 @@
+#pragma once
+
+#include <GL/glew.h>
+
+#include <cstddef>
+#include <fstream>
+
+// Per frame counts of the GL work the renderer submits. Draws, dispatches,
+// uniform uploads and data uploads are counted by the U wrappers below,
+// state changes by GLState once they pass its filter. Calls made straight
+// to gl* are not counted. Indirect draws count as one call each; their
+// primitives are decided on the GPU and are not known here.
+struct GLCounters
+{
+	enum StateCategory { STATE_VERTEX_ARRAY, STATE_TEXTURE, STATE_BUFFER, STATE_FRAMEBUFFER, STATE_VIEWPORT, STATE_ENABLE, STATE_DEPTH, STATE_COLOR_MASK, NUM_STATE_CATEGORIES };
+	static const char* const stateCategoryNames[NUM_STATE_CATEGORIES];
+
+	size_t numDrawCalls;
+	size_t numPrimitives; // direct draws only
+	size_t numDispatches;
+	size_t numProgramSwitches;
+	size_t stateChanges[NUM_STATE_CATEGORIES];
+	size_t numFilteredStateCalls; // dropped by GLState
+	size_t numUniformUploads;
+	size_t bufferBytes; // uploaded from the CPU
+	size_t textureBytes;
+};
+
+// Counts of the frame in progress, render thread only
+GLCounters& UGLCounters();
+
+// Writes the mean counts per frame every interval frames, one CSV row or
+// one JSON object per line depending on the extension of the path
+class GLCounterLog
+{
+public:
+	bool Create(const char* path, size_t interval);
+	void Destroy();
+
+	// Call once per frame with the counts of the finished frame
+	void AddFrame(const GLCounters& counters);
+
+private:
+	std::ofstream file;
+	bool json = false;
+	size_t interval = 0;
+	size_t numFrames = 0; // since the last write
+	size_t frameIndex = 0;
+	GLCounters sum = {};
+
+	void UWrite();
+};
+
+// Counted GL calls
+void UDrawArrays(GLenum mode, GLint first, GLsizei count);
+void UDrawElements(GLenum mode, GLsizei count, GLenum type, const void* indices);
+void UMultiDrawArraysIndirectCount(GLenum mode, const void* indirect, GLintptr drawCount, GLsizei maxDrawCount, GLsizei stride);
+void UMultiDrawElementsIndirectCount(GLenum mode, GLenum type, const void* indirect, GLintptr drawCount, GLsizei maxDrawCount, GLsizei stride);
+void UDispatchCompute(GLuint x, GLuint y, GLuint z);
+
+void UUniform1i(GLint location, GLint value);
+void UUniform1f(GLint location, GLfloat value);
+void UUniform1ui(GLint location, GLuint value);
+void UUniform3f(GLint location, GLfloat x, GLfloat y, GLfloat z);
+void UUniform2fv(GLint location, GLsizei count, const GLfloat* value);
+void UUniform4fv(GLint location, GLsizei count, const GLfloat* value);
+void UUniformMatrix4fv(GLint location, GLsizei count, GLboolean transpose, const GLfloat* value);
+
+void UBufferData(GLenum target, GLsizeiptr size, const void* data, GLenum usage);
+void UBufferSubData(GLenum target, GLintptr offset, GLsizeiptr size, const void* data);
+void UTexImage2D(GLenum target, GLint level, GLint internalFormat, GLsizei width, GLsizei height, GLenum format, GLenum type, const void* pixels);
@@ -0,0 +1,296 @@
+#include <algorithm>
+#include <iterator>
+#include "GLState.h"
+#include "GLCounters.h"
+
+using namespace std;
+
+namespace
+{
+	const GLenum bufferTargets[] = { GL_ARRAY_BUFFER, GL_SHADER_STORAGE_BUFFER, GL_DRAW_INDIRECT_BUFFER,
+		GL_PARAMETER_BUFFER_ARB, GL_UNIFORM_BUFFER, GL_DISPATCH_INDIRECT_BUFFER };
+	const GLenum indexedTargets[] = { GL_SHADER_STORAGE_BUFFER, GL_UNIFORM_BUFFER };
+	const GLenum capabilities[] = { GL_DEPTH_TEST, GL_CULL_FACE, GL_BLEND, GL_POLYGON_OFFSET_FILL, GL_SCISSOR_TEST, GL_STENCIL_TEST };
+
+	// index of value in a table, -1 when it is not tracked
+	template<size_t Size>
+	int UFind(const GLenum (&table)[Size], GLenum value)
+	{
+		for (size_t i = 0; i < Size; ++i)
+		{
+			if (table[i] == value)
+				return (int)i;
+		}
+		return -1;
+	}
+}
+
+const GLuint GLState::unknown;
+
+GLState& UGLState()
+{
+	static GLState state;
+	return state;
+}
+
+// Forgets everything, the next call of each kind reaches the driver
+void GLState::Invalidate()
+{
+	program = unknown;
+	vao = unknown;
+	elementBuffer = unknown;
+	activeUnit = -1;
+	fill(begin(textures), end(textures), unknown);
+	fill(begin(buffers), end(buffers), unknown);
+	for (GLuint (&bindings)[maxIndexedBuffers] : indexedBuffers)
+		fill(begin(bindings), end(bindings), unknown);
+	drawFramebuffer = unknown;
+	readFramebuffer = unknown;
+	fill(begin(viewport), end(viewport), -1);
+	fill(begin(enabled), end(enabled), -1);
+	depthFunc = unknown;
+	depthMask = -1;
+	colorMask = -1;
+}
+
+// Starts counting a new frame
+void GLState::BeginFrame()
+{
+	lastFrame = frame;
+	frame = {};
+}
+
+void GLState::UseProgram(GLuint program)
+{
+	if (USkip(this->program == program, -1))
+		return;
+
+	this->program = program;
+	glUseProgram(program);
+}
+
+void GLState::BindVertexArray(GLuint vao)
+{
+	if (USkip(this->vao == vao, GLCounters::STATE_VERTEX_ARRAY))
+		return;
+
+	this->vao = vao;
+	elementBuffer = unknown;
+	glBindVertexArray(vao);
+}
+
+// Binds texture to a unit, the active unit only changes when a bind is needed.
+// Counted as one call, switching the unit is part of it.
+void GLState::BindTexture(int unit, GLenum target, GLuint texture)
+{
+	bool tracked = target == GL_TEXTURE_2D && unit >= 0 && unit < maxTextureUnits;
+	if (USkip(tracked && textures[unit] == texture, GLCounters::STATE_TEXTURE))
+		return;
+
+	UActiveTexture(unit);
+	if (tracked)
+		textures[unit] = texture;
+	glBindTexture(target, texture);
+}
+
+void GLState::BindBuffer(GLenum target, GLuint buffer)
+{
+	if (target == GL_ELEMENT_ARRAY_BUFFER)
+	{
+		if (USkip(elementBuffer == buffer, GLCounters::STATE_BUFFER))
+			return;
+
+		elementBuffer = buffer;
+		glBindBuffer(target, buffer);
+		return;
+	}
+
+	int index = UFind(bufferTargets, target);
+	if (USkip(index >= 0 && buffers[index] == buffer, GLCounters::STATE_BUFFER))
+		return;
+
+	if (index >= 0)
+		buffers[index] = buffer;
+	glBindBuffer(target, buffer);
+}
+
+// Also binds the buffer to the generic binding point of target, as GL does
+void GLState::BindBufferBase(GLenum target, GLuint index, GLuint buffer)
+{
+	int indexedTarget = UFind(indexedTargets, target);
+	bool tracked = indexedTarget >= 0 && index < (GLuint)maxIndexedBuffers;
+	int generic = UFind(bufferTargets, target);
+
+	if (USkip(tracked && indexedBuffers[indexedTarget][index] == buffer && generic >= 0 && buffers[generic] == buffer, GLCounters::STATE_BUFFER))
+		return;
+
+	if (tracked)
+		indexedBuffers[indexedTarget][index] = buffer;
+	if (generic >= 0)
+		buffers[generic] = buffer;
+	glBindBufferBase(target, index, buffer);
+}
+
+void GLState::BindFramebuffer(GLenum target, GLuint fbo)
+{
+	bool draw = target == GL_FRAMEBUFFER || target == GL_DRAW_FRAMEBUFFER;
+	bool read = target == GL_FRAMEBUFFER || target == GL_READ_FRAMEBUFFER;
+
+	if (USkip((!draw || drawFramebuffer == fbo) && (!read || readFramebuffer == fbo), GLCounters::STATE_FRAMEBUFFER))
+		return;
+
+	if (draw)
+		drawFramebuffer = fbo;
+	if (read)
+		readFramebuffer = fbo;
+	glBindFramebuffer(target, fbo);
+}
+
+void GLState::Viewport(GLint x, GLint y, GLsizei width, GLsizei height)
+{
+	if (USkip(viewport[0] == x && viewport[1] == y && viewport[2] == width && viewport[3] == height, GLCounters::STATE_VIEWPORT))
+		return;
+
+	viewport[0] = x;
+	viewport[1] = y;
+	viewport[2] = width;
+	viewport[3] = height;
+	glViewport(x, y, width, height);
+}
+
+void GLState::Enable(GLenum capability)
+{
+	USetEnabled(capability, true);
+}
+
+void GLState::Disable(GLenum capability)
+{
+	USetEnabled(capability, false);
+}
+
+void GLState::DepthFunc(GLenum func)
+{
+	if (USkip(depthFunc == func, GLCounters::STATE_DEPTH))
+		return;
+
+	depthFunc = func;
+	glDepthFunc(func);
+}
+
+void GLState::DepthMask(GLboolean write)
+{
+	int mask = write ? 1 : 0;
+	if (USkip(depthMask == mask, GLCounters::STATE_DEPTH))
+		return;
+
+	depthMask = mask;
+	glDepthMask(write);
+}
+
+void GLState::ColorMask(GLboolean red, GLboolean green, GLboolean blue, GLboolean alpha)
+{
+	int mask = (red ? 1 : 0) | (green ? 2 : 0) | (blue ? 4 : 0) | (alpha ? 8 : 0);
+	if (USkip(colorMask == mask, GLCounters::STATE_COLOR_MASK))
+		return;
+
+	colorMask = mask;
+	glColorMask(red, green, blue, alpha);
+}
+
+void GLState::DeleteTextures(GLsizei count, const GLuint* textures)
+{
+	for (GLsizei i = 0; i < count; ++i)
+		replace(begin(this->textures), end(this->textures), textures[i], unknown);
+	glDeleteTextures(count, textures);
+}
+
+void GLState::DeleteBuffers(GLsizei count, const GLuint* buffers)
+{
+	for (GLsizei i = 0; i < count; ++i)
+	{
+		replace(begin(this->buffers), end(this->buffers), buffers[i], unknown);
+		for (GLuint (&bindings)[maxIndexedBuffers] : indexedBuffers)
+			replace(begin(bindings), end(bindings), buffers[i], unknown);
+		if (elementBuffer == buffers[i])
+			elementBuffer = unknown;
+	}
+	glDeleteBuffers(count, buffers);
+}
+
+void GLState::DeleteVertexArrays(GLsizei count, const GLuint* vaos)
+{
+	for (GLsizei i = 0; i < count; ++i)
+	{
+		if (vao == vaos[i])
+			vao = elementBuffer = unknown;
+	}
+	glDeleteVertexArrays(count, vaos);
+}
+
+void GLState::DeleteFramebuffers(GLsizei count, const GLuint* fbos)
+{
+	for (GLsizei i = 0; i < count; ++i)
+	{
+		if (drawFramebuffer == fbos[i])
+			drawFramebuffer = unknown;
+		if (readFramebuffer == fbos[i])
+			readFramebuffer = unknown;
+	}
+	glDeleteFramebuffers(count, fbos);
+}
+
+void GLState::DeleteProgram(GLuint program)
+{
+	if (this->program == program)
+		this->program = unknown;
+	glDeleteProgram(program);
+}
+
+// Counts a requested change, true when it can be dropped. Changes reaching
+// the driver are counted by category, -1 is a program switch.
+bool GLState::USkip(bool unchanged, int category)
+{
+	GLCounters& counters = UGLCounters();
+	++frame.numCalls;
+
+	if (unchanged)
+	{
+		++frame.numSkipped;
+		++counters.numFilteredStateCalls;
+	}
+	else if (category < 0)
+	{
+		++counters.numProgramSwitches;
+	}
+	else
+	{
+		++counters.stateChanges[category];
+	}
+
+	return unchanged;
+}
+
+// Part of a bind that was already counted, not a call of its own
+void GLState::UActiveTexture(int unit)
+{
+	if (activeUnit == unit)
+		return;
+
+	activeUnit = unit;
+	glActiveTexture(GL_TEXTURE0 + unit);
+}
+
+void GLState::USetEnabled(GLenum capability, bool enable)
+{
+	int index = UFind(capabilities, capability);
+	if (USkip(index >= 0 && enabled[index] == (enable ? 1 : 0), GLCounters::STATE_ENABLE))
+		return;
+
+	if (index >= 0)
+		enabled[index] = enable ? 1 : 0;
+
+	if (enable)
+		glEnable(capability);
+	else
+		glDisable(capability);
+}
@@ -0,0 +1,91 @@
+#pragma once
+
+#include <GL/glew.h>
+
+#include <cstddef>
+
+// Shadow copy of the GL state the renderer changes all the time: program,
+// vertex array, texture units, buffer bindings, framebuffers, viewport, a
+// few enable bits, the depth function and the depth and color write masks.
+// Calls that would leave the state as it is are dropped before they reach
+// the driver, and counted once per call made here. Every change of this
+// state on the render thread has to go through here; Invalidate() forgets
+// the copy after code that went around it, like the setup done on the main
+// thread.
+//
+// Deliberately untracked, called straight to GL: glClipControl and
+// glClearDepth, switched once per camera pass with reverse-Z, glClearColor,
+// glPolygonOffset of the shadow passes, glBlendFunc of the overlay,
+// glBindSampler of the present pass and glBindImageTexture of the Hi-Z
+// build. Each is set right before the work that needs it, and restored by
+// the code that changed it where later passes rely on the default.
+class GLState
+{
+public:
+	static const int maxTextureUnits = 16;
+	static const int maxIndexedBuffers = 8; // binding points per indexed target
+
+	struct Stats
+	{
+		size_t numCalls; // state changes asked for
+		size_t numSkipped; // of those, dropped because nothing would change
+	};
+
+	Stats frame = {}; // frame in progress
+	Stats lastFrame = {};
+
+public:
+	GLState() { Invalidate(); }
+
+	void Invalidate();
+	void BeginFrame();
+
+	void UseProgram(GLuint program);
+	void BindVertexArray(GLuint vao);
+	void BindTexture(int unit, GLenum target, GLuint texture);
+	void BindBuffer(GLenum target, GLuint buffer);
+	void BindBufferBase(GLenum target, GLuint index, GLuint buffer);
+	void BindFramebuffer(GLenum target, GLuint fbo);
+	void Viewport(GLint x, GLint y, GLsizei width, GLsizei height);
+	void Enable(GLenum capability);
+	void Disable(GLenum capability);
+	void DepthFunc(GLenum func);
+	void DepthMask(GLboolean write);
+	void ColorMask(GLboolean red, GLboolean green, GLboolean blue, GLboolean alpha);
+
+	// deleted names are reused by the next glGen*, so the copy drops them
+	void DeleteTextures(GLsizei count, const GLuint* textures);
+	void DeleteBuffers(GLsizei count, const GLuint* buffers);
+	void DeleteVertexArrays(GLsizei count, const GLuint* vaos);
+	void DeleteFramebuffers(GLsizei count, const GLuint* fbos);
+	void DeleteProgram(GLuint program);
+
+private:
+	static const GLuint unknown = 0xFFFFFFFFu; // never a GL name
+	static const int numBufferTargets = 6;
+	static const int numIndexedTargets = 2;
+	static const int numCapabilities = 6;
+
+	GLuint program = unknown;
+	GLuint vao = unknown;
+	GLuint elementBuffer = unknown; // belongs to the bound vertex array
+	int activeUnit = -1;
+	GLuint textures[maxTextureUnits]; // GL_TEXTURE_2D of each unit
+	GLuint buffers[numBufferTargets];
+	GLuint indexedBuffers[numIndexedTargets][maxIndexedBuffers];
+	GLuint drawFramebuffer = unknown;
+	GLuint readFramebuffer = unknown;
+	GLint viewport[4] = { -1, -1, -1, -1 };
+	int enabled[numCapabilities]; // -1 unknown, 0 disabled, 1 enabled
+	GLenum depthFunc = unknown;
+	int depthMask = -1; // -1 unknown, else 0 or 1
+	int colorMask = -1; // -1 unknown, else one bit per channel, red first
+
+	bool USkip(bool unchanged, int category);
+	void UActiveTexture(int unit);
+	void USetEnabled(GLenum capability, bool enable);
+};
+
+// State of the application's GL context. Only the thread the context is
+// current on may use it.
+GLState& UGLState();
@@ -0,0 +1,837 @@
+#include <iostream>
+#include <cctype>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <glm/gtc/type_ptr.hpp>
+#include "GltfImporter.h"
+#include "JsonDocument.h"
+#include "MappedFile.h"
+#include "Texture.h"
+#include "CpuProfiler.h"
+
+using namespace std;
+
+namespace
+{
+	const uint32_t glbMagic = 0x46546C67; // "glTF"
+	const uint32_t glbJsonChunk = 0x4E4F534A; // "JSON"
+	const uint32_t glbBinaryChunk = 0x004E4942; // "BIN"
+	const int trianglesMode = 4;
+
+	// Bytes of a buffer or buffer view
+	struct View
+	{
+		const unsigned char* data;
+		size_t size;
+		size_t stride; // views only, 0 for tightly packed
+	};
+
+	// Element i starts at data + i * stride
+	struct Accessor
+	{
+		const unsigned char* data; // nullptr without a buffer view, the elements read as zeros
+		size_t count;
+		size_t stride;
+		int components;
+		GLenum componentType;
+		bool normalized;
+	};
+
+	// One triangle primitive, decoded by one job
+	struct Primitive
+	{
+		int position; // accessors, -1 when missing
+		int normal;
+		int texCoord;
+		int tangent;
+		int indices;
+		int material;
+		vector<Vertex> vertices;
+		vector<unsigned int> indexData;
+		bool valid; // every index refers to a vertex
+	};
+
+	uint32_t ULoad32(const unsigned char* bytes)
+	{
+		uint32_t value;
+		memcpy(&value, bytes, sizeof(value));
+		return value;
+	}
+
+	// Negative and missing sizes are 0
+	size_t USize(const JsonDocument& json, int value)
+	{
+		double number = json.Number(value, 0.0);
+		return number > 0.0 ? (size_t)number : 0;
+	}
+
+	size_t UComponentSize(GLenum componentType)
+	{
+		switch (componentType)
+		{
+		case GL_BYTE:
+		case GL_UNSIGNED_BYTE: return 1;
+		case GL_SHORT:
+		case GL_UNSIGNED_SHORT: return 2;
+		case GL_UNSIGNED_INT:
+		case GL_FLOAT: return 4;
+		default: return 0;
+		}
+	}
+
+	int UComponentCount(const JsonDocument& json, int type)
+	{
+		static const char* names[] = { "SCALAR", "VEC2", "VEC3", "VEC4", "MAT2", "MAT3", "MAT4" };
+		static const int counts[] = { 1, 2, 3, 4, 4, 9, 16 };
+
+		for (int i = 0; i < 7; ++i)
+		{
+			if (json.Equals(type, names[i]))
+				return counts[i];
+		}
+		return 0;
+	}
+
+	// Splits a .glb into its JSON chunk and the binary chunk after it, if any
+	bool UReadGlb(const MappedFile& file, const char*& jsonText, size_t& jsonLength, View& binary)
+	{
+		const unsigned char* data = file.Data();
+		size_t size = min(file.Size(), (size_t)ULoad32(data + 8));
+		if (size < 20 || ULoad32(data + 4) != 2 || ULoad32(data + 16) != glbJsonChunk)
+			return false;
+
+		jsonLength = ULoad32(data + 12);
+		if (jsonLength > size - 20)
+			return false;
+		jsonText = reinterpret_cast<const char*>(data + 20);
+
+		// chunks start 4 byte aligned
+		size_t next = (20 + jsonLength + 3) & ~(size_t)3;
+		if (next + 8 <= size && ULoad32(data + next + 4) == glbBinaryChunk)
+		{
+			size_t binaryLength = ULoad32(data + next);
+			if (binaryLength > size - next - 8)
+				return false;
+			binary.data = data + next + 8;
+			binary.size = binaryLength;
+		}
+
+		return true;
+	}
+
+	// "data:[type];base64,..." into bytes
+	bool UDecodeDataUri(const string& uri, vector<unsigned char>& bytes)
+	{
+		size_t comma = uri.find(',');
+		if (comma == string::npos || comma < 7 || uri.compare(comma - 7, 7, ";base64") != 0)
+			return false;
+
+		bytes.clear();
+		bytes.reserve((uri.size() - comma) / 4 * 3);
+
+		uint32_t bits = 0;
+		int numBits = 0;
+		for (size_t i = comma + 1; i < uri.size() && uri[i] != '='; ++i)
+		{
+			char c = uri[i];
+			int value;
+			if (c >= 'A' && c <= 'Z')
+				value = c - 'A';
+			else if (c >= 'a' && c <= 'z')
+				value = c - 'a' + 26;
+			else if (c >= '0' && c <= '9')
+				value = c - '0' + 52;
+			else if (c == '+')
+				value = 62;
+			else if (c == '/')
+				value = 63;
+			else
+				return false;
+
+			bits = (bits << 6) | (uint32_t)value;
+			numBits += 6;
+			if (numBits >= 8)
+			{
+				numBits -= 8;
+				bytes.push_back((unsigned char)(bits >> numBits));
+			}
+		}
+
+		return true;
+	}
+
+	// Relative URIs are percent encoded
+	string UDecodeUri(const string& uri)
+	{
+		string path;
+		path.reserve(uri.size());
+
+		for (size_t i = 0; i < uri.size(); ++i)
+		{
+			if (uri[i] == '%' && i + 2 < uri.size() && isxdigit((unsigned char)uri[i + 1]) && isxdigit((unsigned char)uri[i + 2]))
+			{
+				path += (char)strtol(uri.substr(i + 1, 2).c_str(), nullptr, 16);
+				i += 2;
+			}
+			else
+				path += uri[i];
+		}
+
+		return path;
+	}
+
+	// Up to and including the last separator, relative URIs start there
+	string UDirectory(const char* path)
+	{
+		string directory = path;
+		size_t separator = directory.find_last_of("/\\");
+		return separator == string::npos ? string() : directory.substr(0, separator + 1);
+	}
+
+	// Reads n floats of element i, missing components are 0
+	void UReadFloats(const Accessor& accessor, size_t i, float* values, int n)
+	{
+		int count = accessor.data != nullptr ? min(n, accessor.components) : 0;
+		const unsigned char* element = accessor.data + i * accessor.stride;
+
+		for (int c = 0; c < count; ++c)
+		{
+			switch (accessor.componentType)
+			{
+			case GL_FLOAT:
+				memcpy(&values[c], element + c * 4, 4);
+				break;
+			case GL_UNSIGNED_BYTE:
+				values[c] = accessor.normalized ? element[c] / 255.0f : (float)element[c];
+				break;
+			case GL_BYTE:
+			{
+				int8_t value = (int8_t)element[c];
+				values[c] = accessor.normalized ? max(value / 127.0f, -1.0f) : (float)value;
+				break;
+			}
+			case GL_UNSIGNED_SHORT:
+			{
+				uint16_t value;
+				memcpy(&value, element + c * 2, 2);
+				values[c] = accessor.normalized ? value / 65535.0f : (float)value;
+				break;
+			}
+			case GL_SHORT:
+			{
+				int16_t value;
+				memcpy(&value, element + c * 2, 2);
+				values[c] = accessor.normalized ? max(value / 32767.0f, -1.0f) : (float)value;
+				break;
+			}
+			default:
+				values[c] = (float)ULoad32(element + c * 4);
+				break;
+			}
+		}
+
+		for (int c = count; c < n; ++c)
+			values[c] = 0.0f;
+	}
+
+	uint32_t UReadIndex(const Accessor& accessor, size_t i)
+	{
+		if (accessor.data == nullptr)
+			return 0;
+
+		const unsigned char* element = accessor.data + i * accessor.stride;
+		switch (accessor.componentType)
+		{
+		case GL_UNSIGNED_BYTE:
+			return element[0];
+		case GL_UNSIGNED_SHORT:
+		{
+			uint16_t value;
+			memcpy(&value, element, 2);
+			return value;
+		}
+		default:
+			return ULoad32(element);
+		}
+	}
+
+	// Any unit vector perpendicular to n
+	glm::vec3 UPerpendicular(const glm::vec3& n)
+	{
+		glm::vec3 axis = fabs(n.x) < 0.9f ? glm::vec3(1.0f, 0.0f, 0.0f) : glm::vec3(0.0f, 1.0f, 0.0f);
+		return glm::normalize(glm::cross(n, axis));
+	}
+
+	// Area weighted face normals summed at the vertices
+	void UGenerateNormals(vector<Vertex>& vertices, const vector<unsigned int>& indices)
+	{
+		for (Vertex& vertex : vertices)
+			vertex.Normal = glm::vec3(0.0f);
+
+		for (size_t i = 0; i + 2 < indices.size(); i += 3)
+		{
+			Vertex& v0 = vertices[indices[i]];
+			Vertex& v1 = vertices[indices[i + 1]];
+			Vertex& v2 = vertices[indices[i + 2]];
+			glm::vec3 normal = glm::cross(v1.Position - v0.Position, v2.Position - v0.Position);
+			v0.Normal += normal;
+			v1.Normal += normal;
+			v2.Normal += normal;
+		}
+
+		for (Vertex& vertex : vertices)
+		{
+			float length = glm::length(vertex.Normal);
+			vertex.Normal = length > 1e-12f ? vertex.Normal / length : glm::vec3(0.0f, 0.0f, 1.0f);
+		}
+	}
+
+	// Per triangle tangents and bitangents from the texture coordinates,
+	// summed at the vertices and made orthogonal to the normal
+	void UGenerateTangents(vector<Vertex>& vertices, const vector<unsigned int>& indices)
+	{
+		for (Vertex& vertex : vertices)
+			vertex.Tangent = vertex.Bitangent = glm::vec3(0.0f);
+
+		for (size_t i = 0; i + 2 < indices.size(); i += 3)
+		{
+			Vertex& v0 = vertices[indices[i]];
+			Vertex& v1 = vertices[indices[i + 1]];
+			Vertex& v2 = vertices[indices[i + 2]];
+
+			glm::vec3 edge1 = v1.Position - v0.Position;
+			glm::vec3 edge2 = v2.Position - v0.Position;
+			glm::vec2 uv1 = v1.TexCoords - v0.TexCoords;
+			glm::vec2 uv2 = v2.TexCoords - v0.TexCoords;
+
+			// triangles without texture space area add nothing
+			float determinant = uv1.x * uv2.y - uv2.x * uv1.y;
+			if (fabs(determinant) < 1e-12f)
+				continue;
+
+			float scale = 1.0f / determinant;
+			glm::vec3 tangent = (edge1 * uv2.y - edge2 * uv1.y) * scale;
+			glm::vec3 bitangent = (edge2 * uv1.x - edge1 * uv2.x) * scale;
+			v0.Tangent += tangent;
+			v1.Tangent += tangent;
+			v2.Tangent += tangent;
+			v0.Bitangent += bitangent;
+			v1.Bitangent += bitangent;
+			v2.Bitangent += bitangent;
+		}
+
+		for (Vertex& vertex : vertices)
+		{
+			glm::vec3 n = vertex.Normal;
+			glm::vec3 t = vertex.Tangent - n * glm::dot(n, vertex.Tangent);
+			t = glm::dot(t, t) > 1e-12f ? glm::normalize(t) : UPerpendicular(n);
+
+			// mirrored texture coordinates flip the bitangent
+			float handedness = glm::dot(glm::cross(n, t), vertex.Bitangent) < 0.0f ? -1.0f : 1.0f;
+			vertex.Tangent = t;
+			vertex.Bitangent = glm::cross(n, t) * handedness;
+		}
+	}
+
+	// Runs on a job thread, only touches the primitive and the mapped buffers
+	void UDecodePrimitive(const vector<Accessor>& accessors, Primitive& primitive)
+	{
+		CPU_PROFILE_SCOPE("UDecodePrimitive");
+
+		const Accessor& position = accessors[primitive.position];
+		size_t numVertices = position.count;
+		vector<Vertex>& vertices = primitive.vertices;
+		vector<unsigned int>& indices = primitive.indexData;
+		vertices.resize(numVertices);
+
+		for (size_t i = 0; i < numVertices; ++i)
+			UReadFloats(position, i, glm::value_ptr(vertices[i].Position), 3);
+
+		if (primitive.indices >= 0)
+		{
+			const Accessor& accessor = accessors[primitive.indices];
+			indices.resize(accessor.count - accessor.count % 3);
+			for (size_t i = 0; i < indices.size(); ++i)
+			{
+				indices[i] = UReadIndex(accessor, i);
+				if (indices[i] >= numVertices)
+				{
+					primitive.valid = false;
+					return;
+				}
+			}
+		}
+		else
+		{
+			indices.resize(numVertices - numVertices % 3);
+			for (size_t i = 0; i < indices.size(); ++i)
+				indices[i] = (unsigned int)i;
+		}
+
+		if (primitive.normal >= 0)
+		{
+			for (size_t i = 0; i < numVertices; ++i)
+				UReadFloats(accessors[primitive.normal], i, glm::value_ptr(vertices[i].Normal), 3);
+		}
+		else
+			UGenerateNormals(vertices, indices);
+
+		// glTF puts v = 0 at the top of the image
+		if (primitive.texCoord >= 0)
+		{
+			for (size_t i = 0; i < numVertices; ++i)
+			{
+				UReadFloats(accessors[primitive.texCoord], i, glm::value_ptr(vertices[i].TexCoords), 2);
+				vertices[i].TexCoords.y = 1.0f - vertices[i].TexCoords.y;
+			}
+		}
+
+		if (primitive.tangent >= 0)
+		{
+			// w is the handedness of the bitangent
+			for (size_t i = 0; i < numVertices; ++i)
+			{
+				float tangent[4];
+				UReadFloats(accessors[primitive.tangent], i, tangent, 4);
+				vertices[i].Tangent = glm::vec3(tangent[0], tangent[1], tangent[2]);
+				vertices[i].Bitangent = glm::cross(vertices[i].Normal, vertices[i].Tangent) * (tangent[3] < 0.0f ? -1.0f : 1.0f);
+			}
+		}
+		else if (primitive.texCoord >= 0)
+			UGenerateTangents(vertices, indices);
+		else
+		{
+			for (Vertex& vertex : vertices)
+			{
+				vertex.Tangent = UPerpendicular(vertex.Normal);
+				vertex.Bitangent = glm::cross(vertex.Normal, vertex.Tangent);
+			}
+		}
+
+		primitive.valid = true;
+	}
+
+	// A matrix, or translation, rotation and scale applied in TRS order
+	glm::mat4 ULocalTransform(const JsonDocument& json, int node)
+	{
+		int matrix = json.Member(node, "matrix");
+		if (json.Size(matrix) == 16)
+		{
+			float values[16];
+			for (int i = 0; i < 16; ++i)
+				values[i] = (float)json.Number(json.Element(matrix, i));
+			return glm::make_mat4(values);
+		}
+
+		int translation = json.Member(node, "translation");
+		int rotation = json.Member(node, "rotation");
+		int scale = json.Member(node, "scale");
+		float t[3], s[3];
+		for (int i = 0; i < 3; ++i)
+		{
+			t[i] = (float)json.Number(json.Element(translation, i), 0.0);
+			s[i] = (float)json.Number(json.Element(scale, i), 1.0);
+		}
+
+		float x = (float)json.Number(json.Element(rotation, 0), 0.0);
+		float y = (float)json.Number(json.Element(rotation, 1), 0.0);
+		float z = (float)json.Number(json.Element(rotation, 2), 0.0);
+		float w = (float)json.Number(json.Element(rotation, 3), 1.0);
+
+		glm::mat4 local(1.0f);
+		local[0] = glm::vec4(1.0f - 2.0f * (y * y + z * z), 2.0f * (x * y + w * z), 2.0f * (x * z - w * y), 0.0f) * s[0];
+		local[1] = glm::vec4(2.0f * (x * y - w * z), 1.0f - 2.0f * (x * x + z * z), 2.0f * (y * z + w * x), 0.0f) * s[1];
+		local[2] = glm::vec4(2.0f * (x * z + w * y), 2.0f * (y * z - w * x), 1.0f - 2.0f * (x * x + y * y), 0.0f) * s[2];
+		local[3] = glm::vec4(t[0], t[1], t[2], 1.0f);
+		return local;
+	}
+
+	// From the image's file, a data URI or a buffer view
+	bool ULoadImage(const JsonDocument& json, int image, const string& directory, const vector<View>& views, GLuint& textureId)
+	{
+		Texture loader;
+		string uri;
+		if (json.String(json.Member(image, "uri"), uri))
+		{
+			if (uri.compare(0, 5, "data:") == 0)
+			{
+				vector<unsigned char> bytes;
+				return UDecodeDataUri(uri, bytes) && loader.UCreateTextureFromMemory(bytes.data(), bytes.size(), textureId);
+			}
+			return loader.UCreateTexture((directory + UDecodeUri(uri)).c_str(), textureId);
+		}
+
+		int view = json.Int(json.Member(image, "bufferView"));
+		if (view < 0 || view >= (int)views.size())
+			return false;
+
+		return loader.UCreateTextureFromMemory(views[view].data, views[view].size, textureId);
+	}
+}
+
+bool GltfImporter::Import(const char* path)
+{
+	CPU_PROFILE_SCOPE("GltfImporter::Import");
+	Destroy();
+
+	MappedFile file;
+	if (!file.Map(path))
+		return false;
+
+	// a .glb holds the JSON and the first buffer, a .gltf is only JSON
+	const char* jsonText = reinterpret_cast<const char*>(file.Data());
+	size_t jsonLength = file.Size();
+	View binary = { nullptr, 0, 0 };
+	if (file.Size() >= 12 && ULoad32(file.Data()) == glbMagic && !UReadGlb(file, jsonText, jsonLength, binary))
+	{
+		cout << "ERROR::GLTF::INVALID_GLB " << path << endl;
+		return false;
+	}
+
+	JsonDocument json;
+	if (!json.Parse(jsonText, jsonLength))
+	{
+		cout << "ERROR::GLTF::INVALID_JSON " << path << endl;
+		return false;
+	}
+
+	int root = json.Root();
+	string version;
+	if (!json.String(json.Member(json.Member(root, "asset"), "version"), version) || version.compare(0, 2, "2.") != 0)
+	{
+		cout << "ERROR::GLTF::UNSUPPORTED_VERSION " << path << endl;
+		return false;
+	}
+
+	// external buffers stay mapped until the meshes are built
+	string directory = UDirectory(path);
+	int jsonBuffers = json.Member(root, "buffers");
+	size_t numBuffers = json.Size(jsonBuffers);
+	vector<View> buffers(numBuffers);
+	vector<unique_ptr<MappedFile>> bufferFiles;
+	vector<vector<unsigned char>> decodedBuffers;
+	decodedBuffers.reserve(numBuffers);
+
+	for (size_t i = 0; i < numBuffers; ++i)
+	{
+		int buffer = json.Element(jsonBuffers, i);
+		string uri;
+		if (!json.String(json.Member(buffer, "uri"), uri))
+		{
+			// only the first buffer of a .glb has no URI
+			if (i != 0 || binary.data == nullptr)
+			{
+				cout << "ERROR::GLTF::MISSING_BUFFER " << i << endl;
+				return false;
+			}
+			buffers[i] = binary;
+		}
+		else if (uri.compare(0, 5, "data:") == 0)
+		{
+			decodedBuffers.emplace_back();
+			if (!UDecodeDataUri(uri, decodedBuffers.back()))
+			{
+				cout << "ERROR::GLTF::INVALID_DATA_URI " << i << endl;
+				return false;
+			}
+			buffers[i] = { decodedBuffers.back().data(), decodedBuffers.back().size(), 0 };
+		}
+		else
+		{
+			bufferFiles.emplace_back(new MappedFile());
+			if (!bufferFiles.back()->Map((directory + UDecodeUri(uri)).c_str()))
+				return false;
+			buffers[i] = { bufferFiles.back()->Data(), bufferFiles.back()->Size(), 0 };
+		}
+
+		size_t byteLength = USize(json, json.Member(buffer, "byteLength"));
+		if (buffers[i].size < byteLength)
+		{
+			cout << "ERROR::GLTF::BUFFER_TOO_SHORT " << i << endl;
+			return false;
+		}
+		buffers[i].size = byteLength;
+	}
+
+	int jsonViews = json.Member(root, "bufferViews");
+	vector<View> views(json.Size(jsonViews));
+	for (size_t i = 0; i < views.size(); ++i)
+	{
+		int view = json.Element(jsonViews, i);
+		int buffer = json.Int(json.Member(view, "buffer"));
+		size_t offset = USize(json, json.Member(view, "byteOffset"));
+		size_t length = USize(json, json.Member(view, "byteLength"));
+		if (buffer < 0 || buffer >= (int)numBuffers || offset > buffers[buffer].size || length > buffers[buffer].size - offset)
+		{
+			cout << "ERROR::GLTF::INVALID_BUFFER_VIEW " << i << endl;
+			return false;
+		}
+		views[i] = { buffers[buffer].data + offset, length, USize(json, json.Member(view, "byteStride")) };
+	}
+
+	// every accessor is checked to lie inside its view, decoding trusts them
+	int jsonAccessors = json.Member(root, "accessors");
+	vector<Accessor> accessors(json.Size(jsonAccessors));
+	for (size_t i = 0; i < accessors.size(); ++i)
+	{
+		int accessor = json.Element(jsonAccessors, i);
+		Accessor& resolved = accessors[i];
+		resolved.count = USize(json, json.Member(accessor, "count"));
+		resolved.components = UComponentCount(json, json.Member(accessor, "type"));
+		resolved.componentType = (GLenum)json.Int(json.Member(accessor, "componentType"), 0);
+		resolved.normalized = json.Bool(json.Member(accessor, "normalized"));
+		resolved.data = nullptr;
+
+		size_t elementSize = UComponentSize(resolved.componentType) * resolved.components;
+		int view = json.Int(json.Member(accessor, "bufferView"));
+		bool valid = elementSize > 0 && view < (int)views.size();
+		resolved.stride = elementSize;
+
+		if (valid && view >= 0)
+		{
+			size_t offset = USize(json, json.Member(accessor, "byteOffset"));
+			resolved.stride = views[view].stride > 0 ? views[view].stride : elementSize;
+			size_t size = views[view].size;
+			valid = resolved.stride >= elementSize && offset <= size && elementSize <= size - offset
+				&& (resolved.count == 0 || resolved.count - 1 <= (size - offset - elementSize) / resolved.stride);
+			resolved.data = views[view].data + offset;
+		}
+
+		if (!valid)
+		{
+			cout << "ERROR::GLTF::INVALID_ACCESSOR " << i << endl;
+			return false;
+		}
+
+		if (json.Member(accessor, "sparse") >= 0)
+			cout << "ERROR::GLTF::SPARSE_ACCESSOR_IGNORED " << i << endl;
+	}
+
+	// triangle primitives of every mesh, the range of mesh m starts at meshPrimitives[m]
+	int jsonMeshes = json.Member(root, "meshes");
+	size_t numMeshes = json.Size(jsonMeshes);
+	size_t numMaterials = json.Size(json.Member(root, "materials"));
+	vector<Primitive> primitives;
+	vector<size_t> meshPrimitives(numMeshes + 1, 0);
+	size_t numSkipped = 0;
+
+	for (size_t m = 0; m < numMeshes; ++m)
+	{
+		meshPrimitives[m] = primitives.size();
+		int jsonPrimitives = json.Member(json.Element(jsonMeshes, m), "primitives");
+
+		for (size_t p = 0; p < json.Size(jsonPrimitives); ++p)
+		{
+			int primitive = json.Element(jsonPrimitives, p);
+			int attributes = json.Member(primitive, "attributes");
+
+			Primitive resolved;
+			resolved.position = json.Int(json.Member(attributes, "POSITION"));
+			resolved.normal = json.Int(json.Member(attributes, "NORMAL"));
+			resolved.texCoord = json.Int(json.Member(attributes, "TEXCOORD_0"));
+			resolved.tangent = json.Int(json.Member(attributes, "TANGENT"));
+			resolved.indices = json.Int(json.Member(primitive, "indices"));
+			resolved.material = json.Int(json.Member(primitive, "material"));
+			resolved.valid = false;
+
+			// attributes of the wrong shape or length are dropped and generated instead
+			int* attributeAccessors[] = { &resolved.position, &resolved.normal, &resolved.texCoord, &resolved.tangent, &resolved.indices };
+			const int attributeComponents[] = { 3, 3, 2, 4, 1 };
+			for (int a = 0; a < 5; ++a)
+			{
+				int& index = *attributeAccessors[a];
+				if (index >= (int)accessors.size() || (index >= 0 && accessors[index].components != attributeComponents[a]))
+					index = -1;
+			}
+			// every vertex attribute is read for as many elements as there are positions
+			for (int a = 1; a < 4 && resolved.position >= 0; ++a)
+			{
+				int& index = *attributeAccessors[a];
+				if (index >= 0 && accessors[index].count != accessors[resolved.position].count)
+					index = -1;
+			}
+			if (resolved.indices >= 0 && accessors[resolved.indices].componentType != GL_UNSIGNED_BYTE
+				&& accessors[resolved.indices].componentType != GL_UNSIGNED_SHORT && accessors[resolved.indices].componentType != GL_UNSIGNED_INT)
+				resolved.indices = -1;
+			if (resolved.material >= (int)numMaterials)
+				resolved.material = -1;
+
+			// points and lines are not drawn by Mesh
+			if (json.Int(json.Member(primitive, "mode"), trianglesMode) != trianglesMode || resolved.position < 0)
+			{
+				++numSkipped;
+				continue;
+			}
+
+			primitives.push_back(move(resolved));
+		}
+	}
+	meshPrimitives[numMeshes] = primitives.size();
+
+	{
+		CPU_PROFILE_SCOPE("Decode");
+		UParallelFor(jobs, primitives.size(), 1, [&accessors, &primitives](size_t begin, size_t end)
+		{
+			for (size_t i = begin; i < end; ++i)
+				UDecodePrimitive(accessors, primitives[i]);
+		});
+	}
+
+	// images load once, however many textures and materials refer to them
+	int jsonImages = json.Member(root, "images");
+	int jsonTextures = json.Member(root, "textures");
+	vector<GLuint> imageTextures(json.Size(jsonImages), 0);
+	vector<bool> imageLoaded(imageTextures.size(), false);
+
+	int jsonMaterials = json.Member(root, "materials");
+	vector<vector<MeshTexture>> materialTextures(numMaterials);
+	for (size_t i = 0; i < numMaterials; ++i)
+	{
+		int material = json.Element(jsonMaterials, i);
+		int pbr = json.Member(material, "pbrMetallicRoughness");
+		const int slots[] = { json.Member(pbr, "baseColorTexture"), json.Member(pbr, "metallicRoughnessTexture"), json.Member(material, "normalTexture") };
+		const char* types[] = { "texture_diffuse", "texture_specular", "texture_normal" };
+
+		for (int slot = 0; slot < 3; ++slot)
+		{
+			int image = json.Int(json.Member(json.Element(jsonTextures, json.Int(json.Member(slots[slot], "index"))), "source"));
+			if (image < 0 || image >= (int)imageTextures.size())
+				continue;
+
+			if (!imageLoaded[image])
+			{
+				imageLoaded[image] = true;
+				if (ULoadImage(json, json.Element(jsonImages, image), directory, views, imageTextures[image]))
+					textures.push_back(imageTextures[image]);
+				else
+				{
+					imageTextures[image] = 0;
+					cout << "Failed to load glTF image " << image << endl;
+				}
+			}
+
+			if (imageTextures[image] != 0)
+			{
+				MeshTexture meshTexture;
+				meshTexture.id = imageTextures[image];
+				meshTexture.type = types[slot];
+				json.String(json.Member(json.Element(jsonImages, image), "uri"), meshTexture.path);
+				materialTextures[i].push_back(meshTexture);
+			}
+		}
+	}
+
+	// GL objects are made here, on the thread with the context
+	const size_t noMesh = (size_t)-1;
+	vector<size_t> primitiveMeshes(primitives.size(), noMesh);
+	meshes.reserve(primitives.size());
+	for (size_t i = 0; i < primitives.size(); ++i)
+	{
+		Primitive& primitive = primitives[i];
+		if (!primitive.valid)
+		{
+			cout << "ERROR::GLTF::INDEX_OUT_OF_RANGE " << i << endl;
+			Destroy();
+			return false;
+		}
+		if (primitive.vertices.empty() || primitive.indexData.empty())
+			continue;
+
+		primitiveMeshes[i] = meshes.size();
+		meshes.emplace_back(move(primitive.vertices), move(primitive.indexData),
+			primitive.material >= 0 ? materialTextures[primitive.material] : vector<MeshTexture>(), retention);
+	}
+
+	// the node trees of the default scene, every mesh once at the origin without one
+	struct NodeEntry
+	{
+		int node;
+		glm::mat4 parent;
+	};
+
+	int jsonNodes = json.Member(root, "nodes");
+	int scene = json.Element(json.Member(root, "scenes"), (size_t)max(json.Int(json.Member(root, "scene"), 0), 0));
+	int roots = json.Member(scene, "nodes");
+	vector<bool> visited(json.Size(jsonNodes), false);
+	vector<NodeEntry> stack;
+
+	for (size_t i = json.Size(roots); i > 0; --i)
+		stack.push_back({ json.Int(json.Element(roots, i - 1)), glm::mat4(1.0f) });
+
+	if (scene < 0)
+	{
+		for (size_t i = 0; i < meshes.size(); ++i)
+			instances.push_back({ i, glm::mat4(1.0f) });
+	}
+
+	while (!stack.empty())
+	{
+		NodeEntry entry = stack.back();
+		stack.pop_back();
+
+		// nodes form trees, one reached twice is skipped instead of looping
+		if (entry.node < 0 || entry.node >= (int)visited.size() || visited[entry.node])
+			continue;
+		visited[entry.node] = true;
+
+		int node = json.Element(jsonNodes, entry.node);
+		glm::mat4 world = entry.parent * ULocalTransform(json, node);
+
+		int mesh = json.Int(json.Member(node, "mesh"));
+		if (mesh >= 0 && mesh < (int)numMeshes)
+		{
+			for (size_t p = meshPrimitives[mesh]; p < meshPrimitives[mesh + 1]; ++p)
+			{
+				if (primitiveMeshes[p] != noMesh)
+					instances.push_back({ primitiveMeshes[p], world });
+			}
+		}
+
+		int children = json.Member(node, "children");
+		for (size_t i = json.Size(children); i > 0; --i)
+			stack.push_back({ json.Int(json.Element(children, i - 1)), world });
+	}
+
+	cout << "INFO: glTF " << path << ": " << meshes.size() << " meshes, " << instances.size() << " instances, "
+		<< textures.size() << " textures, " << numSkipped << " primitives skipped" << endl;
+	return true;
+}
+
+// Frees the meshes and the images they use
+void GltfImporter::Destroy()
+{
+	for (Mesh& mesh : meshes)
+		mesh.DestroyMesh();
+
+	Texture loader;
+	for (GLuint texture : textures)
+		loader.UDestroyTexture(texture);
+
+	meshes.clear();
+	instances.clear();
+	textures.clear();
+}
+
+void GltfImporter::PrintMemoryReport() const
+{
+	static const char* retentionNames[] = { "none", "compact", "all" };
+	size_t cpuBytes = 0, gpuBytes = 0;
+	char line[128];
+
+	cout << "mesh    vertices    indices  retention    CPU KB    GPU KB" << endl;
+	for (size_t i = 0; i < meshes.size(); ++i)
+	{
+		MeshMemory memory = meshes[i].Memory();
+		snprintf(line, sizeof(line), "%4zu %11d %10d  %-9s %9.1f %9.1f", i, meshes[i].numVertices, meshes[i].numIndices,
+			retentionNames[meshes[i].retention], memory.cpuBytes / 1024.0, memory.gpuBytes / 1024.0);
+		cout << line << endl;
+		cpuBytes += memory.cpuBytes;
+		gpuBytes += memory.gpuBytes;
+	}
+
+	snprintf(line, sizeof(line), "total %zu meshes: CPU %.1f MB, GPU %.1f MB", meshes.size(), cpuBytes / (1024.0 * 1024.0), gpuBytes / (1024.0 * 1024.0));
+	cout << line << endl;
+}
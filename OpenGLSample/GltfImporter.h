@@ -0,0 +1,43 @@
+#pragma once
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+#include <vector>
+
+#include "JobSystem.h"
+#include "mesh.h"
+
+// Imports the triangle meshes of a glTF 2.0 file, .gltf with its buffers in
+// .bin files or data URIs, or a single .glb, into mesh.h Meshes. Buffers are
+// memory mapped and read in place; the primitives are decoded in parallel on
+// the job system, each into its own vertex and index arrays, with normals and
+// tangents generated where the file has none. The GL objects are created on
+// the calling thread afterwards, images go through the Texture loader once
+// each, however many materials share them. Texture coordinates are flipped to
+// the bottom left origin the loader's flipped images use. By default only a
+// compact copy of the geometry stays in RAM, enough for picking.
+class GltfImporter
+{
+public:
+	// One mesh placed by a node of the default scene
+	struct Instance
+	{
+		size_t mesh; // into meshes
+		glm::mat4 model; // world transform of the node
+	};
+
+	JobSystem* jobs = nullptr; // decodes the primitives in parallel when set
+	MeshRetention retention = RETAIN_COMPACT; // what the meshes keep in RAM after the upload
+	std::vector<Mesh> meshes; // one per triangle primitive
+	std::vector<Instance> instances;
+	std::vector<GLuint> textures; // every image the meshes use, owned
+
+public:
+	// Call with the GL context current
+	bool Import(const char* path);
+	void Destroy();
+
+	// CPU and GPU bytes of every mesh and the totals
+	void PrintMemoryReport() const;
+};
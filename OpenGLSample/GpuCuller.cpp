@@ -0,0 +1,539 @@
+#include <iostream>
+#include <algorithm>
+#include <glm/gtc/type_ptr.hpp>
+#include "GpuCuller.h"
+#include "GLState.h"
+#include "GLCounters.h"
+
+using namespace std;
+
+// Shader macro
+#ifndef GLSL
+#define GLSL(Version, Source) "#version " #Version " core \n" #Source
+#endif
+
+namespace
+{
+	// One invocation per item: frustum and Hi-Z test, then one command per draw range
+	const GLchar* cullComputeShaderSource = GLSL(440,
+		layout(local_size_x = 64) in;
+
+		struct Item
+		{
+			mat4 model;
+			vec4 boundsMin;
+			vec4 boundsMax;
+			uvec4 draws; // x first draw, y number of draws
+		};
+
+		struct Draw
+		{
+			uint batch;
+			uint count;
+			uint first;
+			uint indexed;
+		};
+
+		layout(std430, binding = 0) readonly buffer Items { Item items[]; };
+		layout(std430, binding = 1) readonly buffer Draws { Draw draws[]; };
+		layout(std430, binding = 2) readonly buffer Batches { uint batchFirstCommand[]; };
+		layout(std430, binding = 3) writeonly buffer Commands { uint commands[]; };
+		layout(std430, binding = 4) buffer Counts { uint counts[]; };
+		layout(std430, binding = 5) buffer Visibility { uint visibility[]; };
+
+		layout(binding = 0) uniform sampler2D hiZ;
+
+		uniform mat4 viewProjection;
+		uniform vec4 planes[6];
+		uniform uint numItems;
+		uniform uint numDraws;
+		uniform uint numBatches;
+		uniform uint phase;
+		uniform int numLevels;
+
+		// true when the box is behind the pyramid at every texel it covers
+		bool IsOccluded(vec3 worldMin, vec3 worldMax)
+		{
+			vec2 minUV = vec2(1.0);
+			vec2 maxUV = vec2(0.0);
+			float nearest = 1.0;
+
+			for (int corner = 0; corner < 8; ++corner)
+			{
+				vec3 position = mix(worldMin, worldMax, vec3(corner & 1, (corner >> 1) & 1, (corner >> 2) & 1));
+				vec4 clip = viewProjection * vec4(position, 1.0);
+
+				// boxes crossing the near plane are always drawn
+				if (clip.w <= 0.0 || clip.z < -clip.w)
+					return false;
+
+				vec3 ndc = clip.xyz / clip.w;
+				minUV = min(minUV, ndc.xy * 0.5 + 0.5);
+				maxUV = max(maxUV, ndc.xy * 0.5 + 0.5);
+				nearest = min(nearest, ndc.z * 0.5 + 0.5);
+			}
+
+			ivec2 size = textureSize(hiZ, 0);
+			ivec2 minTexel = clamp(ivec2(floor(minUV * vec2(size))), ivec2(0), size - 1);
+			ivec2 maxTexel = clamp(ivec2(floor(maxUV * vec2(size))), ivec2(0), size - 1);
+
+			// the level where the rectangle covers at most 2x2 texels
+			ivec2 span = maxTexel - minTexel + 1;
+			int level = clamp(int(ceil(log2(float(max(span.x, span.y))))), 0, numLevels - 1);
+			ivec2 last = textureSize(hiZ, level) - 1;
+			ivec2 a = min(minTexel >> level, last);
+			ivec2 b = min(maxTexel >> level, last);
+
+			float farthest = max(max(texelFetch(hiZ, a, level).r, texelFetch(hiZ, ivec2(b.x, a.y), level).r),
+				max(texelFetch(hiZ, ivec2(a.x, b.y), level).r, texelFetch(hiZ, b, level).r));
+
+			return nearest > farthest;
+		}
+
+		void main()
+		{
+			uint index = gl_GlobalInvocationID.x;
+			if (index >= numItems)
+				return;
+
+			Item item = items[index];
+
+			// world space box (Arvo)
+			vec3 center = vec3(item.model * vec4((item.boundsMin.xyz + item.boundsMax.xyz) * 0.5, 1.0));
+			vec3 extent = (item.boundsMax.xyz - item.boundsMin.xyz) * 0.5;
+			vec3 worldExtent = abs(item.model[0].xyz) * extent.x + abs(item.model[1].xyz) * extent.y + abs(item.model[2].xyz) * extent.z;
+
+			bool inFrustum = true;
+			for (int i = 0; i < 6; ++i)
+			{
+				if (dot(planes[i].xyz, center) + planes[i].w + dot(abs(planes[i].xyz), worldExtent) < 0.0)
+					inFrustum = false;
+			}
+
+			// phase 0 remembers what it drew, phase 1 only draws what it missed
+			bool drawn;
+			if (phase == 0u)
+			{
+				drawn = inFrustum && !IsOccluded(center - worldExtent, center + worldExtent);
+				visibility[index] = drawn ? 1u : 0u;
+			}
+			else
+			{
+				drawn = inFrustum && visibility[index] == 0u && !IsOccluded(center - worldExtent, center + worldExtent);
+			}
+
+			if (!drawn)
+				return;
+
+			for (uint i = item.draws.x; i < item.draws.x + item.draws.y; ++i)
+			{
+				Draw draw = draws[i];
+				uint slot = atomicAdd(counts[phase * numBatches + draw.batch], 1u);
+				uint base = (phase * numDraws + batchFirstCommand[draw.batch] + slot) * 5u;
+
+				// elements: count, instances, first index, base vertex, base instance
+				// arrays: count, instances, first vertex, base instance
+				commands[base + 0u] = draw.count;
+				commands[base + 1u] = 1u;
+				commands[base + 2u] = draw.first;
+				commands[base + 3u] = draw.indexed != 0u ? 0u : index;
+				commands[base + 4u] = index;
+			}
+		}
+	);
+
+	// Level 0 reads the depth texture, every other level keeps the farthest
+	// depth of the texels below it
+	const GLchar* hiZComputeShaderSource = GLSL(440,
+		layout(local_size_x = 8, local_size_y = 8) in;
+
+		layout(r32f, binding = 0) uniform readonly image2D source;
+		layout(r32f, binding = 1) uniform writeonly image2D destination;
+		layout(binding = 0) uniform sampler2D depthTexture;
+
+		uniform int copyDepth;
+		uniform int reverseDepth;
+
+		void main()
+		{
+			ivec2 texel = ivec2(gl_GlobalInvocationID.xy);
+			ivec2 destinationSize = imageSize(destination);
+			if (any(greaterThanEqual(texel, destinationSize)))
+				return;
+
+			if (copyDepth != 0)
+			{
+				float depth = texelFetch(depthTexture, texel, 0).r;
+				imageStore(destination, texel, vec4(reverseDepth != 0 ? 1.0 - depth : depth));
+				return;
+			}
+
+			// the last texel of an odd sized level also covers the extra row or column
+			ivec2 sourceSize = imageSize(source);
+			ivec2 first = texel * 2;
+			ivec2 last = min(first + 1 + ivec2(equal(texel, destinationSize - 1)) * (sourceSize & 1), sourceSize - 1);
+
+			float farthest = 0.0;
+			for (int y = first.y; y <= last.y; ++y)
+			{
+				for (int x = first.x; x <= last.x; ++x)
+					farthest = max(farthest, imageLoad(source, ivec2(x, y)).r);
+			}
+
+			imageStore(destination, texel, vec4(farthest));
+		}
+	);
+
+	// Compiles and links a single compute shader
+	bool UCreateComputeProgram(const char* source, GLuint& programId)
+	{
+		int success = 0;
+		char infoLog[512];
+
+		programId = glCreateProgram();
+		GLuint shaderId = glCreateShader(GL_COMPUTE_SHADER);
+		glShaderSource(shaderId, 1, &source, NULL);
+
+		glCompileShader(shaderId);
+		glGetShaderiv(shaderId, GL_COMPILE_STATUS, &success);
+		if (!success)
+		{
+			glGetShaderInfoLog(shaderId, sizeof(infoLog), NULL, infoLog);
+			cout << "ERROR::SHADER::COMPUTE::COMPILATION_FAILED\n" << infoLog << endl;
+			glDeleteShader(shaderId);
+			return false;
+		}
+
+		glAttachShader(programId, shaderId);
+		glLinkProgram(programId);
+		glDeleteShader(shaderId);
+		glGetProgramiv(programId, GL_LINK_STATUS, &success);
+		if (!success)
+		{
+			glGetProgramInfoLog(programId, sizeof(infoLog), NULL, infoLog);
+			cout << "ERROR::SHADER::PROGRAM::LINKING_FAILED\n" << infoLog << endl;
+			return false;
+		}
+
+		return true;
+	}
+}
+
+// Compiles the compute passes and allocates the pyramid
+bool GpuCuller::Create(int width, int height)
+{
+	// the draw count is read from a buffer, core in 4.6 and ARB before that
+	if (!GLEW_ARB_indirect_parameters)
+	{
+		cout << "ERROR::GPUCULLER::ARB_INDIRECT_PARAMETERS_NOT_SUPPORTED" << endl;
+		return false;
+	}
+
+	if (!UCreateComputeProgram(cullComputeShaderSource, cullProgramId))
+		return false;
+	if (!UCreateComputeProgram(hiZComputeShaderSource, hiZProgramId))
+		return false;
+
+	this->width = width;
+	this->height = height;
+	UCreateTargets();
+
+	return true;
+}
+
+// Destroys programs, pyramid and buffers
+void GpuCuller::Destroy()
+{
+	glDeleteProgram(cullProgramId);
+	glDeleteProgram(hiZProgramId);
+	cullProgramId = hiZProgramId = 0;
+
+	UDestroyTargets();
+	UDestroyBuffers();
+}
+
+// Recreates the pyramid when the framebuffer size changes
+bool GpuCuller::Resize(int width, int height)
+{
+	if (width == this->width && height == this->height)
+		return true;
+
+	// minimized windows report a 0x0 framebuffer
+	if (width <= 0 || height <= 0)
+		return true;
+
+	UDestroyTargets();
+	this->width = width;
+	this->height = height;
+	UCreateTargets();
+
+	return true;
+}
+
+// Uploads the items and sorts their draw ranges into batches
+void GpuCuller::Upload(const vector<DrawItem>& items)
+{
+	UDestroyBuffers();
+	batches.clear();
+	gpuItems.resize(items.size());
+	numItems = (GLuint)items.size();
+
+	vector<GpuDraw> draws;
+
+	for (size_t i = 0; i < items.size(); ++i)
+	{
+		const DrawItem& item = items[i];
+		GpuItem& gpuItem = gpuItems[i];
+		gpuItem.model = item.model;
+		gpuItem.boundsMin = glm::vec4(item.bounds.min, 1.0f);
+		gpuItem.boundsMax = glm::vec4(item.bounds.max, 1.0f);
+		gpuItem.firstDraw = (GLuint)draws.size();
+		gpuItem.numDraws = (GLuint)item.numRanges;
+		gpuItem.padding[0] = gpuItem.padding[1] = 0;
+
+		for (int r = 0; r < item.numRanges; ++r)
+		{
+			const DrawRange& range = item.ranges[r];
+
+			// the scene only has a handful of batches
+			size_t b = 0;
+			for (; b < batches.size(); ++b)
+			{
+				const Batch& batch = batches[b];
+				if (batch.vao == item.vao && batch.indexed == item.indexed && batch.mode == range.mode && batch.texture == item.texture
+					&& batch.textureExtra == item.textureExtra && batch.extraTexture == range.extraTexture)
+					break;
+			}
+
+			if (b == batches.size())
+				batches.push_back({ item.vao, item.indexed, range.mode, item.texture, item.textureExtra, range.extraTexture, 0, 0 });
+
+			++batches[b].numCommands;
+			draws.push_back({ (GLuint)b, (GLuint)range.count, (GLuint)range.first, item.indexed ? 1u : 0u });
+		}
+	}
+
+	numDraws = (GLuint)draws.size();
+	if (numItems == 0)
+		return;
+
+	// each batch owns a slice of the command buffer
+	vector<GLuint> batchFirstCommand(batches.size());
+	GLuint nextCommand = 0;
+	for (size_t b = 0; b < batches.size(); ++b)
+	{
+		batches[b].firstCommand = nextCommand;
+		batchFirstCommand[b] = nextCommand;
+		nextCommand += batches[b].numCommands;
+	}
+
+	vector<GLuint> itemIndices(numItems);
+	for (GLuint i = 0; i < numItems; ++i)
+		itemIndices[i] = i;
+
+	glGenBuffers(1, &itemBuffer);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, itemBuffer);
+	UBufferData(GL_SHADER_STORAGE_BUFFER, gpuItems.size() * sizeof(GpuItem), gpuItems.data(), GL_DYNAMIC_DRAW);
+
+	glGenBuffers(1, &drawBuffer);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, drawBuffer);
+	UBufferData(GL_SHADER_STORAGE_BUFFER, draws.size() * sizeof(GpuDraw), draws.data(), GL_STATIC_DRAW);
+
+	glGenBuffers(1, &batchBuffer);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, batchBuffer);
+	UBufferData(GL_SHADER_STORAGE_BUFFER, batchFirstCommand.size() * sizeof(GLuint), batchFirstCommand.data(), GL_STATIC_DRAW);
+
+	// one slice of commands and counts per phase, only the GPU writes them
+	glGenBuffers(1, &commandBuffer);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, commandBuffer);
+	UBufferData(GL_SHADER_STORAGE_BUFFER, 2 * numDraws * commandSize, NULL, GL_DYNAMIC_COPY);
+
+	glGenBuffers(1, &countBuffer);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, countBuffer);
+	UBufferData(GL_SHADER_STORAGE_BUFFER, 2 * batches.size() * sizeof(GLuint), NULL, GL_DYNAMIC_COPY);
+
+	glGenBuffers(1, &visibilityBuffer);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, visibilityBuffer);
+	UBufferData(GL_SHADER_STORAGE_BUFFER, numItems * sizeof(GLuint), NULL, GL_DYNAMIC_COPY);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+	// baseInstance selects the item, the vertex shader reads its model matrix
+	glGenBuffers(1, &itemIndexBuffer);
+	glBindBuffer(GL_ARRAY_BUFFER, itemIndexBuffer);
+	UBufferData(GL_ARRAY_BUFFER, itemIndices.size() * sizeof(GLuint), itemIndices.data(), GL_STATIC_DRAW);
+
+	for (size_t b = 0; b < batches.size(); ++b)
+	{
+		glBindVertexArray(batches[b].vao);
+		glVertexAttribIPointer(itemIndexLocation, 1, GL_UNSIGNED_INT, sizeof(GLuint), 0);
+		glVertexAttribDivisor(itemIndexLocation, 1);
+		glEnableVertexAttribArray(itemIndexLocation);
+	}
+
+	glBindVertexArray(0);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+// Uploads the model matrix of the items that move every frame
+void GpuCuller::UpdateTransforms(const vector<DrawItem>& items)
+{
+	if (itemBuffer == 0)
+		return;
+
+	UGLState().BindBuffer(GL_SHADER_STORAGE_BUFFER, itemBuffer);
+
+	for (size_t i = 0; i < items.size() && i < gpuItems.size(); ++i)
+	{
+		if (!items[i].dynamic)
+			continue;
+
+		gpuItems[i].model = items[i].model;
+		UBufferSubData(GL_SHADER_STORAGE_BUFFER, i * sizeof(GpuItem), sizeof(glm::mat4), glm::value_ptr(gpuItems[i].model));
+	}
+
+	UGLState().BindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+}
+
+// Runs the culling pass of a phase and writes its commands and counts
+void GpuCuller::Cull(int phase, const glm::mat4& viewProjection, const glm::vec4 planes[6])
+{
+	if (numItems == 0)
+		return;
+
+	// resets the draw count of every batch of this phase
+	GLuint zero = 0;
+	UGLState().BindBuffer(GL_SHADER_STORAGE_BUFFER, countBuffer);
+	glClearBufferSubData(GL_SHADER_STORAGE_BUFFER, GL_R32UI, phase * batches.size() * sizeof(GLuint), batches.size() * sizeof(GLuint),
+		GL_RED_INTEGER, GL_UNSIGNED_INT, &zero);
+	UGLState().BindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+	UGLState().UseProgram(cullProgramId);
+	UUniformMatrix4fv(glGetUniformLocation(cullProgramId, "viewProjection"), 1, GL_FALSE, glm::value_ptr(viewProjection));
+	UUniform4fv(glGetUniformLocation(cullProgramId, "planes"), 6, glm::value_ptr(planes[0]));
+	UUniform1ui(glGetUniformLocation(cullProgramId, "numItems"), numItems);
+	UUniform1ui(glGetUniformLocation(cullProgramId, "numDraws"), numDraws);
+	UUniform1ui(glGetUniformLocation(cullProgramId, "numBatches"), (GLuint)batches.size());
+	UUniform1ui(glGetUniformLocation(cullProgramId, "phase"), (GLuint)phase);
+	UUniform1i(glGetUniformLocation(cullProgramId, "numLevels"), numLevels);
+
+	UGLState().BindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, itemBuffer);
+	UGLState().BindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, drawBuffer);
+	UGLState().BindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, batchBuffer);
+	UGLState().BindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, commandBuffer);
+	UGLState().BindBufferBase(GL_SHADER_STORAGE_BUFFER, 4, countBuffer);
+	UGLState().BindBufferBase(GL_SHADER_STORAGE_BUFFER, 5, visibilityBuffer);
+
+	UGLState().BindTexture(0, GL_TEXTURE_2D, hiZTexture);
+
+	UDispatchCompute((numItems + 63) / 64, 1, 1);
+
+	// the multi draws read the commands and counts, phase 1 reads the visibility
+	glMemoryBarrier(GL_COMMAND_BARRIER_BIT | GL_SHADER_STORAGE_BARRIER_BIT);
+}
+
+// Draws the commands of a phase, one multi draw per batch
+void GpuCuller::Draw(int phase, GLuint programId)
+{
+	if (numItems == 0)
+		return;
+
+	GLState& state = UGLState();
+	state.UseProgram(programId);
+	GLint multipleTexturesLoc = glGetUniformLocation(programId, "multipleTextures");
+
+	// model matrices for the vertex shader
+	state.BindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, itemBuffer);
+	state.BindBuffer(GL_DRAW_INDIRECT_BUFFER, commandBuffer);
+	state.BindBuffer(GL_PARAMETER_BUFFER_ARB, countBuffer);
+
+	for (size_t b = 0; b < batches.size(); ++b)
+	{
+		const Batch& batch = batches[b];
+
+		state.BindTexture(0, GL_TEXTURE_2D, batch.texture);
+
+		if (batch.textureExtra != 0)
+			state.BindTexture(9, GL_TEXTURE_2D, batch.textureExtra); // unit 9 must match uTextureExtra
+
+		UUniform1i(multipleTexturesLoc, batch.extraTexture);
+		state.BindVertexArray(batch.vao);
+
+		const void* commands = (const void*)((size_t)(phase * numDraws + batch.firstCommand) * commandSize);
+		GLintptr count = (GLintptr)((phase * batches.size() + b) * sizeof(GLuint));
+
+		if (batch.indexed)
+			UMultiDrawElementsIndirectCount(batch.mode, GL_UNSIGNED_INT, commands, count, batch.numCommands, commandSize);
+		else
+			UMultiDrawArraysIndirectCount(batch.mode, commands, count, batch.numCommands, commandSize);
+	}
+
+	state.BindVertexArray(0);
+	state.BindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+	state.BindBuffer(GL_PARAMETER_BUFFER_ARB, 0);
+}
+
+// Builds the pyramid from a depth texture of the pyramid's size
+void GpuCuller::BuildHiZ(GLuint depthTexture)
+{
+	UGLState().UseProgram(hiZProgramId);
+	GLint copyDepthLoc = glGetUniformLocation(hiZProgramId, "copyDepth");
+	GLint reverseDepthLoc = glGetUniformLocation(hiZProgramId, "reverseDepth");
+
+	UGLState().BindTexture(0, GL_TEXTURE_2D, depthTexture);
+
+	UUniform1i(copyDepthLoc, 1);
+	UUniform1i(reverseDepthLoc, reverseDepth);
+	glBindImageTexture(1, hiZTexture, 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_R32F);
+	UDispatchCompute((width + 7) / 8, (height + 7) / 8, 1);
+
+	UUniform1i(copyDepthLoc, 0);
+	for (int level = 1; level < numLevels; ++level)
+	{
+		int levelWidth = max(1, width >> level);
+		int levelHeight = max(1, height >> level);
+
+		glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+		glBindImageTexture(0, hiZTexture, level - 1, GL_FALSE, 0, GL_READ_ONLY, GL_R32F);
+		glBindImageTexture(1, hiZTexture, level, GL_FALSE, 0, GL_WRITE_ONLY, GL_R32F);
+		UDispatchCompute((levelWidth + 7) / 8, (levelHeight + 7) / 8, 1);
+	}
+
+	// the culling pass fetches from the pyramid
+	glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT);
+	UGLState().BindTexture(0, GL_TEXTURE_2D, 0);
+}
+
+// Allocates the pyramid
+void GpuCuller::UCreateTargets()
+{
+	numLevels = 1;
+	while ((max(width, height) >> numLevels) > 0)
+		++numLevels;
+
+	glGenTextures(1, &hiZTexture);
+	UGLState().BindTexture(0, GL_TEXTURE_2D, hiZTexture);
+	glTexStorage2D(GL_TEXTURE_2D, numLevels, GL_R32F, width, height);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+
+	// nothing is drawn yet, so nothing is occluded on the first frame
+	GLfloat farDepth = 1.0f;
+	for (int level = 0; level < numLevels; ++level)
+		glClearTexImage(hiZTexture, level, GL_RED, GL_FLOAT, &farDepth);
+	UGLState().BindTexture(0, GL_TEXTURE_2D, 0);
+}
+
+// Frees the pyramid
+void GpuCuller::UDestroyTargets()
+{
+	UGLState().DeleteTextures(1, &hiZTexture);
+	hiZTexture = 0;
+}
+
+// Frees the item, draw and command buffers
+void GpuCuller::UDestroyBuffers()
+{
+	GLuint buffers[] = { itemBuffer, drawBuffer, batchBuffer, commandBuffer, countBuffer, visibilityBuffer, itemIndexBuffer };
+	UGLState().DeleteBuffers(sizeof(buffers) / sizeof(buffers[0]), buffers);
+	itemBuffer = drawBuffer = batchBuffer = commandBuffer = countBuffer = visibilityBuffer = itemIndexBuffer = 0;
+}
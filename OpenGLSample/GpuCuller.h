@@ -0,0 +1,98 @@
+#pragma once
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+#include <vector>
+
+#include "DrawItem.h"
+
+// GPU driven culling. A compute pass tests every item against the view
+// frustum and a hierarchical-Z pyramid, then writes the survivors as
+// indirect draw commands grouped in batches that share VAO, primitive type
+// and textures. Each batch is one glMultiDraw*IndirectCount call, so the
+// CPU never looks at per-item visibility.
+//
+// A frame runs two phases. Phase 0 tests against the pyramid built from the
+// previous frame's depth and draws what passes. The pyramid is then rebuilt
+// straight from the pass's depth texture, which the compute shader samples,
+// and phase 1 draws the items that phase 0 rejected but are visible now.
+class GpuCuller
+{
+public:
+	static const GLuint itemIndexLocation = 3; // per draw attribute fed by baseInstance
+
+	int width = 0; // pyramid level 0 size, matches the framebuffer
+	int height = 0;
+	int numLevels = 0;
+	bool reverseDepth = false; // depth textures store 1 - depth, the pyramid keeps standard depth
+
+public:
+	bool Create(int width, int height);
+	void Destroy();
+	bool Resize(int width, int height);
+
+	void Upload(const std::vector<DrawItem>& items);
+	void UpdateTransforms(const std::vector<DrawItem>& items);
+	void Cull(int phase, const glm::mat4& viewProjection, const glm::vec4 planes[6]);
+	void Draw(int phase, GLuint programId);
+	void BuildHiZ(GLuint depthTexture);
+
+private:
+	// std430 mirrors of the compute shader structs
+	struct GpuItem
+	{
+		glm::mat4 model;
+		glm::vec4 boundsMin;
+		glm::vec4 boundsMax;
+		GLuint firstDraw;
+		GLuint numDraws;
+		GLuint padding[2];
+	};
+
+	struct GpuDraw
+	{
+		GLuint batch;
+		GLuint count;
+		GLuint first;
+		GLuint indexed;
+	};
+
+	// draws that go through one multi draw call
+	struct Batch
+	{
+		GLuint vao;
+		bool indexed;
+		GLenum mode;
+		GLuint texture;
+		GLuint textureExtra;
+		bool extraTexture;
+		GLuint firstCommand; // offset in the command buffer of each phase
+		GLuint numCommands; // worst case, every draw of the batch visible
+	};
+
+	// 5 uints, fits both the elements and the arrays command
+	static const GLuint commandSize = 5 * sizeof(GLuint);
+
+	GLuint cullProgramId = 0;
+	GLuint hiZProgramId = 0;
+
+	GLuint hiZTexture = 0; // r32f, farthest depth per texel on every level
+
+	GLuint itemBuffer = 0;
+	GLuint drawBuffer = 0;
+	GLuint batchBuffer = 0;
+	GLuint commandBuffer = 0;
+	GLuint countBuffer = 0;
+	GLuint visibilityBuffer = 0;
+	GLuint itemIndexBuffer = 0; // 0..n-1, read with divisor 1 at baseInstance
+
+	std::vector<GpuItem> gpuItems;
+	std::vector<Batch> batches;
+	GLuint numItems = 0;
+	GLuint numDraws = 0;
+
+	void UCreateTargets();
+	void UDestroyTargets();
+	void UDestroyBuffers();
+};
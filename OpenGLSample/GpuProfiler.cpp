@@ -0,0 +1,197 @@
+#include <iostream>
+#include <cstring>
+#include <algorithm>
+#include "GpuProfiler.h"
+
+using namespace std;
+
+const int GpuProfiler::historySize;
+
+// framesInFlight frames are queued before the oldest one is read back
+bool GpuProfiler::Create(int framesInFlight)
+{
+	if (framesInFlight < 2)
+	{
+		cout << "ERROR::GPUPROFILER::TOO_FEW_FRAMES " << framesInFlight << endl;
+		return false;
+	}
+
+	frames.resize(framesInFlight);
+	for (Frame& frame : frames)
+	{
+		frame.queries.resize(maxRegionsPerFrame * 2);
+		glGenQueries((GLsizei)frame.queries.size(), frame.queries.data());
+		frame.numSamples = 0;
+		frame.numQueries = 0;
+		frame.tag = -1;
+		frame.pending = false;
+	}
+
+	regions.reserve(maxRegionsPerFrame);
+	currentFrame = 0;
+	depth = 0;
+	created = true;
+	return true;
+}
+
+void GpuProfiler::Destroy()
+{
+	for (Frame& frame : frames)
+		glDeleteQueries((GLsizei)frame.queries.size(), frame.queries.data());
+
+	frames.clear();
+	regions.clear();
+	created = false;
+}
+
+// Reads back the frame that used this slot before and opens the frame
+// region. The tag comes back in frameTag with the times of this frame.
+void GpuProfiler::BeginFrame(int tag)
+{
+	if (!created)
+		return;
+
+	Frame& frame = frames[currentFrame];
+	if (frame.pending)
+		UReadBack(frame);
+
+	frame.numSamples = 0;
+	frame.numQueries = 0;
+	frame.tag = tag;
+	frame.pending = false;
+	depth = 0;
+	numDropped = 0;
+
+	Begin("Frame");
+}
+
+void GpuProfiler::EndFrame()
+{
+	if (!created)
+		return;
+
+	// regions left open end with the frame
+	while (depth > 0)
+		End();
+
+	frames[currentFrame].pending = frames[currentFrame].numQueries > 0;
+	currentFrame = (currentFrame + 1) % (int)frames.size();
+}
+
+void GpuProfiler::Begin(const char* name)
+{
+	if (!created)
+		return;
+
+	// nested past the stack, counted so End() stays balanced
+	if (depth == maxRegionsPerFrame)
+	{
+		++numDropped;
+		return;
+	}
+
+	Frame& frame = frames[currentFrame];
+	if (frame.numSamples == maxRegionsPerFrame)
+	{
+		// counted so End() stays balanced, but not timed
+		openSamples[depth++] = -1;
+		return;
+	}
+
+	Sample& sample = frame.samples[frame.numSamples];
+	sample.region = UFindRegion(name, depth);
+	sample.beginQuery = frame.numQueries++;
+	sample.endQuery = -1;
+	glQueryCounter(frame.queries[sample.beginQuery], GL_TIMESTAMP);
+
+	openSamples[depth++] = frame.numSamples++;
+}
+
+void GpuProfiler::End()
+{
+	if (!created || depth == 0)
+		return;
+
+	if (numDropped > 0)
+	{
+		--numDropped;
+		return;
+	}
+
+	int index = openSamples[--depth];
+	if (index < 0)
+		return;
+
+	Frame& frame = frames[currentFrame];
+	Sample& sample = frame.samples[index];
+	sample.endQuery = frame.numQueries++;
+	glQueryCounter(frame.queries[sample.endQuery], GL_TIMESTAMP);
+}
+
+// The GPU finishes queries in order, so once the last one is available all are.
+// A driver running further behind than the ring skips the frame instead of waiting.
+void GpuProfiler::UReadBack(Frame& frame)
+{
+	GLint available = 0;
+	glGetQueryObjectiv(frame.queries[frame.numQueries - 1], GL_QUERY_RESULT_AVAILABLE, &available);
+	if (!available)
+		return;
+
+	for (int i = 0; i < frame.numSamples; ++i)
+	{
+		if (frame.samples[i].endQuery >= 0)
+			regions[frame.samples[i].region].frameSumMs = 0.0f;
+	}
+
+	for (int i = 0; i < frame.numSamples; ++i)
+	{
+		const Sample& sample = frame.samples[i];
+		if (sample.endQuery < 0)
+			continue;
+
+		GLuint64 begin = 0, end = 0;
+		glGetQueryObjectui64v(frame.queries[sample.beginQuery], GL_QUERY_RESULT, &begin);
+		glGetQueryObjectui64v(frame.queries[sample.endQuery], GL_QUERY_RESULT, &end);
+		regions[sample.region].frameSumMs += (float)((double)(end - begin) / 1.0e6);
+	}
+
+	for (int i = 0; i < frame.numSamples; ++i)
+	{
+		Region& region = regions[frame.samples[i].region];
+		if (region.frameSumMs < 0.0f)
+			continue;
+
+		region.lastMs = region.frameSumMs;
+		region.frameSumMs = -1.0f;
+
+		// rolling mean over the newest samples
+		region.history[region.nextSample] = region.lastMs;
+		region.nextSample = (region.nextSample + 1) % historySize;
+		region.numSamples = min(region.numSamples + 1, historySize);
+
+		float sum = 0.0f;
+		for (int s = 0; s < region.numSamples; ++s)
+			sum += region.history[s];
+		region.averageMs = sum / region.numSamples;
+	}
+
+	frameMs = regions[0].lastMs;
+	frameTag = frame.tag;
+}
+
+// Regions are identified by name and depth, new ones are added in the order they first ran
+int GpuProfiler::UFindRegion(const char* name, int depth)
+{
+	for (size_t i = 0; i < regions.size(); ++i)
+	{
+		if (regions[i].depth == depth && (regions[i].name == name || strcmp(regions[i].name, name) == 0))
+			return (int)i;
+	}
+
+	Region region = {};
+	region.name = name;
+	region.depth = depth;
+	region.frameSumMs = -1.0f;
+	regions.push_back(region);
+	return (int)regions.size() - 1;
+}
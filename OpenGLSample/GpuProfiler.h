@@ -0,0 +1,75 @@
+#pragma once
+
+#include <GL/glew.h>
+
+#include <vector>
+
+// GPU time per region of a frame from timestamp queries. Every region
+// writes a timestamp at its start and end, so regions may nest. The queries
+// of a frame are read back framesInFlight frames later, when the GPU has
+// long finished them, so profiling never waits on the pipeline. Every
+// frame is one region of its own, the first one. A region running several
+// times in a frame counts once with the sum of its times.
+class GpuProfiler
+{
+public:
+	static const int maxRegionsPerFrame = 64;
+	static const int historySize = 60; // frames in the rolling average
+
+	struct Region
+	{
+		const char* name; // string literals, compared by address first
+		int depth; // nesting level, 0 for the frame
+		float lastMs; // newest frame that contained the region
+		float averageMs; // over the last historySize frames that contained it
+		float frameSumMs; // regions running several times a frame add up, -1 once stored
+		float history[historySize];
+		int numSamples;
+		int nextSample;
+	};
+
+	float frameMs = 0.0f; // GPU time of the newest frame read back
+	int frameTag = -1; // tag BeginFrame() was given for that frame
+
+public:
+	bool Create(int framesInFlight);
+	void Destroy();
+
+	void BeginFrame(int tag = -1);
+	void EndFrame();
+
+	void Begin(const char* name);
+	void End();
+
+	const std::vector<Region>& Regions() const { return regions; }
+
+private:
+	struct Sample
+	{
+		int region;
+		int beginQuery;
+		int endQuery;
+	};
+
+	// queries of one frame, reused once it was read back
+	struct Frame
+	{
+		std::vector<GLuint> queries; // two per region
+		Sample samples[maxRegionsPerFrame];
+		int numSamples;
+		int numQueries;
+		int tag;
+		bool pending;
+	};
+
+	std::vector<Frame> frames;
+	int currentFrame = 0;
+	std::vector<Region> regions;
+	int openSamples[maxRegionsPerFrame]; // stack of samples still open
+	int depth = 0;
+	int numDropped = 0; // regions begun past the stack, still to end
+	bool created = false;
+
+	void UReadBack(Frame& frame);
+	int UFindRegion(const char* name, int depth);
+};
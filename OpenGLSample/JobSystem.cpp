@@ -0,0 +1,293 @@
+#include <iostream>
+#include "JobSystem.h"
+#include "CpuProfiler.h"
+
+using namespace std;
+
+namespace
+{
+	// index of the calling thread in the job system, -1 outside of it
+	thread_local int tlsThreadIndex = -1;
+
+	// empty polls before an idle worker goes to sleep
+	const int spinsBeforeSleep = 256;
+}
+
+// Starts numThreads - 1 workers, the calling thread is thread 0
+bool JobSystem::Create(int numThreads)
+{
+	if (numThreads <= 0)
+	{
+		cout << "ERROR::JOBSYSTEM::INVALID_THREAD_COUNT " << numThreads << endl;
+		return false;
+	}
+
+	this->numThreads = numThreads;
+
+	for (int i = 0; i < numThreads; ++i)
+	{
+		threads.push_back(unique_ptr<ThreadData>(new ThreadData()));
+		threads.back()->jobs.reset(new Job[jobsPerThread]);
+		threads.back()->arena.Create(arenaSize);
+		threads.back()->random = 0x9E3779B9u * (i + 1);
+	}
+
+	tlsThreadIndex = 0;
+	running = true;
+
+	for (int i = 1; i < numThreads; ++i)
+		workers.emplace_back(&JobSystem::UWorkerLoop, this, i);
+
+	return true;
+}
+
+// Stops the workers, jobs still queued are dropped
+void JobSystem::Destroy()
+{
+	{
+		lock_guard<mutex> lock(sleepMutex);
+		running = false;
+	}
+	wake.notify_all();
+
+	for (thread& worker : workers)
+		worker.join();
+
+	workers.clear();
+	threads.clear();
+	tlsThreadIndex = -1;
+	numThreads = 1;
+}
+
+// job runs only after dependency finished. Call before running either of them.
+void JobSystem::AddDependency(Job* job, Job* dependency)
+{
+	int index = dependency->numContinuations.fetch_add(1);
+	if (index >= maxContinuations)
+	{
+		// out of slots, the job does not wait
+		dependency->numContinuations.fetch_sub(1);
+		cout << "ERROR::JOBSYSTEM::TOO_MANY_CONTINUATIONS" << endl;
+		return;
+	}
+
+	job->pendingDependencies.fetch_add(1);
+	dependency->continuations[index] = job;
+}
+
+// Queues a job on the calling thread once its dependencies finished
+void JobSystem::Run(Job* job)
+{
+	if (job->pendingDependencies.fetch_sub(1) != 1)
+		return;
+
+	int index = UThreadIndex();
+
+	// a full deque or a thread outside the system runs the job right away
+	if (index < 0 || !threads[index]->deque.Push(job))
+	{
+		UExecute(job);
+		return;
+	}
+
+	numQueued.fetch_add(1);
+	if (numSleeping.load() > 0)
+	{
+		lock_guard<mutex> lock(sleepMutex);
+		wake.notify_one();
+	}
+}
+
+// Runs other jobs until job and its children finished
+void JobSystem::Wait(Job* job)
+{
+	while (job->unfinished.load() > 0)
+	{
+		Job* next = UGetJob();
+		if (next != nullptr)
+			UExecute(next);
+		else
+			this_thread::yield();
+	}
+}
+
+Arena& JobSystem::ThreadArena()
+{
+	return threads[UThreadIndex()]->arena;
+}
+
+// Call between frames, when no job is running
+void JobSystem::ResetThreadArenas()
+{
+	for (unique_ptr<ThreadData>& data : threads)
+		data->arena.Reset();
+}
+
+JobSystem::Job* JobSystem::UAllocateJob(Job* parent)
+{
+	ThreadData& data = *threads[UThreadIndex()];
+
+	// the ring is large enough for every job of a frame
+	Job* job = &data.jobs[data.nextJob++ & (jobsPerThread - 1)];
+	job->function = nullptr;
+	job->parent = parent;
+	job->unfinished.store(1);
+	job->pendingDependencies.store(1);
+	job->numContinuations.store(0);
+
+	if (parent != nullptr)
+		parent->unfinished.fetch_add(1);
+
+	return job;
+}
+
+// Own deque first, then steals from the others starting at a random one
+JobSystem::Job* JobSystem::UGetJob()
+{
+	int index = UThreadIndex();
+	if (index < 0)
+		return nullptr;
+
+	ThreadData& data = *threads[index];
+	Job* job = data.deque.Pop();
+
+	if (job == nullptr)
+	{
+		data.random ^= data.random << 13;
+		data.random ^= data.random >> 17;
+		data.random ^= data.random << 5;
+
+		int first = (int)(data.random % (uint32_t)numThreads);
+		for (int i = 0; i < numThreads && job == nullptr; ++i)
+		{
+			int victim = (first + i) % numThreads;
+			if (victim != index)
+				job = threads[victim]->deque.Steal();
+		}
+	}
+
+	if (job != nullptr)
+		numQueued.fetch_sub(1);
+
+	return job;
+}
+
+void JobSystem::UExecute(Job* job)
+{
+	CPU_PROFILE_SCOPE("Job");
+	job->function(*job);
+	UFinish(job);
+}
+
+// Finishes the parent with its last child and releases the continuations
+void JobSystem::UFinish(Job* job)
+{
+	// a waiting thread may reuse the job as soon as it finished, read it first
+	Job* parent = job->parent;
+	Job* continuations[maxContinuations];
+	int numContinuations = job->numContinuations.load();
+	for (int i = 0; i < numContinuations; ++i)
+		continuations[i] = job->continuations[i];
+
+	if (job->unfinished.fetch_sub(1) != 1)
+		return;
+
+	if (parent != nullptr)
+		UFinish(parent);
+
+	for (int i = 0; i < numContinuations; ++i)
+		Run(continuations[i]);
+}
+
+void JobSystem::UWorkerLoop(int index)
+{
+	tlsThreadIndex = index;
+	int idleSpins = 0;
+	CPU_PROFILE_THREAD("Job Worker");
+
+	while (running.load())
+	{
+		Job* job = UGetJob();
+		if (job != nullptr)
+		{
+			UExecute(job);
+			idleSpins = 0;
+			continue;
+		}
+
+		if (++idleSpins < spinsBeforeSleep)
+		{
+			this_thread::yield();
+			continue;
+		}
+
+		// nothing queued anywhere, sleep until Run() or Destroy()
+		unique_lock<mutex> lock(sleepMutex);
+		numSleeping.fetch_add(1);
+		wake.wait(lock, [this] { return !running.load() || numQueued.load() > 0; });
+		numSleeping.fetch_sub(1);
+		idleSpins = 0;
+	}
+}
+
+int JobSystem::UThreadIndex() const
+{
+	return tlsThreadIndex < (int)threads.size() ? tlsThreadIndex : -1;
+}
+
+// Owner only
+bool JobSystem::Deque::Push(Job* job)
+{
+	int64_t b = bottom.load(memory_order_relaxed);
+	int64_t t = top.load(memory_order_acquire);
+	if (b - t >= capacity)
+		return false;
+
+	jobs[b & (capacity - 1)].store(job, memory_order_relaxed);
+	bottom.store(b + 1, memory_order_release);
+	return true;
+}
+
+// Owner only, takes the newest job
+JobSystem::Job* JobSystem::Deque::Pop()
+{
+	int64_t b = bottom.load(memory_order_relaxed) - 1;
+	bottom.store(b, memory_order_relaxed);
+	atomic_thread_fence(memory_order_seq_cst);
+	int64_t t = top.load(memory_order_relaxed);
+
+	if (t > b)
+	{
+		// empty
+		bottom.store(b + 1, memory_order_relaxed);
+		return nullptr;
+	}
+
+	Job* job = jobs[b & (capacity - 1)].load(memory_order_relaxed);
+	if (t == b)
+	{
+		// last job, race the thieves for it
+		if (!top.compare_exchange_strong(t, t + 1, memory_order_seq_cst, memory_order_relaxed))
+			job = nullptr;
+		bottom.store(b + 1, memory_order_relaxed);
+	}
+
+	return job;
+}
+
+// Any thread, takes the oldest job
+JobSystem::Job* JobSystem::Deque::Steal()
+{
+	int64_t t = top.load(memory_order_acquire);
+	atomic_thread_fence(memory_order_seq_cst);
+	int64_t b = bottom.load(memory_order_acquire);
+
+	if (t >= b)
+		return nullptr;
+
+	Job* job = jobs[t & (capacity - 1)].load(memory_order_relaxed);
+	if (!top.compare_exchange_strong(t, t + 1, memory_order_seq_cst, memory_order_relaxed))
+		return nullptr;
+
+	return job;
+}
@@ -0,0 +1,164 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <thread>
+#include <vector>
+
+#include "Arena.h"
+
+// Work stealing job system. Every thread owns a deque of jobs: it pushes and
+// pops its own end without locks while idle threads steal from the other
+// end. The thread calling Create() becomes thread 0 and runs jobs while it
+// waits. Jobs have a parent, which finishes once all its children did, and
+// dependencies, which hold a job back until the jobs it depends on finished.
+// Jobs come from a ring per thread, so creating one never allocates; only
+// threads of the system create jobs, ParallelFor runs inline elsewhere.
+// Every thread also owns an arena for the scratch memory of its jobs.
+class JobSystem
+{
+public:
+	static const int maxContinuations = 8; // jobs waiting on one job
+	static const int payloadSize = 64; // bytes of captured state per job
+	static const size_t arenaSize = 256 * 1024; // initial scratch bytes per thread
+
+	struct Job
+	{
+		void (*function)(Job& job);
+		Job* parent;
+		std::atomic<int> unfinished; // this job plus its unfinished children
+		std::atomic<int> pendingDependencies; // unfinished dependencies, plus 1 until Run()
+		Job* continuations[maxContinuations];
+		std::atomic<int> numContinuations;
+		alignas(16) unsigned char payload[payloadSize];
+	};
+
+	int numThreads = 1; // workers plus the creating thread
+
+public:
+	bool Create(int numThreads);
+	void Destroy();
+
+	template<typename Function>
+	Job* CreateJob(const Function& function, Job* parent = nullptr);
+	void AddDependency(Job* job, Job* dependency);
+	void Run(Job* job);
+	void Wait(Job* job);
+
+	// Scratch memory of the calling thread, which must belong to the system.
+	// It is valid until ResetThreadArenas().
+	Arena& ThreadArena();
+	void ResetThreadArenas();
+
+	// Calls function(begin, end) over [0, count) in chunks of at least grainSize
+	template<typename Function>
+	void ParallelFor(size_t count, size_t grainSize, const Function& function);
+
+private:
+	// Chase-Lev deque, the owner pushes and pops at the bottom, thieves take the top
+	class Deque
+	{
+	public:
+		static const int64_t capacity = 4096; // power of two
+
+		bool Push(Job* job);
+		Job* Pop();
+		Job* Steal();
+
+	private:
+		std::atomic<int64_t> top{ 0 };
+		std::atomic<int64_t> bottom{ 0 };
+		std::atomic<Job*> jobs[capacity];
+	};
+
+	// one per thread, jobs are reused in a ring
+	struct ThreadData
+	{
+		Deque deque;
+		std::unique_ptr<Job[]> jobs;
+		size_t nextJob = 0;
+		Arena arena;
+		uint32_t random = 0; // victim selection
+	};
+
+	static const size_t jobsPerThread = 4096;
+
+	std::vector<std::unique_ptr<ThreadData>> threads;
+	std::vector<std::thread> workers;
+	std::atomic<bool> running{ false };
+	std::atomic<int> numQueued{ 0 };
+	std::atomic<int> numSleeping{ 0 };
+	std::mutex sleepMutex;
+	std::condition_variable wake;
+
+	Job* UAllocateJob(Job* parent);
+	Job* UGetJob();
+	void UExecute(Job* job);
+	void UFinish(Job* job);
+	void UWorkerLoop(int index);
+	int UThreadIndex() const;
+};
+
+// Copies the callable into the job, it is destroyed after it ran
+template<typename Function>
+JobSystem::Job* JobSystem::CreateJob(const Function& function, Job* parent)
+{
+	static_assert(sizeof(Function) <= payloadSize, "job captures too much state");
+	static_assert(alignof(Function) <= 16, "job captures over aligned state");
+
+	Job* job = UAllocateJob(parent);
+	new (job->payload) Function(function);
+	job->function = [](Job& job)
+	{
+		Function& callable = *reinterpret_cast<Function*>(job.payload);
+		callable();
+		callable.~Function();
+	};
+
+	return job;
+}
+
+template<typename Function>
+void JobSystem::ParallelFor(size_t count, size_t grainSize, const Function& function)
+{
+	if (count == 0)
+		return;
+
+	// small ranges and threads outside the system run inline
+	if (numThreads <= 1 || count <= grainSize || UThreadIndex() < 0)
+	{
+		function(0, count);
+		return;
+	}
+
+	// a few chunks per thread leaves room for stealing without flooding the deques
+	size_t maxChunks = (size_t)numThreads * 4;
+	size_t chunkSize = std::max(std::max(grainSize, (size_t)1), (count + maxChunks - 1) / maxChunks);
+
+	Job* root = CreateJob([]() {});
+	const Function* body = &function;
+
+	for (size_t begin = 0; begin < count; begin += chunkSize)
+	{
+		size_t end = std::min(begin + chunkSize, count);
+		Run(CreateJob([body, begin, end]() { (*body)(begin, end); }, root));
+	}
+
+	Run(root);
+	Wait(root);
+}
+
+// Runs the loop on the job system when there is one, inline otherwise
+template<typename Function>
+void UParallelFor(JobSystem* jobs, size_t count, size_t grainSize, const Function& function)
+{
+	if (jobs != nullptr)
+		jobs->ParallelFor(count, grainSize, function);
+	else if (count > 0)
+		function(0, count);
+}
@@ -0,0 +1,367 @@
+#include <iostream>
+#include <cstdlib>
+#include <cstring>
+#include "JsonDocument.h"
+
+using namespace std;
+
+namespace
+{
+	int UHexDigit(char c)
+	{
+		if (c >= '0' && c <= '9')
+			return c - '0';
+		if (c >= 'a' && c <= 'f')
+			return c - 'a' + 10;
+		if (c >= 'A' && c <= 'F')
+			return c - 'A' + 10;
+		return -1;
+	}
+
+	// Four hex digits of a \u escape, -1 when malformed
+	int UCodeUnit(const char* digits, const char* end)
+	{
+		if (end - digits < 4)
+			return -1;
+
+		int unit = 0;
+		for (int i = 0; i < 4; ++i)
+		{
+			int digit = UHexDigit(digits[i]);
+			if (digit < 0)
+				return -1;
+			unit = unit * 16 + digit;
+		}
+		return unit;
+	}
+
+	void UAppendUtf8(string& text, uint32_t codePoint)
+	{
+		if (codePoint < 0x80)
+			text += (char)codePoint;
+		else if (codePoint < 0x800)
+		{
+			text += (char)(0xC0 | (codePoint >> 6));
+			text += (char)(0x80 | (codePoint & 0x3F));
+		}
+		else if (codePoint < 0x10000)
+		{
+			text += (char)(0xE0 | (codePoint >> 12));
+			text += (char)(0x80 | ((codePoint >> 6) & 0x3F));
+			text += (char)(0x80 | (codePoint & 0x3F));
+		}
+		else
+		{
+			text += (char)(0xF0 | (codePoint >> 18));
+			text += (char)(0x80 | ((codePoint >> 12) & 0x3F));
+			text += (char)(0x80 | ((codePoint >> 6) & 0x3F));
+			text += (char)(0x80 | (codePoint & 0x3F));
+		}
+	}
+}
+
+bool JsonDocument::Parse(const char* text, size_t length)
+{
+	this->text = text;
+	this->length = length;
+	position = 0;
+	values.clear();
+	children.clear();
+	stack.clear();
+
+	if (length >= UINT32_MAX)
+		return UError("TEXT_TOO_LARGE");
+
+	if (!UParseValue(0))
+	{
+		values.clear();
+		children.clear();
+		return false;
+	}
+
+	USkipWhitespace();
+	if (position != length)
+	{
+		values.clear();
+		children.clear();
+		return UError("TRAILING_CHARACTERS");
+	}
+
+	return true;
+}
+
+JsonDocument::Type JsonDocument::GetType(int value) const
+{
+	return value >= 0 ? values[value].type : JSON_NULL;
+}
+
+size_t JsonDocument::Size(int value) const
+{
+	Type type = GetType(value);
+	return type == JSON_ARRAY || type == JSON_OBJECT ? values[value].size : 0;
+}
+
+int JsonDocument::Element(int array, size_t index) const
+{
+	if (GetType(array) != JSON_ARRAY || index >= values[array].size)
+		return -1;
+
+	return (int)children[values[array].first + index];
+}
+
+// Member names are compared as written, glTF names need no escapes
+int JsonDocument::Member(int object, const char* name) const
+{
+	if (GetType(object) != JSON_OBJECT)
+		return -1;
+
+	size_t nameLength = strlen(name);
+	const Value& parent = values[object];
+	for (uint32_t i = 0; i < parent.size; ++i)
+	{
+		uint32_t child = children[parent.first + i];
+		const Value& member = values[child];
+		if (member.keyLength == nameLength && memcmp(text + member.key, name, nameLength) == 0)
+			return (int)child;
+	}
+
+	return -1;
+}
+
+double JsonDocument::Number(int value, double fallback) const
+{
+	return GetType(value) == JSON_NUMBER ? values[value].number : fallback;
+}
+
+int JsonDocument::Int(int value, int fallback) const
+{
+	return GetType(value) == JSON_NUMBER ? (int)values[value].number : fallback;
+}
+
+bool JsonDocument::Bool(int value, bool fallback) const
+{
+	return GetType(value) == JSON_BOOL ? values[value].number != 0.0 : fallback;
+}
+
+bool JsonDocument::String(int value, string& result) const
+{
+	result.clear();
+	if (GetType(value) != JSON_STRING)
+		return false;
+
+	const char* begin = text + values[value].text;
+	const char* end = begin + values[value].length;
+	result.reserve(values[value].length);
+
+	for (const char* c = begin; c < end; ++c)
+	{
+		if (*c != '\\')
+		{
+			result += *c;
+			continue;
+		}
+
+		// the parser made sure an escaped character follows
+		++c;
+		switch (*c)
+		{
+		case 'b': result += '\b'; break;
+		case 'f': result += '\f'; break;
+		case 'n': result += '\n'; break;
+		case 'r': result += '\r'; break;
+		case 't': result += '\t'; break;
+		case 'u':
+		{
+			int unit = UCodeUnit(c + 1, end);
+			if (unit < 0)
+				return false;
+			c += 4;
+
+			uint32_t codePoint = (uint32_t)unit;
+			// a high surrogate pairs with the low one after it
+			if (unit >= 0xD800 && unit < 0xDC00 && end - c > 6 && c[1] == '\\' && c[2] == 'u')
+			{
+				int low = UCodeUnit(c + 3, end);
+				if (low >= 0xDC00 && low < 0xE000)
+				{
+					codePoint = 0x10000 + (((uint32_t)unit - 0xD800) << 10) + ((uint32_t)low - 0xDC00);
+					c += 6;
+				}
+			}
+			UAppendUtf8(result, codePoint);
+			break;
+		}
+		default: result += *c; break;
+		}
+	}
+
+	return true;
+}
+
+bool JsonDocument::Equals(int value, const char* name) const
+{
+	if (GetType(value) != JSON_STRING)
+		return false;
+
+	size_t nameLength = strlen(name);
+	return values[value].length == nameLength && memcmp(text + values[value].text, name, nameLength) == 0;
+}
+
+// Appends the value at the current position, its children follow it
+bool JsonDocument::UParseValue(int depth)
+{
+	if (depth > maxDepth)
+		return UError("TOO_DEEP");
+
+	USkipWhitespace();
+	if (position >= length)
+		return UError("UNEXPECTED_END");
+
+	uint32_t index = (uint32_t)values.size();
+	values.push_back(Value());
+	Value value = {};
+	char c = text[position];
+
+	if (c == '{' || c == '[')
+	{
+		bool object = c == '{';
+		char close = object ? '}' : ']';
+		value.type = object ? JSON_OBJECT : JSON_ARRAY;
+		size_t firstOpen = stack.size();
+		++position;
+
+		USkipWhitespace();
+		if (position < length && text[position] == close)
+			++position;
+		else
+		{
+			while (true)
+			{
+				uint32_t key = 0, keyLength = 0;
+				if (object)
+				{
+					USkipWhitespace();
+					if (!UParseString(key, keyLength))
+						return false;
+					USkipWhitespace();
+					if (position >= length || text[position] != ':')
+						return UError("EXPECTED_COLON");
+					++position;
+				}
+
+				uint32_t child = (uint32_t)values.size();
+				if (!UParseValue(depth + 1))
+					return false;
+				values[child].key = key;
+				values[child].keyLength = keyLength;
+				stack.push_back(child);
+
+				USkipWhitespace();
+				if (position < length && text[position] == ',')
+				{
+					++position;
+					continue;
+				}
+				if (position < length && text[position] == close)
+				{
+					++position;
+					break;
+				}
+				return UError(object ? "EXPECTED_COMMA_OR_BRACE" : "EXPECTED_COMMA_OR_BRACKET");
+			}
+		}
+
+		// the children of this container are the top of the stack
+		value.first = (uint32_t)children.size();
+		value.size = (uint32_t)(stack.size() - firstOpen);
+		children.insert(children.end(), stack.begin() + firstOpen, stack.end());
+		stack.resize(firstOpen);
+	}
+	else if (c == '"')
+	{
+		value.type = JSON_STRING;
+		if (!UParseString(value.text, value.length))
+			return false;
+	}
+	else if (c == 't' && length - position >= 4 && memcmp(text + position, "true", 4) == 0)
+	{
+		value.type = JSON_BOOL;
+		value.number = 1.0;
+		position += 4;
+	}
+	else if (c == 'f' && length - position >= 5 && memcmp(text + position, "false", 5) == 0)
+	{
+		value.type = JSON_BOOL;
+		position += 5;
+	}
+	else if (c == 'n' && length - position >= 4 && memcmp(text + position, "null", 4) == 0)
+	{
+		value.type = JSON_NULL;
+		position += 4;
+	}
+	else
+	{
+		value.type = JSON_NUMBER;
+		if (!UParseNumber(value.number))
+			return false;
+	}
+
+	values[index] = value;
+	return true;
+}
+
+// Records where the contents are, String() unescapes them later
+bool JsonDocument::UParseString(uint32_t& offset, uint32_t& count)
+{
+	if (position >= length || text[position] != '"')
+		return UError("EXPECTED_STRING");
+
+	size_t begin = ++position;
+	while (position < length && text[position] != '"')
+	{
+		if ((unsigned char)text[position] < 0x20)
+			return UError("CONTROL_CHARACTER_IN_STRING");
+		position += text[position] == '\\' ? 2 : 1;
+	}
+
+	if (position >= length)
+		return UError("UNTERMINATED_STRING");
+
+	offset = (uint32_t)begin;
+	count = (uint32_t)(position - begin);
+	++position;
+	return true;
+}
+
+bool JsonDocument::UParseNumber(double& number)
+{
+	// strtod needs a terminated copy, the text may end right after the number
+	char digits[64];
+	size_t count = 0;
+	while (position + count < length && count < sizeof(digits) - 1 && strchr("+-0123456789.eE", text[position + count]) != nullptr)
+	{
+		digits[count] = text[position + count];
+		++count;
+	}
+	digits[count] = '\0';
+
+	char* end = nullptr;
+	number = strtod(digits, &end);
+	if (count == 0 || end != digits + count)
+		return UError("INVALID_NUMBER");
+
+	position += count;
+	return true;
+}
+
+void JsonDocument::USkipWhitespace()
+{
+	while (position < length && (text[position] == ' ' || text[position] == '\t' || text[position] == '\n' || text[position] == '\r'))
+		++position;
+}
+
+bool JsonDocument::UError(const char* what)
+{
+	cout << "ERROR::JSON::" << what << " at " << position << endl;
+	return false;
+}
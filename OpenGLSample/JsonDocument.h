@@ -0,0 +1,70 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Read only JSON document. Parse() builds a flat array of values that point
+// back into the text, strings are only unescaped when they are asked for,
+// and the children of every array or object are stored next to each other,
+// so Element() is an index and Member() a scan of the object's own members.
+// Values are referred to by index; -1 is "missing", and every accessor takes
+// it and returns the fallback, so lookups chain without checks in between.
+class JsonDocument
+{
+public:
+	enum Type
+	{
+		JSON_NULL,
+		JSON_BOOL,
+		JSON_NUMBER,
+		JSON_STRING,
+		JSON_ARRAY,
+		JSON_OBJECT
+	};
+
+	static const int maxDepth = 64; // nesting allowed before the text is rejected
+
+public:
+	// The text must outlive the document
+	bool Parse(const char* text, size_t length);
+
+	int Root() const { return values.empty() ? -1 : 0; }
+	Type GetType(int value) const;
+	size_t Size(int value) const; // elements or members, 0 for other types
+	int Element(int array, size_t index) const;
+	int Member(int object, const char* name) const;
+
+	double Number(int value, double fallback = 0.0) const;
+	int Int(int value, int fallback = -1) const;
+	bool Bool(int value, bool fallback = false) const;
+	bool String(int value, std::string& text) const; // unescaped
+	bool Equals(int value, const char* text) const; // raw comparison, for keywords
+
+private:
+	struct Value
+	{
+		Type type;
+		uint32_t first; // arrays and objects: first child in children
+		uint32_t size;
+		uint32_t key; // members: name offset in the text, escapes kept
+		uint32_t keyLength;
+		uint32_t text; // strings: contents offset in the text, escapes kept
+		uint32_t length;
+		double number; // numbers and booleans
+	};
+
+	const char* text = nullptr;
+	size_t length = 0;
+	size_t position = 0;
+	std::vector<Value> values;
+	std::vector<uint32_t> children; // indices into values
+	std::vector<uint32_t> stack; // children of the open containers
+
+	bool UParseValue(int depth);
+	bool UParseString(uint32_t& offset, uint32_t& count);
+	bool UParseNumber(double& number);
+	void USkipWhitespace();
+	bool UError(const char* what);
+};
@@ -0,0 +1,120 @@
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include "LodManager.h"
+
+using namespace std;
+
+namespace
+{
+	// triangles produced by one draw range
+	GLuint UCountTriangles(const DrawRange& range)
+	{
+		if (range.mode == GL_TRIANGLES)
+			return range.count / 3;
+
+		// fans and strips
+		return range.count > 2 ? range.count - 2 : 0;
+	}
+}
+
+// Adds a chain of levels, finest first, and returns its id for DrawItem::lodChain
+int LodManager::Register(const vector<LodLevel>& levels)
+{
+	chains.push_back(levels);
+
+	for (LodLevel& level : chains.back())
+	{
+		level.numTriangles = 0;
+		for (int i = 0; i < level.numRanges; ++i)
+			level.numTriangles += UCountTriangles(level.ranges[i]);
+	}
+
+	return (int)chains.size() - 1;
+}
+
+// Picks the level of every item from its projected error
+void LodManager::Select(vector<DrawItem>& items, const glm::vec3& cameraPosition, float fovY, int viewportHeight)
+{
+	// pixels covered by one world unit at distance 1
+	float pixelsPerUnit = viewportHeight / (2.0f * tan(glm::radians(fovY) * 0.5f));
+	float coarserThreshold = pixelThreshold * (1.0f - hysteresis);
+	float finerThreshold = pixelThreshold * (1.0f + hysteresis);
+	atomic<size_t> selectedTriangles(0);
+
+	UParallelFor(jobs, items.size(), 1024, [&](size_t begin, size_t end)
+	{
+		size_t rangeTriangles = 0;
+
+		for (size_t i = begin; i < end; ++i)
+		{
+			DrawItem& item = items[i];
+			if (item.lodChain < 0)
+				continue;
+
+			const vector<LodLevel>& chain = chains[item.lodChain];
+
+			// distance to the nearest point of the bounding sphere
+			glm::vec3 center = glm::vec3(item.model * glm::vec4(item.bounds.center, 1.0f));
+			float scale = max(glm::length(glm::vec3(item.model[0])), max(glm::length(glm::vec3(item.model[1])), glm::length(glm::vec3(item.model[2]))));
+			float distance = max(glm::length(center - cameraPosition) - item.bounds.radius * scale, 0.1f);
+
+			// projected pixels per local unit of error
+			float errorScale = scale * pixelsPerUnit / distance;
+			int level = min(max(item.lodLevel, 0), (int)chain.size() - 1);
+
+			if (chain[level].error * errorScale > finerThreshold)
+			{
+				// too coarse, step to the first level that fits
+				while (level > 0 && chain[level].error * errorScale > pixelThreshold)
+					--level;
+			}
+			else
+			{
+				// coarser levels only once they are well under the threshold
+				while (level + 1 < (int)chain.size() && chain[level + 1].error * errorScale <= coarserThreshold)
+					++level;
+			}
+
+			UApplyLevel(item, level);
+			rangeTriangles += chain[level].numTriangles;
+		}
+
+		selectedTriangles += rangeTriangles;
+	});
+
+	numTriangles = selectedTriangles;
+}
+
+// Puts every item back on its finest level
+void LodManager::UseFinest(vector<DrawItem>& items)
+{
+	numTriangles = 0;
+
+	for (DrawItem& item : items)
+	{
+		if (item.lodChain < 0)
+			continue;
+
+		UApplyLevel(item, 0);
+		numTriangles += chains[item.lodChain][0].numTriangles;
+	}
+}
+
+// Swaps the geometry of an item, keeping its textures and per range flags
+void LodManager::UApplyLevel(DrawItem& item, int level) const
+{
+	const LodLevel& lod = chains[item.lodChain][level];
+
+	item.lodLevel = level;
+	item.vao = lod.vao;
+	item.indexed = lod.indexed;
+	item.numRanges = lod.numRanges;
+
+	for (int i = 0; i < lod.numRanges; ++i)
+	{
+		item.ranges[i].mode = lod.ranges[i].mode;
+		item.ranges[i].first = lod.ranges[i].first;
+		item.ranges[i].count = lod.ranges[i].count;
+	}
+}
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+#include <vector>
+
+#include "DrawItem.h"
+#include "JobSystem.h"
+
+// One level of detail of a mesh. All levels of a chain use the same range
+// layout, so the item's per range texture flags stay valid.
+struct LodLevel
+{
+	GLuint vao;
+	bool indexed;
+	DrawRange ranges[3];
+	int numRanges;
+	float error; // local space distance to the true surface
+	GLuint numTriangles; // filled in by LodManager::Register
+};
+
+// Screen space error level of detail. Meshes register a chain of levels,
+// finest first. Every frame each item gets the coarsest level whose error,
+// projected at the camera distance and field of view, stays under a pixel
+// threshold. Switching needs a margin in both directions to avoid popping.
+class LodManager
+{
+public:
+	float pixelThreshold = 1.0f; // largest allowed projected error
+	float hysteresis = 0.25f; // fraction of the threshold needed to switch
+	size_t numTriangles = 0; // triangles of the selected levels last frame
+	JobSystem* jobs = nullptr; // splits the selection over cores when set
+
+public:
+	int Register(const std::vector<LodLevel>& levels);
+	void Select(std::vector<DrawItem>& items, const glm::vec3& cameraPosition, float fovY, int viewportHeight);
+	void UseFinest(std::vector<DrawItem>& items);
+	const std::vector<LodLevel>& Levels(int chain) const { return chains[chain]; }
+
+private:
+	std::vector<std::vector<LodLevel>> chains;
+
+	void UApplyLevel(DrawItem& item, int level) const;
+};
@@ -0,0 +1,81 @@
+#include <iostream>
+#include "MappedFile.h"
+
+#if defined(_WIN32)
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+using namespace std;
+
+// Empty files cannot be mapped and fail like missing ones
+bool MappedFile::Map(const char* path)
+{
+	Unmap();
+
+#if defined(_WIN32)
+	file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+	if (file == INVALID_HANDLE_VALUE)
+	{
+		file = nullptr;
+		cout << "ERROR::MAPPEDFILE::CANNOT_OPEN " << path << endl;
+		return false;
+	}
+
+	LARGE_INTEGER fileSize;
+	GetFileSizeEx(file, &fileSize);
+	size = (size_t)fileSize.QuadPart;
+
+	mapping = size > 0 ? CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr) : nullptr;
+	data = mapping != nullptr ? static_cast<const unsigned char*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0)) : nullptr;
+#else
+	int descriptor = open(path, O_RDONLY);
+	if (descriptor < 0)
+	{
+		cout << "ERROR::MAPPEDFILE::CANNOT_OPEN " << path << endl;
+		return false;
+	}
+
+	struct stat status;
+	fstat(descriptor, &status);
+	size = (size_t)status.st_size;
+
+	void* view = size > 0 ? mmap(nullptr, size, PROT_READ, MAP_PRIVATE, descriptor, 0) : MAP_FAILED;
+	data = view != MAP_FAILED ? static_cast<const unsigned char*>(view) : nullptr;
+	close(descriptor);
+#endif
+
+	if (data == nullptr)
+	{
+		cout << "ERROR::MAPPEDFILE::CANNOT_MAP " << path << endl;
+		Unmap();
+		return false;
+	}
+
+	return true;
+}
+
+void MappedFile::Unmap()
+{
+#if defined(_WIN32)
+	if (data != nullptr)
+		UnmapViewOfFile(data);
+	if (mapping != nullptr)
+		CloseHandle(mapping);
+	if (file != nullptr)
+		CloseHandle(file);
+	mapping = nullptr;
+	file = nullptr;
+#else
+	if (data != nullptr)
+		munmap(const_cast<unsigned char*>(data), size);
+#endif
+
+	data = nullptr;
+	size = 0;
+}
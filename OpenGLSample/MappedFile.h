@@ -0,0 +1,30 @@
+#pragma once
+
+#include <cstddef>
+
+// Read only mapping of a whole file. The pages are read in on first touch,
+// so a large file costs address space until it is used, not memory.
+class MappedFile
+{
+public:
+	MappedFile() {}
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+	~MappedFile() { Unmap(); }
+
+	// The data stays valid until Unmap()
+	bool Map(const char* path);
+	void Unmap();
+
+	const unsigned char* Data() const { return data; }
+	size_t Size() const { return size; }
+
+private:
+	const unsigned char* data = nullptr;
+	size_t size = 0;
+
+#if defined(_WIN32)
+	void* file = nullptr;
+	void* mapping = nullptr;
+#endif
+};
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+#include <vector>
+
+// Appends the triangles of one glDraw* call to a flat local space list
+// (3 positions per triangle). Used for CPU ray picking.
+inline void UAppendTriangles(std::vector<glm::vec3>& triangles, const GLfloat* vertexData, size_t floatsPerStride,
+	GLenum mode, GLint first, GLsizei count, const GLuint* indices = nullptr)
+{
+	auto position = [&](GLint i)
+	{
+		GLuint vertex = indices ? indices[first + i] : GLuint(first + i);
+		const GLfloat* p = vertexData + vertex * floatsPerStride;
+		return glm::vec3(p[0], p[1], p[2]);
+	};
+
+	if (mode == GL_TRIANGLES)
+	{
+		for (GLint i = 0; i + 2 < count; i += 3)
+		{
+			triangles.push_back(position(i));
+			triangles.push_back(position(i + 1));
+			triangles.push_back(position(i + 2));
+		}
+	}
+	else if (mode == GL_TRIANGLE_FAN)
+	{
+		for (GLint i = 1; i + 1 < count; ++i)
+		{
+			triangles.push_back(position(0));
+			triangles.push_back(position(i));
+			triangles.push_back(position(i + 1));
+		}
+	}
+	else if (mode == GL_TRIANGLE_STRIP)
+	{
+		for (GLint i = 0; i + 2 < count; ++i)
+		{
+			triangles.push_back(position(i));
+			triangles.push_back(position(i + 1));
+			triangles.push_back(position(i + 2));
+		}
+	}
+}
@@ -0,0 +1,398 @@
+#include <iostream>
+#include <algorithm>
+#include <atomic>
+#include <cfloat>
+#include <cmath>
+#include "OcclusionCuller.h"
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define OCCLUSION_AVX2
+#endif
+
+using namespace std;
+
+// Allocates the depth buffer, the bands run on jobs when there are any
+bool OcclusionCuller::Create(int width, int height, JobSystem* jobs)
+{
+	if (width <= 0 || height <= 0)
+	{
+		cout << "ERROR::OCCLUSION::INVALID_SIZE " << width << "x" << height << endl;
+		return false;
+	}
+
+	// whole tiles only, so a tile row is always one full SIMD load
+	this->width = (width + tileSize - 1) / tileSize * tileSize;
+	this->height = (height + tileSize - 1) / tileSize * tileSize;
+	tilesX = this->width / tileSize;
+	tilesY = this->height / tileSize;
+
+	depth.assign((size_t)this->width * this->height, 1.0f);
+	tileMaxDepth.assign((size_t)tilesX * tilesY, 1.0f);
+
+	// each band is at least one tile row
+	this->jobs = jobs;
+	numBands = max(1, min(jobs != nullptr ? jobs->numThreads : 1, tilesY));
+
+	return true;
+}
+
+// Frees the buffers
+void OcclusionCuller::Destroy()
+{
+	jobs = nullptr;
+	depth.clear();
+	tileMaxDepth.clear();
+	triangles.clear();
+}
+
+// Transforms the occluder triangles to the screen and rasterizes them
+void OcclusionCuller::RenderOccluders(const vector<DrawItem>& items, const glm::mat4& viewProjection)
+{
+	this->viewProjection = viewProjection;
+
+	// clipping splits a triangle in at most two
+	size_t maxTriangles = 0;
+	for (const DrawItem& item : items)
+	{
+		if (item.occluder && item.triangles != nullptr)
+			maxTriangles += item.numTriangles * 2;
+	}
+
+	triangles.resize(maxTriangles);
+	atomic<size_t> numTriangles{ 0 };
+
+	// chunks of items set up into thread scratch, then take a range of the list
+	UParallelFor(jobs, items.size(), 64, [this, &items, &viewProjection, &numTriangles](size_t begin, size_t end)
+	{
+		size_t bound = 0;
+		for (size_t i = begin; i < end; ++i)
+		{
+			if (items[i].occluder && items[i].triangles != nullptr)
+				bound += items[i].numTriangles * 2;
+		}
+
+		if (bound == 0)
+			return;
+
+		// without a job system the only chunk writes the list directly
+		Triangle* setup = jobs != nullptr ? jobs->ThreadArena().AllocateArray<Triangle>(bound) : triangles.data();
+		size_t count = 0;
+
+		for (size_t i = begin; i < end; ++i)
+		{
+			const DrawItem& item = items[i];
+			if (!item.occluder || item.triangles == nullptr)
+				continue;
+
+			glm::mat4 modelViewProjection = viewProjection * item.model;
+			const glm::vec3* local = item.triangles;
+
+			for (size_t v = 0; v < item.numTriangles * 3; v += 3)
+			{
+				UAddClippedTriangle(modelViewProjection * glm::vec4(local[v], 1.0f),
+					modelViewProjection * glm::vec4(local[v + 1], 1.0f),
+					modelViewProjection * glm::vec4(local[v + 2], 1.0f), setup, count);
+			}
+		}
+
+		size_t first = numTriangles.fetch_add(count);
+		if (setup != triangles.data() + first)
+			copy(setup, setup + count, triangles.begin() + first);
+	});
+
+	triangles.resize(numTriangles.load());
+	numOccluderTriangles = triangles.size();
+
+	// bands touch disjoint rows, so they need no locking
+	UParallelFor(jobs, numBands, 1, [this](size_t begin, size_t end)
+	{
+		for (size_t band = begin; band < end; ++band)
+			URasterizeBand((int)band);
+	});
+}
+
+// True when the world box of the item is behind the occluders at every pixel it covers
+bool OcclusionCuller::IsOccluded(const Bounds& bounds, const glm::mat4& model) const
+{
+	glm::vec3 worldMin, worldMax;
+	UTransformBounds(bounds, model, worldMin, worldMax);
+
+	float minX = FLT_MAX, minY = FLT_MAX;
+	float maxX = -FLT_MAX, maxY = -FLT_MAX;
+	float nearest = FLT_MAX;
+
+	// corners are the projected center plus or minus the projected half axes
+	glm::vec3 extent = (worldMax - worldMin) * 0.5f;
+	glm::vec4 clipCenter = viewProjection * glm::vec4((worldMin + worldMax) * 0.5f, 1.0f);
+	glm::vec4 clipX = viewProjection[0] * extent.x;
+	glm::vec4 clipY = viewProjection[1] * extent.y;
+	glm::vec4 clipZ = viewProjection[2] * extent.z;
+
+	for (int corner = 0; corner < 8; ++corner)
+	{
+		glm::vec4 clip = clipCenter + ((corner & 1) ? clipX : -clipX) + ((corner & 2) ? clipY : -clipY) + ((corner & 4) ? clipZ : -clipZ);
+
+		// boxes crossing the near plane are always drawn
+		if (clip.w <= 0.0f || clip.z < -clip.w)
+			return false;
+
+		float invW = 1.0f / clip.w;
+		float x = (clip.x * invW * 0.5f + 0.5f) * width;
+		float y = (clip.y * invW * 0.5f + 0.5f) * height;
+		minX = min(minX, x);
+		maxX = max(maxX, x);
+		minY = min(minY, y);
+		maxY = max(maxY, y);
+		nearest = min(nearest, clip.z * invW * 0.5f + 0.5f);
+	}
+
+	// every pixel the rectangle touches
+	int x0 = max(0, (int)floor(minX));
+	int y0 = max(0, (int)floor(minY));
+	int x1 = min(width - 1, (int)floor(maxX));
+	int y1 = min(height - 1, (int)floor(maxY));
+
+	// off screen items are left to frustum culling
+	if (x0 > x1 || y0 > y1)
+		return false;
+
+	for (int ty = y0 / tileSize; ty <= y1 / tileSize; ++ty)
+	{
+		for (int tx = x0 / tileSize; tx <= x1 / tileSize; ++tx)
+		{
+			// whole tile is in front of the item
+			if (nearest > tileMaxDepth[(size_t)ty * tilesX + tx])
+				continue;
+
+			int rowEnd = min(y1, ty * tileSize + tileSize - 1);
+			int columnEnd = min(x1, tx * tileSize + tileSize - 1);
+
+			for (int y = max(y0, ty * tileSize); y <= rowEnd; ++y)
+			{
+				const float* line = &depth[(size_t)y * width];
+
+				for (int x = max(x0, tx * tileSize); x <= columnEnd; ++x)
+				{
+					if (line[x] >= nearest)
+						return false;
+				}
+			}
+		}
+	}
+
+	return true;
+}
+
+// Removes the occluded items from the list, occluders themselves are kept
+void OcclusionCuller::Cull(vector<DrawItem>& visibleItems)
+{
+	size_t kept = 0;
+	numTested = 0;
+
+	for (size_t i = 0; i < visibleItems.size(); ++i)
+	{
+		const DrawItem& item = visibleItems[i];
+
+		if (!item.occluder)
+		{
+			++numTested;
+			if (IsOccluded(item.bounds, item.model))
+				continue;
+		}
+
+		if (kept != i)
+			visibleItems[kept] = item;
+		++kept;
+	}
+
+	numOccluded = visibleItems.size() - kept;
+	visibleItems.resize(kept);
+}
+
+// Clears, rasterizes and builds the tile depths of one band of tile rows
+void OcclusionCuller::URasterizeBand(int band)
+{
+	int firstTileRow = band * tilesY / numBands;
+	int lastTileRow = (band + 1) * tilesY / numBands;
+	int bandMinY = firstTileRow * tileSize;
+	int bandMaxY = lastTileRow * tileSize - 1;
+
+	fill(depth.begin() + (size_t)bandMinY * width, depth.begin() + (size_t)(bandMaxY + 1) * width, 1.0f);
+
+#if defined(OCCLUSION_AVX2)
+	const __m256 laneOffsets = _mm256_setr_ps(0.5f, 1.5f, 2.5f, 3.5f, 4.5f, 5.5f, 6.5f, 7.5f);
+	const __m256 zero = _mm256_setzero_ps();
+#endif
+
+	for (const Triangle& triangle : triangles)
+	{
+		int minY = max(triangle.minY, bandMinY);
+		int maxY = min(triangle.maxY, bandMaxY);
+		int firstX = triangle.minX & ~(tileSize - 1);
+
+		for (int y = minY; y <= maxY; ++y)
+		{
+			float centerY = y + 0.5f;
+			float* line = &depth[(size_t)y * width];
+
+#if defined(OCCLUSION_AVX2)
+			// 8 pixels per step, the row terms are constant along x
+			__m256 edgeA0 = _mm256_set1_ps(triangle.edgeA[0]);
+			__m256 edgeA1 = _mm256_set1_ps(triangle.edgeA[1]);
+			__m256 edgeA2 = _mm256_set1_ps(triangle.edgeA[2]);
+			__m256 depthA = _mm256_set1_ps(triangle.depthA);
+			__m256 row0 = _mm256_set1_ps(triangle.edgeB[0] * centerY + triangle.edgeC[0]);
+			__m256 row1 = _mm256_set1_ps(triangle.edgeB[1] * centerY + triangle.edgeC[1]);
+			__m256 row2 = _mm256_set1_ps(triangle.edgeB[2] * centerY + triangle.edgeC[2]);
+			__m256 rowDepth = _mm256_set1_ps(triangle.depthB * centerY + triangle.depthC);
+
+			for (int x = firstX; x <= triangle.maxX; x += tileSize)
+			{
+				__m256 centerX = _mm256_add_ps(_mm256_set1_ps((float)x), laneOffsets);
+				__m256 edge0 = _mm256_add_ps(_mm256_mul_ps(edgeA0, centerX), row0);
+				__m256 edge1 = _mm256_add_ps(_mm256_mul_ps(edgeA1, centerX), row1);
+				__m256 edge2 = _mm256_add_ps(_mm256_mul_ps(edgeA2, centerX), row2);
+				__m256 inside = _mm256_and_ps(_mm256_and_ps(_mm256_cmp_ps(edge0, zero, _CMP_GE_OQ), _mm256_cmp_ps(edge1, zero, _CMP_GE_OQ)),
+					_mm256_cmp_ps(edge2, zero, _CMP_GE_OQ));
+
+				if (_mm256_movemask_ps(inside) == 0)
+					continue;
+
+				__m256 pixelDepth = _mm256_add_ps(_mm256_mul_ps(depthA, centerX), rowDepth);
+				__m256 oldDepth = _mm256_loadu_ps(line + x);
+				_mm256_storeu_ps(line + x, _mm256_blendv_ps(oldDepth, _mm256_min_ps(oldDepth, pixelDepth), inside));
+			}
+#else
+			for (int x = triangle.minX; x <= triangle.maxX; ++x)
+			{
+				float centerX = x + 0.5f;
+				bool inside = true;
+
+				for (int i = 0; i < 3 && inside; ++i)
+					inside = triangle.edgeA[i] * centerX + triangle.edgeB[i] * centerY + triangle.edgeC[i] >= 0.0f;
+
+				if (inside)
+					line[x] = min(line[x], triangle.depthA * centerX + triangle.depthB * centerY + triangle.depthC);
+			}
+#endif
+		}
+	}
+
+	// farthest depth of each tile of the band
+	for (int ty = firstTileRow; ty < lastTileRow; ++ty)
+	{
+		for (int tx = 0; tx < tilesX; ++tx)
+		{
+			const float* tile = &depth[(size_t)ty * tileSize * width + tx * tileSize];
+
+#if defined(OCCLUSION_AVX2)
+			__m256 farthest = _mm256_loadu_ps(tile);
+			for (int row = 1; row < tileSize; ++row)
+				farthest = _mm256_max_ps(farthest, _mm256_loadu_ps(tile + (size_t)row * width));
+
+			__m128 half = _mm_max_ps(_mm256_castps256_ps128(farthest), _mm256_extractf128_ps(farthest, 1));
+			half = _mm_max_ps(half, _mm_movehl_ps(half, half));
+			half = _mm_max_ss(half, _mm_shuffle_ps(half, half, 1));
+			tileMaxDepth[(size_t)ty * tilesX + tx] = _mm_cvtss_f32(half);
+#else
+			float farthest = 0.0f;
+			for (int row = 0; row < tileSize; ++row)
+			{
+				for (int column = 0; column < tileSize; ++column)
+					farthest = max(farthest, tile[(size_t)row * width + column]);
+			}
+
+			tileMaxDepth[(size_t)ty * tilesX + tx] = farthest;
+#endif
+		}
+	}
+}
+
+// Projects a clip space triangle and appends its edge functions and depth plane to output
+void OcclusionCuller::USetupTriangle(const glm::vec4 clip[3], Triangle* output, size_t& count) const
+{
+	glm::vec3 v[3];
+	for (int i = 0; i < 3; ++i)
+	{
+		if (clip[i].w <= 0.0f)
+			return;
+
+		float invW = 1.0f / clip[i].w;
+		v[i] = glm::vec3((clip[i].x * invW * 0.5f + 0.5f) * width,
+			(clip[i].y * invW * 0.5f + 0.5f) * height,
+			clip[i].z * invW * 0.5f + 0.5f);
+	}
+
+	// occluders are two sided, counter clockwise after the swap
+	float area = (v[1].x - v[0].x) * (v[2].y - v[0].y) - (v[1].y - v[0].y) * (v[2].x - v[0].x);
+	if (area < 0.0f)
+	{
+		swap(v[1], v[2]);
+		area = -area;
+	}
+
+	if (area < 1e-6f)
+		return;
+
+	Triangle triangle;
+	triangle.minX = max(0, (int)floor(min(v[0].x, min(v[1].x, v[2].x))));
+	triangle.minY = max(0, (int)floor(min(v[0].y, min(v[1].y, v[2].y))));
+	triangle.maxX = min(width - 1, (int)floor(max(v[0].x, max(v[1].x, v[2].x))));
+	triangle.maxY = min(height - 1, (int)floor(max(v[0].y, max(v[1].y, v[2].y))));
+
+	if (triangle.minX > triangle.maxX || triangle.minY > triangle.maxY)
+		return;
+
+	// edge i is opposite vertex i, so edge / area is its barycentric weight
+	triangle.depthA = triangle.depthB = triangle.depthC = 0.0f;
+	for (int i = 0; i < 3; ++i)
+	{
+		const glm::vec3& a = v[(i + 1) % 3];
+		const glm::vec3& b = v[(i + 2) % 3];
+
+		triangle.edgeA[i] = a.y - b.y;
+		triangle.edgeB[i] = b.x - a.x;
+		triangle.edgeC[i] = -(triangle.edgeA[i] * a.x + triangle.edgeB[i] * a.y);
+
+		triangle.depthA += triangle.edgeA[i] * v[i].z / area;
+		triangle.depthB += triangle.edgeB[i] * v[i].z / area;
+		triangle.depthC += triangle.edgeC[i] * v[i].z / area;
+	}
+
+	output[count++] = triangle;
+}
+
+// Clips a triangle against the near plane (z >= -w), giving up to two triangles
+void OcclusionCuller::UAddClippedTriangle(const glm::vec4& a, const glm::vec4& b, const glm::vec4& c, Triangle* output, size_t& count) const
+{
+	const glm::vec4 input[3] = { a, b, c };
+	glm::vec4 polygon[4];
+	int corners = 0;
+
+	for (int i = 0; i < 3; ++i)
+	{
+		const glm::vec4& current = input[i];
+		const glm::vec4& next = input[(i + 1) % 3];
+		float currentDistance = current.z + current.w;
+		float nextDistance = next.z + next.w;
+
+		if (currentDistance >= 0.0f)
+			polygon[corners++] = current;
+
+		if ((currentDistance >= 0.0f) != (nextDistance >= 0.0f))
+			polygon[corners++] = current + (next - current) * (currentDistance / (currentDistance - nextDistance));
+	}
+
+	if (corners < 3)
+		return;
+
+	glm::vec4 first[3] = { polygon[0], polygon[1], polygon[2] };
+	USetupTriangle(first, output, count);
+
+	if (corners == 4)
+	{
+		glm::vec4 second[3] = { polygon[0], polygon[2], polygon[3] };
+		USetupTriangle(second, output, count);
+	}
+}
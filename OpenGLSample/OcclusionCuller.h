@@ -0,0 +1,58 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include <vector>
+
+#include "DrawItem.h"
+#include "JobSystem.h"
+
+// Software occlusion culling. The occluders of the draw list are rasterized
+// on the CPU into a low resolution depth buffer, split in horizontal bands
+// over the job system, with a max depth per 8x8 tile on top. Items whose
+// screen rectangle lies behind that buffer are dropped before submission.
+// The occluder triangles are set up in parallel in the threads' arenas.
+// No GL calls are made, so it also runs on machines without a GPU.
+class OcclusionCuller
+{
+public:
+	static const int tileSize = 8; // pixels per tile side, one AVX2 register per tile row
+
+	int width = 0; // depth buffer size, multiples of tileSize
+	int height = 0;
+	size_t numOccluderTriangles = 0; // triangles rasterized last frame
+	size_t numTested = 0; // items tested last frame
+	size_t numOccluded = 0; // items dropped last frame
+
+public:
+	bool Create(int width, int height, JobSystem* jobs);
+	void Destroy();
+
+	void RenderOccluders(const std::vector<DrawItem>& items, const glm::mat4& viewProjection);
+	bool IsOccluded(const Bounds& bounds, const glm::mat4& model) const;
+	void Cull(std::vector<DrawItem>& visibleItems);
+
+private:
+	// screen space triangle as three edge functions and a depth plane
+	struct Triangle
+	{
+		float edgeA[3], edgeB[3], edgeC[3]; // inside when A * x + B * y + C >= 0
+		float depthA, depthB, depthC; // depth = A * x + B * y + C
+		int minX, minY, maxX, maxY; // pixel bounds, clamped to the buffer
+	};
+
+	std::vector<float> depth; // nearest occluder depth per pixel, 0 near 1 far
+	std::vector<float> tileMaxDepth; // farthest depth of each tile
+	int tilesX = 0;
+	int tilesY = 0;
+	glm::mat4 viewProjection = glm::mat4(1.0f);
+	std::vector<Triangle> triangles;
+
+	// one band of tile rows per job system thread
+	int numBands = 1;
+	JobSystem* jobs = nullptr;
+
+	void URasterizeBand(int band);
+	void USetupTriangle(const glm::vec4 clip[3], Triangle* output, size_t& count) const;
+	void UAddClippedTriangle(const glm::vec4& a, const glm::vec4& b, const glm::vec4& c, Triangle* output, size_t& count) const;
+};
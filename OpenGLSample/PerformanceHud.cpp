@@ -0,0 +1,376 @@
+#include <iostream>
+#include <cstdio>
+#include <cstddef>
+#include <algorithm>
+#include "PerformanceHud.h"
+#include "GLState.h"
+#include "GLCounters.h"
+#include "shader.hpp"
+
+using namespace std;
+
+// Shader macro
+#ifndef GLSL
+#define GLSL(Version, Source) "#version " #Version " core \n" #Source
+#endif
+
+namespace
+{
+	const GLchar* hudVertexShaderSource = GLSL(440,
+		layout(location = 0) in vec2 position;
+		layout(location = 1) in vec2 textureCoordinate;
+		layout(location = 2) in vec4 color;
+
+		out vec2 vertexTextureCoordinate;
+		out vec4 vertexColor;
+
+		uniform vec2 screenSize;
+
+		void main()
+		{
+			// pixels from the top left corner to clip space
+			gl_Position = vec4(position.x / screenSize.x * 2.0 - 1.0, 1.0 - position.y / screenSize.y * 2.0, 0.0, 1.0);
+			vertexTextureCoordinate = textureCoordinate;
+			vertexColor = color;
+		}
+	);
+
+	const GLchar* hudFragmentShaderSource = GLSL(440,
+		in vec2 vertexTextureCoordinate;
+		in vec4 vertexColor;
+
+		out vec4 fragmentColor;
+
+		uniform sampler2D atlas;
+
+		void main()
+		{
+			fragmentColor = vec4(vertexColor.rgb, vertexColor.a * texture(atlas, vertexTextureCoordinate).r);
+		}
+	);
+
+	// 5x7 glyphs for ASCII 32 to 95, one byte per row, bit 4 is the left column
+	const unsigned char font[64][7] = {
+		{ 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 }, // space
+		{ 0x04, 0x04, 0x04, 0x04, 0x04, 0x00, 0x04 }, // !
+		{ 0x0A, 0x0A, 0x00, 0x00, 0x00, 0x00, 0x00 }, // "
+		{ 0x0A, 0x0A, 0x1F, 0x0A, 0x1F, 0x0A, 0x0A }, // #
+		{ 0x04, 0x0F, 0x14, 0x0E, 0x05, 0x1E, 0x04 }, // $
+		{ 0x18, 0x19, 0x02, 0x04, 0x08, 0x13, 0x03 }, // %
+		{ 0x0C, 0x12, 0x14, 0x08, 0x15, 0x12, 0x0D }, // &
+		{ 0x04, 0x04, 0x00, 0x00, 0x00, 0x00, 0x00 }, // '
+		{ 0x02, 0x04, 0x08, 0x08, 0x08, 0x04, 0x02 }, // (
+		{ 0x08, 0x04, 0x02, 0x02, 0x02, 0x04, 0x08 }, // )
+		{ 0x00, 0x04, 0x15, 0x0E, 0x15, 0x04, 0x00 }, // *
+		{ 0x00, 0x04, 0x04, 0x1F, 0x04, 0x04, 0x00 }, // +
+		{ 0x00, 0x00, 0x00, 0x00, 0x0C, 0x04, 0x08 }, // ,
+		{ 0x00, 0x00, 0x00, 0x1F, 0x00, 0x00, 0x00 }, // -
+		{ 0x00, 0x00, 0x00, 0x00, 0x00, 0x0C, 0x0C }, // .
+		{ 0x00, 0x01, 0x02, 0x04, 0x08, 0x10, 0x00 }, // /
+		{ 0x0E, 0x11, 0x13, 0x15, 0x19, 0x11, 0x0E }, // 0
+		{ 0x04, 0x0C, 0x04, 0x04, 0x04, 0x04, 0x0E }, // 1
+		{ 0x0E, 0x11, 0x01, 0x02, 0x04, 0x08, 0x1F }, // 2
+		{ 0x1F, 0x02, 0x04, 0x02, 0x01, 0x11, 0x0E }, // 3
+		{ 0x02, 0x06, 0x0A, 0x12, 0x1F, 0x02, 0x02 }, // 4
+		{ 0x1F, 0x10, 0x1E, 0x01, 0x01, 0x11, 0x0E }, // 5
+		{ 0x06, 0x08, 0x10, 0x1E, 0x11, 0x11, 0x0E }, // 6
+		{ 0x1F, 0x01, 0x02, 0x04, 0x08, 0x08, 0x08 }, // 7
+		{ 0x0E, 0x11, 0x11, 0x0E, 0x11, 0x11, 0x0E }, // 8
+		{ 0x0E, 0x11, 0x11, 0x0F, 0x01, 0x02, 0x0C }, // 9
+		{ 0x00, 0x0C, 0x0C, 0x00, 0x0C, 0x0C, 0x00 }, // :
+		{ 0x00, 0x0C, 0x0C, 0x00, 0x0C, 0x04, 0x08 }, // ;
+		{ 0x02, 0x04, 0x08, 0x10, 0x08, 0x04, 0x02 }, // <
+		{ 0x00, 0x00, 0x1F, 0x00, 0x1F, 0x00, 0x00 }, // =
+		{ 0x08, 0x04, 0x02, 0x01, 0x02, 0x04, 0x08 }, // >
+		{ 0x0E, 0x11, 0x01, 0x02, 0x04, 0x00, 0x04 }, // ?
+		{ 0x0E, 0x11, 0x01, 0x0D, 0x15, 0x15, 0x0E }, // @
+		{ 0x0E, 0x11, 0x11, 0x1F, 0x11, 0x11, 0x11 }, // A
+		{ 0x1E, 0x11, 0x11, 0x1E, 0x11, 0x11, 0x1E }, // B
+		{ 0x0E, 0x11, 0x10, 0x10, 0x10, 0x11, 0x0E }, // C
+		{ 0x1C, 0x12, 0x11, 0x11, 0x11, 0x12, 0x1C }, // D
+		{ 0x1F, 0x10, 0x10, 0x1E, 0x10, 0x10, 0x1F }, // E
+		{ 0x1F, 0x10, 0x10, 0x1E, 0x10, 0x10, 0x10 }, // F
+		{ 0x0E, 0x11, 0x10, 0x17, 0x11, 0x11, 0x0F }, // G
+		{ 0x11, 0x11, 0x11, 0x1F, 0x11, 0x11, 0x11 }, // H
+		{ 0x0E, 0x04, 0x04, 0x04, 0x04, 0x04, 0x0E }, // I
+		{ 0x07, 0x02, 0x02, 0x02, 0x02, 0x12, 0x0C }, // J
+		{ 0x11, 0x12, 0x14, 0x18, 0x14, 0x12, 0x11 }, // K
+		{ 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x1F }, // L
+		{ 0x11, 0x1B, 0x15, 0x15, 0x11, 0x11, 0x11 }, // M
+		{ 0x11, 0x11, 0x19, 0x15, 0x13, 0x11, 0x11 }, // N
+		{ 0x0E, 0x11, 0x11, 0x11, 0x11, 0x11, 0x0E }, // O
+		{ 0x1E, 0x11, 0x11, 0x1E, 0x10, 0x10, 0x10 }, // P
+		{ 0x0E, 0x11, 0x11, 0x11, 0x15, 0x12, 0x0D }, // Q
+		{ 0x1E, 0x11, 0x11, 0x1E, 0x14, 0x12, 0x11 }, // R
+		{ 0x0F, 0x10, 0x10, 0x0E, 0x01, 0x01, 0x1E }, // S
+		{ 0x1F, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04 }, // T
+		{ 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x0E }, // U
+		{ 0x11, 0x11, 0x11, 0x11, 0x11, 0x0A, 0x04 }, // V
+		{ 0x11, 0x11, 0x11, 0x15, 0x15, 0x15, 0x0A }, // W
+		{ 0x11, 0x11, 0x0A, 0x04, 0x0A, 0x11, 0x11 }, // X
+		{ 0x11, 0x11, 0x0A, 0x04, 0x04, 0x04, 0x04 }, // Y
+		{ 0x1F, 0x01, 0x02, 0x04, 0x08, 0x10, 0x1F }, // Z
+		{ 0x0E, 0x08, 0x08, 0x08, 0x08, 0x08, 0x0E }, // [
+		{ 0x00, 0x10, 0x08, 0x04, 0x02, 0x01, 0x00 }, // backslash
+		{ 0x0E, 0x02, 0x02, 0x02, 0x02, 0x02, 0x0E }, // ]
+		{ 0x04, 0x0A, 0x11, 0x00, 0x00, 0x00, 0x00 }, // ^
+		{ 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x1F }, // _
+	};
+
+	// the atlas holds the glyphs in 6x8 cells, 16 per row, and one solid cell after them
+	const int cellWidth = 6;
+	const int cellHeight = 8;
+	const int glyphWidth = 5;
+	const int glyphHeight = 7;
+	const int atlasColumns = 16;
+	const int atlasWidth = atlasColumns * cellWidth;
+	const int atlasHeight = 5 * cellHeight;
+	const int solidCell = 64;
+
+	// layout in pixels, glyphs are drawn at twice their size
+	const float textScale = 2.0f;
+	const float lineHeight = 18.0f;
+	const float margin = 8.0f;
+	const float panelWidth = 264.0f;
+	const float graphHeight = 48.0f;
+	const float graphMs = 100.0f / 3.0f; // full graph height, 30 fps
+	const float budgetMs = 1000.0f / 60.0f;
+
+	uint32_t URgba(int r, int g, int b, int a)
+	{
+		return (uint32_t)r | (uint32_t)g << 8 | (uint32_t)b << 16 | (uint32_t)a << 24;
+	}
+
+	const uint32_t white = URgba(255, 255, 255, 255);
+	const uint32_t background = URgba(0, 0, 0, 160);
+
+	// green within the 60 fps budget, yellow within 30 fps, red above
+	uint32_t UFrameColor(float ms)
+	{
+		if (ms <= budgetMs)
+			return URgba(80, 220, 80, 255);
+		if (ms <= graphMs)
+			return URgba(240, 200, 60, 255);
+		return URgba(240, 70, 60, 255);
+	}
+}
+
+// Compiles the program, bakes the font atlas and allocates the vertex buffer
+bool PerformanceHud::Create()
+{
+	if (!UCreateShaderProgram(hudVertexShaderSource, hudFragmentShaderSource, programId))
+	{
+		cout << "ERROR::HUD::PROGRAM_NOT_CREATED" << endl;
+		Destroy();
+		return false;
+	}
+
+	screenSizeLoc = glGetUniformLocation(programId, "screenSize");
+	UGLState().UseProgram(programId);
+	UUniform1i(glGetUniformLocation(programId, "atlas"), 0);
+	UGLState().UseProgram(0);
+
+	// one byte of coverage per texel
+	vector<unsigned char> pixels(atlasWidth * atlasHeight, 0);
+	for (int glyph = 0; glyph < 64; ++glyph)
+	{
+		int originX = glyph % atlasColumns * cellWidth;
+		int originY = glyph / atlasColumns * cellHeight;
+		for (int y = 0; y < glyphHeight; ++y)
+		{
+			for (int x = 0; x < glyphWidth; ++x)
+			{
+				if (font[glyph][y] & (0x10 >> x))
+					pixels[(originY + y) * atlasWidth + originX + x] = 255;
+			}
+		}
+	}
+	for (int y = 0; y < cellHeight; ++y)
+	{
+		for (int x = 0; x < cellWidth; ++x)
+			pixels[(solidCell / atlasColumns * cellHeight + y) * atlasWidth + solidCell % atlasColumns * cellWidth + x] = 255;
+	}
+
+	glGenTextures(1, &atlas);
+	UGLState().BindTexture(0, GL_TEXTURE_2D, atlas);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+	UTexImage2D(GL_TEXTURE_2D, 0, GL_R8, atlasWidth, atlasHeight, GL_RED, GL_UNSIGNED_BYTE, pixels.data());
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+	vertices.reserve(maxQuads * 6);
+
+	glGenVertexArrays(1, &vao);
+	glGenBuffers(1, &vbo);
+	UGLState().BindVertexArray(vao);
+	UGLState().BindBuffer(GL_ARRAY_BUFFER, vbo);
+	UBufferData(GL_ARRAY_BUFFER, maxQuads * 6 * sizeof(Vertex), NULL, GL_STREAM_DRAW);
+
+	glEnableVertexAttribArray(0);
+	glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, x));
+	glEnableVertexAttribArray(1);
+	glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, u));
+	glEnableVertexAttribArray(2);
+	glVertexAttribPointer(2, 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(Vertex), (void*)offsetof(Vertex, color));
+	UGLState().BindVertexArray(0);
+
+	return true;
+}
+
+void PerformanceHud::Destroy()
+{
+	UGLState().DeleteProgram(programId);
+	UGLState().DeleteVertexArrays(1, &vao);
+	UGLState().DeleteBuffers(1, &vbo);
+	UGLState().DeleteTextures(1, &atlas);
+	programId = vao = vbo = atlas = 0;
+	vertices.clear();
+}
+
+void PerformanceHud::Draw(int width, int height, const Stats& stats)
+{
+	if (programId == 0)
+		return;
+
+	cpuHistory[nextSample] = stats.cpuMs;
+	gpuHistory[nextSample] = stats.gpuMs;
+	nextSample = (nextSample + 1) % historySize;
+
+	vertices.clear();
+
+	float panelHeight = 5.0f * lineHeight + 2.0f * (lineHeight + graphHeight + 6.0f) + 2.0f * margin;
+	UAddQuad(margin, margin, panelWidth, panelHeight, solidCell, background);
+
+	float x = 2.0f * margin;
+	float y = 2.0f * margin;
+	UAddGraph(x, y, cpuHistory, "CPU", white);
+	y += lineHeight + graphHeight + 6.0f;
+	UAddGraph(x, y, gpuHistory, "GPU", white);
+	y += lineHeight + graphHeight + 6.0f;
+
+	char line[64];
+	snprintf(line, sizeof(line), "DRAWS %zu", stats.drawCalls);
+	UAddText(x, y, line, white);
+	y += lineHeight;
+
+	if (stats.triangles >= 10000)
+		snprintf(line, sizeof(line), "TRIS  %.1fK", stats.triangles / 1000.0);
+	else
+		snprintf(line, sizeof(line), "TRIS  %zu", stats.triangles);
+	UAddText(x, y, line, white);
+	y += lineHeight;
+
+	snprintf(line, sizeof(line), "RT    %.1f MB", stats.targetBytes / (1024.0 * 1024.0));
+	UAddText(x, y, line, white);
+	y += lineHeight;
+
+	snprintf(line, sizeof(line), "ARENA %.0f KB", stats.arenaBytes / 1024.0);
+	UAddText(x, y, line, white);
+	y += lineHeight;
+
+	snprintf(line, sizeof(line), "RES   %.0f%% %dX%d", stats.resolutionScale * 100.0f, stats.sceneWidth, stats.sceneHeight);
+	UAddText(x, y, line, white);
+
+	// drawn over the scene without depth, blended by the glyph coverage
+	UGLState().BindFramebuffer(GL_FRAMEBUFFER, 0);
+	UGLState().Viewport(0, 0, width, height);
+	UGLState().Disable(GL_DEPTH_TEST);
+	UGLState().Enable(GL_BLEND);
+	glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+
+	UGLState().UseProgram(programId);
+	float screenSize[2] = { (float)width, (float)height };
+	UUniform2fv(screenSizeLoc, 1, screenSize);
+	UGLState().BindTexture(0, GL_TEXTURE_2D, atlas);
+
+	// orphans last frame's storage so the upload never waits for it
+	UGLState().BindBuffer(GL_ARRAY_BUFFER, vbo);
+	UBufferData(GL_ARRAY_BUFFER, maxQuads * 6 * sizeof(Vertex), NULL, GL_STREAM_DRAW);
+	UBufferSubData(GL_ARRAY_BUFFER, 0, vertices.size() * sizeof(Vertex), vertices.data());
+
+	UGLState().BindVertexArray(vao);
+	UDrawArrays(GL_TRIANGLES, 0, (GLsizei)vertices.size());
+	UGLState().BindVertexArray(0);
+
+	UGLState().UseProgram(0);
+	UGLState().Disable(GL_BLEND);
+	UGLState().Enable(GL_DEPTH_TEST);
+}
+
+// Two triangles covering a rectangle in pixels, textured with one atlas cell
+void PerformanceHud::UAddQuad(float x, float y, float width, float height, int cell, uint32_t color)
+{
+	if (vertices.size() + 6 > vertices.capacity())
+		return;
+
+	float u0, v0, u1, v1;
+	float cellX = (float)(cell % atlasColumns * cellWidth);
+	float cellY = (float)(cell / atlasColumns * cellHeight);
+	if (cell == solidCell)
+	{
+		// the middle of the cell, away from the neighbours
+		u0 = u1 = (cellX + cellWidth * 0.5f) / atlasWidth;
+		v0 = v1 = (cellY + cellHeight * 0.5f) / atlasHeight;
+	}
+	else
+	{
+		u0 = cellX / atlasWidth;
+		v0 = cellY / atlasHeight;
+		u1 = (cellX + glyphWidth) / atlasWidth;
+		v1 = (cellY + glyphHeight) / atlasHeight;
+	}
+
+	Vertex topLeft = { x, y, u0, v0, color };
+	Vertex topRight = { x + width, y, u1, v0, color };
+	Vertex bottomLeft = { x, y + height, u0, v1, color };
+	Vertex bottomRight = { x + width, y + height, u1, v1, color };
+
+	vertices.push_back(topLeft);
+	vertices.push_back(bottomLeft);
+	vertices.push_back(topRight);
+	vertices.push_back(topRight);
+	vertices.push_back(bottomLeft);
+	vertices.push_back(bottomRight);
+}
+
+// Lower case letters use the upper case glyphs, characters outside the font are skipped
+void PerformanceHud::UAddText(float x, float y, const char* text, uint32_t color)
+{
+	for (const char* c = text; *c != '\0'; ++c)
+	{
+		int code = *c >= 'a' && *c <= 'z' ? *c - 'a' + 'A' : *c;
+		if (code > ' ' && code < ' ' + 64)
+			UAddQuad(x, y, glyphWidth * textScale, glyphHeight * textScale, code - ' ', color);
+		x += cellWidth * textScale;
+	}
+}
+
+// Label with the last and mean time, then one bar per frame, oldest on the left
+void PerformanceHud::UAddGraph(float x, float y, const float* history, const char* label, uint32_t color)
+{
+	int newest = (nextSample + historySize - 1) % historySize;
+	float sum = 0.0f;
+	for (int i = 0; i < historySize; ++i)
+		sum += history[i];
+
+	char line[64];
+	snprintf(line, sizeof(line), "%s %5.2f MS  AVG %5.2f", label, history[newest], sum / historySize);
+	UAddText(x, y, line, color);
+	y += lineHeight;
+
+	const float barWidth = 2.0f;
+	for (int i = 0; i < historySize; ++i)
+	{
+		float ms = history[(nextSample + i) % historySize];
+		float barHeight = min(ms / graphMs, 1.0f) * graphHeight;
+		if (barHeight > 0.0f)
+			UAddQuad(x + i * barWidth, y + graphHeight - barHeight, barWidth, barHeight, solidCell, UFrameColor(ms));
+	}
+
+	// the 60 fps budget
+	float budgetY = y + graphHeight - budgetMs / graphMs * graphHeight;
+	UAddQuad(x, budgetY, historySize * barWidth, 1.0f, solidCell, URgba(255, 255, 255, 96));
+}
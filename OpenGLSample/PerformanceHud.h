@@ -0,0 +1,61 @@
+#pragma once
+
+#include <GL/glew.h>
+
+#include <cstdint>
+#include <vector>
+
+// Overlay with frame time graphs and counters, drawn on top of the
+// finished frame. Text comes from a 5x7 bitmap font baked into the code,
+// so the whole overlay is quads textured from one small atlas: they are
+// written to one dynamic vertex buffer and drawn with a single call.
+class PerformanceHud
+{
+public:
+	static const int historySize = 120; // frames in the graphs
+	static const int maxQuads = 2048;
+
+	// values of the last finished frame
+	struct Stats
+	{
+		float cpuMs; // render thread time until the swap
+		float gpuMs; // read back a few frames late
+		size_t drawCalls;
+		size_t triangles;
+		size_t targetBytes; // pooled render targets
+		size_t arenaBytes; // peak of the frame arena
+		float resolutionScale; // scene targets against the window
+		int sceneWidth;
+		int sceneHeight;
+	};
+
+public:
+	bool Create();
+	void Destroy();
+
+	// Adds the frame to the graphs and draws into the bound framebuffer
+	void Draw(int width, int height, const Stats& stats);
+
+private:
+	struct Vertex
+	{
+		float x, y; // pixels from the top left corner
+		float u, v;
+		uint32_t color; // rgba8
+	};
+
+	GLuint programId = 0;
+	GLuint vao = 0;
+	GLuint vbo = 0;
+	GLuint atlas = 0;
+	GLint screenSizeLoc = -1;
+
+	std::vector<Vertex> vertices; // capacity for maxQuads, kept between frames
+	float cpuHistory[historySize] = {};
+	float gpuHistory[historySize] = {};
+	int nextSample = 0;
+
+	void UAddQuad(float x, float y, float width, float height, int cell, uint32_t color);
+	void UAddText(float x, float y, const char* text, uint32_t color);
+	void UAddGraph(float x, float y, const float* history, const char* label, uint32_t color);
+};
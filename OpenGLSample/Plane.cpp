@@ -1,10 +1,12 @@
 #include "Plane.h"
+#include "CpuProfiler.h"
 #include <vector>
 
 using namespace std;
 
 void Plane::CreateMesh()
 {
+	CPU_PROFILE_SCOPE("Plane::CreateMesh");
 	UCreatePlane(planeMesh);
 }
 
@@ -38,6 +40,11 @@ void Plane::UCreatePlane(GLMesh& mesh)
 
 	mesh.numVert = sizeof(vertices) / (sizeof(vertices[0]) * (floatsPerVertex + floatsPerNormal + floatsPerUV));  // Vertex data
 	mesh.numIndicies = sizeof(indices) / sizeof(indices[0]);  // index data
+	mesh.bounds = UComputeBounds(vertices, mesh.numVert, floatsPerVertex + floatsPerNormal + floatsPerUV); // culling volumes
+
+	// CPU copy of the triangles for picking
+	mesh.triangles.clear();
+	UAppendTriangles(mesh.triangles, vertices, floatsPerVertex + floatsPerNormal + floatsPerUV, GL_TRIANGLES, 0, mesh.numIndicies, indices);
 
 	// Creates VAO
 	glGenVertexArrays(1, &mesh.vao); // generates VAO
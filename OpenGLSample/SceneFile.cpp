@@ -0,0 +1,159 @@
+#include <iostream>
+#include <fstream>
+#include <cstring>
+#include "SceneFile.h"
+
+using namespace std;
+
+const uint64_t SceneFile::alignment;
+
+namespace
+{
+	// bytes of one element of every section, sizes must be multiples of them
+	size_t UElementSize(int section)
+	{
+		switch (section)
+		{
+		case SceneFile::SECTION_MESHES: return sizeof(SceneFile::Mesh);
+		case SceneFile::SECTION_NODES: return sizeof(SceneFile::Node);
+		case SceneFile::SECTION_MATERIALS: return sizeof(SceneFile::Material);
+		case SceneFile::SECTION_TEXTURES: return sizeof(uint32_t);
+		case SceneFile::SECTION_VERTICES: return SceneFile::vertexSize;
+		case SceneFile::SECTION_INDICES: return sizeof(uint32_t);
+		case SceneFile::SECTION_TRIANGLES: return sizeof(glm::vec3);
+		default: return 1;
+		}
+	}
+
+	uint64_t UAlign(uint64_t offset)
+	{
+		return (offset + SceneFile::alignment - 1) & ~(SceneFile::alignment - 1);
+	}
+}
+
+// Returns the offset of the string, the same text is stored once
+uint32_t SceneFile::Contents::AddString(const char* text)
+{
+	size_t length = strlen(text);
+	for (size_t offset = 0; offset + length < strings.size(); offset += strlen(&strings[offset]) + 1)
+	{
+		if (strcmp(&strings[offset], text) == 0)
+			return (uint32_t)offset;
+	}
+
+	uint32_t offset = (uint32_t)strings.size();
+	strings.insert(strings.end(), text, text + length + 1);
+	return offset;
+}
+
+bool SceneFile::Write(const char* path, const Contents& contents)
+{
+	ofstream file(path, ios::binary);
+	if (!file)
+	{
+		cout << "ERROR::SCENEFILE::CANNOT_OPEN " << path << endl;
+		return false;
+	}
+
+	const void* sectionData[NUM_SECTIONS] = { contents.meshes.data(), contents.nodes.data(), contents.materials.data(),
+		contents.textures.data(), contents.strings.data(), contents.vertices.data(), contents.indices.data(), contents.triangles.data() };
+	const uint64_t sectionSizes[NUM_SECTIONS] = { contents.meshes.size() * sizeof(Mesh), contents.nodes.size() * sizeof(Node),
+		contents.materials.size() * sizeof(Material), contents.textures.size() * sizeof(uint32_t), contents.strings.size(),
+		contents.vertices.size(), contents.indices.size() * sizeof(uint32_t), contents.triangles.size() * sizeof(glm::vec3) };
+
+	Header header = {};
+	header.magic = magic;
+	header.version = version;
+	header.meshSize = sizeof(Mesh);
+	header.nodeSize = sizeof(Node);
+
+	uint64_t offset = UAlign(sizeof(Header));
+	for (int i = 0; i < NUM_SECTIONS; ++i)
+	{
+		header.sections[i].offset = offset;
+		header.sections[i].size = sectionSizes[i];
+		offset = UAlign(offset + sectionSizes[i]);
+	}
+	header.fileSize = offset;
+
+	// zeros up to the next aligned offset
+	const char padding[alignment] = {};
+	uint64_t written = sizeof(Header);
+	file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+
+	for (int i = 0; i < NUM_SECTIONS; ++i)
+	{
+		file.write(padding, header.sections[i].offset - written);
+		file.write(static_cast<const char*>(sectionData[i]), sectionSizes[i]);
+		written = header.sections[i].offset + sectionSizes[i];
+	}
+	file.write(padding, header.fileSize - written);
+
+	if (!file)
+	{
+		cout << "ERROR::SCENEFILE::WRITE_FAILED " << path << endl;
+		return false;
+	}
+
+	return true;
+}
+
+// Maps the whole file read only and checks every section lies inside it
+bool SceneFile::Map(const char* path)
+{
+	Unmap();
+
+	if (!file.Map(path))
+		return false;
+
+	const unsigned char* data = file.Data();
+	size_t size = file.Size();
+	header = reinterpret_cast<const Header*>(data);
+	bool valid = size >= sizeof(Header) && header->magic == magic && header->version == version
+		&& header->meshSize == sizeof(Mesh) && header->nodeSize == sizeof(Node) && header->fileSize <= size;
+
+	for (int i = 0; valid && i < NUM_SECTIONS; ++i)
+	{
+		const SectionEntry& section = header->sections[i];
+		valid = section.offset % alignment == 0 && section.offset <= size && section.size <= size - section.offset
+			&& section.size % UElementSize(i) == 0;
+	}
+
+	// every string ends inside the section
+	const SectionEntry& strings = header->sections[SECTION_STRINGS];
+	valid = valid && (strings.size == 0 || data[strings.offset + strings.size - 1] == '\0');
+
+	if (!valid)
+	{
+		cout << "ERROR::SCENEFILE::INVALID_FILE " << path << endl;
+		Unmap();
+		return false;
+	}
+
+	return true;
+}
+
+void SceneFile::Unmap()
+{
+	file.Unmap();
+	header = nullptr;
+}
+
+const void* SceneFile::Data(Section section) const
+{
+	return header != nullptr ? file.Data() + header->sections[section].offset : nullptr;
+}
+
+size_t SceneFile::Size(Section section) const
+{
+	return header != nullptr ? (size_t)header->sections[section].size : 0;
+}
+
+// Empty for offsets outside the string section
+const char* SceneFile::String(uint32_t offset) const
+{
+	if (offset >= Size(SECTION_STRINGS))
+		return "";
+
+	return static_cast<const char*>(Data(SECTION_STRINGS)) + offset;
+}
@@ -0,0 +1,141 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "MappedFile.h"
+
+// Binary scene container: meshes with their vertex and index data, the
+// node hierarchy with local transforms, materials and texture references.
+// Every section is an array of plain structs starting at an aligned offset,
+// so a mapped file is used in place. The vertex and index sections go to
+// glBufferStorage straight from the mapping and the picking triangles are
+// read from it while the scene is drawn, nothing is parsed or copied.
+// Little endian, the layout is the in memory one.
+class SceneFile
+{
+public:
+	static const uint32_t magic = 0x454E4353; // "SCNE"
+	static const uint32_t version = 1;
+	static const uint64_t alignment = 256; // of every section, enough for any GL buffer offset
+	static const uint32_t vertexSize = 8 * sizeof(float); // position, normal, texture coordinate
+
+	enum Section
+	{
+		SECTION_MESHES, // Mesh
+		SECTION_NODES, // Node, parents before their children
+		SECTION_MATERIALS, // Material
+		SECTION_TEXTURES, // string offsets of the texture paths
+		SECTION_STRINGS, // zero terminated
+		SECTION_VERTICES, // vertexSize bytes per vertex
+		SECTION_INDICES, // GLuint, relative to the first vertex of their mesh
+		SECTION_TRIANGLES, // local space positions, 3 per triangle, for picking and occlusion
+		NUM_SECTIONS
+	};
+
+	struct Range
+	{
+		uint32_t mode; // primitive type
+		uint32_t first; // first vertex, or first index relative to the mesh
+		uint32_t count;
+	};
+
+	struct Mesh
+	{
+		uint64_t vertexOffset; // bytes into the vertex section
+		uint32_t numVertices;
+		uint32_t firstIndex; // into the index section
+		uint32_t numIndices; // 0 for glDrawArrays
+		uint32_t numRanges;
+		Range ranges[3];
+		float boundsMin[3];
+		float boundsMax[3];
+		float center[3];
+		float radius;
+		float lodError;
+		uint32_t numLods; // levels of the chain starting here, coarser ones follow; 0 for those
+		uint32_t firstTriangle; // into the triangle section, 0 triangles for coarser levels
+		uint32_t numTriangles;
+	};
+
+	enum NodeFlag
+	{
+		NODE_DYNAMIC = 1 << 0,
+		NODE_OCCLUDER = 1 << 1
+	};
+
+	struct Node
+	{
+		int32_t parent; // -1 for roots
+		int32_t mesh; // -1 for groups
+		int32_t material;
+		uint32_t name; // string offset
+		uint32_t flags; // NodeFlag
+		float local[16]; // column major, relative to the parent
+	};
+
+	struct Material
+	{
+		int32_t baseTexture; // texture index, -1 for none
+		int32_t extraTexture;
+		uint32_t extraRanges; // bit per mesh range layering the extra texture
+	};
+
+	// Filled in by the cooker, then written with Write()
+	struct Contents
+	{
+		std::vector<Mesh> meshes;
+		std::vector<Node> nodes;
+		std::vector<Material> materials;
+		std::vector<uint32_t> textures;
+		std::vector<char> strings;
+		std::vector<unsigned char> vertices;
+		std::vector<uint32_t> indices;
+		std::vector<glm::vec3> triangles;
+
+		uint32_t AddString(const char* text);
+	};
+
+public:
+	static bool Write(const char* path, const Contents& contents);
+
+	// The sections stay valid until Unmap()
+	bool Map(const char* path);
+	void Unmap();
+
+	template<typename T>
+	const T* Get(Section section, size_t& count) const;
+	const void* Data(Section section) const;
+	size_t Size(Section section) const;
+	const char* String(uint32_t offset) const;
+
+private:
+	struct SectionEntry
+	{
+		uint64_t offset; // bytes from the start of the file
+		uint64_t size;
+	};
+
+	struct Header
+	{
+		uint32_t magic;
+		uint32_t version;
+		uint32_t meshSize; // catch files written with other struct layouts
+		uint32_t nodeSize;
+		uint64_t fileSize;
+		SectionEntry sections[NUM_SECTIONS];
+	};
+
+	MappedFile file;
+	const Header* header = nullptr;
+};
+
+template<typename T>
+const T* SceneFile::Get(Section section, size_t& count) const
+{
+	count = Size(section) / sizeof(T);
+	return static_cast<const T*>(Data(section));
+}
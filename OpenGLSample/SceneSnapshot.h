@@ -0,0 +1,48 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include <vector>
+
+// Model matrix of one moving draw item
+struct ItemTransform
+{
+	int item; // index in the scene draw list
+	glm::mat4 model;
+};
+
+// Everything the render thread needs from the main thread for one frame.
+// The main thread fills a free snapshot and publishes it; from then on it
+// is read only until the render thread hands it back.
+struct SceneSnapshot
+{
+	// camera
+	glm::mat4 view;
+	glm::mat4 projection;
+	glm::vec3 cameraPosition;
+	float cameraZoom;
+
+	// lights
+	glm::vec3 lightPositions[2];
+	glm::vec3 lightColors[2];
+	glm::vec3 objectColor;
+
+	// moving items only, static items keep the model of the draw list
+	std::vector<ItemTransform> transforms;
+
+	// window and render settings
+	int framebufferWidth;
+	int framebufferHeight;
+	bool deferredShading;
+	bool shadows;
+	int cullingMode;
+	bool occlusionCulling;
+	bool levelOfDetail;
+	int pacingMode; // FramePacer::Mode
+	bool pick; // picks under the crosshair with this frame's camera
+	bool showHud; // performance overlay on top of the frame
+	bool reverseZ; // float depth cleared to 0, nearer is greater
+	bool depthPrepass; // depth only pass before the forward or geometry pass
+	bool dynamicResolution; // scene targets scaled to hold the GPU budget
+	int benchmarkFrame; // frame of the camera path replay, -1 outside of one
+};
@@ -0,0 +1,140 @@
+#include <iostream>
+#include <glm/gtc/matrix_transform.hpp>
+#include "ShadowMap.h"
+#include "GLState.h"
+
+using namespace std;
+
+namespace
+{
+	// light frustum, the lights sit about 10 units away from the desk
+	const float lightFov = 45.0f;
+	const float lightNear = 1.0f;
+	const float lightFar = 30.0f;
+
+	// the shadow pass runs first in the frame, nothing before it sets depth state
+	void UBeginShadowDepth()
+	{
+		UGLState().Enable(GL_DEPTH_TEST);
+		UGLState().DepthFunc(GL_LESS);
+		UGLState().DepthMask(GL_TRUE);
+
+		// slope scaled bias against shadow acne
+		UGLState().Enable(GL_POLYGON_OFFSET_FILL);
+		glPolygonOffset(2.0f, 4.0f);
+	}
+}
+
+// Creates the cached and the composited depth targets
+bool ShadowMap::Create(int size)
+{
+	this->size = size;
+	valid = composited = false;
+
+	if (!UCreateTarget(staticFbo, staticDepthTexture))
+		return false;
+
+	return UCreateTarget(fbo, depthTexture);
+}
+
+void ShadowMap::Destroy()
+{
+	glDeleteTextures(1, &staticDepthTexture);
+	glDeleteTextures(1, &depthTexture);
+	glDeleteFramebuffers(1, &staticFbo);
+	glDeleteFramebuffers(1, &fbo);
+	staticFbo = staticDepthTexture = fbo = depthTexture = 0;
+	valid = composited = false;
+}
+
+// The cache is only rebuilt when the light moves or it was invalidated
+bool ShadowMap::NeedsStaticUpdate(const glm::vec3& lightPosition, const glm::vec3& target) const
+{
+	return !valid || lightPosition != cachedLightPosition || target != cachedTarget;
+}
+
+// The composited map is stale until the dynamic casters are drawn on the new cache
+bool ShadowMap::NeedsDynamicUpdate() const
+{
+	return !composited;
+}
+
+// Binds and clears the cached map for the static casters
+void ShadowMap::BeginStatic(const glm::vec3& lightPosition, const glm::vec3& target)
+{
+	glm::mat4 lightProjection = glm::perspective(glm::radians(lightFov), 1.0f, lightNear, lightFar);
+	glm::mat4 lightView = glm::lookAt(lightPosition, target, glm::vec3(0.0f, 1.0f, 0.0f));
+	lightSpace = lightProjection * lightView;
+
+	cachedLightPosition = lightPosition;
+	cachedTarget = target;
+	valid = true;
+	composited = false;
+	++staticRenders;
+
+	UGLState().BindFramebuffer(GL_FRAMEBUFFER, staticFbo);
+	UGLState().Viewport(0, 0, size, size);
+	UBeginShadowDepth(); // the clear needs the depth mask too
+	glClear(GL_DEPTH_BUFFER_BIT);
+}
+
+// Copies the cached map and binds it for the dynamic casters
+void ShadowMap::BeginDynamic()
+{
+	glCopyImageSubData(staticDepthTexture, GL_TEXTURE_2D, 0, 0, 0, 0,
+		depthTexture, GL_TEXTURE_2D, 0, 0, 0, 0, size, size, 1);
+	composited = true;
+
+	UGLState().BindFramebuffer(GL_FRAMEBUFFER, fbo);
+	UGLState().Viewport(0, 0, size, size);
+	UBeginShadowDepth();
+}
+
+void ShadowMap::End()
+{
+	UGLState().Disable(GL_POLYGON_OFFSET_FILL);
+	UGLState().BindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+// Without dynamic casters the cached map is sampled directly
+GLuint ShadowMap::Texture(bool hasDynamicCasters) const
+{
+	return hasDynamicCasters ? depthTexture : staticDepthTexture;
+}
+
+bool ShadowMap::UCreateTarget(GLuint& targetFbo, GLuint& targetTexture)
+{
+	glGenTextures(1, &targetTexture);
+	glBindTexture(GL_TEXTURE_2D, targetTexture);
+	glTexStorage2D(GL_TEXTURE_2D, 1, GL_DEPTH_COMPONENT24, size, size);
+
+	// hardware depth comparison with bilinear PCF
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_COMPARE_MODE, GL_COMPARE_REF_TO_TEXTURE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL);
+
+	// outside of the light frustum is lit
+	GLfloat border[] = { 1.0f, 1.0f, 1.0f, 1.0f };
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
+	glTexParameterfv(GL_TEXTURE_2D, GL_TEXTURE_BORDER_COLOR, border);
+
+	glGenFramebuffers(1, &targetFbo);
+	glBindFramebuffer(GL_FRAMEBUFFER, targetFbo);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, targetTexture, 0);
+	glDrawBuffer(GL_NONE);
+	glReadBuffer(GL_NONE);
+
+	GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+	glBindTexture(GL_TEXTURE_2D, 0);
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+	if (status != GL_FRAMEBUFFER_COMPLETE)
+	{
+		cout << "ERROR::SHADOWMAP::INCOMPLETE_FRAMEBUFFER " << status << endl;
+		return false;
+	}
+
+	return true;
+}
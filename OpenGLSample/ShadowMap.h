@@ -0,0 +1,40 @@
+#pragma once
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+// Shadow map for one scene light. Static casters are rendered once into a
+// cached map, they never move; dynamic casters are drawn on top of a copy of
+// it whenever one of them moves or the cache is rebuilt.
+class ShadowMap
+{
+public:
+	GLuint staticFbo = 0; // static casters only, cached
+	GLuint staticDepthTexture = 0;
+	GLuint fbo = 0; // static + dynamic casters
+	GLuint depthTexture = 0;
+	int size = 0;
+	glm::mat4 lightSpace = glm::mat4(1.0f); // light projection * light view
+	unsigned int staticRenders = 0; // number of times the cache was rebuilt
+
+public:
+	bool Create(int size);
+	void Destroy();
+
+	bool NeedsStaticUpdate(const glm::vec3& lightPosition, const glm::vec3& target) const;
+	bool NeedsDynamicUpdate() const;
+
+	void BeginStatic(const glm::vec3& lightPosition, const glm::vec3& target);
+	void BeginDynamic();
+	void End();
+
+	GLuint Texture(bool hasDynamicCasters) const;
+
+private:
+	bool valid = false;
+	bool composited = false; // the dynamic casters are on the current cache
+	glm::vec3 cachedLightPosition;
+	glm::vec3 cachedTarget;
+
+	bool UCreateTarget(GLuint& targetFbo, GLuint& targetTexture);
+};
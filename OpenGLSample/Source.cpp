@@ -1,5 +1,14 @@
 ﻿#include <iostream>
+#include <cassert>
 #include <cstdlib>
+#include <cstring>
+#include <chrono>
+#include <vector>
+#include <algorithm>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
 #include <GL/glew.h>        
 #include <GLFW/glfw3.h>
 #include <glm/glm.hpp>
@@ -11,7 +20,32 @@
 #include "Torus.h"
 #include "Box.h"
 #include "Texture.h"
+#include "FrameGraph.h"
+#include "ShadowMap.h"
+#include "DrawItem.h"
+#include "FrustumCuller.h"
+#include "Bvh.h"
+#include "OcclusionCuller.h"
+#include "GpuCuller.h"
+#include "LodManager.h"
+#include "JobSystem.h"
+#include "SceneSnapshot.h"
+#include "SpscQueue.h"
+#include "FramePacer.h"
+#include "Arena.h"
+#include "AllocationCounter.h"
+#include "GLState.h"
+#include "GLCounters.h"
+#include "GpuProfiler.h"
+#include "CpuProfiler.h"
+#include "PerformanceHud.h"
+#include "CameraPath.h"
+#include "Benchmark.h"
+#include "DynamicResolution.h"
+#include "SceneFile.h"
+#include "GltfImporter.h"
 #include "camera.h"
+#include "shader.hpp"
 
 using namespace std;
 
@@ -30,6 +64,9 @@ namespace
 	const int windowWidth = 800;
 	const int windowHeight = 600;
 
+	// shadow map resolution
+	const int shadowMapSize = 2048;
+
 	// GL mesh data
 	struct GLMesh
 	{
@@ -40,6 +77,29 @@ namespace
 
 	// Window
 	GLFWwindow* gWindow = nullptr;
+	int gFramebufferWidth = windowWidth; // written by the main thread, rendered from the snapshot
+	int gFramebufferHeight = windowHeight;
+
+	// Render thread. The main thread fills a free snapshot and publishes it,
+	// the render thread draws it and hands it back, so at most one frame is
+	// in flight while the next one is filled.
+	SceneSnapshot gSnapshots[2];
+	SpscQueue<SceneSnapshot*, 2> gPublishedSnapshots; // main thread to render thread
+	SpscQueue<SceneSnapshot*, 2> gFreeSnapshots; // render thread to main thread
+	const SceneSnapshot* gFrame = nullptr; // snapshot being rendered, render thread only
+	atomic<bool> gRenderThreadRunning(false);
+	mutex gPublishMutex; // the render thread sleeps on it until a snapshot or the stop arrives
+	condition_variable gSnapshotPublished;
+	// Moving item simulated on the main thread, only sent to the render thread
+	// in the snapshot after it changed
+	struct DynamicItem
+	{
+		ItemTransform transform;
+		bool dirty; // moved since the last published snapshot
+	};
+	vector<DynamicItem> gDynamicItems;
+	bool gHasDynamicItems = false; // some items stay out of the cached shadow maps, set before the render thread starts
+	bool gPickRequested = false; // left click since the last snapshot
 
 	// Meshes 
 	Sphere sphere;
@@ -61,11 +121,155 @@ namespace
 	GLuint gTextureWallLight;
 	GLuint gTextureCanvas;
 
+	// texture files of the desk, cooked scenes reference them by path
+	struct DeskTexture
+	{
+		const char* path;
+		GLuint* texture;
+	};
+	const DeskTexture deskTextures[] = {
+		{ "../resources/textures/Glass.png", &gTextureGlass },
+		{ "../resources/textures/BottleCap.png", &gTextureCap },
+		{ "../resources/textures/DarkWood.png", &gTextureDarkWood },
+		{ "../resources/textures/Metal.png", &gTextureMetal },
+		{ "../resources/textures/MatteBlack.png", &gTextureMatteBlack },
+		{ "../resources/textures/ShiaLisa.png", &gTextureArt },
+		{ "../resources/textures/Paper.png", &gTexturePaper },
+		{ "../resources/textures/WallLight.png", &gTextureWallLight },
+		{ "../resources/textures/Canvas.png", &gTextureCanvas },
+		{ "../resources/textures/ShiaLogo.png", &gTextureLogo }, // Needs to be on top
+	};
+
 	glm::vec2 gUVScale(1.0f, 1.0f);
 
 	// Shader
 	GLuint gModelProgramId;
 	//GLuint gLampProgramId;
+	GLuint gGeometryProgramId; // deferred geometry pass
+	GLuint gLightingProgramId; // deferred lighting pass
+	GLuint gShadowProgramId; // depth only pass from a light
+	GLuint gGpuModelProgramId; // forward pass for GPU culled draws
+	GLuint gGpuGeometryProgramId; // deferred geometry pass for GPU culled draws
+	GLuint gDepthProgramId; // depth prepass from the camera
+	GLuint gPresentProgramId; // copies the forward scene target to the window
+
+	// Scene draw list
+	vector<DrawItem> gSceneItems;
+	vector<DrawItem> gVisibleItems; // items that survived culling this frame
+
+	// per frame CPU work runs on every core, GL calls stay on this thread
+	JobSystem gJobSystem;
+
+	// Culling
+	enum CullingMode { CULL_NONE, CULL_FRUSTUM, CULL_BVH, CULL_GPU };
+	const char* const cullingModeNames[] = { "off", "SIMD frustum", "BVH", "GPU Hi-Z" };
+	CullingMode gCullingMode = CULL_BVH; // "F3" key cycles the culling modes
+	FrustumCuller gFrustumCuller;
+	Bvh gSceneBvh; // scene hierarchy for culling and picking
+	vector<int> gVisibleIndices;
+	OcclusionCuller gOcclusionCuller;
+	bool gOcclusionCulling = true; // "F4" key toggles software occlusion culling
+	const int occlusionBufferWidth = 256;
+	const int occlusionBufferHeight = 128;
+	GpuCuller gGpuCuller;
+	bool gGpuCullingSupported = false; // needs ARB_indirect_parameters
+
+	// Level of detail
+	LodManager gLodManager;
+	bool gLevelOfDetail = true; // "F5" key toggles level of detail
+	int gCylinderLods = -1; // chains registered by URegisterLods
+	int gSphereLods = -1;
+	int gTorusLods = -1;
+
+	// camera transforms of the frame being rendered, used for picking
+	glm::mat4 gView(1.0f);
+	glm::mat4 gProjection(1.0f);
+
+	// passes of the frame, redeclared every frame
+	FrameGraph gFrameGraph;
+
+	// memory of one frame on the render thread, freed at the start of the next
+	Arena gFrameArena;
+	const size_t frameArenaSize = 1024 * 1024;
+
+	// a frame with the same settings as the last ones must not allocate
+	const int steadyFramesBeforeCheck = 120;
+	int gSteadyFrames = 0;
+	unsigned long long gLastFrameSettings = 0;
+
+	// GL calls of the last finished frame, the log keeps the means over many frames
+	GLCounters gLastGLCounters = {};
+	GLCounterLog gGLCounterLog;
+	const char* const glCountersPath = "gl_counters.csv"; // a .json path writes JSON lines
+	const size_t glCountersInterval = 300; // frames per row
+
+	// GPU time per pass, read back a few frames late so it never stalls
+	GpuProfiler gGpuProfiler;
+	const int gpuProfilerFrames = 4;
+
+	// CPU scopes of every thread, "F7" key starts and stops a capture, --cpu-trace captures from launch
+	const char* const cpuTracePath = "cpu_trace.json";
+
+	// performance overlay, "F8" key toggles it
+	PerformanceHud gHud;
+	bool gShowHud = false;
+	float gLastCpuFrameMs = 0.0f; // render thread time of the last frame until the swap
+
+	// camera paths, "F9" key starts and stops a recording, --replay plays one back
+	CameraPath gRecordedPath;
+	bool gRecording = false;
+	const char* const cameraPathFile = "camera_path.bin";
+	CameraPath gReplayPath;
+	int gReplayFrame = -1; // next frame of gReplayPath, -1 when not replaying
+	int gDrainFrames = 0; // frames drawn after the replay until its GPU times are read back
+	bool gHeadless = false; // --headless: hidden window, uncapped, closes after the replay
+	uint32_t gInputKeys = 0; // CameraPath::Key bits of the frame being published
+
+	// per frame times of the replay, --benchmark writes them
+	Benchmark gBenchmark;
+	const char* gBenchmarkPath = nullptr;
+
+	// dynamic resolution, "F12" key toggles it, --gpu-budget sets the GPU time it holds
+	DynamicResolution gDynamicResolution;
+	bool gDynamicResolutionEnabled = true;
+	float gGpuBudgetMs = 15.0f; // leaves headroom under a 60 Hz frame
+	const float maxPresentSharpness = 0.6f; // at the lowest scale
+	int gSceneWidth = windowWidth; // scene targets of the frame being rendered
+	int gSceneHeight = windowHeight;
+	GLuint gPresentSampler = 0; // bilinear, the pooled targets are nearest
+
+	// binary scenes, --cook-scene writes the desk into one, --scene draws one instead of the desk
+	const char* gCookScenePath = nullptr;
+	const char* gScenePath = nullptr;
+	SceneFile gSceneFile; // stays mapped, the items read their triangles from it
+	GLuint gSceneBuffers[2] = { 0, 0 }; // vertices and indices of every mesh
+	vector<GLuint> gSceneVaos; // one per mesh, all on gSceneBuffers
+	vector<GLuint> gSceneTextures;
+
+	// --gltf draws the instances of a glTF file instead of the desk
+	const char* gGltfPath = nullptr;
+	GltfImporter gGltfImporter;
+
+	// stress mode, --stress NxMxK tiles the desk with randomized copies, --seed picks them
+	int gStressCounts[3] = { 0, 0, 0 };
+	uint32_t gStressSeed = 1;
+
+	// Deferred shading
+	GLuint gScreenVao; // empty VAO for the full screen triangle
+	bool gDeferredShading = false; // "F1" key switches between forward and deferred
+
+	// Shadows, one cached map per scene light
+	ShadowMap gShadowMaps[2];
+	glm::vec3 gShadowTarget(0.0f, 0.0f, 0.0f); // where the lights point at
+	bool gShadows = true; // "F2" key toggles shadows
+
+	// Depth buffer, reverse-Z keeps float precision far away from the camera
+	bool gReverseZSupported = false; // needs ARB_clip_control
+	bool gReverseZ = true; // "F11" key toggles reverse-Z
+	bool gDepthPrepass = false; // "F10" key toggles the depth prepass
+
+	// keys held down last frame, for one shot toggles
+	bool gKeyDown[GLFW_KEY_LAST + 1] = {};
 
 	// camera
 	Camera gCamera(glm::vec3(0.0f, 0.0f, 3.0f));
@@ -73,9 +277,20 @@ namespace
 	float gLastY = windowHeight / 2.0f;
 	bool gFirstMouse = true;
 
-	// timing
-	float gDeltaTime = 0.0f;
-	float gLastFrame = 0.0f;
+	// timing, the simulation advances in fixed steps and the snapshots
+	// interpolate between the last two steps
+	const double simulationStep = 1.0 / 120.0;
+	const double maxFrameTime = 0.25; // longer stalls are dropped, not simulated
+	double gLastFrameTime = 0.0;
+	double gSimulationAccumulator = 0.0;
+	glm::vec3 gPreviousCameraPosition; // camera position one step ago
+
+	// frame pacing, applied by the render thread
+	FramePacer gFramePacer;
+	FramePacer::Mode gPacingMode = FramePacer::PACING_VSYNC; // "F6" key cycles the pacing modes
+	const double cappedFps = 60.0;
+	const double pacingReportInterval = 5.0; // seconds between jitter reports
+	double gLastPacingReport = 0.0;
 
 	//Lighing 
 	// position and scale
@@ -98,12 +313,43 @@ namespace
 bool UInitialize(int, char* [], GLFWwindow** window);
 void UResizeWindow(GLFWwindow* window, int width, int height);
 void UProcessInput(GLFWwindow* window);
+void USimulate(GLFWwindow* window, float step);
 void UMousePositionCallback(GLFWwindow* window, double xpos, double ypos);
 void UMouseScrollCallback(GLFWwindow* window, double xoffset, double yoffset);
 void UMouseButtonCallback(GLFWwindow* window, int button, int action, int mods);
+void UPickObject();
+bool UKeyPressedOnce(GLFWwindow* window, int key);
+void UPublishSnapshot(SceneSnapshot& snapshot, float interpolation);
+uint32_t UReadInputKeys(GLFWwindow* window);
+int UReplayStep();
+void URecordFrame(const SceneSnapshot& snapshot);
+void UReportFramePacing();
+void UCheckSteadyState(size_t allocations);
+void URenderThread();
 void URender();
-bool UCreateShaderProgram(const char* vtxShaderSource, const char* fragShaderSource, GLuint& programId);
-void UDestroyShaderProgram(GLuint programId);
+void UAddShadowPass(FrameGraph::Resource shadowMaps[2]);
+void UAddForwardPass(const glm::mat4& view, const glm::mat4& projection, const FrameGraph::Resource shadowMaps[2], FrameGraph::Resource& backbuffer);
+void UAddDeferredPasses(const glm::mat4& view, const glm::mat4& projection, const FrameGraph::Resource shadowMaps[2], FrameGraph::Resource& backbuffer);
+void UAddHudPass(FrameGraph::Resource& backbuffer);
+void UAddPresentPass(FrameGraph::Resource color, FrameGraph::Resource& backbuffer);
+glm::mat4 UDepthProjection(const glm::mat4& projection);
+GLenum USceneDepthFormat();
+void UBeginSceneDepth();
+void UEndSceneDepth();
+void UDrawDepthPrepass(const glm::mat4& view, const glm::mat4& depthProjection);
+void USetCameraUniforms(GLuint programId, const glm::mat4& view, const glm::mat4& projection);
+void USetLightUniforms(GLuint programId);
+void UDrawItems(const vector<DrawItem>& items, GLuint programId);
+void UDrawItemsGpuCulled(GLuint programId, const glm::mat4& viewProjection, GLuint depthTexture);
+void UUpdateShadowMaps();
+void UDrawItemsDepth(const vector<DrawItem>& items, GLuint programId, bool dynamic);
+void URegisterLods();
+void UBuildScene(vector<DrawItem>& items);
+void UBuildStressScene(vector<DrawItem>& items, const int counts[3], uint32_t seed);
+bool UCookScene(const char* path, const vector<DrawItem>& items);
+bool ULoadScene(const char* path, vector<DrawItem>& items);
+void UDestroyScene();
+bool UImportGltf(const char* path, vector<DrawItem>& items);
 #pragma endregion
 
 #pragma region Shader Source code
@@ -116,6 +362,8 @@ const GLchar* cubeVertexShaderSource = GLSL(440,
 	out vec3 vertexFragmentPos; // For outgoing color / pixels to fragment shader
 	out vec2 vertexTextureCoordinate;
 
+	invariant gl_Position; // matches the depth prepass exactly for GL_EQUAL
+
 	//Uniform / Global variables for the  transform matrices
 	uniform mat4 model;
 	uniform mat4 view;
@@ -132,6 +380,41 @@ const GLchar* cubeVertexShaderSource = GLSL(440,
 	}
 );
 
+// Vertex shader for GPU culled draws, the model matrix comes from the culler's item buffer
+const GLchar* gpuCulledVertexShaderSource = GLSL(440,
+	layout(location = 0) in vec3 position;
+	layout(location = 1) in vec3 normal;
+	layout(location = 2) in vec2 textureCoordinate;
+	layout(location = 3) in uint itemIndex; // baseInstance of the indirect draw
+
+	struct Item
+	{
+		mat4 model;
+		vec4 boundsMin;
+		vec4 boundsMax;
+		uvec4 draws;
+	};
+
+	layout(std430, binding = 0) readonly buffer Items { Item items[]; };
+
+	out vec3 vertexNormal;
+	out vec3 vertexFragmentPos;
+	out vec2 vertexTextureCoordinate;
+
+	uniform mat4 view;
+	uniform mat4 projection;
+
+	void main()
+	{
+		mat4 model = items[itemIndex].model;
+		gl_Position = projection * view * model * vec4(position, 1.0f);
+
+		vertexFragmentPos = vec3(model * vec4(position, 1.0f));
+		vertexNormal = mat3(transpose(inverse(model))) * normal;
+		vertexTextureCoordinate = textureCoordinate;
+	}
+);
+
 // Fragment shader source code
 const  GLchar* cubeFragmentShaderSource = GLSL(440,
 	in vec3 vertexNormal; // For incoming normals
@@ -153,6 +436,32 @@ const  GLchar* cubeFragmentShaderSource = GLSL(440,
 	uniform bool multipleTextures;
 	uniform vec2 uvScale;
 
+	// Shadows
+	uniform sampler2DShadow shadowMap; // light 1
+	uniform mat4 lightSpace;
+	uniform sampler2DShadow shadowMap2; // light 2
+	uniform mat4 lightSpace2;
+	uniform bool shadowsEnabled;
+
+	// 1.0 when lit, 0.0 when fully in shadow
+	float ShadowFactor(sampler2DShadow map, mat4 lightMatrix, vec3 worldPos)
+	{
+		vec4 lightPos = lightMatrix * vec4(worldPos, 1.0);
+		vec3 coord = lightPos.xyz / lightPos.w * 0.5 + 0.5;
+
+		if (!shadowsEnabled || lightPos.w <= 0.0 || coord.z > 1.0)
+			return 1.0;
+
+		// 2x2 taps on top of the hardware bilinear compare
+		vec2 texel = 1.0 / vec2(textureSize(map, 0));
+		float lit = 0.0;
+		lit += texture(map, vec3(coord.xy + vec2(-0.5, -0.5) * texel, coord.z));
+		lit += texture(map, vec3(coord.xy + vec2(0.5, -0.5) * texel, coord.z));
+		lit += texture(map, vec3(coord.xy + vec2(-0.5, 0.5) * texel, coord.z));
+		lit += texture(map, vec3(coord.xy + vec2(0.5, 0.5) * texel, coord.z));
+		return lit * 0.25;
+	}
+
 	void main()
 	{
 		// Ambient lighting (global)
@@ -192,6 +501,14 @@ const  GLchar* cubeFragmentShaderSource = GLSL(440,
 		float specularComponent2 = pow(max(dot(viewDir, reflectDir2), 0.0), highlightSize2);
 		vec3 specular2 = specularIntensity2 * specularComponent2 * lightColor2;
 
+		// Shadows only block the direct light
+		float shadow = ShadowFactor(shadowMap, lightSpace, vertexFragmentPos);
+		float shadow2 = ShadowFactor(shadowMap2, lightSpace2, vertexFragmentPos);
+		diffuse *= shadow;
+		specular *= shadow;
+		diffuse2 *= shadow2;
+		specular2 *= shadow2;
+
 		// Texture holds the color to be used for all three components
 		vec4 textureColor = texture(uTexture, vertexTextureCoordinate * uvScale);
 
@@ -213,11 +530,300 @@ const  GLchar* cubeFragmentShaderSource = GLSL(440,
 	}
 );
 
+// G-buffer fragment shader, writes albedo and normals for the deferred path
+const GLchar* gBufferFragmentShaderSource = GLSL(440,
+	in vec3 vertexNormal; // For incoming normals
+	in vec3 vertexFragmentPos; // For incoming fragment position
+	in vec2 vertexTextureCoordinate;
+
+	layout(location = 0) out vec4 gAlbedo; // rgb albedo, a unused
+	layout(location = 1) out vec4 gNormal; // world space normal
+
+	uniform sampler2D uTexture;
+	uniform sampler2D uTextureExtra;
+	uniform bool multipleTextures;
+	uniform vec2 uvScale;
+
+	void main()
+	{
+		vec4 textureColor = texture(uTexture, vertexTextureCoordinate * uvScale);
+
+		if (multipleTextures)
+		{
+			vec4 extraTexture = texture(uTextureExtra, vertexTextureCoordinate * uvScale);
+
+			if (extraTexture.a != 0.0)
+				textureColor = extraTexture;
+		}
+
+		gAlbedo = vec4(textureColor.xyz, 1.0);
+		gNormal = vec4(normalize(vertexNormal), 0.0);
+	}
+);
+
+// Full screen triangle, no vertex buffer needed
+const GLchar* screenVertexShaderSource = GLSL(440,
+	out vec2 screenCoordinate;
+
+	void main()
+	{
+		screenCoordinate = vec2((gl_VertexID << 1) & 2, gl_VertexID & 2);
+		gl_Position = vec4(screenCoordinate * 2.0 - 1.0, 0.0, 1.0);
+	}
+);
+
+// Deferred lighting, same phong model as cubeFragmentShaderSource
+const GLchar* lightingFragmentShaderSource = GLSL(440,
+	in vec2 screenCoordinate;
+	out vec4 fragmentColor;
+
+	uniform sampler2D gAlbedo;
+	uniform sampler2D gNormal;
+	uniform sampler2D gDepth;
+	uniform mat4 inverseViewProjection; // rebuilds world position from depth
+	uniform bool reverseDepth; // depth is in [0, 1] with the far plane at 0
+
+	// Lights
+	uniform vec3 lightColor; // light 1
+	uniform vec3 lightPos;
+	uniform vec3 lightColor2; // light 2
+	uniform vec3 lightPos2;
+
+	uniform vec3 viewPosition;
+
+	// Shadows
+	uniform sampler2DShadow shadowMap; // light 1
+	uniform mat4 lightSpace;
+	uniform sampler2DShadow shadowMap2; // light 2
+	uniform mat4 lightSpace2;
+	uniform bool shadowsEnabled;
+
+	// 1.0 when lit, 0.0 when fully in shadow
+	float ShadowFactor(sampler2DShadow map, mat4 lightMatrix, vec3 worldPos)
+	{
+		vec4 lightPos = lightMatrix * vec4(worldPos, 1.0);
+		vec3 coord = lightPos.xyz / lightPos.w * 0.5 + 0.5;
+
+		if (!shadowsEnabled || lightPos.w <= 0.0 || coord.z > 1.0)
+			return 1.0;
+
+		// 2x2 taps on top of the hardware bilinear compare
+		vec2 texel = 1.0 / vec2(textureSize(map, 0));
+		float lit = 0.0;
+		lit += texture(map, vec3(coord.xy + vec2(-0.5, -0.5) * texel, coord.z));
+		lit += texture(map, vec3(coord.xy + vec2(0.5, -0.5) * texel, coord.z));
+		lit += texture(map, vec3(coord.xy + vec2(-0.5, 0.5) * texel, coord.z));
+		lit += texture(map, vec3(coord.xy + vec2(0.5, 0.5) * texel, coord.z));
+		return lit * 0.25;
+	}
+
+	void main()
+	{
+		float depth = texture(gDepth, screenCoordinate).r;
+
+		// nothing was drawn here, keep the clear color
+		if (depth == (reverseDepth ? 0.0 : 1.0))
+			discard;
+
+		vec4 clipPos = vec4(screenCoordinate * 2.0 - 1.0, reverseDepth ? depth : depth * 2.0 - 1.0, 1.0);
+		vec4 worldPos = inverseViewProjection * clipPos;
+		vec3 vertexFragmentPos = worldPos.xyz / worldPos.w;
+
+		vec4 albedo = texture(gAlbedo, screenCoordinate);
+		vec3 norm = normalize(texture(gNormal, screenCoordinate).xyz);
+
+		// Ambient lighting (global)
+		float ambientStrength = 0.1f; // Ambient strength
+		vec3 ambient = ambientStrength * vec3(1.0f, 1.0f, 1.0f); // Generates color
+
+		// Diffuse lighting
+		// Light 1
+		vec3 lightDirection = normalize(lightPos - vertexFragmentPos);
+		float impact = max(dot(norm, lightDirection), 0.0);
+		vec3 diffuse = impact * lightColor;
+		// Light 2
+		vec3 lightDirection2 = normalize(lightPos2 - vertexFragmentPos);
+		float impact2 = max(dot(norm, lightDirection2), 0.0);
+		vec3 diffuse2 = impact2 * lightColor2;
+
+		// Specular lighting, the same for every material as in the forward path
+		// Light 1
+		float specularIntensity = 1.0f; // Set specular light strength
+		float highlightSize = 7.0f; // Set specular highlight size
+		// Light 2
+		float specularIntensity2 = 0.01f; // Set specular light strength
+		float highlightSize2 = 3.0f; // Set specular highlight size
+
+		vec3 viewDir = normalize(viewPosition - vertexFragmentPos); // Calculate view direction
+
+		// Calculates reflection vector
+		vec3 reflectDir = reflect(-lightDirection, norm); // Light 1
+		vec3 reflectDir2 = reflect(-lightDirection2, norm); // Light 2
+
+		//Calculate specular component
+		// Light 1
+		float specularComponent = pow(max(dot(viewDir, reflectDir), 0.0), highlightSize);
+		vec3 specular = specularIntensity * specularComponent * lightColor;
+		// Light 2
+		float specularComponent2 = pow(max(dot(viewDir, reflectDir2), 0.0), highlightSize2);
+		vec3 specular2 = specularIntensity2 * specularComponent2 * lightColor2;
+
+		// Shadows only block the direct light
+		float shadow = ShadowFactor(shadowMap, lightSpace, vertexFragmentPos);
+		float shadow2 = ShadowFactor(shadowMap2, lightSpace2, vertexFragmentPos);
+		diffuse *= shadow;
+		specular *= shadow;
+		diffuse2 *= shadow2;
+		specular2 *= shadow2;
+
+		// Calculates phong
+		vec3 phong = (ambient + diffuse + specular) * albedo.xyz; // Light 1
+		vec3 phong2 = (ambient + diffuse2 + specular2) * albedo.xyz; // Light 2
+
+		fragmentColor = vec4(phong + phong2, 1.0); // Send lighting results to GPU
+	}
+);
+
+// Depth only vertex shader, renders the scene from a light
+const GLchar* shadowVertexShaderSource = GLSL(440,
+	layout(location = 0) in vec3 position;
+
+	uniform mat4 model;
+	uniform mat4 lightSpace;
+
+	void main()
+	{
+		gl_Position = lightSpace * model * vec4(position, 1.0f);
+	}
+);
+
+// Depth only fragment shader, depth is written by the fixed pipeline
+const GLchar* shadowFragmentShaderSource = GLSL(440,
+	void main()
+	{
+	}
+);
+
+// Depth prepass from the camera, positions only and the same transform as cubeVertexShaderSource
+const GLchar* depthVertexShaderSource = GLSL(440,
+	layout(location = 0) in vec3 position;
+
+	invariant gl_Position;
+
+	uniform mat4 model;
+	uniform mat4 view;
+	uniform mat4 projection;
+
+	void main()
+	{
+		gl_Position = projection * view * model * vec4(position, 1.0f);
+	}
+);
+
+// Upscales the scene target to the window. Below full resolution an
+// unsharp mask over the bilinear taps brings back some of the lost detail,
+// clamped to the neighbours so edges do not ring.
+const GLchar* presentFragmentShaderSource = GLSL(440,
+	in vec2 screenCoordinate;
+	out vec4 fragmentColor;
+
+	uniform sampler2D sceneColor;
+	uniform float sharpness; // 0 copies the target
+
+	void main()
+	{
+		vec3 center = texture(sceneColor, screenCoordinate).rgb;
+		if (sharpness <= 0.0)
+		{
+			fragmentColor = vec4(center, 1.0);
+			return;
+		}
+
+		vec2 texel = 1.0 / vec2(textureSize(sceneColor, 0));
+		vec3 left = texture(sceneColor, screenCoordinate - vec2(texel.x, 0.0)).rgb;
+		vec3 right = texture(sceneColor, screenCoordinate + vec2(texel.x, 0.0)).rgb;
+		vec3 down = texture(sceneColor, screenCoordinate - vec2(0.0, texel.y)).rgb;
+		vec3 up = texture(sceneColor, screenCoordinate + vec2(0.0, texel.y)).rgb;
+
+		vec3 minimum = min(center, min(min(left, right), min(down, up)));
+		vec3 maximum = max(center, max(max(left, right), max(down, up)));
+		vec3 sharpened = center + sharpness * (4.0 * center - left - right - down - up);
+
+		fragmentColor = vec4(clamp(sharpened, minimum, maximum), 1.0);
+	}
+);
+
 // possibly add lamp shaders
 #pragma endregion
 
 int main(int argc, char* argv[])
 {
+	CPU_PROFILE_THREAD("Main");
+	for (int i = 1; i < argc; ++i)
+	{
+		if (strcmp(argv[i], "--cpu-trace") == 0)
+			UCpuProfiler().SetCapturing(true);
+		else if (strcmp(argv[i], "--headless") == 0)
+			gHeadless = true;
+		else if (strcmp(argv[i], "--benchmark") == 0 && i + 1 < argc)
+			gBenchmarkPath = argv[++i];
+		else if (strcmp(argv[i], "--stress") == 0 && i + 1 < argc)
+		{
+			int* counts = gStressCounts;
+			if (sscanf(argv[++i], "%dx%dx%d", &counts[0], &counts[1], &counts[2]) != 3 || counts[0] <= 0 || counts[1] <= 0 || counts[2] <= 0)
+			{
+				cout << "ERROR::STRESS::INVALID_COUNTS " << argv[i] << ", expected NxMxK" << endl;
+				return EXIT_FAILURE;
+			}
+		}
+		else if (strcmp(argv[i], "--gpu-budget") == 0 && i + 1 < argc)
+		{
+			gGpuBudgetMs = (float)atof(argv[++i]);
+			if (gGpuBudgetMs <= 0.0f)
+			{
+				cout << "ERROR::DYNAMIC_RESOLUTION::INVALID_BUDGET " << argv[i] << endl;
+				return EXIT_FAILURE;
+			}
+		}
+		else if (strcmp(argv[i], "--cook-scene") == 0 && i + 1 < argc)
+			gCookScenePath = argv[++i];
+		else if (strcmp(argv[i], "--scene") == 0 && i + 1 < argc)
+			gScenePath = argv[++i];
+		else if (strcmp(argv[i], "--gltf") == 0 && i + 1 < argc)
+			gGltfPath = argv[++i];
+		else if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc)
+			gStressSeed = (uint32_t)strtoul(argv[++i], nullptr, 10);
+		else if (strcmp(argv[i], "--replay") == 0 && i + 1 < argc)
+		{
+			if (!gReplayPath.Load(argv[++i]))
+				return EXIT_FAILURE;
+
+			// the replay ends after its last frame, a path without one never would
+			if (gReplayPath.frames.empty())
+			{
+				cout << "ERROR::CAMERAPATH::EMPTY " << argv[i] << endl;
+				return EXIT_FAILURE;
+			}
+			gReplayFrame = 0;
+			gBenchmark.Create(gReplayPath.frames.size());
+		}
+		else if (strcmp(argv[i], "--compare") == 0 && i + 2 < argc)
+		{
+			// compares two benchmark runs without opening a window
+			return Benchmark::Compare(argv[i + 1], argv[i + 2]) ? EXIT_SUCCESS : EXIT_FAILURE;
+		}
+	}
+
+	// headless runs go as fast as the GPU allows and close when the replay ends,
+	// without one nothing would ever close the hidden window, cooking exits on its own
+	if (gHeadless && gReplayFrame < 0 && gCookScenePath == nullptr)
+	{
+		cout << "ERROR::HEADLESS::NO_REPLAY --headless needs --replay" << endl;
+		return EXIT_FAILURE;
+	}
+	if (gHeadless)
+		gPacingMode = FramePacer::PACING_CAPPED;
+
 	// if UInitialize returns false
 	if (!UInitialize(argc, argv, &gWindow))
 		return EXIT_FAILURE; // Terminates program
@@ -233,91 +839,218 @@ int main(int argc, char* argv[])
 	if (!UCreateShaderProgram(cubeVertexShaderSource, cubeFragmentShaderSource, gModelProgramId))
 		return EXIT_FAILURE; // Terminates program
 
-	// Loads textures
-	const char* texFilename = "../resources/textures/Glass.png";
-	if (!texture.UCreateTexture(texFilename, gTextureGlass))
-	{
-		cout << "Failed to load texture " << texFilename << endl;
+	// deferred path shaders
+	if (!UCreateShaderProgram(cubeVertexShaderSource, gBufferFragmentShaderSource, gGeometryProgramId))
 		return EXIT_FAILURE;
-	}
-	texFilename = "../resources/textures/BottleCap.png";
-	if (!texture.UCreateTexture(texFilename, gTextureCap))
-	{
-		cout << "Failed to load texture " << texFilename << endl;
+	if (!UCreateShaderProgram(screenVertexShaderSource, lightingFragmentShaderSource, gLightingProgramId))
 		return EXIT_FAILURE;
-	}
-	texFilename = "../resources/textures/DarkWood.png";
-	if (!texture.UCreateTexture(texFilename, gTextureDarkWood))
-	{
-		cout << "Failed to load texture " << texFilename << endl;
+
+	// shadow map shaders
+	if (!UCreateShaderProgram(shadowVertexShaderSource, shadowFragmentShaderSource, gShadowProgramId))
 		return EXIT_FAILURE;
-	}
-	texFilename = "../resources/textures/Metal.png";
-	if (!texture.UCreateTexture(texFilename, gTextureMetal))
-	{
-		cout << "Failed to load texture " << texFilename << endl;
+
+	// camera depth prepass and the copy of the forward target
+	if (!UCreateShaderProgram(depthVertexShaderSource, shadowFragmentShaderSource, gDepthProgramId))
 		return EXIT_FAILURE;
-	}
-	texFilename = "../resources/textures/MatteBlack.png";
-	if (!texture.UCreateTexture(texFilename, gTextureMatteBlack))
-	{
-		cout << "Failed to load texture " << texFilename << endl;
+	if (!UCreateShaderProgram(screenVertexShaderSource, presentFragmentShaderSource, gPresentProgramId))
 		return EXIT_FAILURE;
-	}
-	texFilename = "../resources/textures/ShiaLisa.png";
-	if (!texture.UCreateTexture(texFilename, gTextureArt))
-	{
-		cout << "Failed to load texture " << texFilename << endl;
+
+	// GPU culled variants of the forward and geometry passes
+	if (!UCreateShaderProgram(gpuCulledVertexShaderSource, cubeFragmentShaderSource, gGpuModelProgramId))
 		return EXIT_FAILURE;
+	if (!UCreateShaderProgram(gpuCulledVertexShaderSource, gBufferFragmentShaderSource, gGpuGeometryProgramId))
+		return EXIT_FAILURE;
+
+	// Loads textures, a cooked scene brings its own
+	for (const DeskTexture& deskTexture : deskTextures)
+	{
+		if (gScenePath != nullptr || gGltfPath != nullptr)
+			break;
+
+		if (!texture.UCreateTexture(deskTexture.path, *deskTexture.texture))
+		{
+			cout << "Failed to load texture " << deskTexture.path << endl;
+			return EXIT_FAILURE;
+		}
 	}
-	texFilename = "../resources/textures/Paper.png";
-	if (!texture.UCreateTexture(texFilename, gTexturePaper))
+	glUseProgram(gModelProgramId);
+	glUniform1i(glGetUniformLocation(gModelProgramId, "uTextureBase"), 0);
+	glUniform1i(glGetUniformLocation(gModelProgramId, "uTextureExtra"), 9);
+	glUniform1i(glGetUniformLocation(gModelProgramId, "shadowMap"), 10);
+	glUniform1i(glGetUniformLocation(gModelProgramId, "shadowMap2"), 11);
+
+	glUseProgram(gGeometryProgramId);
+	glUniform1i(glGetUniformLocation(gGeometryProgramId, "uTexture"), 0);
+	glUniform1i(glGetUniformLocation(gGeometryProgramId, "uTextureExtra"), 9);
+
+	glUseProgram(gGpuModelProgramId);
+	glUniform1i(glGetUniformLocation(gGpuModelProgramId, "uTextureBase"), 0);
+	glUniform1i(glGetUniformLocation(gGpuModelProgramId, "uTextureExtra"), 9);
+	glUniform1i(glGetUniformLocation(gGpuModelProgramId, "shadowMap"), 10);
+	glUniform1i(glGetUniformLocation(gGpuModelProgramId, "shadowMap2"), 11);
+
+	glUseProgram(gGpuGeometryProgramId);
+	glUniform1i(glGetUniformLocation(gGpuGeometryProgramId, "uTexture"), 0);
+	glUniform1i(glGetUniformLocation(gGpuGeometryProgramId, "uTextureExtra"), 9);
+
+	glUseProgram(gLightingProgramId);
+	glUniform1i(glGetUniformLocation(gLightingProgramId, "gAlbedo"), 0);
+	glUniform1i(glGetUniformLocation(gLightingProgramId, "gNormal"), 1);
+	glUniform1i(glGetUniformLocation(gLightingProgramId, "gDepth"), 2);
+	glUniform1i(glGetUniformLocation(gLightingProgramId, "shadowMap"), 10);
+	glUniform1i(glGetUniformLocation(gLightingProgramId, "shadowMap2"), 11);
+
+	glUseProgram(gPresentProgramId);
+	glUniform1i(glGetUniformLocation(gPresentProgramId, "sceneColor"), 0);
+
+	// the present pass filters the scaled scene up to the window
+	glGenSamplers(1, &gPresentSampler);
+	glSamplerParameteri(gPresentSampler, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glSamplerParameteri(gPresentSampler, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glSamplerParameteri(gPresentSampler, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glSamplerParameteri(gPresentSampler, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+	// render targets match the framebuffer, not the window size
+	glfwGetFramebufferSize(gWindow, &gFramebufferWidth, &gFramebufferHeight);
+
+	// one shadow map per scene light
+	for (ShadowMap& shadowMap : gShadowMaps)
 	{
-		cout << "Failed to load texture " << texFilename << endl;
-		return EXIT_FAILURE;
+		if (!shadowMap.Create(shadowMapSize))
+			return EXIT_FAILURE;
 	}
-	texFilename = "../resources/textures/WallLight.png";
-	if (!texture.UCreateTexture(texFilename, gTextureWallLight))
+	glGenVertexArrays(1, &gScreenVao);
+
+	// Builds the scene draw list once, the desk does not move
+	URegisterLods();
+	if (gScenePath != nullptr)
 	{
-		cout << "Failed to load texture " << texFilename << endl;
-		return EXIT_FAILURE;
+		if (!ULoadScene(gScenePath, gSceneItems))
+			return EXIT_FAILURE;
 	}
-	texFilename = "../resources/textures/Canvas.png";
-	if (!texture.UCreateTexture(texFilename, gTextureCanvas))
+	else if (gGltfPath != nullptr)
 	{
-		cout << "Failed to load texture " << texFilename << endl;
-		return EXIT_FAILURE;
+		if (!UImportGltf(gGltfPath, gSceneItems))
+			return EXIT_FAILURE;
 	}
-	texFilename = "../resources/textures/ShiaLogo.png";	// Needs to be on top
-	if (!texture.UCreateTexture(texFilename, gTextureLogo))
+	else if (gStressCounts[0] > 0)
+		UBuildStressScene(gSceneItems, gStressCounts, gStressSeed);
+	else
+		UBuildScene(gSceneItems);
+
+	// cooking only writes the scene out
+	if (gCookScenePath != nullptr)
+		return UCookScene(gCookScenePath, gSceneItems) ? EXIT_SUCCESS : EXIT_FAILURE;
+
+	gSceneBvh.Build(gSceneItems);
+
+	// culling never keeps more than the whole scene, so the lists never grow while rendering
+	gVisibleItems.reserve(gSceneItems.size());
+	gVisibleIndices.reserve(gSceneItems.size());
+
+	// moving items are simulated on the main thread, the render thread starts from the same models
+	for (size_t i = 0; i < gSceneItems.size(); ++i)
 	{
-		cout << "Failed to load texture " << texFilename << endl;
-		return EXIT_FAILURE;
+		if (gSceneItems[i].dynamic)
+			gDynamicItems.push_back({ { (int)i, gSceneItems[i].model }, false });
 	}
-	glUseProgram(gModelProgramId);
-	glUniform1i(glGetUniformLocation(gModelProgramId, "uTextureBase"), 0);
-	glUniform1i(glGetUniformLocation(gModelProgramId, "uTextureExtra"), 9);
+	gHasDynamicItems = !gDynamicItems.empty();
+
+	// GPU culling is optional, the other culling modes work everywhere
+	gGpuCullingSupported = gGpuCuller.Create(gFramebufferWidth, gFramebufferHeight);
+	if (gGpuCullingSupported)
+		gGpuCuller.Upload(gSceneItems);
 
 	// Sets BG to black (red, green, blue, alpha)
 	glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
 
-	// loops to render window while glfwWindowShouldClose returns false
+	gLastFrameTime = UClockSeconds();
+	gPreviousCameraPosition = gCamera.Position;
+
+	// the render thread owns the GL context from here on
+	for (SceneSnapshot& snapshot : gSnapshots)
+	{
+		snapshot.transforms.reserve(gDynamicItems.size());
+		gFreeSnapshots.Push(&snapshot);
+	}
+
+	glfwMakeContextCurrent(NULL);
+	gRenderThreadRunning = true;
+	thread renderThread(URenderThread);
+
+	// building snapshots may allocate, only the render side is checked
+	UCountAllocations(false);
+
+	// loops to handle input while glfwWindowShouldClose returns false
 	while (!glfwWindowShouldClose(gWindow))
 	{
 		// frame timing
-		float currentFrame = glfwGetTime(); // gets current frame
-		gDeltaTime = currentFrame - gLastFrame;
-		gLastFrame = currentFrame;
+		double currentFrame = UClockSeconds();
+		gSimulationAccumulator += min(currentFrame - gLastFrameTime, maxFrameTime);
+		gLastFrameTime = currentFrame;
 
 		// calls UProcessInput
 		UProcessInput(gWindow);
 
-		// calls URender
-		URender();
+		// fixed steps keep movement independent of the frame rate, a replay sets the camera itself
+		if (gReplayFrame >= 0)
+			gSimulationAccumulator = 0.0;
+		while (gSimulationAccumulator >= simulationStep)
+		{
+			gPreviousCameraPosition = gCamera.Position;
+			USimulate(gWindow, (float)simulationStep);
+			gSimulationAccumulator -= simulationStep;
+		}
+
+		// publishes the input state once the render thread handed a snapshot back
+		SceneSnapshot* snapshot = nullptr;
+		if (gFreeSnapshots.Pop(snapshot))
+		{
+			// a replay overrides the camera, keys and settings with the recorded frame
+			int replayFrame = UReplayStep();
+			if (replayFrame < 0)
+				gInputKeys = UReadInputKeys(gWindow);
+
+			UPublishSnapshot(*snapshot, (float)(gSimulationAccumulator / simulationStep));
+			snapshot->benchmarkFrame = replayFrame;
+
+			if (gRecording)
+				URecordFrame(*snapshot);
+
+			gPublishedSnapshots.Push(snapshot);
+			{
+				lock_guard<mutex> lock(gPublishMutex);
+			}
+			gSnapshotPublished.notify_one();
+		}
+
+		// calls glfwPollEvents, waits for events while both snapshots are in use
+		if (snapshot != nullptr)
+		{
+			CPU_PROFILE_SCOPE("glfwPollEvents");
+			glfwPollEvents();
+		}
+		else
+		{
+			CPU_PROFILE_SCOPE("glfwWaitEventsTimeout");
+			glfwWaitEventsTimeout(0.001);
+		}
+	}
 
-		// calls glfwPollEvents
-		glfwPollEvents();
+	// stops the render thread and takes the context back for cleanup
+	{
+		lock_guard<mutex> lock(gPublishMutex);
+		gRenderThreadRunning = false;
 	}
+	gSnapshotPublished.notify_one();
+	renderThread.join();
+	glfwMakeContextCurrent(gWindow);
+
+	// the render thread is done with the benchmark
+	if (gBenchmarkPath != nullptr && !gReplayPath.frames.empty())
+		gBenchmark.Write(gBenchmarkPath);
+	if (gRecording)
+		gRecordedPath.Save(cameraPathFile);
 
 	// Destroys meshes
 	cylinder.DestroyMesh();
@@ -330,8 +1063,38 @@ int main(int argc, char* argv[])
 	texture.UDestroyTexture(gTextureGlass);
 	// Add other destroy functions for other textures
 
+	// Destroys the cooked scene or the glTF meshes, if one was drawn
+	UDestroyScene();
+	gGltfImporter.Destroy();
+
+	// Destroys deferred path and frame graph resources
+	gFrameGraph.Destroy();
+	glDeleteVertexArrays(1, &gScreenVao);
+	glDeleteSamplers(1, &gPresentSampler);
+
+	// Destroys shadow maps
+	for (ShadowMap& shadowMap : gShadowMaps)
+		shadowMap.Destroy();
+
+	// Destroys the GPU culling buffers
+	gGpuCuller.Destroy();
+
 	// calls UDestroyShaderProgram
 	UDestroyShaderProgram(gModelProgramId);
+	UDestroyShaderProgram(gGeometryProgramId);
+	UDestroyShaderProgram(gLightingProgramId);
+	UDestroyShaderProgram(gShadowProgramId);
+	UDestroyShaderProgram(gGpuModelProgramId);
+	UDestroyShaderProgram(gGpuGeometryProgramId);
+	UDestroyShaderProgram(gDepthProgramId);
+	UDestroyShaderProgram(gPresentProgramId);
+
+	// a capture still running when the window closes is kept
+	if (UCpuProfiler().IsCapturing())
+	{
+		UCpuProfiler().SetCapturing(false);
+		UCpuProfiler().ExportTrace(cpuTracePath);
+	}
 
 	// Terminates program
 	exit(EXIT_SUCCESS);
@@ -347,6 +1110,10 @@ bool UInitialize(int argc, char* argv[], GLFWwindow** window)
 	glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 4);
 	glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
 
+	// benchmarks replay into a window nobody sees
+	if (gHeadless)
+		glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+
 #ifdef __APPLE__
 	glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
 #endif // For Apple Devices
@@ -384,39 +1151,160 @@ bool UInitialize(int argc, char* argv[], GLFWwindow** window)
 	// Displays OpenGL version
 	cout << "INFO: OpenGL Version: " << glGetString(GL_VERSION) << endl;
 
+	// reverse-Z remaps the clip space depth to [0, 1], core in 4.5
+	gReverseZSupported = GLEW_ARB_clip_control || GLEW_VERSION_4_5;
+	gReverseZ = gReverseZ && gReverseZSupported;
+
 	return true;
 }
 
 // Processes user input
 void UProcessInput(GLFWwindow* window)
 {
+	CPU_PROFILE_SCOPE("UProcessInput");
+
 	// "esc" key closes window
 	if (glfwGetKey(window, GLFW_KEY_ESCAPE) == GLFW_PRESS)
 		glfwSetWindowShouldClose(window, true);
 
-	// "W" key moves camera forwards
-	if (glfwGetKey(window, GLFW_KEY_W) == GLFW_PRESS)
-		gCamera.ProcessKeyboard(FORWARD, gDeltaTime);
+	// "F1" key switches between forward and deferred shading
+	if (UKeyPressedOnce(window, GLFW_KEY_F1))
+	{
+		gDeferredShading = !gDeferredShading;
+		cout << "INFO: Render path: " << (gDeferredShading ? "deferred" : "forward") << endl;
+	}
 
-	// "S" key moves camera backwards
-	if (glfwGetKey(window, GLFW_KEY_S) == GLFW_PRESS)
-		gCamera.ProcessKeyboard(BACKWARD, gDeltaTime);
+	// "F2" key toggles shadows
+	if (UKeyPressedOnce(window, GLFW_KEY_F2))
+		gShadows = !gShadows;
 
-	// "A" key moves camera left
-	if (glfwGetKey(window, GLFW_KEY_A) == GLFW_PRESS)
-		gCamera.ProcessKeyboard(LEFT, gDeltaTime);
+	// "F3" key cycles the culling modes
+	if (UKeyPressedOnce(window, GLFW_KEY_F3))
+	{
+		int numModes = gGpuCullingSupported ? 4 : 3;
+		gCullingMode = CullingMode((gCullingMode + 1) % numModes);
+		cout << "INFO: Culling: " << cullingModeNames[gCullingMode] << endl;
+	}
 
-	// "D" key moves camera right
-	if (glfwGetKey(window, GLFW_KEY_D) == GLFW_PRESS)
-		gCamera.ProcessKeyboard(RIGHT, gDeltaTime);
+	// "F4" key toggles software occlusion culling
+	if (UKeyPressedOnce(window, GLFW_KEY_F4))
+	{
+		gOcclusionCulling = !gOcclusionCulling;
+		cout << "INFO: Occlusion culling: " << (gOcclusionCulling ? "on" : "off") << endl;
+	}
 
-	// "Q" key moves camea up
-	if (glfwGetKey(window, GLFW_KEY_Q) == GLFW_PRESS)
-		gCamera.ProcessKeyboard(UP, gDeltaTime);
+	// "F5" key toggles level of detail
+	if (UKeyPressedOnce(window, GLFW_KEY_F5))
+	{
+		gLevelOfDetail = !gLevelOfDetail;
+		cout << "INFO: Level of detail: " << (gLevelOfDetail ? "on" : "off") << (gCullingMode == CULL_GPU ? " (GPU culling always draws the finest level)" : "") << endl;
+	}
+
+	// "F6" key cycles vsync, adaptive vsync and the frame cap
+	if (UKeyPressedOnce(window, GLFW_KEY_F6))
+	{
+		gPacingMode = FramePacer::Mode((gPacingMode + 1) % 3);
+		cout << "INFO: Frame pacing: " << FramePacer::modeNames[gPacingMode] << endl;
+	}
+
+	// "F7" key starts a CPU capture, the next press writes it out
+	if (UKeyPressedOnce(window, GLFW_KEY_F7))
+	{
+		CpuProfiler& profiler = UCpuProfiler();
+		if (profiler.IsCapturing())
+		{
+			profiler.SetCapturing(false);
+			profiler.ExportTrace(cpuTracePath);
+		}
+		else
+		{
+			profiler.Clear();
+			profiler.SetCapturing(true);
+			cout << "INFO: CPU trace capture started" << endl;
+		}
+	}
+
+	// "F8" key toggles the performance overlay
+	if (UKeyPressedOnce(window, GLFW_KEY_F8))
+		gShowHud = !gShowHud;
+
+	// "F10" key toggles the depth prepass
+	if (UKeyPressedOnce(window, GLFW_KEY_F10))
+	{
+		gDepthPrepass = !gDepthPrepass;
+		cout << "INFO: Depth prepass: " << (gDepthPrepass ? "on" : "off") << endl;
+	}
+
+	// "F11" key toggles reverse-Z
+	if (UKeyPressedOnce(window, GLFW_KEY_F11))
+	{
+		gReverseZ = !gReverseZ && gReverseZSupported;
+		cout << "INFO: Reverse-Z: " << (gReverseZ ? "on" : gReverseZSupported ? "off" : "not supported") << endl;
+	}
+
+	// "F12" key toggles dynamic resolution
+	if (UKeyPressedOnce(window, GLFW_KEY_F12))
+	{
+		gDynamicResolutionEnabled = !gDynamicResolutionEnabled;
+		cout << "INFO: Dynamic resolution: " << (gDynamicResolutionEnabled ? "on" : "off") << endl;
+	}
+
+	// "F9" key starts recording the camera path, the next press saves it
+	if (UKeyPressedOnce(window, GLFW_KEY_F9))
+	{
+		if (gRecording)
+		{
+			gRecording = false;
+			if (gRecordedPath.Save(cameraPathFile))
+				cout << "INFO: Camera path of " << gRecordedPath.frames.size() << " frames saved to " << cameraPathFile << endl;
+		}
+		else
+		{
+			gRecordedPath.frames.clear();
+			gRecording = true;
+			cout << "INFO: Camera path recording started" << endl;
+		}
+	}
+}
+
+// Advances the simulation by one fixed step
+void USimulate(GLFWwindow* window, float step)
+{
+	CPU_PROFILE_SCOPE("USimulate");
+
+	// "W" key moves camera forwards
+	if (glfwGetKey(window, GLFW_KEY_W) == GLFW_PRESS)
+		gCamera.ProcessKeyboard(FORWARD, step);
+
+	// "S" key moves camera backwards
+	if (glfwGetKey(window, GLFW_KEY_S) == GLFW_PRESS)
+		gCamera.ProcessKeyboard(BACKWARD, step);
+
+	// "A" key moves camera left
+	if (glfwGetKey(window, GLFW_KEY_A) == GLFW_PRESS)
+		gCamera.ProcessKeyboard(LEFT, step);
+
+	// "D" key moves camera right
+	if (glfwGetKey(window, GLFW_KEY_D) == GLFW_PRESS)
+		gCamera.ProcessKeyboard(RIGHT, step);
+
+	// "Q" key moves camea up
+	if (glfwGetKey(window, GLFW_KEY_Q) == GLFW_PRESS)
+		gCamera.ProcessKeyboard(UP, step);
 
 	// "E" key moves camera down
 	if (glfwGetKey(window, GLFW_KEY_E) == GLFW_PRESS)
-		gCamera.ProcessKeyboard(DOWN, gDeltaTime);
+		gCamera.ProcessKeyboard(DOWN, step);
+}
+
+// Returns true only on the frame a key goes down
+bool UKeyPressedOnce(GLFWwindow* window, int key)
+{
+	bool isDown = glfwGetKey(window, key) == GLFW_PRESS;
+	bool wasDown = gKeyDown[key];
+	gKeyDown[key] = isDown;
+
+	return isDown && !wasDown;
 }
 
 // callback for mouse movement
@@ -452,7 +1340,7 @@ void UMouseButtonCallback(GLFWwindow* window, int button, int action, int mods)
 	case GLFW_MOUSE_BUTTON_LEFT:
 	{
 		if (action == GLFW_PRESS)
-			cout << "Left mouse button pressed" << endl;
+			gPickRequested = true; // resolved by the render thread with the next snapshot
 		else
 			cout << "Left mouse button released" << endl;
 	}
@@ -482,192 +1370,1101 @@ void UMouseButtonCallback(GLFWwindow* window, int button, int action, int mods)
 	}
 }
 
-// Processes window resizing
+// Picks the object under the crosshair. The cursor is captured, so the ray
+// goes from the camera through the center of the screen.
+void UPickObject()
+{
+	glm::mat4 inverseViewProjection = glm::inverse(gProjection * gView);
+	glm::vec4 nearPoint = inverseViewProjection * glm::vec4(0.0f, 0.0f, -1.0f, 1.0f);
+	glm::vec4 farPoint = inverseViewProjection * glm::vec4(0.0f, 0.0f, 1.0f, 1.0f);
+	glm::vec3 origin = glm::vec3(nearPoint) / nearPoint.w;
+	glm::vec3 direction = glm::normalize(glm::vec3(farPoint) / farPoint.w - origin);
+
+	auto start = chrono::steady_clock::now();
+	Bvh::Hit hit = gSceneBvh.Raycast(gSceneItems, origin, direction);
+	auto end = chrono::steady_clock::now();
+	double microseconds = chrono::duration<double, micro>(end - start).count();
+
+	if (hit.item < 0)
+		cout << "Picked nothing (" << microseconds << " us)" << endl;
+	else
+		cout << "Picked " << gSceneItems[hit.item].region << " item " << hit.item << " triangle " << hit.triangle
+			<< " at distance " << hit.distance << " (" << microseconds << " us)" << endl;
+}
+
+// Keys of the frame in CameraPath::Key bits, in the order of the enum, so recordings and replays see the same input
+uint32_t UReadInputKeys(GLFWwindow* window)
+{
+	const int keys[] = { GLFW_KEY_W, GLFW_KEY_S, GLFW_KEY_A, GLFW_KEY_D, GLFW_KEY_Q, GLFW_KEY_E, GLFW_KEY_P };
+	uint32_t bits = 0;
+	for (int i = 0; i < (int)(sizeof(keys) / sizeof(keys[0])); ++i)
+	{
+		if (glfwGetKey(window, keys[i]) == GLFW_PRESS)
+			bits |= 1u << i;
+	}
+	return bits;
+}
+
+// Sets camera, keys and settings from the next frame of the replay and
+// returns its index. After the last frame a few more are drawn so the GPU
+// times come back; -1 while nothing is replayed.
+int UReplayStep()
+{
+	if (gReplayFrame < 0)
+	{
+		if (gDrainFrames > 0 && --gDrainFrames == 0)
+		{
+			cout << "INFO: Replay of " << gReplayPath.frames.size() << " frames finished" << endl;
+			if (gHeadless)
+				glfwSetWindowShouldClose(gWindow, true);
+		}
+		return -1;
+	}
+
+	const CameraPath::Frame& frame = gReplayPath.frames[gReplayFrame];
+	gCamera.Position = glm::vec3(frame.position[0], frame.position[1], frame.position[2]);
+	gPreviousCameraPosition = gCamera.Position;
+	gCamera.Yaw = frame.yaw;
+	gCamera.Pitch = frame.pitch;
+	gCamera.Zoom = frame.zoom;
+	gCamera.ProcessMouseMovement(0.0f, 0.0f); // recomputes the camera vectors from the angles
+	gInputKeys = frame.keys;
+
+	gDeferredShading = (frame.settings & CameraPath::SETTING_DEFERRED) != 0;
+	gShadows = (frame.settings & CameraPath::SETTING_SHADOWS) != 0;
+	gOcclusionCulling = (frame.settings & CameraPath::SETTING_OCCLUSION) != 0;
+	gLevelOfDetail = (frame.settings & CameraPath::SETTING_LOD) != 0;
+	gShowHud = (frame.settings & CameraPath::SETTING_HUD) != 0;
+	gReverseZ = (frame.settings & CameraPath::SETTING_REVERSE_Z) != 0 && gReverseZSupported;
+	gDepthPrepass = (frame.settings & CameraPath::SETTING_DEPTH_PREPASS) != 0;
+	gDynamicResolutionEnabled = (frame.settings & CameraPath::SETTING_DYNAMIC_RESOLUTION) != 0;
+
+	// paths recorded with GPU culling fall back where it is not supported
+	int cullingMode = (frame.settings >> 8) & 0xFF;
+	gCullingMode = CullingMode(min(cullingMode, gGpuCullingSupported ? (int)CULL_GPU : (int)CULL_BVH));
+
+	int index = gReplayFrame++;
+	if (gReplayFrame == (int)gReplayPath.frames.size())
+	{
+		gReplayFrame = -1;
+		gDrainFrames = gpuProfilerFrames + 1;
+	}
+	return index;
+}
+
+// Appends the published frame to the recording
+void URecordFrame(const SceneSnapshot& snapshot)
+{
+	CameraPath::Frame frame;
+	frame.position[0] = snapshot.cameraPosition.x;
+	frame.position[1] = snapshot.cameraPosition.y;
+	frame.position[2] = snapshot.cameraPosition.z;
+	frame.yaw = gCamera.Yaw;
+	frame.pitch = gCamera.Pitch;
+	frame.zoom = snapshot.cameraZoom;
+	frame.keys = gInputKeys;
+	frame.settings = (snapshot.deferredShading ? CameraPath::SETTING_DEFERRED : 0) | (snapshot.shadows ? CameraPath::SETTING_SHADOWS : 0)
+		| (snapshot.occlusionCulling ? CameraPath::SETTING_OCCLUSION : 0) | (snapshot.levelOfDetail ? CameraPath::SETTING_LOD : 0)
+		| (snapshot.showHud ? CameraPath::SETTING_HUD : 0) | (snapshot.reverseZ ? CameraPath::SETTING_REVERSE_Z : 0)
+		| (snapshot.depthPrepass ? CameraPath::SETTING_DEPTH_PREPASS : 0)
+		| (snapshot.dynamicResolution ? CameraPath::SETTING_DYNAMIC_RESOLUTION : 0) | (uint32_t)snapshot.cullingMode << 8;
+
+	gRecordedPath.frames.push_back(frame);
+}
+
+// Processes window resizing. Runs on the main thread, the render thread
+// picks the new size up from the next snapshot.
 void UResizeWindow(GLFWwindow* window, int width, int height)
 {
-	glViewport(0, 0, width, height);
+	gFramebufferWidth = width;
+	gFramebufferHeight = height;
 }
 
-// Handles frame rendering
-void URender()
+// Copies the camera, lights, moving items and settings into a snapshot for
+// the render thread. interpolation is how far the clock is into the next step.
+void UPublishSnapshot(SceneSnapshot& snapshot, float interpolation)
 {
-	// Projections
-	glm::mat4 perspective = glm::perspective(glm::radians(gCamera.Zoom), (GLfloat)windowWidth / (GLfloat)windowHeight, 0.1f, 100.0f);
-	glm::mat4 orthographic = glm::ortho(-5.0f, 5.0f, -5.0f, 5.0f, 0.1f, 100.0f);
+	CPU_PROFILE_SCOPE("UPublishSnapshot");
+
+	// Projections follow the framebuffer, a minimized window keeps the last aspect
+	static GLfloat aspect = (GLfloat)windowWidth / (GLfloat)windowHeight;
+	if (gFramebufferWidth > 0 && gFramebufferHeight > 0)
+		aspect = (GLfloat)gFramebufferWidth / (GLfloat)gFramebufferHeight;
+
+	glm::mat4 perspective = glm::perspective(glm::radians(gCamera.Zoom), aspect, 0.1f, 100.0f);
+	glm::mat4 orthographic = glm::ortho(-5.0f * aspect, 5.0f * aspect, -5.0f, 5.0f, 0.1f, 100.0f);
 	glm::mat4 projection = perspective;
 	// Projection indicator
 	bool isPerspective = false;
 
 	// "P" key projection changes
-	if (glfwGetKey(gWindow, GLFW_KEY_P) == GLFW_PRESS && isPerspective == true)
+	if ((gInputKeys & CameraPath::KEY_ORTHOGRAPHIC) != 0 && isPerspective == true)
 	{
 		isPerspective = false;
 		projection = perspective;
 	}
-	if (glfwGetKey(gWindow, GLFW_KEY_P) == GLFW_PRESS && isPerspective == false)
+	if ((gInputKeys & CameraPath::KEY_ORTHOGRAPHIC) != 0 && isPerspective == false)
 	{
 		isPerspective = true;
 		projection = orthographic;
 	}
 
-	// z-depth
-	glEnable(GL_DEPTH_TEST);
+	// Transforms camera, the position is blended between the last two steps
+	glm::vec3 cameraPosition = glm::mix(gPreviousCameraPosition, gCamera.Position, interpolation);
+	snapshot.view = glm::lookAt(cameraPosition, cameraPosition + gCamera.Front, gCamera.Up);
+	snapshot.projection = projection;
+	snapshot.cameraPosition = cameraPosition;
+	snapshot.cameraZoom = gCamera.Zoom;
+
+	snapshot.lightPositions[0] = gLightPosition;
+	snapshot.lightPositions[1] = gLightPosition2;
+	snapshot.lightColors[0] = gLightColor;
+	snapshot.lightColors[1] = gLightColor2;
+	snapshot.objectColor = gObjectColor;
+
+	// only what moved, the render thread keeps the models it was sent before
+	snapshot.transforms.clear();
+	for (DynamicItem& dynamicItem : gDynamicItems)
+	{
+		if (!dynamicItem.dirty)
+			continue;
 
-	// sets window color to black
-	glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
-	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+		snapshot.transforms.push_back(dynamicItem.transform);
+		dynamicItem.dirty = false;
+	}
 
-	glUseProgram(gModelProgramId);
+	snapshot.framebufferWidth = gFramebufferWidth;
+	snapshot.framebufferHeight = gFramebufferHeight;
+	snapshot.deferredShading = gDeferredShading;
+	snapshot.shadows = gShadows;
+	snapshot.cullingMode = gCullingMode;
+	snapshot.occlusionCulling = gOcclusionCulling;
+	snapshot.levelOfDetail = gLevelOfDetail;
+	snapshot.pacingMode = gPacingMode;
+	snapshot.pick = gPickRequested;
+	snapshot.showHud = gShowHud;
+	snapshot.reverseZ = gReverseZ;
+	snapshot.depthPrepass = gDepthPrepass;
+	snapshot.dynamicResolution = gDynamicResolutionEnabled;
+	gPickRequested = false;
+}
+
+// Render thread: owns the GL context and draws every published snapshot
+void URenderThread()
+{
+	CPU_PROFILE_THREAD("Render");
+	glfwMakeContextCurrent(gWindow);
+
+	// the main thread set up the context without the state copy
+	UGLState().Invalidate();
+
+	// one job thread per core, the render thread is one of them
+	bool created = gJobSystem.Create(max(1, (int)thread::hardware_concurrency()));
+	gFrustumCuller.jobs = &gJobSystem;
+	gLodManager.jobs = &gJobSystem;
+
+	// low resolution depth for the occluders, one band per core
+	created = created && gOcclusionCuller.Create(occlusionBufferWidth, occlusionBufferHeight, &gJobSystem);
+
+	// the swap interval belongs to the context, so pacing lives here
+	gFramePacer.targetFps = gHeadless ? 0.0 : cappedFps; // no target, capped mode does not wait
+	gFramePacer.Create(FramePacer::PACING_VSYNC, 600);
+	gLastPacingReport = UClockSeconds();
+
+	gFrameArena.Create(frameArenaSize);
+	gGLCounterLog.Create(glCountersPath, glCountersInterval);
+
+	// the graph times its passes, the culling steps inside them time themselves
+	if (gGpuProfiler.Create(gpuProfilerFrames))
+		gFrameGraph.profiler = &gGpuProfiler;
+
+	// a scale shows in the GPU times once its frame is read back
+	gDynamicResolution.Create(gGpuBudgetMs, gpuProfilerFrames + 1);
+
+	// the overlay is optional, the frame draws without it
+	gHud.Create();
+
+	if (!created)
+		glfwSetWindowShouldClose(gWindow, true);
+
+	while (created && gRenderThreadRunning.load())
+	{
+		// sleeps while the main thread is stalled, in a modal loop or long input handling
+		SceneSnapshot* snapshot = nullptr;
+		{
+			unique_lock<mutex> lock(gPublishMutex);
+			gSnapshotPublished.wait(lock, [&snapshot] { return gPublishedSnapshots.Pop(snapshot) || !gRenderThreadRunning.load(); });
+		}
+		if (snapshot == nullptr)
+			continue;
+
+		// the memory of the last frame is reused
+		gFrameArena.Reset();
+		gJobSystem.ResetThreadArenas();
+		UGLState().BeginFrame();
+
+		gFrame = snapshot;
+		size_t allocations = UAllocationCount();
+		URender();
+		UCheckSteadyState(UAllocationCount() - allocations);
+
+		// GPU times arrive a few frames late, tagged with their replay frame
+		gBenchmark.SetCpuTime(gFrame->benchmarkFrame, gLastCpuFrameMs);
+		gBenchmark.SetGpuTime(gGpuProfiler.frameTag, gGpuProfiler.frameMs);
+		gFrame = nullptr;
+
+		gLastGLCounters = UGLCounters();
+		UGLCounters() = {};
+		gGLCounterLog.AddFrame(gLastGLCounters);
+
+		UReportFramePacing();
+
+		// wakes the main thread if it waits for a free snapshot
+		gFreeSnapshots.Push(snapshot);
+		glfwPostEmptyEvent();
+	}
+
+	// Stops the culling and the job threads
+	gOcclusionCuller.Destroy();
+	gJobSystem.Destroy();
+	gFramePacer.Destroy();
+	gFrameArena.Destroy();
+	gGLCounterLog.Destroy();
+	gGpuProfiler.Destroy();
+	gFrameGraph.profiler = nullptr;
+	gHud.Destroy();
+
+	glfwMakeContextCurrent(NULL);
+}
+
+// Handles frame rendering on the render thread, everything the main thread owns comes from gFrame
+void URender()
+{
+	CPU_PROFILE_SCOPE("URender");
+	double frameStart = UClockSeconds();
+
+	// minimized windows have nothing to draw
+	if (gFrame->framebufferWidth <= 0 || gFrame->framebufferHeight <= 0)
+		return;
+
+	if (gFrame->pacingMode != gFramePacer.GetMode())
+		gFramePacer.SetMode(FramePacer::Mode(gFrame->pacingMode));
+
+	gGpuProfiler.BeginFrame(gFrame->benchmarkFrame);
+
+	// the scene targets shrink while the GPU is over budget, without
+	// timestamp queries there is nothing to go by
+	if (gFrame->dynamicResolution && gFrameGraph.profiler != nullptr)
+		gDynamicResolution.Update(gGpuProfiler.frameMs);
+	else
+		gDynamicResolution.Reset();
+
+	gSceneWidth = gDynamicResolution.ScaledSize(gFrame->framebufferWidth);
+	gSceneHeight = gDynamicResolution.ScaledSize(gFrame->framebufferHeight);
+
+	// the pyramid follows the scene depth size
+	if (gGpuCullingSupported)
+	{
+		gGpuCuller.Resize(gSceneWidth, gSceneHeight);
+		gGpuCuller.reverseDepth = gFrame->reverseZ;
+	}
+
+	// moving items take the transforms simulated on the main thread
+	for (const ItemTransform& transform : gFrame->transforms)
+		gSceneItems[transform.item].model = transform.model;
 
 	// Transforms camera
-	glm::mat4 view = gCamera.GetViewMatrix();
-
-	// sends transform data to the shader program
-	GLint modelLoc = glGetUniformLocation(gModelProgramId, "model");
-	GLint viewLoc = glGetUniformLocation(gModelProgramId, "view");
-	GLint projLoc = glGetUniformLocation(gModelProgramId, "projection");
-	GLuint texturesLoc = glGetUniformLocation(gModelProgramId, "texture");
-	GLuint multipleTexturesLoc = glGetUniformLocation(gModelProgramId, "multipleTextures");
-	glUniform1i(multipleTexturesLoc, false);
-
-	glUniformMatrix4fv(viewLoc, 1, GL_FALSE, glm::value_ptr(view));
-	glUniformMatrix4fv(projLoc, 1, GL_FALSE, glm::value_ptr(projection));
-
-	// Reference matrix uniforms from the Cube Shader program for the cub color, light color, light position, and camera position
-	GLint objectColorLoc = glGetUniformLocation(gModelProgramId, "objectColor");
-	GLint lightColorLoc = glGetUniformLocation(gModelProgramId, "lightColor"); // Light color 1
-	GLint lightPositionLoc = glGetUniformLocation(gModelProgramId, "lightPos"); // Light pos 1
-	GLint lightColorLoc2 = glGetUniformLocation(gModelProgramId, "lightColor2"); // Light color 2
-	GLint lightPositionLoc2 = glGetUniformLocation(gModelProgramId, "lightPos2"); // Light pos 2
-	GLint viewPositionLoc = glGetUniformLocation(gModelProgramId, "viewPosition");
-
-	// Pass color, light, and camera data to the Cube Shader program's corresponding uniforms
-	glUniform3f(objectColorLoc, gObjectColor.r, gObjectColor.g, gObjectColor.b);
+	glm::mat4 view = gFrame->view;
+	glm::mat4 projection = gFrame->projection;
+
+	gView = view;
+	gProjection = projection;
+
+	// a click is resolved with the camera of the frame it happened in
+	if (gFrame->pick)
+		UPickObject();
+
+	// distant meshes switch to coarser levels before culling copies them. The
+	// GPU culler draws the finest ranges it was uploaded with, the items match
+	// them so the shadow passes and the triangle count agree with what is drawn.
+	if (gFrame->levelOfDetail && gFrame->cullingMode != CULL_GPU)
+		gLodManager.Select(gSceneItems, gFrame->cameraPosition, gFrame->cameraZoom, gSceneHeight);
+	else
+		gLodManager.UseFinest(gSceneItems);
+
+	// items that moved update their branch of the hierarchy, once the branches
+	// add up to more than the whole tree one bottom up pass is cheaper
+	if (!gFrame->transforms.empty())
+	{
+		if (gFrame->transforms.size() * (gSceneBvh.depth + 1) >= gSceneBvh.nodes.size())
+			gSceneBvh.Refit(gSceneItems);
+		else
+		{
+			for (const ItemTransform& transform : gFrame->transforms)
+				gSceneBvh.RefitItem(gSceneItems, transform.item);
+		}
+
+		if (gFrame->cullingMode == CULL_GPU)
+			gGpuCuller.UpdateTransforms(gSceneItems);
+	}
+
+	// Only items inside the view frustum are submitted
+	if (gFrame->cullingMode == CULL_FRUSTUM)
+	{
+		gFrustumCuller.ExtractPlanes(projection * view);
+		gFrustumCuller.UpdateBounds(gSceneItems);
+		gFrustumCuller.Cull(gSceneItems, gVisibleItems);
+	}
+	else if (gFrame->cullingMode == CULL_BVH)
+	{
+		gFrustumCuller.ExtractPlanes(projection * view);
+		gSceneBvh.CullFrustum(gFrustumCuller.planes, gVisibleIndices);
+
+		// draw list copied in parallel, the GL submission stays on this thread
+		gVisibleItems.resize(gVisibleIndices.size());
+		gJobSystem.ParallelFor(gVisibleIndices.size(), 1024, [](size_t begin, size_t end)
+		{
+			for (size_t i = begin; i < end; ++i)
+				gVisibleItems[i] = gSceneItems[gVisibleIndices[i]];
+		});
+	}
+	else if (gFrame->cullingMode == CULL_GPU)
+	{
+		// the render paths cull and draw on the GPU
+		gVisibleItems.clear();
+	}
+	else
+	{
+		gVisibleItems = gSceneItems;
+	}
+
+	// items hidden behind the big occluders are dropped on the CPU
+	if (gFrame->occlusionCulling && gFrame->cullingMode != CULL_GPU)
+	{
+		gOcclusionCuller.RenderOccluders(gSceneItems, projection * view);
+		gOcclusionCuller.Cull(gVisibleItems);
+	}
+
+	// passes declare what they read and write, the graph orders them, culls
+	// the ones nothing reads and aliases the transient targets
+	gFrameGraph.Reset(gFrameArena);
+	FrameGraph::Resource backbuffer = gFrameGraph.ImportBackbuffer(gFrame->framebufferWidth, gFrame->framebufferHeight);
+	FrameGraph::Resource shadowMaps[2] = { -1, -1 };
+
+	if (gFrame->shadows)
+		UAddShadowPass(shadowMaps);
+
+	if (gFrame->deferredShading)
+		UAddDeferredPasses(view, projection, shadowMaps, backbuffer);
+	else
+		UAddForwardPass(view, projection, shadowMaps, backbuffer);
+
+	if (gFrame->showHud)
+		UAddHudPass(backbuffer);
+
+	{
+		CPU_PROFILE_SCOPE("Frame Graph");
+		gFrameGraph.Compile();
+		gFrameGraph.Execute();
+		gGpuProfiler.EndFrame();
+	}
+
+	gLastCpuFrameMs = (float)((UClockSeconds() - frameStart) * 1000.0);
+
+	// the frame cap holds the swap back until the frame is due
+	{
+		CPU_PROFILE_SCOPE("WaitForNextFrame");
+		gFramePacer.WaitForNextFrame();
+	}
+	{
+		CPU_PROFILE_SCOPE("glfwSwapBuffers");
+		glfwSwapBuffers(gWindow);
+	}
+	gFramePacer.FramePresented();
+}
+
+// Prints the frame interval statistics every few seconds
+void UReportFramePacing()
+{
+	double now = UClockSeconds();
+	if (now - gLastPacingReport < pacingReportInterval)
+		return;
+
+	gLastPacingReport = now;
+	FramePacer::Stats stats = gFramePacer.ComputeStats();
+
+	cout << "INFO: Frame pacing (" << FramePacer::modeNames[gFramePacer.GetMode()] << "): " << stats.mean << " ms mean, "
+		<< stats.stdDev << " ms jitter, " << stats.p99 << " ms p99, " << stats.min << "-" << stats.max << " ms, "
+		<< stats.numHitches << " hitches in " << stats.numFrames << " frames" << endl;
+
+	const GLState::Stats& state = UGLState().lastFrame;
+	cout << "INFO: GL calls last frame: " << gLastGLCounters.numDrawCalls << " draws, " << gLastGLCounters.numPrimitives << " primitives, "
+		<< gLastGLCounters.numUniformUploads << " uniforms, " << state.numSkipped << " of " << state.numCalls << " state calls filtered" << endl;
+
+	// nested regions are indented under their pass
+	for (const GpuProfiler::Region& region : gGpuProfiler.Regions())
+	{
+		cout << "INFO: GPU " << string(region.depth * 2, ' ') << region.name << ": " << region.averageMs << " ms mean, "
+			<< region.lastMs << " ms last" << endl;
+	}
+}
+
+// Once the settings held still for a while, every frame reuses the memory
+// of the last one. Release builds do not count and never report.
+void UCheckSteadyState(size_t allocations)
+{
+	unsigned long long settings = (unsigned long long)gFrame->framebufferWidth << 32 | (unsigned long long)gFrame->framebufferHeight << 17
+		| (unsigned long long)gDynamicResolution.Step() << 12 | gFrame->cullingMode << 8 | gFrame->pacingMode << 4 | gFrame->deferredShading << 3 | gFrame->shadows << 2
+		| gFrame->depthPrepass << 10 | gFrame->reverseZ << 7 | gFrame->showHud << 6 | gFrame->occlusionCulling << 1 | gFrame->levelOfDetail;
+
+	// picking and new settings may grow the buffers
+	if (gFrame->pick || settings != gLastFrameSettings)
+	{
+		gLastFrameSettings = settings;
+		gSteadyFrames = 0;
+		return;
+	}
+
+	if (++gSteadyFrames < steadyFramesBeforeCheck || allocations == 0)
+		return;
+
+	cout << "ERROR::RENDER::STEADY_STATE_ALLOCATIONS " << allocations << endl;
+	assert(allocations == 0);
+}
+
+// Shadow pass: the maps are owned by ShadowMap and only redrawn when something changed
+void UAddShadowPass(FrameGraph::Resource shadowMaps[2])
+{
+	FrameGraph::Resource imported[2];
+
+	for (int i = 0; i < 2; ++i)
+	{
+		FrameGraph::TextureDesc desc = { gShadowMaps[i].size, gShadowMaps[i].size, GL_DEPTH_COMPONENT24 };
+		imported[i] = gFrameGraph.Import(i == 0 ? "Shadow Map" : "Shadow Map 2", gShadowMaps[i].Texture(gHasDynamicItems), desc);
+	}
+
+	gFrameGraph.AddPass("Shadow",
+		[&](FrameGraph::Builder& builder)
+		{
+			shadowMaps[0] = builder.Write(imported[0]);
+			shadowMaps[1] = builder.Write(imported[1]);
+
+			return []()
+			{
+				UUpdateShadowMaps();
+			};
+		});
+}
+
+// Forward pass: shades every fragment with full phong for both lights into a
+// scene target, the present pass copies it to the window
+void UAddForwardPass(const glm::mat4& view, const glm::mat4& projection, const FrameGraph::Resource shadowMaps[2], FrameGraph::Resource& backbuffer)
+{
+	FrameGraph::Resource color = -1;
+	FrameGraph::Resource depth = -1;
+
+	gFrameGraph.AddPass("Forward",
+		[&](FrameGraph::Builder& builder)
+		{
+			color = builder.Create("Scene Color", { gSceneWidth, gSceneHeight, GL_RGBA8 });
+			depth = builder.Create("Scene Depth", { gSceneWidth, gSceneHeight, USceneDepthFormat() });
+			if (shadowMaps[0] >= 0)
+			{
+				builder.Read(shadowMaps[0]);
+				builder.Read(shadowMaps[1]);
+			}
+
+			return [view, projection, depth]()
+			{
+				// z-depth
+				UBeginSceneDepth();
+
+				// sets window color to black
+				glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
+				glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+				glm::mat4 depthProjection = UDepthProjection(projection);
+				if (gFrame->depthPrepass && gFrame->cullingMode != CULL_GPU)
+					UDrawDepthPrepass(view, depthProjection);
+
+				GLuint programId = gFrame->cullingMode == CULL_GPU ? gGpuModelProgramId : gModelProgramId;
+				UGLState().UseProgram(programId);
+
+				// sends transform and light data to the shader program
+				USetCameraUniforms(programId, view, depthProjection);
+				USetLightUniforms(programId);
+
+				// Draws the scene
+				if (gFrame->cullingMode == CULL_GPU)
+					UDrawItemsGpuCulled(programId, projection * view, gFrameGraph.Texture(depth));
+				else
+					UDrawItems(gVisibleItems, programId);
+
+				UEndSceneDepth();
+				UGLState().UseProgram(0);
+			};
+		});
+
+	UAddPresentPass(color, backbuffer);
+}
+
+// Deferred passes: geometry pass into transient G-buffer targets, then one lighting pass per pixel
+void UAddDeferredPasses(const glm::mat4& view, const glm::mat4& projection, const FrameGraph::Resource shadowMaps[2], FrameGraph::Resource& backbuffer)
+{
+	FrameGraph::Resource albedo = -1; // rgb albedo
+	FrameGraph::Resource normal = -1; // world space normal
+	FrameGraph::Resource depth = -1; // depth used to rebuild world position
+	FrameGraph::Resource color = -1; // lit scene, upscaled by the present pass
+
+	gFrameGraph.AddPass("Geometry",
+		[&](FrameGraph::Builder& builder)
+		{
+			albedo = builder.Create("Albedo", { gSceneWidth, gSceneHeight, GL_RGBA8 });
+			normal = builder.Create("Normal", { gSceneWidth, gSceneHeight, GL_RGBA16F });
+			depth = builder.Create("Depth", { gSceneWidth, gSceneHeight, USceneDepthFormat() });
+
+			return [view, projection, depth]()
+			{
+				UBeginSceneDepth();
+				glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
+				glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+				glm::mat4 depthProjection = UDepthProjection(projection);
+				if (gFrame->depthPrepass && gFrame->cullingMode != CULL_GPU)
+					UDrawDepthPrepass(view, depthProjection);
+
+				GLuint programId = gFrame->cullingMode == CULL_GPU ? gGpuGeometryProgramId : gGeometryProgramId;
+				UGLState().UseProgram(programId);
+				USetCameraUniforms(programId, view, depthProjection);
+
+				if (gFrame->cullingMode == CULL_GPU)
+					UDrawItemsGpuCulled(programId, projection * view, gFrameGraph.Texture(depth));
+				else
+					UDrawItems(gVisibleItems, programId);
+
+				UEndSceneDepth();
+			};
+		});
+
+	gFrameGraph.AddPass("Lighting",
+		[&](FrameGraph::Builder& builder)
+		{
+			builder.Read(albedo);
+			builder.Read(normal);
+			builder.Read(depth);
+			if (shadowMaps[0] >= 0)
+			{
+				builder.Read(shadowMaps[0]);
+				builder.Read(shadowMaps[1]);
+			}
+			color = builder.Create("Scene Color", { gSceneWidth, gSceneHeight, GL_RGBA8 });
+
+			return [view, projection, albedo, normal, depth]()
+			{
+				UGLState().Disable(GL_DEPTH_TEST);
+				glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
+				glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+				UGLState().UseProgram(gLightingProgramId);
+				USetLightUniforms(gLightingProgramId);
+
+				// G-buffer targets on the units set up in main
+				UGLState().BindTexture(0, GL_TEXTURE_2D, gFrameGraph.Texture(albedo));
+				UGLState().BindTexture(1, GL_TEXTURE_2D, gFrameGraph.Texture(normal));
+				UGLState().BindTexture(2, GL_TEXTURE_2D, gFrameGraph.Texture(depth));
+
+				// the G-buffer depth was written with the depth projection
+				glm::mat4 inverseViewProjection = glm::inverse(UDepthProjection(projection) * view);
+				GLint inverseViewProjectionLoc = glGetUniformLocation(gLightingProgramId, "inverseViewProjection");
+				GLint reverseDepthLoc = glGetUniformLocation(gLightingProgramId, "reverseDepth");
+				UUniformMatrix4fv(inverseViewProjectionLoc, 1, GL_FALSE, glm::value_ptr(inverseViewProjection));
+				UUniform1i(reverseDepthLoc, gFrame->reverseZ);
+
+				// full screen triangle, the vertices are generated in the vertex shader
+				UGLState().BindVertexArray(gScreenVao);
+				UDrawArrays(GL_TRIANGLES, 0, 3);
+				UGLState().BindVertexArray(0);
+
+				UGLState().Enable(GL_DEPTH_TEST);
+				UGLState().UseProgram(0);
+			};
+		});
+
+	UAddPresentPass(color, backbuffer);
+}
+
+// Upscales the scene target into the window
+void UAddPresentPass(FrameGraph::Resource color, FrameGraph::Resource& backbuffer)
+{
+	gFrameGraph.AddPass("Present",
+		[&](FrameGraph::Builder& builder)
+		{
+			builder.Read(color);
+			backbuffer = builder.Write(backbuffer);
+
+			return [color]()
+			{
+				UGLState().Disable(GL_DEPTH_TEST);
+				UGLState().UseProgram(gPresentProgramId);
+				UGLState().BindTexture(0, GL_TEXTURE_2D, gFrameGraph.Texture(color));
+				glBindSampler(0, gPresentSampler);
+
+				// sharper the further the scene is scaled down
+				float scale = gDynamicResolution.Scale();
+				float range = gDynamicResolution.maxScale - gDynamicResolution.minScale;
+				GLint sharpnessLoc = glGetUniformLocation(gPresentProgramId, "sharpness");
+				UUniform1f(sharpnessLoc, range > 0.0f ? maxPresentSharpness * (gDynamicResolution.maxScale - scale) / range : 0.0f);
+
+				// full screen triangle, every pixel is overwritten so nothing is cleared
+				UGLState().BindVertexArray(gScreenVao);
+				UDrawArrays(GL_TRIANGLES, 0, 3);
+				UGLState().BindVertexArray(0);
+				glBindSampler(0, 0);
+
+				UGLState().Enable(GL_DEPTH_TEST);
+				UGLState().UseProgram(0);
+			};
+		});
+}
+
+// Projection the camera passes rasterize with. Culling, picking and the Hi-Z
+// test keep the standard projection, with reverse-Z only the depth written
+// to the scene targets changes: [0, 1] with the far plane at 0.
+glm::mat4 UDepthProjection(const glm::mat4& projection)
+{
+	if (!gFrame->reverseZ)
+		return projection;
+
+	// z' = (w - z) / 2, with clip control this is 1 - the standard window depth
+	glm::mat4 reverse(1.0f);
+	reverse[2][2] = -0.5f;
+	reverse[3][2] = 0.5f;
+	return reverse * projection;
+}
+
+// Reverse-Z needs float depth, most of its precision is near 0
+GLenum USceneDepthFormat()
+{
+	return gFrame->reverseZ ? GL_DEPTH_COMPONENT32F : GL_DEPTH_COMPONENT24;
+}
+
+// Depth state of the camera passes, the shadow maps set their own
+void UBeginSceneDepth()
+{
+	UGLState().Enable(GL_DEPTH_TEST);
+
+	if (gFrame->reverseZ)
+	{
+		glClipControl(GL_LOWER_LEFT, GL_ZERO_TO_ONE);
+		glClearDepth(0.0);
+		UGLState().DepthFunc(GL_GREATER);
+	}
+}
+
+void UEndSceneDepth()
+{
+	if (gFrame->reverseZ)
+	{
+		glClipControl(GL_LOWER_LEFT, GL_NEGATIVE_ONE_TO_ONE);
+		glClearDepth(1.0);
+	}
+
+	UGLState().DepthFunc(GL_LESS);
+	UGLState().DepthMask(GL_TRUE);
+}
+
+// Lays down the depth of the visible items with the position only program,
+// the main pass then shades each pixel once with GL_EQUAL and no depth writes
+void UDrawDepthPrepass(const glm::mat4& view, const glm::mat4& depthProjection)
+{
+	gGpuProfiler.Begin("Depth Prepass");
+
+	UGLState().UseProgram(gDepthProgramId);
+	GLint viewLoc = glGetUniformLocation(gDepthProgramId, "view");
+	GLint projLoc = glGetUniformLocation(gDepthProgramId, "projection");
+	UUniformMatrix4fv(viewLoc, 1, GL_FALSE, glm::value_ptr(view));
+	UUniformMatrix4fv(projLoc, 1, GL_FALSE, glm::value_ptr(depthProjection));
+
+	UGLState().ColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+	UDrawItemsDepth(gVisibleItems, gDepthProgramId, false);
+	UDrawItemsDepth(gVisibleItems, gDepthProgramId, true);
+	UGLState().ColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+
+	UGLState().DepthFunc(GL_EQUAL);
+	UGLState().DepthMask(GL_FALSE);
+	gGpuProfiler.End();
+}
+
+// Performance overlay on top of whatever the frame drew last
+void UAddHudPass(FrameGraph::Resource& backbuffer)
+{
+	gFrameGraph.AddPass("HUD",
+		[&](FrameGraph::Builder& builder)
+		{
+			backbuffer = builder.Write(backbuffer);
+
+			return []()
+			{
+				// counters of the last finished frame, this one is still being drawn
+				PerformanceHud::Stats stats;
+				stats.cpuMs = gLastCpuFrameMs;
+				stats.gpuMs = gGpuProfiler.frameMs;
+				stats.drawCalls = gLastGLCounters.numDrawCalls;
+				stats.triangles = gLastGLCounters.numPrimitives;
+				stats.targetBytes = gFrameGraph.physicalBytes;
+				stats.arenaBytes = gFrameArena.peak;
+				stats.resolutionScale = gDynamicResolution.Scale();
+				stats.sceneWidth = gSceneWidth;
+				stats.sceneHeight = gSceneHeight;
+
+				gHud.Draw(gFrame->framebufferWidth, gFrame->framebufferHeight, stats);
+			};
+		});
+}
+
+void USetCameraUniforms(GLuint programId, const glm::mat4& view, const glm::mat4& projection)
+{
+	GLint viewLoc = glGetUniformLocation(programId, "view");
+	GLint projLoc = glGetUniformLocation(programId, "projection");
+	UUniformMatrix4fv(viewLoc, 1, GL_FALSE, glm::value_ptr(view));
+	UUniformMatrix4fv(projLoc, 1, GL_FALSE, glm::value_ptr(projection));
+
+	GLint UVScaleLoc = glGetUniformLocation(programId, "uvScale");
+	UUniform2fv(UVScaleLoc, 1, glm::value_ptr(gUVScale));
+}
+
+// Sends light and camera position data to a program that does the phong lighting
+void USetLightUniforms(GLuint programId)
+{
+	// Reference matrix uniforms from the shader program for the object color, light color, light position, and camera position
+	GLint objectColorLoc = glGetUniformLocation(programId, "objectColor");
+	GLint lightColorLoc = glGetUniformLocation(programId, "lightColor"); // Light color 1
+	GLint lightPositionLoc = glGetUniformLocation(programId, "lightPos"); // Light pos 1
+	GLint lightColorLoc2 = glGetUniformLocation(programId, "lightColor2"); // Light color 2
+	GLint lightPositionLoc2 = glGetUniformLocation(programId, "lightPos2"); // Light pos 2
+	GLint viewPositionLoc = glGetUniformLocation(programId, "viewPosition");
+
+	// Pass color, light, and camera data to the shader program's corresponding uniforms
+	UUniform3f(objectColorLoc, gFrame->objectColor.r, gFrame->objectColor.g, gFrame->objectColor.b);
 
 	// Light 1 color and position
-	glUniform3f(lightColorLoc, gLightColor.x, gLightColor.y, gLightColor.z);
-	glUniform3f(lightPositionLoc, gLightPosition.x, gLightPosition.y, gLightPosition.z);
+	UUniform3f(lightColorLoc, gFrame->lightColors[0].x, gFrame->lightColors[0].y, gFrame->lightColors[0].z);
+	UUniform3f(lightPositionLoc, gFrame->lightPositions[0].x, gFrame->lightPositions[0].y, gFrame->lightPositions[0].z);
 	// Light 2 color and position
-	glUniform3f(lightColorLoc2, gLightColor2.x, gLightColor2.y, gLightColor2.z);
-	glUniform3f(lightPositionLoc2, gLightPosition2.x, gLightPosition2.y, gLightPosition2.z);
+	UUniform3f(lightColorLoc2, gFrame->lightColors[1].x, gFrame->lightColors[1].y, gFrame->lightColors[1].z);
+	UUniform3f(lightPositionLoc2, gFrame->lightPositions[1].x, gFrame->lightPositions[1].y, gFrame->lightPositions[1].z);
+
+	const glm::vec3 cameraPosition = gFrame->cameraPosition;
+	UUniform3f(viewPositionLoc, cameraPosition.x, cameraPosition.y, cameraPosition.z);
+
+	// Shadow maps and light transforms
+	GLint lightSpaceLoc = glGetUniformLocation(programId, "lightSpace");
+	GLint lightSpaceLoc2 = glGetUniformLocation(programId, "lightSpace2");
+	GLint shadowsEnabledLoc = glGetUniformLocation(programId, "shadowsEnabled");
+	UUniformMatrix4fv(lightSpaceLoc, 1, GL_FALSE, glm::value_ptr(gShadowMaps[0].lightSpace));
+	UUniformMatrix4fv(lightSpaceLoc2, 1, GL_FALSE, glm::value_ptr(gShadowMaps[1].lightSpace));
+	UUniform1i(shadowsEnabledLoc, gFrame->shadows);
+
+	UGLState().BindTexture(10, GL_TEXTURE_2D, gShadowMaps[0].Texture(gHasDynamicItems));
+	UGLState().BindTexture(11, GL_TEXTURE_2D, gShadowMaps[1].Texture(gHasDynamicItems));
+}
 
-	const glm::vec3 cameraPosition = gCamera.Position;
-	glUniform3f(viewPositionLoc, cameraPosition.x, cameraPosition.y, cameraPosition.z);
+// Draws every item of a draw list with the currently bound program
+void UDrawItems(const vector<DrawItem>& items, GLuint programId)
+{
+	GLint modelLoc = glGetUniformLocation(programId, "model");
+	GLint multipleTexturesLoc = glGetUniformLocation(programId, "multipleTextures");
 
-	GLint UVScaleLoc = glGetUniformLocation(gModelProgramId, "uvScale");
-	glUniform2fv(UVScaleLoc, 1, glm::value_ptr(gUVScale));
+	// items sharing textures and meshes skip the binds through the state copy
+	GLState& state = UGLState();
 
-#pragma region Bottle
-	/*BOTTLE*/
-	// bottle parent
-	glm::mat4 bottleScale = glm::scale(glm::vec3(0.09f, 0.09f, 0.09f)); // scale
-	glm::mat4 bottleRotation = glm::rotate(190.0f, glm::vec3(0.0f, 1.0f, 0.0f)); // rotation
-	glm::mat4 bottleTranslation = glm::translate(glm::vec3(0.0f, -1.0f, 0.0f)); // translation
-	glm::mat4 bottleModel = bottleTranslation * bottleRotation * bottleScale;
+	for (const DrawItem& item : items)
+	{
+		state.BindTexture(0, GL_TEXTURE_2D, item.texture);
+
+		if (item.textureExtra != 0)
+			state.BindTexture(9, GL_TEXTURE_2D, item.textureExtra); // unit 9 must match uTextureExtra
+
+		state.BindVertexArray(item.vao);
+		UUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(item.model));
+
+		// Draws the triangles
+		for (int i = 0; i < item.numRanges; ++i)
+		{
+			const DrawRange& range = item.ranges[i];
+			UUniform1i(multipleTexturesLoc, range.extraTexture);
+
+			if (item.indexed)
+				UDrawElements(range.mode, range.count, GL_UNSIGNED_INT, (void*)(sizeof(GLuint) * range.first));
+			else
+				UDrawArrays(range.mode, range.first, range.count);
+		}
+	}
 
-	//Bottle Cylinder 1 base
-	// Turns on multiple textures
-	multipleTexturesLoc = glGetUniformLocation(gModelProgramId, "multipleTextures");
-	glUniform1i(multipleTexturesLoc, false);
+	// Deactivates the VAO
+	state.BindVertexArray(0);
+}
 
-	glActiveTexture(GL_TEXTURE0);
-	glBindTexture(GL_TEXTURE_2D, gTextureGlass);
+// Culls and draws the whole scene on the GPU in two phases
+void UDrawItemsGpuCulled(GLuint programId, const glm::mat4& viewProjection, GLuint depthTexture)
+{
+	gFrustumCuller.ExtractPlanes(viewProjection);
+
+	// items visible against last frame's depth
+	gGpuProfiler.Begin("Cull Early");
+	gGpuCuller.Cull(0, viewProjection, gFrustumCuller.planes);
+	gGpuProfiler.End();
+	gGpuProfiler.Begin("Draw Early");
+	gGpuCuller.Draw(0, programId);
+	gGpuProfiler.End();
+
+	// pyramid from what is drawn so far, then the items that became visible
+	gGpuProfiler.Begin("Hi-Z");
+	gGpuCuller.BuildHiZ(depthTexture);
+	gGpuProfiler.End();
+	gGpuProfiler.Begin("Cull Late");
+	gGpuCuller.Cull(1, viewProjection, gFrustumCuller.planes);
+	gGpuProfiler.End();
+	gGpuProfiler.Begin("Draw Late");
+	gGpuCuller.Draw(1, programId);
+	gGpuProfiler.End();
+}
 
-	glActiveTexture(GL_TEXTURE9);// GL_TEXTURE8 number must be changes to the highest one
-	glBindTexture(GL_TEXTURE_2D, gTextureLogo);
+// Redraws the cached static shadow maps when a light moved, then the dynamic
+// casters on top when one of them moved or the cache under them changed
+void UUpdateShadowMaps()
+{
+	const glm::vec3* lightPositions = gFrame->lightPositions;
+
+	bool castersMoved = !gFrame->transforms.empty(); // one transform per item that moved
+
+	UGLState().UseProgram(gShadowProgramId);
+	GLint lightSpaceLoc = glGetUniformLocation(gShadowProgramId, "lightSpace");
+
+	for (int i = 0; i < 2; ++i)
+	{
+		ShadowMap& shadowMap = gShadowMaps[i];
+
+		// static casters, steady state costs nothing
+		if (shadowMap.NeedsStaticUpdate(lightPositions[i], gShadowTarget))
+		{
+			shadowMap.BeginStatic(lightPositions[i], gShadowTarget);
+			UUniformMatrix4fv(lightSpaceLoc, 1, GL_FALSE, glm::value_ptr(shadowMap.lightSpace));
+			UDrawItemsDepth(gSceneItems, gShadowProgramId, false);
+			shadowMap.End();
+		}
 
-	glBindVertexArray(cylinder.cylinderMesh.vao);
+		// dynamic casters on top of a copy of the cache
+		if (gHasDynamicItems && (castersMoved || shadowMap.NeedsDynamicUpdate()))
+		{
+			shadowMap.BeginDynamic();
+			UUniformMatrix4fv(lightSpaceLoc, 1, GL_FALSE, glm::value_ptr(shadowMap.lightSpace));
+			UDrawItemsDepth(gSceneItems, gShadowProgramId, true);
+			shadowMap.End();
+		}
+	}
 
-	glm::mat4 scale = glm::scale(glm::vec3(3.0f, 10.0f, 3.0f)); // scale
-	glm::mat4 rotation = glm::rotate(0.0f, glm::vec3(1.0, 1.0f, 1.0f)); // rotation
-	glm::mat4 translation = glm::translate(glm::vec3(0.0f, 0.0f, 0.0f)); // translation
-	glm::mat4 model = bottleModel * translation * rotation * scale;
-	glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
+	UGLState().UseProgram(0);
+	UGLState().Viewport(0, 0, gFrame->framebufferWidth, gFrame->framebufferHeight);
+}
 
-	glProgramUniform4f(gModelProgramId, texturesLoc, 1.0f, 1.0f, 0.0f, 1.0f);
+// Draws the static or the dynamic items of a draw list into the bound depth target
+void UDrawItemsDepth(const vector<DrawItem>& items, GLuint programId, bool dynamic)
+{
+	GLint modelLoc = glGetUniformLocation(programId, "model");
+	GLState& state = UGLState();
 
-	// Draws the triangles
-	glDrawArrays(GL_TRIANGLE_FAN, 0, 36);
-	glDrawArrays(GL_TRIANGLE_FAN, 36, 36);
+	for (const DrawItem& item : items)
+	{
+		if (item.dynamic != dynamic)
+			continue;
 
-	multipleTexturesLoc = glGetUniformLocation(gModelProgramId, "multipleTextures");
-	glUniform1i(multipleTexturesLoc, true);
+		state.BindVertexArray(item.vao);
+		UUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(item.model));
 
-	glDrawArrays(GL_TRIANGLE_STRIP, 72, 146);
+		for (int i = 0; i < item.numRanges; ++i)
+		{
+			const DrawRange& range = item.ranges[i];
 
-	// Turns off multiple textures
-	multipleTexturesLoc = glGetUniformLocation(gModelProgramId, "multipleTextures");
-	glUniform1i(multipleTexturesLoc, false);
+			if (item.indexed)
+				UDrawElements(range.mode, range.count, GL_UNSIGNED_INT, (void*)(sizeof(GLuint) * range.first));
+			else
+				UDrawArrays(range.mode, range.first, range.count);
+		}
+	}
 
-	// Deactivates the VAO
-	glBindVertexArray(0);
+	state.BindVertexArray(0);
+}
 
-	//Cylinder 2 top
-	glActiveTexture(GL_TEXTURE0);
-	glBindTexture(GL_TEXTURE_2D, gTextureGlass);
-	glBindVertexArray(cylinder.cylinderMesh.vao);
+#pragma endregion
+
+#pragma region Scene
+// Registers the level of detail chains of the tessellated meshes, finest first
+void URegisterLods()
+{
+	vector<LodLevel> levels;
+
+	// cylinder: bottom fan, top fan, body strip
+	levels.push_back({ cylinder.cylinderMesh.vao, false, { { GL_TRIANGLE_FAN, 0, 36 }, { GL_TRIANGLE_FAN, 36, 36 }, { GL_TRIANGLE_STRIP, 72, 146 } }, 3, cylinder.cylinderMesh.error });
+	for (const auto& mesh : cylinder.lodMeshes)
+	{
+		GLsizei segments = (mesh.numVert - 2) / 4;
+		levels.push_back({ mesh.vao, false, { { GL_TRIANGLE_FAN, 0, segments }, { GL_TRIANGLE_FAN, segments, segments }, { GL_TRIANGLE_STRIP, 2 * segments, 2 * segments + 2 } }, 3, mesh.error });
+	}
+	gCylinderLods = gLodManager.Register(levels);
+
+	levels.clear();
+	levels.push_back({ sphere.sphererMesh.vao, true, { { GL_TRIANGLES, 0, (GLsizei)sphere.sphererMesh.numIndicies } }, 1, sphere.sphererMesh.error });
+	for (const auto& mesh : sphere.lodMeshes)
+		levels.push_back({ mesh.vao, true, { { GL_TRIANGLES, 0, (GLsizei)mesh.numIndicies } }, 1, mesh.error });
+	gSphereLods = gLodManager.Register(levels);
+
+	levels.clear();
+	levels.push_back({ torus.torusMesh.vao, false, { { GL_TRIANGLES, 0, (GLsizei)torus.torusMesh.numVert } }, 1, torus.torusMesh.error });
+	for (const auto& mesh : torus.lodMeshes)
+		levels.push_back({ mesh.vao, false, { { GL_TRIANGLES, 0, (GLsizei)mesh.numVert } }, 1, mesh.error });
+	gTorusLods = gLodManager.Register(levels);
+}
+
+// Adds a cylinder (bottom, top and body) to the draw list
+void UAddCylinder(vector<DrawItem>& items, const char* region, GLuint texture, GLuint textureExtra, const glm::mat4& model)
+{
+	DrawItem item = {};
+	item.region = region;
+	item.vao = cylinder.cylinderMesh.vao;
+	item.bounds = cylinder.cylinderMesh.bounds;
+	item.triangles = cylinder.cylinderMesh.triangles.data();
+	item.numTriangles = cylinder.cylinderMesh.triangles.size() / 3;
+	item.lodChain = gCylinderLods;
+	item.indexed = false;
+	item.ranges[0] = { GL_TRIANGLE_FAN, 0, 36, false };
+	item.ranges[1] = { GL_TRIANGLE_FAN, 36, 36, false };
+	item.ranges[2] = { GL_TRIANGLE_STRIP, 72, 146, textureExtra != 0 };
+	item.numRanges = 3;
+	item.texture = texture;
+	item.textureExtra = textureExtra;
+	item.model = model;
+	items.push_back(item);
+}
+
+// Adds a sphere to the draw list
+void UAddSphere(vector<DrawItem>& items, const char* region, GLuint texture, const glm::mat4& model)
+{
+	DrawItem item = {};
+	item.region = region;
+	item.vao = sphere.sphererMesh.vao;
+	item.bounds = sphere.sphererMesh.bounds;
+	item.triangles = sphere.sphererMesh.triangles.data();
+	item.numTriangles = sphere.sphererMesh.triangles.size() / 3;
+	item.lodChain = gSphereLods;
+	item.indexed = true;
+	item.ranges[0] = { GL_TRIANGLES, 0, (GLsizei)sphere.sphererMesh.numIndicies, false };
+	item.numRanges = 1;
+	item.texture = texture;
+	item.model = model;
+	items.push_back(item);
+}
+
+// Adds a torus to the draw list
+void UAddTorus(vector<DrawItem>& items, const char* region, GLuint texture, const glm::mat4& model)
+{
+	DrawItem item = {};
+	item.region = region;
+	item.vao = torus.torusMesh.vao;
+	item.bounds = torus.torusMesh.bounds;
+	item.triangles = torus.torusMesh.triangles.data();
+	item.numTriangles = torus.torusMesh.triangles.size() / 3;
+	item.lodChain = gTorusLods;
+	item.indexed = false;
+	item.ranges[0] = { GL_TRIANGLES, 0, (GLsizei)torus.torusMesh.numVert, false };
+	item.numRanges = 1;
+	item.texture = texture;
+	item.model = model;
+	items.push_back(item);
+}
+
+// Adds a box to the draw list
+void UAddBox(vector<DrawItem>& items, const char* region, GLuint texture, const glm::mat4& model)
+{
+	DrawItem item = {};
+	item.region = region;
+	item.vao = box.boxMesh.vao;
+	item.bounds = box.boxMesh.bounds;
+	item.triangles = box.boxMesh.triangles.data();
+	item.numTriangles = box.boxMesh.triangles.size() / 3;
+	item.lodChain = -1;
+	item.indexed = true;
+	item.ranges[0] = { GL_TRIANGLES, 0, (GLsizei)box.boxMesh.numIndicies, false };
+	item.numRanges = 1;
+	item.texture = texture;
+	item.model = model;
+	items.push_back(item);
+}
+
+// Adds a plane to the draw list
+void UAddPlane(vector<DrawItem>& items, const char* region, GLuint texture, const glm::mat4& model)
+{
+	DrawItem item = {};
+	item.region = region;
+	item.vao = plane.planeMesh.vao;
+	item.bounds = plane.planeMesh.bounds;
+	item.triangles = plane.planeMesh.triangles.data();
+	item.numTriangles = plane.planeMesh.triangles.size() / 3;
+	item.lodChain = -1;
+	item.indexed = true;
+	item.ranges[0] = { GL_TRIANGLES, 0, (GLsizei)plane.planeMesh.numIndicies, false };
+	item.numRanges = 1;
+	item.texture = texture;
+	item.model = model;
+	items.push_back(item);
+}
+
+// Builds the desk scene draw list
+void UBuildScene(vector<DrawItem>& items)
+{
+	glm::mat4 scale;
+	glm::mat4 rotation;
+	glm::mat4 translation;
+	glm::mat4 model;
+
+#pragma region Bottle
+	/*BOTTLE*/
+	// bottle parent
+	glm::mat4 bottleScale = glm::scale(glm::vec3(0.09f, 0.09f, 0.09f)); // scale
+	glm::mat4 bottleRotation = glm::rotate(190.0f, glm::vec3(0.0f, 1.0f, 0.0f)); // rotation
+	glm::mat4 bottleTranslation = glm::translate(glm::vec3(0.0f, -1.0f, 0.0f)); // translation
+	glm::mat4 bottleModel = bottleTranslation * bottleRotation * bottleScale;
+
+	//Bottle Cylinder 1 base, logo on the body
+	scale = glm::scale(glm::vec3(3.0f, 10.0f, 3.0f)); // scale
+	rotation = glm::rotate(0.0f, glm::vec3(1.0, 1.0f, 1.0f)); // rotation
+	translation = glm::translate(glm::vec3(0.0f, 0.0f, 0.0f)); // translation
+	model = bottleModel * translation * rotation * scale;
+	UAddCylinder(items, "Bottle", gTextureGlass, gTextureLogo, model);
 
+	//Cylinder 2 top
 	scale = glm::scale(glm::vec3(1.6f, 7.0f, 1.6f)); // scale
 	rotation = glm::rotate(0.0f, glm::vec3(1.0, 1.0f, 1.0f)); // rotation
 	translation = glm::translate(glm::vec3(0.0f, 12.0f, 0.0f)); // translation
 	model = bottleModel * translation * rotation * scale;
-	glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
-
-	glProgramUniform4f(gModelProgramId, texturesLoc, 1.0f, 1.0f, 1.0f, 1.0f);
-
-	// Draws the triangles
-	glDrawArrays(GL_TRIANGLE_FAN, 0, 36);
-	glDrawArrays(GL_TRIANGLE_FAN, 36, 36);
-	glDrawArrays(GL_TRIANGLE_STRIP, 72, 146);
-
-	// Deactivates the VAO
-	glBindVertexArray(0);
+	UAddCylinder(items, "Bottle", gTextureGlass, 0, model);
 
 	//Cylinder 3 lid
-	glActiveTexture(GL_TEXTURE0);
-	glBindTexture(GL_TEXTURE_2D, gTextureCap);
-	glBindVertexArray(cylinder.cylinderMesh.vao);
-
 	scale = glm::scale(glm::vec3(1.75f, 0.5f, 1.75f)); // scale
 	rotation = glm::rotate(0.0f, glm::vec3(1.0, 1.0f, 1.0f)); // rotation
 	translation = glm::translate(glm::vec3(0.0f, 19.0f, 0.0f)); // translation
 	model = bottleModel * translation * rotation * scale;
-	glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
-
-	glProgramUniform4f(gModelProgramId, texturesLoc, 1.0f, 1.0f, 1.0f, 1.0f);
-
-	// Draws the triangles
-	glDrawArrays(GL_TRIANGLE_FAN, 0, 36);
-	glDrawArrays(GL_TRIANGLE_FAN, 36, 36);
-	glDrawArrays(GL_TRIANGLE_STRIP, 72, 146);
-
-	// Deactivates the VAO
-	glBindVertexArray(0);
+	UAddCylinder(items, "Bottle", gTextureCap, 0, model);
 
 	// sphere
-	glActiveTexture(GL_TEXTURE0);
-	glBindTexture(GL_TEXTURE_2D, gTextureGlass);
-	glBindVertexArray(sphere.sphererMesh.vao);
-
 	scale = glm::scale(glm::vec3(3.0f, 3.0f, 3.0f));
 	rotation = glm::rotate(0.0f, glm::vec3(1.0, 1.0f, 1.0f));
 	translation = glm::translate(glm::vec3(0.0f, 10.0f, 0.0f));
 	model = bottleModel * translation * rotation * scale;
-	glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
-
-	glProgramUniform4f(gModelProgramId, texturesLoc, 0.0f, 0.0f, 1.0f, 1.0f);
-
-	// Draws the triangles
-	glDrawElements(GL_TRIANGLES, sphere.sphererMesh.numIndicies, GL_UNSIGNED_INT, (void*)0);
-
-	// Activate the VBOs contained within the mesh's VAO
-	glBindVertexArray(sphere.sphererMesh.vao);
+	UAddSphere(items, "Bottle", gTextureGlass, model);
 #pragma endregion
 
 #pragma region Binder
-	// Deactivate the Vertex Array Object
-	glBindVertexArray(0);
-
 	/*BINDER*/
 	// binder parent
 	glm::mat4 binderScale = glm::scale(glm::vec3(2.0f, 2.0f, 2.0f)); // scale
@@ -676,134 +2473,63 @@ void URender()
 	glm::mat4 binderModel = binderTranslation * binderRotation * binderScale;
 
 	// Ring 1 Middle
-	glActiveTexture(GL_TEXTURE0);
-	glBindTexture(GL_TEXTURE_2D, gTextureMetal);
-	glBindVertexArray(torus.torusMesh.vao);
-
 	scale = glm::scale(glm::vec3(0.08f, 0.08f, 0.08f));
 	rotation = glm::rotate(1.57f, glm::vec3(1.0, 0.0f, 0.0f));
 	translation = glm::translate(glm::vec3(-0.386f, 0.0f, 0.0f));
 	model = binderModel * translation * rotation * scale;
-	glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
-
-	// Draws the triangles
-	glDrawArrays(GL_TRIANGLES, 0, torus.torusMesh.numVert);
-
-	// Deactivate the Vertex Array Object
-	glBindVertexArray(0);
+	UAddTorus(items, "Binder", gTextureMetal, model);
 
 	// Ring 2 Top
-	glBindVertexArray(torus.torusMesh.vao);
-
 	scale = glm::scale(glm::vec3(0.08f, 0.08f, 0.08f));
 	rotation = glm::rotate(1.57f, glm::vec3(1.0, 0.0f, 0.0f));
 	translation = glm::translate(glm::vec3(-0.386f, 0.38f, 0.0f));
 	model = binderModel * translation * rotation * scale;
-	glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
-
-	// Draws the triangles
-	glDrawArrays(GL_TRIANGLES, 0, torus.torusMesh.numVert);
-
-	// Deactivate the Vertex Array Object
-	glBindVertexArray(0);
+	UAddTorus(items, "Binder", gTextureMetal, model);
 
 	// Ring 3 Bottom
-	glBindVertexArray(torus.torusMesh.vao);
-
 	scale = glm::scale(glm::vec3(0.08f, 0.08f, 0.08f));
 	rotation = glm::rotate(1.57f, glm::vec3(1.0, 0.0f, 0.0f));
 	translation = glm::translate(glm::vec3(-0.386f, -0.4f, 0.0f));
 	model = binderModel * translation * rotation * scale;
-	glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
-
-	// Draws the triangles
-	glDrawArrays(GL_TRIANGLES, 0, torus.torusMesh.numVert);
-
-	// Deactivate the Vertex Array Object
-	glBindVertexArray(0);
+	UAddTorus(items, "Binder", gTextureMetal, model);
 
 	// Ring Holder
-	glBindVertexArray(box.boxMesh.vao);
-
 	scale = glm::scale(glm::vec3(0.13f, 1.0f, 0.02f));
 	rotation = glm::rotate(0.3f, glm::vec3(0.0, 1.0f, 0.0f));
 	translation = glm::translate(glm::vec3(-0.41f, 0.0f, -0.08f));
 	model = binderModel * translation * rotation * scale;
-	glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
-
-	// Draws the triangles
-	glDrawElements(GL_TRIANGLES, box.boxMesh.numIndicies, GL_UNSIGNED_INT, (void*)0);
-
-	// Deactivate the Vertex Array Object
-	glBindVertexArray(0);
+	UAddBox(items, "Binder", gTextureMetal, model);
 
 	// Spine
-	glActiveTexture(GL_TEXTURE0);
-	glBindTexture(GL_TEXTURE_2D, gTextureMatteBlack);
-	glBindVertexArray(box.boxMesh.vao);
-
 	scale = glm::scale(glm::vec3(0.2f, 1.1f, 0.01f));
 	rotation = glm::rotate(0.3f, glm::vec3(0.0, 1.0f, 0.0f));
 	translation = glm::translate(glm::vec3(-0.42f, 0.0f, -0.087f));
 	model = binderModel * translation * rotation * scale;
-	glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
-
-	// Draws the triangles
-	glDrawElements(GL_TRIANGLES, box.boxMesh.numIndicies, GL_UNSIGNED_INT, (void*)0);
-
-	// Deactivate the Vertex Array Object
-	glBindVertexArray(0);
+	UAddBox(items, "Binder", gTextureMatteBlack, model);
 
 	// Back
-	glBindVertexArray(box.boxMesh.vao);
-
 	scale = glm::scale(glm::vec3(0.75f, 1.1f, 0.01f));
 	rotation = glm::rotate(0.0f, glm::vec3(1.0, 1.0f, 1.0f));
 	translation = glm::translate(glm::vec3(0.045f, 0.0f, -0.115f));
 	model = binderModel * translation * rotation * scale;
-	glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
-
-	// Draws the triangles
-	glDrawElements(GL_TRIANGLES, box.boxMesh.numIndicies, GL_UNSIGNED_INT, (void*)0);
-
-	// Deactivate the Vertex Array Object
-	glBindVertexArray(0);
+	UAddBox(items, "Binder", gTextureMatteBlack, model);
 
 	// Front
-	glBindVertexArray(box.boxMesh.vao);
-
 	scale = glm::scale(glm::vec3(0.75f, 1.1f, 0.01f));
 	rotation = glm::rotate(-2.3f, glm::vec3(0.0, 1.0f, 0.0f));
 	translation = glm::translate(glm::vec3(-0.76f, 0.0f, 0.22f));
 	model = binderModel * translation * rotation * scale;
-	glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
-
-	// Draws the triangles
-	glDrawElements(GL_TRIANGLES, box.boxMesh.numIndicies, GL_UNSIGNED_INT, (void*)0);
-
-	// Deactivate the Vertex Array Object
-	glBindVertexArray(0);
+	UAddBox(items, "Binder", gTextureMatteBlack, model);
 
 	// Paper
-	glActiveTexture(GL_TEXTURE0);
-	glBindTexture(GL_TEXTURE_2D, gTexturePaper);
-	glBindVertexArray(box.boxMesh.vao);
-
 	scale = glm::scale(glm::vec3(0.7f, 1.0f, 0.001f));
 	rotation = glm::rotate(0.0f, glm::vec3(1.0, 1.0f, 1.0f));
 	translation = glm::translate(glm::vec3(0.0f, 0.0f, 0.0f));
 	model = binderModel * translation * rotation * scale;
-	glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
-
-	// Draws the triangles
-	glDrawElements(GL_TRIANGLES, box.boxMesh.numIndicies, GL_UNSIGNED_INT, (void*)0);
-
+	UAddBox(items, "Binder", gTexturePaper, model);
 #pragma endregion
 
 #pragma region Painting
-	// Deactivate the Vertex Array Object
-	glBindVertexArray(0);
-
 	/*PAINTING*/
 	// painting parent
 	glm::mat4 paintingScale = glm::scale(glm::vec3(1.0f, 1.0f, 1.0f)); // scale
@@ -812,41 +2538,22 @@ void URender()
 	glm::mat4 paintingModel = paintingTranslation * paintingRotation * paintingScale;
 
 	// Base
-	glActiveTexture(GL_TEXTURE0);
-	glBindTexture(GL_TEXTURE_2D, gTextureCanvas);
-	glBindVertexArray(box.boxMesh.vao);
-
 	scale = glm::scale(glm::vec3(1.5f, 2.0f, 0.3f));
 	rotation = glm::rotate(0.0f, glm::vec3(0.0f, 1.0f, 0.0f));
 	translation = glm::translate(glm::vec3(-1.0f, 0.0f, -1.0f));
 	model = paintingModel * translation * rotation * scale;
-	glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
-
-	// Draws the triangles
-	glDrawElements(GL_TRIANGLES, box.boxMesh.numIndicies, GL_UNSIGNED_INT, (void*)0);
-
-	// Deactivate the Vertex Array Object
-	glBindVertexArray(0);
+	UAddBox(items, "Painting", gTextureCanvas, model);
+	items.back().occluder = true;
 
 	// Art
-	glActiveTexture(GL_TEXTURE0);
-	glBindTexture(GL_TEXTURE_2D, gTextureArt);
-	glBindVertexArray(box.boxMesh.vao);
-
 	scale = glm::scale(glm::vec3(1.5f, 2.0f, 0.001f));
 	rotation = glm::rotate(0.0f, glm::vec3(0.0f, 1.0f, 0.0f));
 	translation = glm::translate(glm::vec3(-1.0f, 0.0f, -0.85f));
 	model = paintingModel * translation * rotation * scale;
-	glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
-
-	// Draws the triangles
-	glDrawElements(GL_TRIANGLES, box.boxMesh.numIndicies, GL_UNSIGNED_INT, (void*)0); 
+	UAddBox(items, "Painting", gTextureArt, model);
 #pragma endregion
 
 #pragma region Wall Light
-	// Deactivate the Vertex Array Object
-	glBindVertexArray(0);
-
 	/*WALL LIGHT*/
 	// WALL LIGHT parent
 	glm::mat4 lightScale = glm::scale(glm::vec3(1.0f, 1.0f, 0.4f)); // scale
@@ -855,146 +2562,506 @@ void URender()
 	glm::mat4 lightModel = lightTranslation * lightRotation * lightScale;
 
 	// Base
-	glActiveTexture(GL_TEXTURE0);
-	glBindTexture(GL_TEXTURE_2D, gTextureMetal);
-	glBindVertexArray(box.boxMesh.vao);
-
 	scale = glm::scale(glm::vec3(1.8f, 0.3f, 0.3f));
 	rotation = glm::rotate(0.0f, glm::vec3(0.0f, 1.0f, 0.0f));
 	translation = glm::translate(glm::vec3(-1.0f, 0.0f, -1.0f));
 	model = lightModel * translation * rotation * scale;
-	glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
-
-	// Draws the triangles
-	glDrawElements(GL_TRIANGLES, box.boxMesh.numIndicies, GL_UNSIGNED_INT, (void*)0);
-
-	// Deactivate the Vertex Array Object
-	glBindVertexArray(0);
+	UAddBox(items, "Wall Light", gTextureMetal, model);
+	items.back().occluder = true;
 
 	// Light
-	glActiveTexture(GL_TEXTURE0);
-	glBindTexture(GL_TEXTURE_2D, gTextureWallLight);
-	glBindVertexArray(box.boxMesh.vao);
-
 	scale = glm::scale(glm::vec3(1.4f, 0.25f, 0.001f));
 	rotation = glm::rotate(0.0f, glm::vec3(0.0f, 1.0f, 0.0f));
 	translation = glm::translate(glm::vec3(-0.85f, 0.0f, -0.85f));
 	model = lightModel * translation * rotation * scale;
-	glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
-
-	// Draws the triangles
-	glDrawElements(GL_TRIANGLES, box.boxMesh.numIndicies, GL_UNSIGNED_INT, (void*)0);
+	UAddBox(items, "Wall Light", gTextureWallLight, model);
 
 	// Button
-	glBindVertexArray(sphere.sphererMesh.vao);
-
 	scale = glm::scale(glm::vec3(0.05f, 0.05f, 0.05f));
 	rotation = glm::rotate(0.0f, glm::vec3(1.0, 1.0f, 1.0f));
 	translation = glm::translate(glm::vec3(-1.7f, 0.0f, -0.85f));
 	model = lightModel * translation * rotation * scale;
-	glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
-
-	glProgramUniform4f(gModelProgramId, texturesLoc, 0.0f, 0.0f, 1.0f, 1.0f);
-
-	// Draws the triangles
-	glDrawElements(GL_TRIANGLES, sphere.sphererMesh.numIndicies, GL_UNSIGNED_INT, (void*)0);
-
-	// Activate the VBOs contained within the mesh's VAO
-	glBindVertexArray(sphere.sphererMesh.vao);
+	UAddSphere(items, "Wall Light", gTextureWallLight, model);
 #pragma endregion
 
 #pragma region Main Plane
-	// Deactivate the Vertex Array Object
-	glBindVertexArray(0);
-
 	/*Main Plane*/
 	// Plane
-	glActiveTexture(GL_TEXTURE0);
-	glBindTexture(GL_TEXTURE_2D, gTextureDarkWood);
-	glBindVertexArray(plane.planeMesh.vao);
-
 	scale = glm::scale(glm::vec3(3.0f, 1.0f, 1.5f));
 	rotation = glm::rotate(0.0f, glm::vec3(1.0, 1.0f, 1.0f));
 	translation = glm::translate(glm::vec3(0.7f, -1.0f, 0.0f));
 	model = translation * rotation * scale;
-	glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
-
-	// Draws the triangles
-	glDrawElements(GL_TRIANGLES, plane.planeMesh.numIndicies, GL_UNSIGNED_INT, (void*)0);
+	UAddPlane(items, "Main Plane", gTextureDarkWood, model);
+	items.back().occluder = true;
 #pragma endregion
+}
+
+// Tiles the desk counts[0] x counts[1] x counts[2] times. Every copy gets
+// its own offset, turn and scale, some of its parts other textures, and
+// the lights move somewhere over the grid. Everything comes from seed, so
+// a stress scene is the same on every run.
+void UBuildStressScene(vector<DrawItem>& items, const int counts[3], uint32_t seed)
+{
+	vector<DrawItem> desk;
+	UBuildScene(desk);
 
-	// Deactivate the Vertex Array Object
+	// xorshift, the standard distributions differ between libraries
+	uint32_t state = seed != 0 ? seed : 1;
+	auto random = [&state]()
+	{
+		state ^= state << 13;
+		state ^= state >> 17;
+		state ^= state << 5;
+		return (state >> 8) * (1.0f / 16777216.0f);
+	};
+
+	const GLuint textures[] = { gTextureGlass, gTextureCap, gTextureDarkWood, gTextureMetal, gTextureMatteBlack,
+		gTextureArt, gTexturePaper, gTextureWallLight, gTextureCanvas };
+	const int numTextures = sizeof(textures) / sizeof(textures[0]);
+	const float retextureChance = 0.25f;
+	const glm::vec3 spacing(8.0f, 4.0f, 5.0f); // one desk with room around it
+
+	size_t numCopies = (size_t)counts[0] * counts[1] * counts[2];
+	items.clear();
+	items.reserve(numCopies * desk.size());
+
+	// the grid is centered on the original desk
+	glm::vec3 extent = spacing * glm::vec3(counts[0] - 1, counts[1] - 1, counts[2] - 1);
+	for (int z = 0; z < counts[2]; ++z)
+	{
+		for (int y = 0; y < counts[1]; ++y)
+		{
+			for (int x = 0; x < counts[0]; ++x)
+			{
+				glm::vec3 jitter(random() - 0.5f, 0.0f, random() - 0.5f);
+				glm::vec3 offset = glm::vec3(x, y, z) * spacing - extent * 0.5f + jitter;
+				glm::mat4 copy = glm::translate(offset) * glm::rotate((random() - 0.5f) * 0.6f, glm::vec3(0.0f, 1.0f, 0.0f))
+					* glm::scale(glm::vec3(0.85f + random() * 0.3f));
+
+				for (const DrawItem& part : desk)
+				{
+					DrawItem item = part;
+					item.model = copy * part.model;
+					if (random() < retextureChance)
+						item.texture = textures[min((int)(random() * numTextures), numTextures - 1)];
+					items.push_back(item);
+				}
+			}
+		}
+	}
+
+	gLightPosition += glm::vec3((random() - 0.5f) * extent.x, 0.0f, (random() - 0.5f) * extent.z);
+	gLightPosition2 += glm::vec3((random() - 0.5f) * extent.x, 0.0f, (random() - 0.5f) * extent.z);
+
+	cout << "INFO: Stress scene of " << numCopies << " desks, " << items.size() << " draw items, seed " << seed << endl;
+}
+
+// Index of the desk texture in the cooked scene, -1 for none
+int USceneTextureIndex(GLuint textureId)
+{
+	for (size_t i = 0; i < sizeof(deskTextures) / sizeof(deskTextures[0]); ++i)
+	{
+		if (textureId != 0 && *deskTextures[i].texture == textureId)
+			return (int)i;
+	}
+
+	return -1;
+}
+
+// Reads the vertices and indices of a VAO back from the GPU into the scene
+bool UCookMesh(SceneFile::Contents& contents, GLuint vao, bool indexed, const DrawRange* ranges, int numRanges, SceneFile::Mesh& mesh)
+{
+	glBindVertexArray(vao);
+
+	// every mesh of the desk interleaves position, normal and texture coordinate
+	GLint vbo = 0, ebo = 0, stride = 0;
+	GLvoid* pointer = nullptr;
+	glGetVertexAttribiv(0, GL_VERTEX_ATTRIB_ARRAY_BUFFER_BINDING, &vbo);
+	glGetVertexAttribiv(0, GL_VERTEX_ATTRIB_ARRAY_STRIDE, &stride);
+	glGetVertexAttribPointerv(0, GL_VERTEX_ATTRIB_ARRAY_POINTER, &pointer);
+	glGetIntegerv(GL_ELEMENT_ARRAY_BUFFER_BINDING, &ebo);
 	glBindVertexArray(0);
-	glUseProgram(0);
 
-	glfwSwapBuffers(gWindow);
+	if (vbo == 0 || stride != SceneFile::vertexSize || pointer != nullptr || (indexed && ebo == 0))
+	{
+		cout << "ERROR::SCENE::UNSUPPORTED_VERTEX_LAYOUT " << vao << endl;
+		return false;
+	}
+
+	GLint vertexBytes = 0;
+	glBindBuffer(GL_COPY_READ_BUFFER, vbo);
+	glGetBufferParameteriv(GL_COPY_READ_BUFFER, GL_BUFFER_SIZE, &vertexBytes);
+
+	mesh.vertexOffset = contents.vertices.size();
+	mesh.numVertices = (uint32_t)(vertexBytes / SceneFile::vertexSize);
+	contents.vertices.resize(contents.vertices.size() + (size_t)mesh.numVertices * SceneFile::vertexSize);
+	glGetBufferSubData(GL_COPY_READ_BUFFER, 0, (GLsizeiptr)mesh.numVertices * SceneFile::vertexSize, &contents.vertices[mesh.vertexOffset]);
+
+	mesh.firstIndex = (uint32_t)contents.indices.size();
+	mesh.numIndices = 0;
+	if (indexed)
+	{
+		GLint indexBytes = 0;
+		glBindBuffer(GL_COPY_READ_BUFFER, ebo);
+		glGetBufferParameteriv(GL_COPY_READ_BUFFER, GL_BUFFER_SIZE, &indexBytes);
+
+		mesh.numIndices = (uint32_t)(indexBytes / sizeof(GLuint));
+		contents.indices.resize(contents.indices.size() + mesh.numIndices);
+		glGetBufferSubData(GL_COPY_READ_BUFFER, 0, (GLsizeiptr)mesh.numIndices * sizeof(GLuint), &contents.indices[mesh.firstIndex]);
+	}
+	glBindBuffer(GL_COPY_READ_BUFFER, 0);
+
+	mesh.numRanges = (uint32_t)numRanges;
+	for (int i = 0; i < numRanges; ++i)
+		mesh.ranges[i] = { ranges[i].mode, (uint32_t)ranges[i].first, (uint32_t)ranges[i].count };
+
+	return true;
 }
-#pragma endregion
 
-#pragma region Shader Program Functions
-// Creates Shader Program
-bool UCreateShaderProgram(const char* vtxShaderSource, const char* fragShaderSource, GLuint& programId)
+// Writes a draw list into a scene file. Every mesh is read back from the
+// GPU once, with the coarser levels of its chain right after it. Items
+// become nodes under one group per scene region.
+bool UCookScene(const char* path, const vector<DrawItem>& items)
 {
-	// Compilation and linkage error reporting
-	int success = 0;
-	char infoLog[512];
+	CPU_PROFILE_SCOPE("UCookScene");
+
+	SceneFile::Contents contents;
+	vector<GLuint> meshVaos; // of every cooked mesh
+	vector<const char*> regions;
+	vector<int> regionNodes;
+
+	for (size_t i = 0; i < sizeof(deskTextures) / sizeof(deskTextures[0]); ++i)
+		contents.textures.push_back(contents.AddString(deskTextures[i].path));
+
+	for (const DrawItem& item : items)
+	{
+		// the finest level is drawn at cook time, the chain keeps the others
+		int mesh = (int)(find(meshVaos.begin(), meshVaos.end(), item.vao) - meshVaos.begin());
+		if (mesh == (int)meshVaos.size())
+		{
+			mesh = (int)contents.meshes.size();
+
+			vector<LodLevel> levels;
+			if (item.lodChain >= 0)
+				levels = gLodManager.Levels(item.lodChain);
+			else
+				levels.push_back({ item.vao, item.indexed, {}, item.numRanges, 0.0f, 0 });
+			copy(item.ranges, item.ranges + item.numRanges, levels[0].ranges);
+
+			for (size_t level = 0; level < levels.size(); ++level)
+			{
+				SceneFile::Mesh cooked = {};
+				if (!UCookMesh(contents, levels[level].vao, levels[level].indexed, levels[level].ranges, levels[level].numRanges, cooked))
+					return false;
+
+				cooked.lodError = levels[level].error;
+				if (level == 0)
+				{
+					cooked.numLods = (uint32_t)levels.size();
+					for (int k = 0; k < 3; ++k)
+					{
+						cooked.boundsMin[k] = item.bounds.min[k];
+						cooked.boundsMax[k] = item.bounds.max[k];
+						cooked.center[k] = item.bounds.center[k];
+					}
+					cooked.radius = item.bounds.radius;
+					cooked.firstTriangle = (uint32_t)(contents.triangles.size() / 3);
+					cooked.numTriangles = (uint32_t)item.numTriangles;
+					contents.triangles.insert(contents.triangles.end(), item.triangles, item.triangles + item.numTriangles * 3);
+				}
+				contents.meshes.push_back(cooked);
+				meshVaos.push_back(levels[level].vao);
+			}
+		}
+
+		SceneFile::Material material = { USceneTextureIndex(item.texture), USceneTextureIndex(item.textureExtra), 0 };
+		for (int i = 0; i < item.numRanges; ++i)
+			material.extraRanges |= item.ranges[i].extraTexture ? 1u << i : 0u;
+
+		int materialIndex = 0;
+		while (materialIndex < (int)contents.materials.size() && memcmp(&contents.materials[materialIndex], &material, sizeof(material)) != 0)
+			++materialIndex;
+		if (materialIndex == (int)contents.materials.size())
+			contents.materials.push_back(material);
 
-	// Creates Shader Program Object
-	programId = glCreateProgram();
+		// group node of the region, identity transform
+		int region = (int)(find(regions.begin(), regions.end(), item.region) - regions.begin());
+		if (region == (int)regions.size())
+		{
+			SceneFile::Node group = { -1, -1, -1, contents.AddString(item.region), 0 };
+			memcpy(group.local, glm::value_ptr(glm::mat4(1.0f)), sizeof(group.local));
+			regions.push_back(item.region);
+			regionNodes.push_back((int)contents.nodes.size());
+			contents.nodes.push_back(group);
+		}
 
-	// Create vertex and fragment objects
-	GLuint vtxShaderId = glCreateShader(GL_VERTEX_SHADER);
-	GLuint fragShaderId = glCreateShader(GL_FRAGMENT_SHADER);
+		SceneFile::Node node = { regionNodes[region], mesh, materialIndex, contents.AddString(item.region), 0 };
+		node.flags = (item.dynamic ? SceneFile::NODE_DYNAMIC : 0) | (item.occluder ? SceneFile::NODE_OCCLUDER : 0);
+		memcpy(node.local, glm::value_ptr(item.model), sizeof(node.local));
+		contents.nodes.push_back(node);
+	}
 
-	// Retrives shader program source
-	glShaderSource(vtxShaderId, 1, &vtxShaderSource, NULL);
-	glShaderSource(fragShaderId, 1, &fragShaderSource, NULL);
+	if (!SceneFile::Write(path, contents))
+		return false;
 
-	// vertex shader
-	glCompileShader(vtxShaderId); // Compiles the vertex shader 
-	glGetShaderiv(vtxShaderId, GL_COMPILE_STATUS, &success); // Checks for errors
-	if (!success)// if vertex shader fails to compile
+	cout << "INFO: Cooked " << contents.nodes.size() << " nodes, " << contents.meshes.size() << " meshes and "
+		<< contents.vertices.size() / 1024 << " KB of vertices into " << path << endl;
+	return true;
+}
+
+// Draw ranges of a cooked mesh, indexed ranges move to the mesh's part of the shared index buffer
+void USceneRanges(const SceneFile::Mesh& mesh, uint32_t extraRanges, DrawRange ranges[3])
+{
+	for (uint32_t i = 0; i < mesh.numRanges && i < 3; ++i)
 	{
-		glGetShaderInfoLog(vtxShaderId, 512, NULL, infoLog);
-		cout << "ERROR::SHADER::VERTEX::COMPILATION_FAILED\n" << infoLog << endl;
+		const SceneFile::Range& range = mesh.ranges[i];
+		GLint first = (GLint)range.first + (mesh.numIndices > 0 ? (GLint)mesh.firstIndex : 0);
+		ranges[i] = { (GLenum)range.mode, first, (GLsizei)range.count, (extraRanges >> i & 1) != 0 };
+	}
+}
+
+// Maps a cooked scene and fills the draw list from it. The vertex and
+// index sections are handed to glBufferStorage as they are in the file, the
+// only work per mesh is its VAO and per node its world transform.
+bool ULoadScene(const char* path, vector<DrawItem>& items)
+{
+	CPU_PROFILE_SCOPE("ULoadScene");
 
+	if (!gSceneFile.Map(path))
 		return false;
+
+	size_t numMeshes, numNodes, numMaterials, numTextures, numTriangles;
+	const SceneFile::Mesh* meshes = gSceneFile.Get<SceneFile::Mesh>(SceneFile::SECTION_MESHES, numMeshes);
+	const SceneFile::Node* nodes = gSceneFile.Get<SceneFile::Node>(SceneFile::SECTION_NODES, numNodes);
+	const SceneFile::Material* materials = gSceneFile.Get<SceneFile::Material>(SceneFile::SECTION_MATERIALS, numMaterials);
+	const uint32_t* textures = gSceneFile.Get<uint32_t>(SceneFile::SECTION_TEXTURES, numTextures);
+	const glm::vec3* triangles = gSceneFile.Get<glm::vec3>(SceneFile::SECTION_TRIANGLES, numTriangles);
+	size_t numVertices = gSceneFile.Size(SceneFile::SECTION_VERTICES) / SceneFile::vertexSize;
+	size_t numIndices = gSceneFile.Size(SceneFile::SECTION_INDICES) / sizeof(GLuint);
+	const GLuint* indices = static_cast<const GLuint*>(gSceneFile.Data(SceneFile::SECTION_INDICES));
+
+	// references the file holds are checked once, drawing trusts them
+	for (size_t i = 0; i < numMeshes; ++i)
+	{
+		const SceneFile::Mesh& mesh = meshes[i];
+		bool valid = mesh.vertexOffset % SceneFile::vertexSize == 0 && mesh.vertexOffset / SceneFile::vertexSize + mesh.numVertices <= numVertices
+			&& (size_t)mesh.firstIndex + mesh.numIndices <= numIndices && mesh.numRanges <= 3 && i + max(mesh.numLods, 1u) <= numMeshes
+			&& ((size_t)mesh.firstTriangle + mesh.numTriangles) * 3 <= numTriangles;
+
+		// every range stays inside the mesh's vertices or indices
+		uint64_t rangeLimit = mesh.numIndices > 0 ? mesh.numIndices : mesh.numVertices;
+		for (uint32_t r = 0; valid && r < mesh.numRanges; ++r)
+			valid = (uint64_t)mesh.ranges[r].first + mesh.ranges[r].count <= rangeLimit;
+
+		// indices are relative to the mesh's first vertex
+		for (uint32_t j = 0; valid && j < mesh.numIndices; ++j)
+			valid = indices[mesh.firstIndex + j] < mesh.numVertices;
+
+		if (!valid)
+		{
+			cout << "ERROR::SCENE::INVALID_MESH " << i << endl;
+			return false;
+		}
+	}
+	for (size_t i = 0; i < numNodes; ++i)
+	{
+		const SceneFile::Node& node = nodes[i];
+		if (node.parent >= (int)i || node.mesh >= (int)numMeshes || (node.mesh >= 0 && (node.material < 0 || node.material >= (int)numMaterials)))
+		{
+			cout << "ERROR::SCENE::INVALID_NODE " << i << endl;
+			return false;
+		}
+	}
+	for (size_t i = 0; i < numMaterials; ++i)
+	{
+		if (materials[i].baseTexture >= (int)numTextures || materials[i].extraTexture >= (int)numTextures)
+		{
+			cout << "ERROR::SCENE::INVALID_MATERIAL " << i << endl;
+			return false;
+		}
 	}
 
-	// fragment shader
-	glCompileShader(fragShaderId); // Compiles the fragment shader
-	glGetShaderiv(fragShaderId, GL_COMPILE_STATUS, &success); // Checks for errors
-	if (!success)// if fragment shader fails to compile
+	// the mapped sections are the buffer contents
+	glGenBuffers(2, gSceneBuffers);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, gSceneBuffers[0]);
+	if (numVertices > 0)
+		glBufferStorage(GL_COPY_WRITE_BUFFER, gSceneFile.Size(SceneFile::SECTION_VERTICES), gSceneFile.Data(SceneFile::SECTION_VERTICES), 0);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, gSceneBuffers[1]);
+	if (numIndices > 0)
+		glBufferStorage(GL_COPY_WRITE_BUFFER, gSceneFile.Size(SceneFile::SECTION_INDICES), gSceneFile.Data(SceneFile::SECTION_INDICES), 0);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+	gSceneTextures.assign(numTextures, 0);
+	for (size_t i = 0; i < numTextures; ++i)
 	{
-		glGetShaderInfoLog(fragShaderId, sizeof(infoLog), NULL, infoLog);
-		cout << "ERROR::SHADER::FRAGMENT::COMPILATION_FAILED\n" << infoLog << endl;
+		const char* texturePath = gSceneFile.String(textures[i]);
+		if (!texture.UCreateTexture(texturePath, gSceneTextures[i]))
+		{
+			cout << "Failed to load texture " << texturePath << endl;
+			UDestroyScene();
+			return false;
+		}
+	}
 
-		return false;
+	// one VAO per mesh, each starting at its vertices in the shared buffer
+	gSceneVaos.assign(numMeshes, 0);
+	if (numMeshes > 0)
+		glGenVertexArrays((GLsizei)numMeshes, gSceneVaos.data());
+
+	for (size_t i = 0; i < numMeshes; ++i)
+	{
+		const GLchar* base = (const GLchar*)(size_t)meshes[i].vertexOffset;
+		glBindVertexArray(gSceneVaos[i]);
+		glBindBuffer(GL_ARRAY_BUFFER, gSceneBuffers[0]);
+		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, SceneFile::vertexSize, base);
+		glEnableVertexAttribArray(0);
+		glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, SceneFile::vertexSize, base + 3 * sizeof(float));
+		glEnableVertexAttribArray(1);
+		glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, SceneFile::vertexSize, base + 6 * sizeof(float));
+		glEnableVertexAttribArray(2);
+		if (meshes[i].numIndices > 0)
+			glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, gSceneBuffers[1]);
 	}
+	glBindVertexArray(0);
 
-	// Attaches compiled shaders to the shader program
-	glAttachShader(programId, vtxShaderId);
-	glAttachShader(programId, fragShaderId);
+	// chains of more than one level go to the level of detail manager
+	vector<int> meshChains(numMeshes, -1);
+	vector<LodLevel> levels;
+	for (size_t i = 0; i < numMeshes; ++i)
+	{
+		if (meshes[i].numLods <= 1)
+			continue;
 
-	// Shader Link
-	glLinkProgram(programId);   // links the shader program
-	glGetProgramiv(programId, GL_LINK_STATUS, &success); // Checks for errors
-	if (!success) // if shader fails to Link
+		levels.clear();
+		for (size_t level = i; level < i + meshes[i].numLods; ++level)
+		{
+			LodLevel lodLevel = { gSceneVaos[level], meshes[level].numIndices > 0, {}, (int)meshes[level].numRanges, meshes[level].lodError, 0 };
+			USceneRanges(meshes[level], 0, lodLevel.ranges);
+			levels.push_back(lodLevel);
+		}
+		meshChains[i] = gLodManager.Register(levels);
+	}
+
+	// parents come first, so one pass composes every world transform
+	vector<glm::mat4> world(numNodes);
+	items.reserve(items.size() + numNodes);
+
+	for (size_t i = 0; i < numNodes; ++i)
 	{
-		glGetProgramInfoLog(programId, sizeof(infoLog), NULL, infoLog);
-		cout << "ERROR::SHADER::PROGRAM::LINKING_FAILED\n" << infoLog << endl;
+		const SceneFile::Node& node = nodes[i];
+		glm::mat4 local = glm::make_mat4(node.local);
+		world[i] = node.parent >= 0 ? world[node.parent] * local : local;
+
+		if (node.mesh < 0)
+			continue;
+
+		const SceneFile::Mesh& mesh = meshes[node.mesh];
+		const SceneFile::Material& material = materials[node.material];
+
+		DrawItem item = {};
+		item.region = gSceneFile.String(node.name);
+		item.vao = gSceneVaos[node.mesh];
+		item.indexed = mesh.numIndices > 0;
+		item.numRanges = (int)mesh.numRanges;
+		USceneRanges(mesh, material.extraRanges, item.ranges);
+		item.texture = material.baseTexture >= 0 ? gSceneTextures[material.baseTexture] : 0;
+		item.textureExtra = material.extraTexture >= 0 ? gSceneTextures[material.extraTexture] : 0;
+		item.model = world[i];
+		item.dynamic = (node.flags & SceneFile::NODE_DYNAMIC) != 0;
+		item.occluder = (node.flags & SceneFile::NODE_OCCLUDER) != 0;
+		item.bounds.min = glm::make_vec3(mesh.boundsMin);
+		item.bounds.max = glm::make_vec3(mesh.boundsMax);
+		item.bounds.center = glm::make_vec3(mesh.center);
+		item.bounds.radius = mesh.radius;
+		item.triangles = mesh.numTriangles > 0 ? triangles + (size_t)mesh.firstTriangle * 3 : nullptr;
+		item.numTriangles = mesh.numTriangles;
+		item.lodChain = meshChains[node.mesh];
+		items.push_back(item);
+	}
 
+	cout << "INFO: Scene " << path << ": " << numNodes << " nodes, " << numMeshes << " meshes, " << items.size() << " draw items" << endl;
+	return true;
+}
+
+// Imports a glTF file and adds a draw item per instance. The render thread's
+// job system does not exist yet, a loading one decodes the primitives and is
+// gone before the render thread starts. Picking falls back to the bounds, the
+// meshes keep their compact copy only.
+bool UImportGltf(const char* path, vector<DrawItem>& items)
+{
+	CPU_PROFILE_SCOPE("UImportGltf");
+
+	JobSystem loadingJobs;
+	bool created = loadingJobs.Create(max(1, (int)thread::hardware_concurrency()));
+	gGltfImporter.jobs = created ? &loadingJobs : nullptr;
+	bool imported = gGltfImporter.Import(path);
+	gGltfImporter.jobs = nullptr;
+	if (created)
+		loadingJobs.Destroy();
+
+	if (!imported)
 		return false;
+
+	// local bounds from the retained triangles
+	vector<Bounds> meshBounds(gGltfImporter.meshes.size());
+	vector<glm::vec3> positions;
+	for (size_t i = 0; i < gGltfImporter.meshes.size(); ++i)
+	{
+		const Mesh& mesh = gGltfImporter.meshes[i];
+		positions.clear();
+		glm::vec3 a, b, c;
+		for (size_t t = 0; mesh.Triangle(t, a, b, c); ++t)
+		{
+			positions.push_back(a);
+			positions.push_back(b);
+			positions.push_back(c);
+		}
+		meshBounds[i] = positions.empty() ? Bounds{ glm::vec3(0.0f), glm::vec3(0.0f), glm::vec3(0.0f), 0.0f }
+			: UComputeBounds(glm::value_ptr(positions[0]), positions.size(), 3);
 	}
 
-	glUseProgram(programId); // Uses the shader program
+	items.reserve(items.size() + gGltfImporter.instances.size());
+	for (const GltfImporter::Instance& instance : gGltfImporter.instances)
+	{
+		const Mesh& mesh = gGltfImporter.meshes[instance.mesh];
+
+		DrawItem item = {};
+		item.region = "gltf";
+		item.vao = mesh.VAO;
+		item.indexed = true;
+		item.numRanges = 1;
+		item.ranges[0] = { GL_TRIANGLES, 0, mesh.numIndices, false };
+		for (const MeshTexture& meshTexture : mesh.textures)
+		{
+			if (meshTexture.type == "texture_diffuse")
+			{
+				item.texture = meshTexture.id;
+				break;
+			}
+		}
+		item.model = instance.model;
+		item.bounds = meshBounds[instance.mesh];
+		item.lodChain = -1;
+		items.push_back(item);
+	}
 
+	cout << "INFO: glTF " << path << ": " << gGltfImporter.meshes.size() << " meshes, " << items.size() << " draw items" << endl;
+	gGltfImporter.PrintMemoryReport();
 	return true;
 }
 
-// Destroys shader program
-void UDestroyShaderProgram(GLuint programId)
+// Frees the GL objects of a loaded scene and unmaps its file
+void UDestroyScene()
 {
-	glDeleteProgram(programId);
+	if (!gSceneVaos.empty())
+		glDeleteVertexArrays((GLsizei)gSceneVaos.size(), gSceneVaos.data());
+	for (GLuint sceneTexture : gSceneTextures)
+		texture.UDestroyTexture(sceneTexture);
+	glDeleteBuffers(2, gSceneBuffers);
+
+	gSceneVaos.clear();
+	gSceneTextures.clear();
+	gSceneBuffers[0] = gSceneBuffers[1] = 0;
+	gSceneFile.Unmap();
 }
 #pragma endregion
\ No newline at end of file
@@ -1,4 +1,7 @@
 #include "Sphere.h"
+#include "CpuProfiler.h"
+#include <algorithm>
+#include <cmath>
 #include <vector>
 
 using namespace std;
@@ -10,12 +13,23 @@ namespace
 
 void Sphere::CreateMesh()
 {
+	CPU_PROFILE_SCOPE("Sphere::CreateMesh");
 	UCreateSphere(sphererMesh);
+
+	// coarser levels for distant spheres, down to a few dozen triangles
+	const int lodSegments[][2] = { { 10, 8 }, { 6, 4 } };
+	lodMeshes.resize(sizeof(lodSegments) / sizeof(lodSegments[0]));
+	for (size_t i = 0; i < lodMeshes.size(); ++i)
+		UCreateSphereLod(lodMeshes[i], lodSegments[i][0], lodSegments[i][1]);
 }
 
 void Sphere::DestroyMesh()
 {
 	UDestroySphere(sphererMesh);
+
+	for (GLMesh& lodMesh : lodMeshes)
+		UDestroySphere(lodMesh);
+	lodMeshes.clear();
 }
 
 // Creates Sphere mesh
@@ -821,12 +835,19 @@ void Sphere::UCreateSphere(GLMesh& mesh)
 
 	mesh.numVert = sizeof(vertices) / (sizeof(vertices[0]) * (floatsPerVertex)); // vertex data
 	mesh.numIndicies = sizeof(indices) / (sizeof(indices[0])); // index data
+	mesh.bounds = UComputeBounds(vertices, mesh.numVert, floatsPerVertex); // culling volumes
+	mesh.error = 1.0f - cos(pi / 16.0f); // 16 sectors and 16 stacks
+
+	// CPU copy of the triangles for picking
+	mesh.triangles.clear();
+	UAppendTriangles(mesh.triangles, vertices, floatsPerVertex, GL_TRIANGLES, 0, mesh.numIndicies, indices);
 
 	glm::vec3 normal;
 	glm::vec3 vert;
 	glm::vec3 center(0.0f, 0.0f, 0.0f);
 	float u, v;
 	vector<GLfloat> combinedValues;
+	combinedValues.reserve(sizeof(vertices) / sizeof(vertices[0]) / 3 * 8);
 
 	// combines coordinates for vertices, normals, and textures
 	for (int i = 0; i < sizeof(vertices) / (sizeof(vertices[0])); i += 3)
@@ -851,6 +872,7 @@ void Sphere::UCreateSphere(GLMesh& mesh)
 	glGenBuffers(2, mesh.vbos); // generates VBOs
 	glBindBuffer(GL_ARRAY_BUFFER, mesh.vbos[0]); // Activates VBO 0
 	glBufferData(GL_ARRAY_BUFFER, sizeof(GLfloat)* combinedValues.size(), combinedValues.data(), GL_STATIC_DRAW); // Sends combined coordinate data to the GPU
+	vector<GLfloat>().swap(combinedValues); // uploaded, the GPU copy is the only one needed
 
 	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mesh.vbos[1]); // Activates VBO 1
 	glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(indices), indices, GL_STATIC_DRAW); // Sends index data to the GPU
@@ -869,6 +891,93 @@ void Sphere::UCreateSphere(GLMesh& mesh)
 	glEnableVertexAttribArray(2);
 }
 
+// Creates a coarser unit sphere with the same layout and texture mapping.
+// Picking always uses the finest level, so no triangle copy is kept.
+void Sphere::UCreateSphereLod(GLMesh& mesh, int sectors, int stacks)
+{
+	vector<GLfloat> combinedValues;
+	vector<GLuint> indices;
+	combinedValues.reserve((size_t)(stacks + 1) * (sectors + 1) * 8);
+	indices.reserve((size_t)stacks * sectors * 6);
+
+	// one row per stack, the seam column is duplicated for the texture
+	for (int i = 0; i <= stacks; ++i)
+	{
+		float stackAngle = pi * i / stacks;
+
+		for (int j = 0; j <= sectors; ++j)
+		{
+			float sectorAngle = -pi + 2.0f * pi * j / sectors;
+			glm::vec3 normal(sin(stackAngle) * sin(sectorAngle), cos(stackAngle), sin(stackAngle) * cos(sectorAngle));
+
+			combinedValues.push_back(normal.x);
+			combinedValues.push_back(normal.y);
+			combinedValues.push_back(normal.z);
+			combinedValues.push_back(normal.x);
+			combinedValues.push_back(normal.y);
+			combinedValues.push_back(normal.z);
+			combinedValues.push_back(float(j) / sectors);
+			combinedValues.push_back(normal.y * 0.5f + 0.5f);
+		}
+	}
+
+	// two triangles per quad, one at the poles
+	for (int i = 0; i < stacks; ++i)
+	{
+		for (int j = 0; j < sectors; ++j)
+		{
+			GLuint top = i * (sectors + 1) + j;
+			GLuint bottom = top + sectors + 1;
+
+			if (i != 0)
+			{
+				indices.push_back(top);
+				indices.push_back(bottom);
+				indices.push_back(top + 1);
+			}
+
+			if (i != stacks - 1)
+			{
+				indices.push_back(top + 1);
+				indices.push_back(bottom);
+				indices.push_back(bottom + 1);
+			}
+		}
+	}
+
+	const GLuint floatsPerVertex = 3;
+	const GLuint floatsPerNormal = 3;
+	const GLuint floatsPerUV = 2;
+
+	mesh.numVert = (stacks + 1) * (sectors + 1);
+	mesh.numIndicies = indices.size();
+	mesh.bounds = UComputeBounds(combinedValues.data(), mesh.numVert, floatsPerVertex + floatsPerNormal + floatsPerUV);
+	mesh.error = 1.0f - cos(pi / min(sectors, stacks));
+
+	glGenVertexArrays(1, &mesh.vao);
+	glBindVertexArray(mesh.vao);
+
+	glGenBuffers(2, mesh.vbos);
+	glBindBuffer(GL_ARRAY_BUFFER, mesh.vbos[0]);
+	glBufferData(GL_ARRAY_BUFFER, sizeof(GLfloat) * combinedValues.size(), combinedValues.data(), GL_STATIC_DRAW);
+	vector<GLfloat>().swap(combinedValues);
+
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mesh.vbos[1]);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(GLuint) * indices.size(), indices.data(), GL_STATIC_DRAW);
+	vector<GLuint>().swap(indices);
+
+	GLint stride = sizeof(float) * (floatsPerVertex + floatsPerNormal + floatsPerUV);
+
+	glVertexAttribPointer(0, floatsPerVertex, GL_FLOAT, GL_FALSE, stride, 0);
+	glEnableVertexAttribArray(0);
+
+	glVertexAttribPointer(1, floatsPerNormal, GL_FLOAT, GL_FALSE, stride, (void*)(sizeof(float) * floatsPerVertex));
+	glEnableVertexAttribArray(1);
+
+	glVertexAttribPointer(2, floatsPerUV, GL_FLOAT, GL_FALSE, stride, (void*)(sizeof(float) * (floatsPerVertex + floatsPerNormal)));
+	glEnableVertexAttribArray(2);
+}
+
 // Destroys mesh
 void Sphere::UDestroySphere(GLMesh& mesh)
 {
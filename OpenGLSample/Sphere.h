@@ -3,6 +3,11 @@
 #include <GL/glew.h>
 #include <glm/glm.hpp>
 
+#include <vector>
+
+#include "Bounds.h"
+#include "MeshTriangles.h"
+
 class Sphere
 {
 	struct GLMesh
@@ -11,13 +16,18 @@ class Sphere
 		GLuint vbos[2]; // Vertex buffer object
 		GLuint numVert; // number of verticies in an object
 		GLuint numIndicies;// number if indicies in an object
+		Bounds bounds; // local space bounding box and sphere
+		std::vector<glm::vec3> triangles; // local space triangle list for picking
+		float error; // distance to the true surface, for level of detail
 	};
 
 public:
 	GLMesh sphererMesh;
+	std::vector<GLMesh> lodMeshes; // coarser levels of detail, finest first
 
 private:
 	void UCreateSphere(GLMesh& mesh);
+	void UCreateSphereLod(GLMesh& mesh, int sectors, int stacks);
 	void UDestroySphere(GLMesh& mesh);
 
 public:
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+
+// Lock free queue for one producer thread and one consumer thread. The
+// indices only grow, a slot is index % Capacity. Head and tail live on
+// their own cache lines so the two threads do not share one.
+template<typename T, size_t Capacity>
+class SpscQueue
+{
+public:
+	// Producer only, false when the queue is full
+	bool Push(const T& value)
+	{
+		size_t t = tail.load(std::memory_order_relaxed);
+		if (t - head.load(std::memory_order_acquire) == Capacity)
+			return false;
+
+		slots[t % Capacity] = value;
+		tail.store(t + 1, std::memory_order_release);
+		return true;
+	}
+
+	// Consumer only, false when the queue is empty
+	bool Pop(T& value)
+	{
+		size_t h = head.load(std::memory_order_relaxed);
+		if (h == tail.load(std::memory_order_acquire))
+			return false;
+
+		value = slots[h % Capacity];
+		head.store(h + 1, std::memory_order_release);
+		return true;
+	}
+
+private:
+	alignas(64) std::atomic<size_t> head{ 0 }; // next slot to pop
+	alignas(64) std::atomic<size_t> tail{ 0 }; // next slot to push
+	T slots[Capacity];
+};
@@ -1,7 +1,10 @@
 #include <iostream> 
+#include <climits>
 #define STB_IMAGE_IMPLEMENTATION
 #include "stb_image.h"
 #include "Texture.h"
+#include "GLCounters.h"
+#include "CpuProfiler.h"
 
 using namespace std;
 
@@ -25,45 +28,66 @@ void Texture::flipImageVertically(unsigned char* image, int width, int height, i
 
 bool Texture::UCreateTexture(const char* filename, GLuint& textureId)
 {
+    CPU_PROFILE_SCOPE("UCreateTexture");
     int width, height, channels;
     unsigned char* image = stbi_load(filename, &width, &height, &channels, 0);
     if (image)
-    {
-        flipImageVertically(image, width, height, channels);
+        return UUploadImage(image, width, height, channels, textureId);
+    
+    // image fails to load
+    return false;
+}
 
-        glGenTextures(1, &textureId);
-        glBindTexture(GL_TEXTURE_2D, textureId);
+bool Texture::UCreateTextureFromMemory(const unsigned char* data, size_t size, GLuint& textureId)
+{
+    CPU_PROFILE_SCOPE("UCreateTextureFromMemory");
+    int width, height, channels;
+    unsigned char* image = size <= INT_MAX ? stbi_load_from_memory(data, (int)size, &width, &height, &channels, 0) : nullptr;
+    if (image)
+        return UUploadImage(image, width, height, channels, textureId);
 
-        // set the texture wrapping parameters
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-        // set texture filtering parameters
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    // image fails to decode
+    return false;
+}
 
-        if (channels == 3)
-            glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB8, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, image);
-        else if (channels == 4)
-            glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, image);
-        else
-        {
-            cout << "Not implemented to handle image with " << channels << " channels" << endl;
-            return false;
-        }
+// Flips, uploads and frees a decoded image
+bool Texture::UUploadImage(unsigned char* image, int width, int height, int channels, GLuint& textureId)
+{
+    flipImageVertically(image, width, height, channels);
 
-        glGenerateMipmap(GL_TEXTURE_2D);
+    glGenTextures(1, &textureId);
+    glBindTexture(GL_TEXTURE_2D, textureId);
 
-        stbi_image_free(image);
-        glBindTexture(GL_TEXTURE_2D, 0); // Unbind the texture
+    // set the texture wrapping parameters
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+    // set texture filtering parameters
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
 
-        return true;
+    if (channels == 3)
+        UTexImage2D(GL_TEXTURE_2D, 0, GL_RGB8, width, height, GL_RGB, GL_UNSIGNED_BYTE, image);
+    else if (channels == 4)
+        UTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, GL_RGBA, GL_UNSIGNED_BYTE, image);
+    else
+    {
+        cout << "Not implemented to handle image with " << channels << " channels" << endl;
+        stbi_image_free(image);
+        glBindTexture(GL_TEXTURE_2D, 0);
+        glDeleteTextures(1, &textureId);
+        textureId = 0;
+        return false;
     }
-    
-    // image fails to load
-    return false;
+
+    glGenerateMipmap(GL_TEXTURE_2D);
+
+    stbi_image_free(image);
+    glBindTexture(GL_TEXTURE_2D, 0); // Unbind the texture
+
+    return true;
 }
 
 void Texture::UDestroyTexture(GLuint textureId)
 {
-    glGenTextures(1, &textureId);
+    glDeleteTextures(1, &textureId);
 }
@@ -8,6 +8,11 @@ class Texture
 public: 
 	void flipImageVertically(unsigned char* image, int width, int height, int channels);
 	bool UCreateTexture(const char* filename, GLuint& textureId);
+	// encoded image file contents, such as images embedded in a glTF buffer
+	bool UCreateTextureFromMemory(const unsigned char* data, size_t size, GLuint& textureId);
 	void UDestroyTexture(GLuint textureId);
+
+private:
+	bool UUploadImage(unsigned char* image, int width, int height, int channels, GLuint& textureId);
 };
 
@@ -1,4 +1,5 @@
 #include "Torus.h"
+#include "CpuProfiler.h"
 
 #include <vector>
 
@@ -6,18 +7,27 @@ using namespace std;
 
 void Torus::CreateMesh()
 {
-	UCreateTorus(torusMesh);
+	CPU_PROFILE_SCOPE("Torus::CreateMesh");
+	UCreateTorus(torusMesh, 30, 30);
+
+	// coarser levels for distant rings, down to a few dozen triangles
+	const int lodSegments[][2] = { { 16, 12 }, { 10, 8 }, { 6, 4 } };
+	lodMeshes.resize(sizeof(lodSegments) / sizeof(lodSegments[0]));
+	for (size_t i = 0; i < lodMeshes.size(); ++i)
+		UCreateTorus(lodMeshes[i], lodSegments[i][0], lodSegments[i][1]);
 }
 
 void Torus::DestroyMesh()
 {
 	UDestroyTorus(torusMesh);
+
+	for (GLMesh& lodMesh : lodMeshes)
+		UDestroyTorus(lodMesh);
+	lodMeshes.clear();
 }
 
-void Torus::UCreateTorus(GLMesh& mesh)
+void Torus::UCreateTorus(GLMesh& mesh, int _mainSegments, int _tubeSegments)
 {
-	int _mainSegments = 30;
-	int _tubeSegments = 30;
 	float _mainRadius = 1.0f;
 	float _tubeRadius = .1f;
 
@@ -33,6 +43,13 @@ void Torus::UCreateTorus(GLMesh& mesh)
 	glm::vec3 vertex;
 	glm::vec2 text_coord;
 
+	// the counts are known up front, every cell below adds seven vertices
+	size_t numCellVertices = (size_t)_mainSegments * _tubeSegments * 7;
+	segments_list.reserve(_mainSegments);
+	vertex_list.reserve(numCellVertices);
+	normals_list.reserve(numCellVertices);
+	texture_coords.reserve(numCellVertices);
+
 	// generate the torus vertices
 	auto currentMainSegmentAngle = 0.0f;
 	for (auto i = 0; i < _mainSegments; i++)
@@ -42,6 +59,7 @@ void Torus::UCreateTorus(GLMesh& mesh)
 		auto cosMainSegment = cos(currentMainSegmentAngle);
 		auto currentTubeSegmentAngle = 0.0f;
 		std::vector<glm::vec3> segment_points;
+		segment_points.reserve(_tubeSegments);
 		for (auto j = 0; j < _tubeSegments; j++)
 		{
 			// Calculate sine and cosine of tube segment angle
@@ -60,7 +78,7 @@ void Torus::UCreateTorus(GLMesh& mesh)
 			// Update current tube angle
 			currentTubeSegmentAngle += tubeSegmentAngleStep;
 		}
-		segments_list.push_back(segment_points);
+		segments_list.push_back(std::move(segment_points));
 		segment_points.clear();
 
 		// Update main segment angle
@@ -212,6 +230,7 @@ void Torus::UCreateTorus(GLMesh& mesh)
 	}
 
 	std::vector<GLfloat> combined_values;
+	combined_values.reserve(vertex_list.size() * 8);
 
 	// combine interleaved vertices, normals, and texture coords
 	for (int i = 0; i < vertex_list.size(); i++)
@@ -229,14 +248,28 @@ void Torus::UCreateTorus(GLMesh& mesh)
 		combined_values.push_back(text_coord.y);
 	}
 
+	// the separate lists are done with, free them before the upload adds the driver's copy
+	std::vector<glm::vec3>().swap(vertex_list);
+	std::vector<std::vector<glm::vec3>>().swap(segments_list);
+	std::vector<glm::vec3>().swap(normals_list);
+	std::vector<glm::vec2>().swap(texture_coords);
+
 	// total float values per each type
 	const GLuint floatsPerVertex = 3;
 	const GLuint floatsPerNormal = 3;
 	const GLuint floatsPerUV = 2;
 
 	// store vertex and index count
-	mesh.numVert = vertex_list.size();
+	mesh.numVert = combined_values.size() / (floatsPerVertex + floatsPerNormal + floatsPerUV);
 	mesh.numIndicies = 0;
+	mesh.bounds = UComputeBounds(combined_values.data(), mesh.numVert, floatsPerVertex + floatsPerNormal + floatsPerUV); // culling volumes
+
+	// chord sagitta of both circles
+	mesh.error = (_mainRadius + _tubeRadius) * (1.0f - cos(mainSegmentAngleStep * 0.5f)) + _tubeRadius * (1.0f - cos(tubeSegmentAngleStep * 0.5f));
+
+	// CPU copy of the triangles for picking
+	mesh.triangles.clear();
+	UAppendTriangles(mesh.triangles, combined_values.data(), floatsPerVertex + floatsPerNormal + floatsPerUV, GL_TRIANGLES, 0, mesh.numVert);
 
 	// Create VAO
 	glGenVertexArrays(1, &mesh.vao); // we can also generate multiple VAOs or buffers at the same time
@@ -246,6 +279,7 @@ void Torus::UCreateTorus(GLMesh& mesh)
 	glGenBuffers(1, mesh.vbos);
 	glBindBuffer(GL_ARRAY_BUFFER, mesh.vbos[0]); // Activates the buffer
 	glBufferData(GL_ARRAY_BUFFER, sizeof(GLfloat) * combined_values.size(), combined_values.data(), GL_STATIC_DRAW); // Sends vertex or coordinate data to the GPU
+	std::vector<GLfloat>().swap(combined_values); // uploaded, the GPU copy is the only one needed
 
 	// Strides between vertex coordinates
 	GLint stride = sizeof(float) * (floatsPerVertex + floatsPerNormal + floatsPerUV);
@@ -1,14 +1,22 @@
 #ifndef MESH_H
 #define MESH_H
 
-#include <glad/glad.h> // holds all OpenGL type declarations
+#include <GL/glew.h> // holds all OpenGL type declarations
 
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 
 #include "shader.h"
+#include "GLState.h"
+#include "GLCounters.h"
 
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <iostream>
 #include <string>
+#include <utility>
 #include <vector>
 using namespace std;
 
@@ -25,76 +33,262 @@ struct Vertex {
 	glm::vec3 Bitangent;
 };
 
-struct Texture {
+// named apart from the Texture loader class, which creates the ids
+struct MeshTexture {
 	unsigned int id;
 	string type;
 	string path;
 };
 
+// What a mesh keeps in RAM once its buffers are uploaded
+enum MeshRetention {
+	RETAIN_NONE, // only the GPU copy
+	RETAIN_COMPACT, // positions quantized to 16 bits and narrowed indices, for picking and physics
+	RETAIN_ALL // vertices and indices as uploaded
+};
+
+// Bytes one mesh holds, textures excluded, they are shared
+struct MeshMemory {
+	size_t cpuBytes;
+	size_t gpuBytes;
+};
+
+// Every sampler of a kind has a fixed texture unit, so all meshes drawn with
+// a shader agree on its sampler uniforms: they are set once per program and
+// drawing only binds textures.
 class Mesh {
 public:
-	// mesh Data
+	static const int numTextureTypes = 4;
+	static const int maxTexturesPerType = 4; // texture_diffuse1 to texture_diffuse4 and so on
+
+	// mesh Data, vertices and indices are empty unless the mesh retains them all
 	vector<Vertex>       vertices;
 	vector<unsigned int> indices;
-	vector<Texture>      textures;
-	unsigned int VAO;
+	vector<MeshTexture>  textures;
+	unsigned int VAO = 0;
+	GLsizei numVertices = 0; // uploaded, whatever is retained
+	GLsizei numIndices = 0;
+	MeshRetention retention = RETAIN_ALL;
 
-	// constructor
-	Mesh(vector<Vertex> vertices, vector<unsigned int> indices, vector<Texture> textures)
+	// constructor, the geometry is moved in, never copied
+	Mesh(vector<Vertex>&& vertices, vector<unsigned int>&& indices, vector<MeshTexture> textures, MeshRetention retention = RETAIN_ALL)
+		: vertices(std::move(vertices)), indices(std::move(indices)), textures(std::move(textures)), retention(retention)
 	{
-		this->vertices = vertices;
-		this->indices = indices;
-		this->textures = textures;
+		// the N in texture_diffuseN picks the unit within the type's range
+		int counts[numTextureTypes] = {};
+		textureUnits.reserve(this->textures.size());
+		for (const MeshTexture& texture : this->textures)
+		{
+			int type = 0;
+			while (type < numTextureTypes && texture.type != TextureType(type))
+				++type;
+
+			int unit = -1;
+			if (type < numTextureTypes && counts[type] < maxTexturesPerType)
+				unit = type * maxTexturesPerType + counts[type]++;
+			else
+				cout << "ERROR::MESH::NO_SAMPLER_FOR_TEXTURE " << texture.type << endl;
+			textureUnits.push_back(unit);
+		}
 
 		// now that we have all the required data, set the vertex buffers and its attribute pointers.
 		setupMesh();
+
+		// the uploaded copy is dropped or shrunk right away
+		if (this->retention == RETAIN_COMPACT)
+			compactMesh();
+		if (this->retention != RETAIN_ALL)
+		{
+			vector<Vertex>().swap(this->vertices);
+			vector<unsigned int>().swap(this->indices);
+		}
+	}
+
+	// the GL objects have one owner
+	Mesh(const Mesh&) = delete;
+	Mesh& operator=(const Mesh&) = delete;
+
+	Mesh(Mesh&& other) noexcept
+	{
+		*this = std::move(other);
 	}
 
-	// render the mesh
+	Mesh& operator=(Mesh&& other) noexcept
+	{
+		if (this != &other)
+		{
+			if (VAO != 0)
+				DestroyMesh();
+			vertices = std::move(other.vertices);
+			indices = std::move(other.indices);
+			textures = std::move(other.textures);
+			VAO = other.VAO;
+			numVertices = other.numVertices;
+			numIndices = other.numIndices;
+			retention = other.retention;
+			VBO = other.VBO;
+			EBO = other.EBO;
+			textureUnits = std::move(other.textureUnits);
+			samplerPrograms = std::move(other.samplerPrograms);
+			compactOrigin = other.compactOrigin;
+			compactStep = other.compactStep;
+			compactPositions = std::move(other.compactPositions);
+			compactIndices16 = std::move(other.compactIndices16);
+			compactIndices32 = std::move(other.compactIndices32);
+			other.VAO = other.VBO = other.EBO = 0;
+			other.numVertices = other.numIndices = 0;
+		}
+		return *this;
+	}
+
+	// Points the shader's samplers at the mesh's texture units. Draw() does it
+	// the first time it meets a shader; call it after loading to keep the
+	// lookups out of the first frame. The shader must be in use.
+	void BindSamplers(Shader &shader)
+	{
+		for (size_t i = 0; i < textures.size(); i++)
+		{
+			if (textureUnits[i] < 0)
+				continue;
+
+			char sampler[64];
+			snprintf(sampler, sizeof(sampler), "%s%d", TextureType(textureUnits[i] / maxTexturesPerType), textureUnits[i] % maxTexturesPerType + 1);
+			glUniform1i(glGetUniformLocation(shader.ID, sampler), textureUnits[i]);
+		}
+
+		if (find(samplerPrograms.begin(), samplerPrograms.end(), shader.ID) == samplerPrograms.end())
+			samplerPrograms.push_back(shader.ID);
+	}
+
+	// render the mesh, the shader must be in use. Binds go through the
+	// GLState copy, unchanged textures and VAOs are not bound again.
 	void Draw(Shader &shader)
 	{
+		if (find(samplerPrograms.begin(), samplerPrograms.end(), shader.ID) == samplerPrograms.end())
+			BindSamplers(shader);
+
+		GLState& state = UGLState();
+
 		// bind appropriate textures
-		unsigned int diffuseNr = 1;
-		unsigned int specularNr = 1;
-		unsigned int normalNr = 1;
-		unsigned int heightNr = 1;
-		for (unsigned int i = 0; i < textures.size(); i++)
+		for (size_t i = 0; i < textures.size(); i++)
 		{
-			glActiveTexture(GL_TEXTURE0 + i); // active proper texture unit before binding
-			// retrieve texture number (the N in diffuse_textureN)
-			string number;
-			string name = textures[i].type;
-			if (name == "texture_diffuse")
-				number = std::to_string(diffuseNr++);
-			else if (name == "texture_specular")
-				number = std::to_string(specularNr++); // transfer unsigned int to stream
-			else if (name == "texture_normal")
-				number = std::to_string(normalNr++); // transfer unsigned int to stream
-			else if (name == "texture_height")
-				number = std::to_string(heightNr++); // transfer unsigned int to stream
-
-			// now set the sampler to the correct texture unit
-			glUniform1i(glGetUniformLocation(shader.ID, (name + number).c_str()), i);
-			// and finally bind the texture
-			glBindTexture(GL_TEXTURE_2D, textures[i].id);
+			if (textureUnits[i] >= 0)
+				state.BindTexture(textureUnits[i], GL_TEXTURE_2D, textures[i].id);
 		}
 
 		// draw mesh
-		glBindVertexArray(VAO);
-		glDrawElements(GL_TRIANGLES, indices.size(), GL_UNSIGNED_INT, 0);
-		glBindVertexArray(0);
+		state.BindVertexArray(VAO);
+		UDrawElements(GL_TRIANGLES, numIndices, GL_UNSIGNED_INT, 0);
+		state.BindVertexArray(0);
+	}
 
-		// always good practice to set everything back to defaults once configured.
-		glActiveTexture(GL_TEXTURE0);
+	// Local space corners of triangle t from the retained copy, false when
+	// the mesh keeps none. Compact positions are off by up to half a step.
+	bool Triangle(size_t t, glm::vec3& a, glm::vec3& b, glm::vec3& c) const
+	{
+		glm::vec3* corners[3] = { &a, &b, &c };
+		for (int i = 0; i < 3; i++)
+		{
+			size_t index = t * 3 + i;
+			if (retention == RETAIN_ALL && index < indices.size())
+				*corners[i] = vertices[indices[index]].Position;
+			else if (retention == RETAIN_COMPACT && index < (size_t)numIndices)
+			{
+				size_t vertex = compactIndices16.empty() ? compactIndices32[index] : compactIndices16[index];
+				const uint16_t* q = &compactPositions[vertex * 3];
+				*corners[i] = compactOrigin + glm::vec3(q[0] * compactStep.x, q[1] * compactStep.y, q[2] * compactStep.z);
+			}
+			else
+				return false;
+		}
+		return true;
+	}
+
+	// RAM held by the retained copies, and the vertex and index buffers
+	MeshMemory Memory() const
+	{
+		MeshMemory memory;
+		memory.cpuBytes = vertices.capacity() * sizeof(Vertex) + indices.capacity() * sizeof(unsigned int)
+			+ compactPositions.capacity() * sizeof(uint16_t) + compactIndices16.capacity() * sizeof(uint16_t)
+			+ compactIndices32.capacity() * sizeof(uint32_t);
+		memory.gpuBytes = (size_t)numVertices * sizeof(Vertex) + (size_t)numIndices * sizeof(unsigned int);
+		return memory;
+	}
+
+	// frees the buffers and the VAO, the textures belong to whoever loaded them
+	void DestroyMesh()
+	{
+		glDeleteVertexArrays(1, &VAO);
+		glDeleteBuffers(1, &VBO);
+		glDeleteBuffers(1, &EBO);
+		VAO = VBO = EBO = 0;
 	}
 
 private:
 	// render data 
-	unsigned int VBO, EBO;
+	unsigned int VBO = 0, EBO = 0;
+	vector<GLint> textureUnits; // per texture, -1 when no sampler takes it
+	vector<GLuint> samplerPrograms; // programs whose samplers BindSamplers() set
+
+	// RETAIN_COMPACT copy, position = origin + quantized * step
+	glm::vec3 compactOrigin = glm::vec3(0.0f);
+	glm::vec3 compactStep = glm::vec3(0.0f);
+	vector<uint16_t> compactPositions; // 3 per vertex
+	vector<uint16_t> compactIndices16; // when every index fits, compactIndices32 otherwise
+	vector<uint32_t> compactIndices32;
+
+	// sampler name prefix of every type, in texture unit order
+	static const char* TextureType(int type)
+	{
+		static const char* types[numTextureTypes] = { "texture_diffuse", "texture_specular", "texture_normal", "texture_height" };
+		return types[type];
+	}
+
+	// quantizes the positions to 16 bits within their bounds
+	void compactMesh()
+	{
+		if (vertices.empty())
+			return;
+
+		glm::vec3 low = vertices[0].Position, high = low;
+		for (const Vertex& vertex : vertices)
+		{
+			for (int c = 0; c < 3; c++)
+			{
+				low[c] = std::min(low[c], vertex.Position[c]);
+				high[c] = std::max(high[c], vertex.Position[c]);
+			}
+		}
+
+		compactOrigin = low;
+		compactStep = (high - low) / 65535.0f;
+		compactPositions.resize(vertices.size() * 3);
+		for (size_t i = 0; i < vertices.size(); i++)
+		{
+			for (int c = 0; c < 3; c++)
+			{
+				float extent = high[c] - low[c];
+				float t = extent > 0.0f ? (vertices[i].Position[c] - low[c]) / extent : 0.0f;
+				compactPositions[i * 3 + c] = (uint16_t)std::lround(t * 65535.0f);
+			}
+		}
+
+		if (vertices.size() <= 65536)
+		{
+			compactIndices16.resize(indices.size());
+			for (size_t i = 0; i < indices.size(); i++)
+				compactIndices16[i] = (uint16_t)indices[i];
+		}
+		else
+			compactIndices32.assign(indices.begin(), indices.end());
+	}
 
 	// initializes all the buffer objects/arrays
 	void setupMesh()
 	{
+		numVertices = (GLsizei)vertices.size();
+		numIndices = (GLsizei)indices.size();
+
 		// create buffers/arrays
 		glGenVertexArrays(1, &VAO);
 		glGenBuffers(1, &VBO);
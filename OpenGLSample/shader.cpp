@@ -13,6 +13,7 @@ using namespace std;
 #include <GL/glew.h>
 
 #include "shader.hpp"
+#include "CpuProfiler.h"
 
 GLuint LoadShaders(const char * vertex_file_path,const char * fragment_file_path){
 
@@ -108,4 +109,72 @@ GLuint LoadShaders(const char * vertex_file_path,const char * fragment_file_path
 	return ProgramID;
 }
 
+// Creates Shader Program
+bool UCreateShaderProgram(const char* vtxShaderSource, const char* fragShaderSource, GLuint& programId)
+{
+	CPU_PROFILE_SCOPE("UCreateShaderProgram");
 
+	// Compilation and linkage error reporting
+	int success = 0;
+	char infoLog[512];
+
+	// Creates Shader Program Object
+	programId = glCreateProgram();
+
+	// Create vertex and fragment objects
+	GLuint vtxShaderId = glCreateShader(GL_VERTEX_SHADER);
+	GLuint fragShaderId = glCreateShader(GL_FRAGMENT_SHADER);
+
+	// Retrives shader program source
+	glShaderSource(vtxShaderId, 1, &vtxShaderSource, NULL);
+	glShaderSource(fragShaderId, 1, &fragShaderSource, NULL);
+
+	// vertex shader
+	glCompileShader(vtxShaderId); // Compiles the vertex shader 
+	glGetShaderiv(vtxShaderId, GL_COMPILE_STATUS, &success); // Checks for errors
+	if (!success)// if vertex shader fails to compile
+	{
+		glGetShaderInfoLog(vtxShaderId, 512, NULL, infoLog);
+		cout << "ERROR::SHADER::VERTEX::COMPILATION_FAILED\n" << infoLog << endl;
+
+		return false;
+	}
+
+	// fragment shader
+	glCompileShader(fragShaderId); // Compiles the fragment shader
+	glGetShaderiv(fragShaderId, GL_COMPILE_STATUS, &success); // Checks for errors
+	if (!success)// if fragment shader fails to compile
+	{
+		glGetShaderInfoLog(fragShaderId, sizeof(infoLog), NULL, infoLog);
+		cout << "ERROR::SHADER::FRAGMENT::COMPILATION_FAILED\n" << infoLog << endl;
+
+		return false;
+	}
+
+	// Attaches compiled shaders to the shader program
+	glAttachShader(programId, vtxShaderId);
+	glAttachShader(programId, fragShaderId);
+
+	// Shader Link
+	glLinkProgram(programId);   // links the shader program
+	glGetProgramiv(programId, GL_LINK_STATUS, &success); // Checks for errors
+	if (!success) // if shader fails to Link
+	{
+		glGetProgramInfoLog(programId, sizeof(infoLog), NULL, infoLog);
+		cout << "ERROR::SHADER::PROGRAM::LINKING_FAILED\n" << infoLog << endl;
+
+		return false;
+	}
+
+	// the program keeps what it needs, the render thread binds it through GLState
+	glDeleteShader(vtxShaderId);
+	glDeleteShader(fragShaderId);
+
+	return true;
+}
+
+// Destroys shader program
+void UDestroyShaderProgram(GLuint programId)
+{
+	glDeleteProgram(programId);
+}
@@ -1,6 +1,13 @@
 #ifndef SHADER_HPP
 #define SHADER_HPP
 
+#include <GL/glew.h>
+
 GLuint LoadShaders(const char * vertex_file_path,const char * fragment_file_path);
 
+// Compiles and links a program from GLSL sources, false after printing the
+// ERROR::SHADER log. The program is not left in use.
+bool UCreateShaderProgram(const char* vtxShaderSource, const char* fragShaderSource, GLuint& programId);
+void UDestroyShaderProgram(GLuint programId);
+
 #endif